@@ -20,6 +20,7 @@
 #include "api.hpp"
 #include "python_utils.hpp"
 #include "json_parser.hpp"
+#include "dlpack.hpp"
 #include <numpy/arrayobject.h>
 #include "structmember.h"
 using namespace nervana;
@@ -47,6 +48,10 @@ extern "C" {
 #define IS_PY3K
 #endif
 
+#ifndef Py_TPFLAGS_HAVE_NEWBUFFER
+#define Py_TPFLAGS_HAVE_NEWBUFFER 0
+#endif
+
 #ifdef Py_TPFLAGS_HAVE_FINALIZE
 #define PYOBJ_TAIL_INIT NULL
 #else
@@ -93,7 +98,332 @@ static PyObject* dict2json(PyObject* self, PyObject* dictionary)
     }
 }
 
-static PyObject* wrap_buffer_as_np_array(const buffer_fixed_size_elements* buf, bool transposed);
+static PyObject* wrap_buffer_as_np_array(const buffer_fixed_size_elements* buf,
+                                         bool                              transposed,
+                                         PyObject*                         owner);
+
+static const char* dltensor_capsule_name = "dltensor";
+
+/*
+ * A Buffer exports one output buffer of a borrowed batch through the buffer protocol and
+ * DLPack. Numpy arrays, memoryviews and DLPack tensors made from it all share the export, the
+ * batch goes back to the loader when the last of them is released.
+ */
+struct buffer_export
+{
+    shared_ptr<const fixed_buffer_map> batch;
+    const buffer_fixed_size_elements*  buffer;
+    bool                               batch_major;
+    const char*                        format;
+    DLDataType                         dtype;
+    vector<int64_t>                    shape;
+    vector<int64_t>                    strides;
+    vector<Py_ssize_t>                 view_shape;
+    vector<Py_ssize_t>                 view_strides;
+};
+
+typedef struct
+{
+    PyObject_HEAD shared_ptr<const buffer_export>* m_export;
+} aeon_Buffer;
+
+#define BUF_get_export(v) (**(((aeon_Buffer*)(v))->m_export))
+
+static shared_ptr<const buffer_export> make_buffer_export(
+    const shared_ptr<const fixed_buffer_map>& batch,
+    const buffer_fixed_size_elements*         buf,
+    bool                                      transposed)
+{
+    // buffer protocol format and DLPack type code for each output type
+    static const map<string, pair<const char*, uint8_t>> elements{{"int8_t", {"b", kDLInt}},
+                                                                  {"uint8_t", {"B", kDLUInt}},
+                                                                  {"int16_t", {"h", kDLInt}},
+                                                                  {"uint16_t", {"H", kDLUInt}},
+                                                                  {"int32_t", {"i", kDLInt}},
+                                                                  {"uint32_t", {"I", kDLUInt}},
+                                                                  {"float", {"f", kDLFloat}},
+                                                                  {"double", {"d", kDLFloat}},
+                                                                  {"char", {"b", kDLInt}}};
+
+    const output_type& otype   = buf->get_shape_type().get_otype();
+    auto               element = elements.find(otype.m_tp_name);
+    if (element == elements.end())
+    {
+        throw runtime_error("Unable to export output type " + otype.m_tp_name);
+    }
+
+    auto exp         = make_shared<buffer_export>();
+    exp->batch       = batch;
+    exp->buffer      = buf;
+    exp->batch_major = !transposed;
+    exp->format      = element->second.first;
+    exp->dtype       = {element->second.second, uint8_t(8 * otype.get_size()), 1};
+
+    // N,DATA when batch major and DATA,N otherwise, packed either way
+    auto    item_shape = buf->get_shape_type().get_shape();
+    int64_t items      = buf->get_item_count();
+    exp->shape.assign(item_shape.begin(), item_shape.end());
+    if (transposed)
+    {
+        exp->shape.push_back(items);
+    }
+    else
+    {
+        exp->shape.insert(exp->shape.begin(), items);
+    }
+
+    exp->strides.resize(exp->shape.size());
+    int64_t stride = 1;
+    for (size_t i = exp->shape.size(); i-- > 0;)
+    {
+        exp->strides[i] = stride;
+        stride *= exp->shape[i];
+    }
+    for (size_t i = 0; i < exp->shape.size(); i++)
+    {
+        exp->view_shape.push_back(exp->shape[i]);
+        exp->view_strides.push_back(exp->strides[i] * otype.get_size());
+    }
+    return exp;
+}
+
+static void delete_dlpack_tensor(DLManagedTensor* tensor)
+{
+    delete static_cast<shared_ptr<const buffer_export>*>(tensor->manager_ctx);
+    delete tensor;
+}
+
+static void release_dlpack_capsule(PyObject* capsule)
+{
+    // consumers rename the capsule once they own the tensor
+    if (PyCapsule_IsValid(capsule, dltensor_capsule_name))
+    {
+        auto tensor =
+            static_cast<DLManagedTensor*>(PyCapsule_GetPointer(capsule, dltensor_capsule_name));
+        tensor->deleter(tensor);
+    }
+}
+
+static PyObject* Buffer_dlpack(PyObject* self, PyObject* args, PyObject* kwds)
+{
+    static const char* keyword_list[] = {"stream", "max_version", "dl_device", "copy", nullptr};
+
+    PyObject* stream      = Py_None;
+    PyObject* max_version = Py_None;
+    PyObject* dl_device   = Py_None;
+    PyObject* copy        = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwds,
+                                     "|OOOO",
+                                     const_cast<char**>(keyword_list),
+                                     &stream,
+                                     &max_version,
+                                     &dl_device,
+                                     &copy))
+    {
+        return NULL;
+    }
+    if (stream != Py_None || copy == Py_True)
+    {
+        PyErr_SetString(PyExc_BufferError, "batches are host memory and only exported in place");
+        return NULL;
+    }
+
+    auto exp    = *((aeon_Buffer*)self)->m_export;
+    auto tensor = new DLManagedTensor();
+
+    tensor->dl_tensor.data        = exp->buffer->data();
+    tensor->dl_tensor.device      = {kDLCPU, 0};
+    tensor->dl_tensor.ndim        = exp->shape.size();
+    tensor->dl_tensor.dtype       = exp->dtype;
+    tensor->dl_tensor.shape       = const_cast<int64_t*>(exp->shape.data());
+    tensor->dl_tensor.strides     = const_cast<int64_t*>(exp->strides.data());
+    tensor->dl_tensor.byte_offset = 0;
+    tensor->manager_ctx           = new shared_ptr<const buffer_export>(exp);
+    tensor->deleter               = delete_dlpack_tensor;
+
+    PyObject* capsule = PyCapsule_New(tensor, dltensor_capsule_name, release_dlpack_capsule);
+    if (capsule == NULL)
+    {
+        delete_dlpack_tensor(tensor);
+    }
+    return capsule;
+}
+
+static PyObject* Buffer_dlpack_device(PyObject* self, PyObject*)
+{
+    // pinned batches are still ordinary host memory to the consumer
+    return Py_BuildValue("(ii)", kDLCPU, 0);
+}
+
+static int Buffer_getbuffer(PyObject* self, Py_buffer* view, int flags)
+{
+    const buffer_export& exp = BUF_get_export(self);
+
+    // the export is C contiguous, so every request can be served with the same view
+    view->obj = self;
+    Py_INCREF(self);
+    view->buf        = exp.buffer->data();
+    view->len        = exp.buffer->size();
+    view->readonly   = 0;
+    view->itemsize   = exp.dtype.bits / 8;
+    view->format     = (flags & PyBUF_FORMAT) ? const_cast<char*>(exp.format) : NULL;
+    view->ndim       = exp.view_shape.size();
+    view->shape      = NULL;
+    view->strides    = NULL;
+    view->suboffsets = NULL;
+    view->internal   = NULL;
+    if (flags & PyBUF_ND)
+    {
+        view->shape = const_cast<Py_ssize_t*>(exp.view_shape.data());
+    }
+    else
+    {
+        view->ndim = 1;
+    }
+    if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES)
+    {
+        view->strides = const_cast<Py_ssize_t*>(exp.view_strides.data());
+    }
+    return 0;
+}
+
+static PyObject* Buffer_get_shape(PyObject* self, void*)
+{
+    const buffer_export& exp    = BUF_get_export(self);
+    PyObject*            result = PyTuple_New(exp.shape.size());
+    for (size_t i = 0; result != NULL && i < exp.shape.size(); i++)
+    {
+        PyTuple_SetItem(result, i, PyLong_FromLongLong(exp.shape[i]));
+    }
+    return result;
+}
+
+static PyObject* Buffer_get_strides(PyObject* self, void*)
+{
+    const buffer_export& exp    = BUF_get_export(self);
+    PyObject*            result = PyTuple_New(exp.view_strides.size());
+    for (size_t i = 0; result != NULL && i < exp.view_strides.size(); i++)
+    {
+        PyTuple_SetItem(result, i, PyLong_FromSsize_t(exp.view_strides[i]));
+    }
+    return result;
+}
+
+static PyObject* Buffer_get_dtype(PyObject* self, void*)
+{
+    int nptype = BUF_get_export(self).buffer->get_shape_type().get_otype().get_np_type();
+    return reinterpret_cast<PyObject*>(PyArray_DescrFromType(nptype));
+}
+
+static PyObject* Buffer_get_batch_major(PyObject* self, void*)
+{
+    return PyBool_FromLong(BUF_get_export(self).batch_major);
+}
+
+static void Buffer_dealloc(aeon_Buffer* self)
+{
+    delete self->m_export;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef Buffer_methods[] = {
+    {"__dlpack__",
+     (PyCFunction)Buffer_dlpack,
+     METH_VARARGS | METH_KEYWORDS,
+     "Export as a DLPack capsule"},
+    {"__dlpack_device__", Buffer_dlpack_device, METH_NOARGS, "DLPack device type and id"},
+    {NULL, NULL, 0, NULL} /* Sentinel */
+};
+
+static PyGetSetDef Buffer_getset[] = {
+    {(char*)"shape", Buffer_get_shape, NULL, (char*)"shape in elements", NULL},
+    {(char*)"strides", Buffer_get_strides, NULL, (char*)"strides in bytes", NULL},
+    {(char*)"dtype", Buffer_get_dtype, NULL, (char*)"numpy dtype of the elements", NULL},
+    {(char*)"batch_major", Buffer_get_batch_major, NULL, (char*)"N,DATA if true", NULL},
+    {NULL, NULL, NULL, NULL, NULL} /* Sentinel */
+};
+
+// filled in at module initialization, the slots before bf_getbuffer differ in python 2
+static PyBufferProcs Buffer_as_buffer;
+
+static PyTypeObject aeon_BufferType = {
+#ifdef IS_PY3K
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0,
+#endif
+        "aeon.Buffer",                              /*tp_name*/
+    sizeof(aeon_Buffer),                            /*tp_basicsize*/
+    0,                                              /*tp_itemsize*/
+    (destructor)Buffer_dealloc,                     /*tp_dealloc*/
+    0,                                              /*tp_print*/
+    0,                                              /*tp_getattr*/
+    0,                                              /*tp_setattr*/
+    0,                                              /*tp_compare*/
+    0,                                              /*tp_repr*/
+    0,                                              /*tp_as_number*/
+    0,                                              /*tp_as_sequence*/
+    0,                                              /*tp_as_mapping*/
+    0,                                              /*tp_hash */
+    0,                                              /*tp_call*/
+    0,                                              /*tp_str*/
+    0,                                              /*tp_getattro*/
+    0,                                              /*tp_setattro*/
+    &Buffer_as_buffer,                              /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /*tp_flags*/
+    "Output buffer of a borrowed batch",            /* tp_doc */
+    0,                                              /* tp_traverse */
+    0,                                              /* tp_clear */
+    0,                                              /* tp_richcompare */
+    0,                                              /* tp_weaklistoffset */
+    0,                                              /* tp_iter */
+    0,                                              /* tp_iternext */
+    Buffer_methods,                                 /* tp_methods */
+    0,                                              /* tp_members */
+    Buffer_getset,                                  /* tp_getset */
+    0,                                              /* tp_base */
+    0,                                              /* tp_dict */
+    0,                                              /* tp_descr_get */
+    0,                                              /* tp_descr_set */
+    0,                                              /* tp_dictoffset */
+    0,                                              /* tp_init */
+    0,                                              /* tp_alloc */
+    0,                                              /* tp_new */
+    0,                                              /* tp_free */
+    0,                                              /* tp_is_gc */
+    0,                                              /* tp_bases */
+    0,                                              /* tp_mro */
+    0,                                              /* tp_cache */
+    0,                                              /* tp_subclasses */
+    0,                                              /* tp_weaklist */
+    0,                                              /* tp_del */
+    0,                                              /* tp_version_tag */
+    PYOBJ_TAIL_INIT                                 /* tp_finalize */
+};
+
+static PyObject* export_buffer(const shared_ptr<const fixed_buffer_map>& batch,
+                               const buffer_fixed_size_elements*         buf,
+                               bool                                      transposed)
+{
+    aeon_Buffer* self = (aeon_Buffer*)aeon_BufferType.tp_alloc(&aeon_BufferType, 0);
+    if (!self)
+    {
+        return NULL;
+    }
+    try
+    {
+        self->m_export =
+            new shared_ptr<const buffer_export>(make_buffer_export(batch, buf, transposed));
+    }
+    catch (std::exception& e)
+    {
+        Py_DECREF(self);
+        PyErr_SetString(PyExc_RuntimeError, e.what());
+        return NULL;
+    }
+    return (PyObject*)self;
+}
 
 typedef struct
 {
@@ -105,6 +435,7 @@ typedef struct
     loader*                 m_loader;
     uint32_t                m_i;
     bool                    m_first_iteration;
+    bool                    m_numpy_output;
 } aeon_DataLoader;
 
 static PyMethodDef aeon_methods[] = {
@@ -144,17 +475,43 @@ static PyObject* DataLoader_iternext(PyObject* self)
     }
     if (DL_get_loader(self)->get_current_iter() != DL_get_loader(self)->get_end_iter())
     {
-        // d will be const fixed_buffer_map&
-        const fixed_buffer_map& d     = *(DL_get_loader(self)->get_current_iter());
-        auto                    names = DL_get_loader(self)->get_buffer_names();
+        // the arrays keep the batch away from the pipeline for as long as they live
+        shared_ptr<const fixed_buffer_map> batch;
+        try
+        {
+            batch = DL_get_loader(self)->borrow_output_buffer();
+        }
+        catch (std::exception& e)
+        {
+            // the batch was not handed out, the next call tries it again instead of advancing
+            ((aeon_DataLoader*)(self))->m_first_iteration = true;
+            block_threads b{a};
+            PyErr_SetString(PyExc_RuntimeError, e.what());
+            return NULL;
+        }
+        auto names = DL_get_loader(self)->get_buffer_names();
 
         block_threads b{a};
+        bool          numpy_output = ((aeon_DataLoader*)(self))->m_numpy_output;
+
         result            = PyTuple_New(names.size());
         int buf_tuple_len = 2;
         int tuple_pos     = 0;
         for (auto&& nm : names)
         {
-            PyObject* wrapped_buf     = wrap_buffer_as_np_array(d[nm], !batch_major);
+            PyObject* wrapped_buf = export_buffer(batch, (*batch)[nm], !batch_major);
+            if (wrapped_buf != NULL && numpy_output)
+            {
+                // the array holds the Buffer as its base object
+                PyObject* exported = wrapped_buf;
+                wrapped_buf = wrap_buffer_as_np_array((*batch)[nm], !batch_major, exported);
+                Py_DECREF(exported);
+            }
+            if (wrapped_buf == NULL)
+            {
+                Py_DECREF(result);
+                return NULL;
+            }
             PyObject* buf_name        = Py_BuildValue("s", nm.c_str());
             PyObject* named_buf_tuple = PyTuple_New(buf_tuple_len);
 
@@ -201,7 +558,9 @@ static PySequenceMethods DataLoader_sequence_methods = {aeon_DataLoader_length,
                                                         0, /* sq_inplace_repeat */
                                                         0 /* sq_inplace_repeat */};
 
-static PyObject* wrap_buffer_as_np_array(const buffer_fixed_size_elements* buf, bool transposed)
+static PyObject* wrap_buffer_as_np_array(const buffer_fixed_size_elements* buf,
+                                         bool                              transposed,
+                                         PyObject*                         owner)
 {
     std::vector<npy_intp> dims;
     dims.push_back(buf->get_item_count());
@@ -229,6 +588,12 @@ static PyObject* wrap_buffer_as_np_array(const buffer_fixed_size_elements* buf,
         ERR << "Unable to wrap buffer as npy array";
         PyErr_SetString(PyExc_RuntimeError, "Unable to wrap buffer as npy array");
     }
+    else
+    {
+        // the array steals this reference
+        Py_INCREF(owner);
+        PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(p_array), owner);
+    }
 
     return p_array;
 }
@@ -257,18 +622,27 @@ static PyObject* DataLoader_new(PyTypeObject* type, PyObject* args, PyObject* kw
     INFO << " DataLoader_new";
     aeon_DataLoader* self = nullptr;
 
-    static const char* keyword_list[] = {"config", nullptr};
+    static const char* keyword_list[] = {"config", "output", nullptr};
 
 #ifdef PYTHON_PLUGIN
     Py_Initialize();
     PyEval_InitThreads();
 #endif
-    PyObject* dict;
-    auto      rc = PyArg_ParseTupleAndKeywords(
-        args, kwds, "O!", const_cast<char**>(keyword_list), &PyDict_Type, &dict);
+    PyObject*   dict;
+    const char* output = "numpy";
+    auto        rc     = PyArg_ParseTupleAndKeywords(
+        args, kwds, "O!|s", const_cast<char**>(keyword_list), &PyDict_Type, &dict, &output);
 
     if (rc)
     {
+        // batches come out as numpy arrays or as Buffers for DLPack and buffer protocol consumers
+        string output_format = output;
+        if (output_format != "numpy" && output_format != "buffer")
+        {
+            PyErr_SetString(PyExc_RuntimeError, "output must be either 'numpy' or 'buffer'");
+            return NULL;
+        }
+
         nlohmann::json json_config;
         try
         {
@@ -295,6 +669,7 @@ static PyObject* DataLoader_new(PyTypeObject* type, PyObject* args, PyObject* kw
             self->m_loader          = create_loader(json_config);
             self->m_i               = 0;
             self->m_first_iteration = true;
+            self->m_numpy_output    = output_format == "numpy";
 
             auto name_shape_list = self->m_loader->get_names_and_shapes();
 
@@ -520,6 +895,12 @@ PyMODINIT_FUNC initaeon(void)
         INITERROR;
     }
 
+    Buffer_as_buffer.bf_getbuffer = Buffer_getbuffer;
+    if (PyType_Ready(&aeon_BufferType) < 0)
+    {
+        INITERROR;
+    }
+
     if (_import_array() < 0)
     {
         INITERROR;
@@ -537,6 +918,8 @@ PyMODINIT_FUNC initaeon(void)
 
     Py_INCREF(&aeon_DataLoaderType);
     PyModule_AddObject(m, "DataLoader", (PyObject*)&aeon_DataLoaderType);
+    Py_INCREF(&aeon_BufferType);
+    PyModule_AddObject(m, "Buffer", (PyObject*)&aeon_BufferType);
 
 #ifdef IS_PY3K
     return m;
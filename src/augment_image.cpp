@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include <algorithm>
+#include <immintrin.h>
 #include "augment_image.hpp"
 #include "image.hpp"
 
@@ -351,43 +352,54 @@ void augment::image::sampler::operator=(const nlohmann::json& config)
 
 nbox augment::image::sampler::sample_patch() const
 {
-    auto& random           = get_thread_local_random_engine();
-    float scale            = m_scale_generator(random);
-    float min_aspect_ratio = std::max<float>(m_aspect_ratio_generator.min(), std::pow(scale, 2.));
-    float max_aspect_ratio =
-        std::min<float>(m_aspect_ratio_generator.max(), 1 / std::pow(scale, 2.));
-    auto local_aspect_ratio_generator =
-        std::uniform_real_distribution<float>(min_aspect_ratio, max_aspect_ratio);
-    float aspect_ratio = local_aspect_ratio_generator(random);
-
-    // Figure out nbox dimension.
-    float bbox_width  = scale * sqrt(aspect_ratio);
-    float bbox_height = scale / sqrt(aspect_ratio);
-
-    // Figure out top left coordinates.
-    float                                 w_off, h_off;
-    std::uniform_real_distribution<float> width_generator(0.f, 1.f - bbox_width);
-    std::uniform_real_distribution<float> height_generator(0.f, 1.f - bbox_height);
-    w_off = width_generator(random);
-    h_off = height_generator(random);
-
+    float xmin, ymin, xmax, ymax;
+    sample_patches(1, &xmin, &ymin, &xmax, &ymax);
     try
     {
-        return nbox(w_off, h_off, w_off + bbox_width, h_off + bbox_height);
+        return nbox(xmin, ymin, xmax, ymax);
     }
     catch (exception&)
     {
         ERR << "Error when sampling image:" << endl
-            << " scale range: " << m_scale_generator << " scale: " << scale << endl
-            << " aspect_ratio range: " << m_aspect_ratio_generator
-            << " aspect_ratio: " << aspect_ratio << endl
-            << " bbox_width: " << bbox_width << " bbox_height: " << bbox_height << endl
-            << " width range: " << width_generator << " w_off: " << w_off << endl
-            << " height range: " << height_generator << " h_off: " << h_off;
+            << " scale range: " << m_scale_generator << endl
+            << " aspect_ratio range: " << m_aspect_ratio_generator << endl
+            << " patch: " << xmin << ", " << ymin << ", " << xmax << ", " << ymax;
         throw;
     }
 }
 
+void augment::image::sampler::sample_patches(
+    size_t count, float* xmin, float* ymin, float* xmax, float* ymax) const
+{
+    auto& random = get_thread_local_random_engine();
+    for (size_t i = 0; i < count; i++)
+    {
+        float scale = m_scale_generator(random);
+        float min_aspect_ratio =
+            std::max<float>(m_aspect_ratio_generator.min(), std::pow(scale, 2.));
+        float max_aspect_ratio =
+            std::min<float>(m_aspect_ratio_generator.max(), 1 / std::pow(scale, 2.));
+        auto local_aspect_ratio_generator =
+            std::uniform_real_distribution<float>(min_aspect_ratio, max_aspect_ratio);
+        float aspect_ratio = local_aspect_ratio_generator(random);
+
+        // Figure out nbox dimension.
+        float bbox_width  = scale * sqrt(aspect_ratio);
+        float bbox_height = scale / sqrt(aspect_ratio);
+
+        // Figure out top left coordinates.
+        std::uniform_real_distribution<float> width_generator(0.f, 1.f - bbox_width);
+        std::uniform_real_distribution<float> height_generator(0.f, 1.f - bbox_height);
+        float                                 w_off = width_generator(random);
+        float                                 h_off = height_generator(random);
+
+        xmin[i] = w_off;
+        ymin[i] = h_off;
+        xmax[i] = w_off + bbox_width;
+        ymax[i] = h_off + bbox_height;
+    }
+}
+
 bool augment::image::sample_constraint::satisfies(const nbox&              sampled_bbox,
                                                   const std::vector<nbox>& object_bboxes) const
 {
@@ -455,6 +467,131 @@ bool augment::image::sample_constraint::satisfies(const nbox&              sampl
     return found;
 }
 
+void augment::image::sample_constraint::satisfies(size_t              count,
+                                                  const float*        xmin,
+                                                  const float*        ymin,
+                                                  const float*        xmax,
+                                                  const float*        ymax,
+                                                  const vector<nbox>& object_bboxes,
+                                                  uint8_t*            result) const
+{
+    bool has_jaccard_overlap = has_min_jaccard_overlap() || has_max_jaccard_overlap();
+    bool has_sample_coverage = has_min_sample_coverage() || has_max_sample_coverage();
+    bool has_object_coverage = has_min_object_coverage() || has_max_object_coverage();
+    if (!has_jaccard_overlap && !has_sample_coverage && !has_object_coverage)
+    {
+        fill_n(result, count, 1);
+        return;
+    }
+
+    // In the scalar test an object that passes the first enabled test sets found, and a
+    // later test failing for that object does not clear it. The first enabled test alone
+    // decides the result, so only that measure is computed here.
+    enum class measure
+    {
+        jaccard_overlap,
+        sample_coverage,
+        object_coverage
+    };
+    measure m;
+    float   min_value = -numeric_limits<float>::infinity();
+    float   max_value = numeric_limits<float>::infinity();
+    if (has_jaccard_overlap)
+    {
+        m         = measure::jaccard_overlap;
+        min_value = has_min_jaccard_overlap() ? m_min_jaccard_overlap : min_value;
+        max_value = has_max_jaccard_overlap() ? m_max_jaccard_overlap : max_value;
+    }
+    else if (has_sample_coverage)
+    {
+        m         = measure::sample_coverage;
+        min_value = has_min_sample_coverage() ? m_min_sample_coverage : min_value;
+        max_value = has_max_sample_coverage() ? m_max_sample_coverage : max_value;
+    }
+    else
+    {
+        m         = measure::object_coverage;
+        min_value = has_min_object_coverage() ? m_min_object_coverage : min_value;
+        max_value = has_max_object_coverage() ? m_max_object_coverage : max_value;
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lo   = _mm_set1_ps(min_value);
+    const __m128 hi   = _mm_set1_ps(max_value);
+    for (size_t i = 0; i < count; i += 4)
+    {
+        // four sampled boxes per lane group, the tail is padded with empty boxes
+        size_t n = std::min<size_t>(4, count - i);
+        alignas(16) float tail[4][4] = {};
+        const float*      sx0        = xmin + i;
+        const float*      sy0        = ymin + i;
+        const float*      sx1        = xmax + i;
+        const float*      sy1        = ymax + i;
+        if (n < 4)
+        {
+            copy_n(sx0, n, tail[0]);
+            copy_n(sy0, n, tail[1]);
+            copy_n(sx1, n, tail[2]);
+            copy_n(sy1, n, tail[3]);
+            sx0 = tail[0];
+            sy0 = tail[1];
+            sx1 = tail[2];
+            sy1 = tail[3];
+        }
+        __m128 s_xmin = _mm_loadu_ps(sx0);
+        __m128 s_ymin = _mm_loadu_ps(sy0);
+        __m128 s_xmax = _mm_loadu_ps(sx1);
+        __m128 s_ymax = _mm_loadu_ps(sy1);
+        __m128 s_invalid =
+            _mm_or_ps(_mm_cmplt_ps(s_xmax, s_xmin), _mm_cmplt_ps(s_ymax, s_ymin));
+        __m128 s_size = _mm_andnot_ps(
+            s_invalid, _mm_mul_ps(_mm_sub_ps(s_xmax, s_xmin), _mm_sub_ps(s_ymax, s_ymin)));
+
+        __m128 found = zero;
+        for (const nbox& object : object_bboxes)
+        {
+            __m128 o_xmin = _mm_set1_ps(object.xmin());
+            __m128 o_ymin = _mm_set1_ps(object.ymin());
+            __m128 o_xmax = _mm_set1_ps(object.xmax());
+            __m128 o_ymax = _mm_set1_ps(object.ymax());
+            __m128 o_size = _mm_set1_ps(object.size());
+
+            __m128 disjoint = _mm_or_ps(
+                _mm_or_ps(_mm_cmpgt_ps(o_xmin, s_xmax), _mm_cmplt_ps(o_xmax, s_xmin)),
+                _mm_or_ps(_mm_cmpgt_ps(o_ymin, s_ymax), _mm_cmplt_ps(o_ymax, s_ymin)));
+            __m128 iw = _mm_sub_ps(_mm_min_ps(s_xmax, o_xmax), _mm_max_ps(s_xmin, o_xmin));
+            __m128 ih = _mm_sub_ps(_mm_min_ps(s_ymax, o_ymax), _mm_max_ps(s_ymin, o_ymin));
+            disjoint  = _mm_or_ps(disjoint,
+                                 _mm_or_ps(_mm_cmplt_ps(iw, zero), _mm_cmplt_ps(ih, zero)));
+            __m128 intersect = _mm_andnot_ps(disjoint, _mm_mul_ps(iw, ih));
+
+            __m128 value;
+            switch (m)
+            {
+            case measure::jaccard_overlap:
+                value = _mm_div_ps(intersect,
+                                   _mm_sub_ps(_mm_add_ps(s_size, o_size), intersect));
+                value = _mm_andnot_ps(_mm_cmpeq_ps(intersect, zero), value);
+                break;
+            case measure::sample_coverage:
+                value = _mm_and_ps(_mm_cmpgt_ps(intersect, zero), _mm_div_ps(intersect, s_size));
+                break;
+            case measure::object_coverage:
+                value = _mm_and_ps(_mm_cmpgt_ps(intersect, zero), _mm_div_ps(intersect, o_size));
+                break;
+            }
+            found = _mm_or_ps(found,
+                              _mm_and_ps(_mm_cmpge_ps(value, lo), _mm_cmple_ps(value, hi)));
+        }
+
+        int mask = _mm_movemask_ps(found);
+        for (size_t j = 0; j < n; j++)
+        {
+            result[i + j] = (mask >> j) & 1;
+        }
+    }
+}
+
 augment::image::sample_constraint::sample_constraint(const nlohmann::json& config)
 {
     if (config.is_null())
@@ -561,20 +698,37 @@ augment::image::batch_sampler::batch_sampler(const nlohmann::json& config)
 void augment::image::batch_sampler::sample_patches(const vector<nbox>& object_bboxes,
                                                    vector<nbox>&       output) const
 {
-    int found = 0;
-    for (int i = 0; i < m_max_trials; ++i)
-    {
-        if (has_max_sample() && found >= m_max_sample)
+    // Patches are drawn and tested in groups. A group never holds more patches than are still
+    // needed to reach max_sample, so exactly as many patches are drawn as when they are drawn
+    // one at a time.
+    const size_t      group_size = 64;
+    alignas(16) float xmin[group_size];
+    alignas(16) float ymin[group_size];
+    alignas(16) float xmax[group_size];
+    alignas(16) float ymax[group_size];
+    uint8_t           accepted[group_size];
+
+    int          found = 0;
+    unsigned int trial = 0;
+    while (trial < m_max_trials && !(has_max_sample() && found >= m_max_sample))
+    {
+        size_t count = std::min<size_t>(group_size, m_max_trials - trial);
+        if (has_max_sample())
         {
-            break;
+            count = std::min<size_t>(count, m_max_sample - found);
         }
         // Generate sampled_bbox in the normalized space [0, 1].
-        nbox sampled_bbox = m_sampler.sample_patch();
+        m_sampler.sample_patches(count, xmin, ymin, xmax, ymax);
         // Determine if the sampled nbox is positive or negative by the constraint.
-        if (m_sample_constraint.satisfies(sampled_bbox, object_bboxes))
+        m_sample_constraint.satisfies(count, xmin, ymin, xmax, ymax, object_bboxes, accepted);
+        for (size_t i = 0; i < count; i++)
         {
-            ++found;
-            output.push_back(sampled_bbox);
+            if (accepted[i])
+            {
+                ++found;
+                output.emplace_back(xmin[i], ymin[i], xmax[i], ymax[i]);
+            }
         }
+        trial += count;
     }
 }
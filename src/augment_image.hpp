@@ -277,6 +277,9 @@ public:
     void operator=(const nlohmann::json& config);
 
     normalized_box::box sample_patch() const;
+    // Draws count patches into the coordinate arrays, consuming the random engine exactly as
+    // count calls to sample_patch would.
+    void sample_patches(size_t count, float* xmin, float* ymin, float* xmax, float* ymax) const;
 
 private:
     /** Scale of sampled box */
@@ -308,6 +311,15 @@ public:
 
     bool satisfies(const normalized_box::box&              normalized_sampled_bbox,
                    const std::vector<normalized_box::box>& normalized_object_bboxes) const;
+    // Batched satisfies for count sampled boxes given as coordinate arrays. result[i] is set
+    // to the value satisfies returns for box i.
+    void satisfies(size_t                                  count,
+                   const float*                            xmin,
+                   const float*                            ymin,
+                   const float*                            xmax,
+                   const float*                            ymax,
+                   const std::vector<normalized_box::box>& normalized_object_bboxes,
+                   uint8_t*                                result) const;
 
     bool  has_min_jaccard_overlap() const { return !std::isnan(m_min_jaccard_overlap); }
     float get_min_jaccard_overlap() const;
@@ -17,28 +17,78 @@
 #include "batch_decoder.hpp"
 #include "provider_factory.hpp"
 #include "batch_iterator.hpp"
+#include "transpose.hpp"
 
 using namespace std;
 using namespace nervana;
 
-batch_decoder::batch_decoder(shared_ptr<batch_iterator>                 b_itor,
-                             size_t                                     batch_size,
-                             uint32_t                                   thread_count,
-                             bool                                       pinned,
-                             const std::shared_ptr<provider_interface>& prov,
-                             uint32_t                                   seed)
-    : async_manager<encoded_record_list, fixed_buffer_map>(b_itor, "batch_decoder")
+namespace
+{
+    // Bytes of output per transpose task, small batches get one task per buffer and large
+    // ones are split so that every decode thread gets a share
+    const size_t transpose_task_size = 256 * 1024;
+}
+
+batch_decoder::batch_decoder(shared_ptr<batch_iterator>                   b_itor,
+                             size_t                                       batch_size,
+                             size_t                                       output_batch_size,
+                             bool                                         transpose,
+                             uint32_t                                     thread_count,
+                             const std::shared_ptr<const host_allocator>& allocator,
+                             const std::shared_ptr<provider_interface>&   prov,
+                             uint32_t                                     seed)
+    : async_manager<encoded_record_list, decoded_batches>(b_itor, "batch_decoder")
     , m_batch_size(batch_size)
+    , m_output_batch_size(output_batch_size)
     , m_provider(prov)
     , m_deterministic_mode(seed != 0)
+    , m_transpose(transpose)
 {
+    if (output_batch_size == 0 || batch_size % output_batch_size != 0)
+    {
+        throw invalid_argument("batch_decoder batch size must be a multiple of the output size");
+    }
+    if (output_batch_size % prov->get_batch_multiplier() != 0)
+    {
+        throw invalid_argument("output batch size must be a multiple of the batch multiplier");
+    }
+
     m_thread_pool =
         singleton<thread_pool_queue<batch_decoder, &batch_decoder::process>>::get(thread_count);
     m_number_elements_in = prov->get_input_count();
+    m_record_count       = batch_size / prov->get_batch_multiplier();
+    m_records_per_output = output_batch_size / prov->get_batch_multiplier();
 
     // Allocate the space in the output buffers
     for (unsigned int k = 0; k < 2; ++k)
-        m_containers[k].add_items(prov->get_output_shapes(), batch_size, pinned);
+    {
+        m_containers[k].resize(batch_size / output_batch_size);
+        for (fixed_buffer_map& batch : m_containers[k])
+        {
+            batch.add_items(prov->get_output_shapes(), output_batch_size, allocator);
+        }
+    }
+
+    if (m_transpose)
+    {
+        const auto& shapes = prov->get_output_shapes();
+        m_decoded.add_items(shapes, batch_size);
+        for (size_t batch = 0; batch < batch_size / output_batch_size; batch++)
+        {
+            for (size_t slot = 0; slot < shapes.size(); slot++)
+            {
+                size_t element_size = shapes[slot].second.get_otype().get_size();
+                size_t elements     = shapes[slot].second.get_element_count();
+                size_t row          = output_batch_size * element_size;
+                size_t slice        = max<size_t>(transpose_task_size / row, 1);
+                for (size_t first = 0; first < elements; first += slice)
+                {
+                    m_transpose_tasks.push_back(
+                        {batch, slot, first, min(slice, elements - first)});
+                }
+            }
+        }
+    }
 
     if (m_deterministic_mode)
     {
@@ -53,20 +103,70 @@ batch_decoder::~batch_decoder()
 }
 
 void batch_decoder::process(const int index)
+{
+    if (m_transposing)
+    {
+        transpose_slice(index);
+    }
+    else
+    {
+        decode(index);
+    }
+}
+
+void batch_decoder::decode(int index)
 {
     if (m_deterministic_mode)
         get_thread_local_random_engine() = m_random[index];
 
-    m_provider->provide(index, *m_inputs, *m_outputs);
+    if (m_transpose)
+    {
+        m_provider->provide(index, *m_inputs, m_decoded);
+    }
+    else
+    {
+        m_provider->provide(index,
+                            *m_inputs,
+                            (*m_outputs)[index / m_records_per_output],
+                            index % m_records_per_output);
+    }
 
     if (m_deterministic_mode)
         m_random[index] = get_thread_local_random_engine();
 }
 
-fixed_buffer_map* batch_decoder::filler()
+void batch_decoder::transpose_slice(int index)
+{
+    const transpose_task&             task   = m_transpose_tasks[index];
+    const buffer_fixed_size_elements* source = m_decoded.at(task.slot);
+    buffer_fixed_size_elements*       target = (*m_outputs)[task.batch].at(task.slot);
+
+    size_t element_size = source->get_shape_type().get_otype().get_size();
+    size_t elements     = source->get_stride() / element_size;
+    size_t first_item   = task.batch * m_output_batch_size;
+
+    // the items of the batch are the rows of the source and the columns of the target
+    transpose::block(target->data() + task.first * m_output_batch_size * element_size,
+                     m_output_batch_size,
+                     source->get_item(first_item) + task.first * element_size,
+                     elements,
+                     m_output_batch_size,
+                     task.count,
+                     element_size);
+
+    if (task.first == 0)
+    {
+        for (size_t i = 0; i < m_output_batch_size; i++)
+        {
+            target->set_item_extent(i, source->get_item_extent(first_item + i));
+        }
+    }
+}
+
+decoded_batches* batch_decoder::filler()
 {
     m_state                     = async_state::wait_for_buffer;
-    fixed_buffer_map* outputs   = get_pending_buffer();
+    decoded_batches* outputs    = get_pending_buffer();
     m_state                     = async_state::fetching_data;
     encoded_record_list* inputs = m_source->next();
     m_state                     = async_state::processing;
@@ -83,9 +183,22 @@ fixed_buffer_map* batch_decoder::filler()
         {
             record.rethrow_if_exception();
         }
-        m_inputs  = inputs;
-        m_outputs = outputs;
-        m_thread_pool->run(this, m_batch_size);
+        // batches handed out earlier may have been cut down to their extents
+        for (fixed_buffer_map& batch : *outputs)
+        {
+            batch.restore_shapes();
+        }
+        m_decoded.restore_shapes();
+        m_inputs      = inputs;
+        m_outputs     = outputs;
+        m_transposing = false;
+        m_thread_pool->run(this, m_record_count);
+        if (m_transpose)
+        {
+            m_transposing = true;
+            m_thread_pool->run(this, m_transpose_tasks.size());
+            m_transposing = false;
+        }
     }
     m_state = async_state::idle;
     return outputs;
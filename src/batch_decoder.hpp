@@ -26,23 +26,36 @@ namespace nervana
 {
     class batch_decoder;
     class batch_iterator;
+
+    // The output batches of one decode pass, in order
+    typedef std::vector<fixed_buffer_map> decoded_batches;
 }
 
-class nervana::batch_decoder : public async_manager<encoded_record_list, fixed_buffer_map>
+// Decodes batch_size records per pass, spread over the thread pool. Item i of the pass ends up
+// in item i % output_batch_size of batch i / output_batch_size. Batch major records are
+// written straight to their final item. For batch minor output the pass is decoded into a
+// staging buffer first and a second round of tasks on the pool transposes slices of it into
+// the batches.
+class nervana::batch_decoder : public async_manager<encoded_record_list, decoded_batches>
 {
 public:
-    batch_decoder(std::shared_ptr<batch_iterator>            b_itor,
-                  size_t                                     batch_size,
-                  uint32_t                                   thread_count,
-                  bool                                       pinned,
-                  const std::shared_ptr<provider_interface>& prov,
-                  uint32_t                                   seed = 0);
+    batch_decoder(std::shared_ptr<batch_iterator>              b_itor,
+                  size_t                                       batch_size,
+                  size_t                                       output_batch_size,
+                  bool                                         transpose,
+                  uint32_t                                     thread_count,
+                  const std::shared_ptr<const host_allocator>& allocator,
+                  const std::shared_ptr<provider_interface>&   prov,
+                  uint32_t                                     seed = 0);
 
     virtual ~batch_decoder();
 
-    virtual size_t            record_count() const override { return m_batch_size; }
-    virtual size_t            elements_per_record() const override { return m_number_elements_out; }
-    virtual fixed_buffer_map* filler() override;
+    virtual size_t           record_count() const override { return m_batch_size; }
+    virtual size_t           elements_per_record() const override { return m_number_elements_out; }
+    virtual decoded_batches* filler() override;
+    size_t                   output_batch_size() const { return m_output_batch_size; }
+    // batches are in batch minor order
+    bool transposed() const { return m_transpose; }
 
     void register_info_handler(std::function<void(const fixed_buffer_map*)>& f)
     {
@@ -52,15 +65,34 @@ public:
     void process(const int index);
 
 private:
+    // A range of elements of one buffer, transposed for all items of one output batch
+    struct transpose_task
+    {
+        size_t batch;
+        size_t slot;
+        size_t first;
+        size_t count;
+    };
+
+    void decode(int index);
+    void transpose_slice(int index);
+
     size_t                                    m_batch_size;
+    size_t                                    m_output_batch_size;
+    size_t                                    m_record_count;       // input records per batch
+    size_t                                    m_records_per_output; // input records per output
     size_t                                    m_number_elements_in;
     size_t                                    m_number_elements_out;
     std::shared_ptr<const provider_interface> m_provider;
     encoded_record_list*                      m_inputs{nullptr};
-    fixed_buffer_map*                         m_outputs{nullptr};
+    decoded_batches*                          m_outputs{nullptr};
     std::shared_ptr<thread_pool_queue<batch_decoder, &batch_decoder::process>> m_thread_pool;
     std::function<void(const fixed_buffer_map*)> m_info_handler;
     size_t                                       m_iteration_number{0};
     std::vector<nervana::random_engine_t>        m_random;
     bool                                         m_deterministic_mode;
+    bool                                         m_transpose;
+    bool                                         m_transposing{false};
+    fixed_buffer_map                             m_decoded; // staging for batch minor output
+    std::vector<transpose_task>                  m_transpose_tasks;
 };
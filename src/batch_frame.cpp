@@ -0,0 +1,565 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "batch_frame.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    const char   magic[]           = {'A', 'E', 'O', 'N', 'B', 'F'};
+    const size_t magic_size        = sizeof(magic);
+    const size_t version_offset    = magic_size;
+    const size_t header_size_field = version_offset + sizeof(uint16_t);
+    const size_t count_field       = header_size_field + sizeof(uint32_t);
+    const size_t frame_size_field  = count_field + sizeof(uint32_t);
+    const size_t sequence_field    = frame_size_field + sizeof(uint64_t);
+    const size_t fixed_header_size = sequence_field + sizeof(uint64_t);
+
+    const char padding[batch_frame::alignment] = {};
+
+    size_t align(size_t offset)
+    {
+        return (offset + batch_frame::alignment - 1) / batch_frame::alignment *
+               batch_frame::alignment;
+    }
+
+    // Sizes in a header come from the sender and may be anything
+    size_t checked_multiply(size_t a, size_t b)
+    {
+        if (a != 0 && b > SIZE_MAX / a)
+        {
+            throw runtime_error("batch frame payload size overflows");
+        }
+        return a * b;
+    }
+
+    template <typename T>
+    void put(vector<char>& out, T value)
+    {
+        size_t offset = out.size();
+        out.resize(offset + sizeof(T));
+        pack<T>(out.data(), value, offset);
+    }
+
+    void put_string(vector<char>& out, const string& value)
+    {
+        put<uint32_t>(out, value.size());
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    // Describes a buffer in the header and returns where its payload offset goes
+    size_t put_description(vector<char>&     out,
+                           const string&     name,
+                           const shape_type& shape,
+                           size_t            batch_size)
+    {
+        put_string(out, name);
+        put_string(out, shape.get_otype().m_tp_name);
+        put<uint32_t>(out, batch_size);
+        put<uint32_t>(out, shape.get_shape().size());
+        for (size_t dimension : shape.get_shape())
+        {
+            put<uint64_t>(out, dimension);
+        }
+        vector<string> axis_names = shape.get_names();
+        put<uint32_t>(out, axis_names.size());
+        for (const string& axis_name : axis_names)
+        {
+            put_string(out, axis_name);
+        }
+        size_t offset_field = out.size();
+        put<uint64_t>(out, 0);
+        put<uint64_t>(out, shape.get_byte_size() * batch_size);
+        return offset_field;
+    }
+
+    // The first allocation, the buffer being built, gets the payload in the frame. Copies of the
+    // buffer allocate again and get memory of their own.
+    shared_ptr<const host_allocator> mapped_allocator(char* payload)
+    {
+        shared_ptr<const host_allocator> standard = host_allocator::standard();
+        auto                             taken    = make_shared<atomic<bool>>(false);
+        return make_shared<host_allocator>(
+            [payload, standard, taken](size_t size) -> void* {
+                return taken->exchange(true) ? standard->allocate(size) : payload;
+            },
+            [payload, standard](void* memory, size_t size) {
+                if (memory != payload)
+                {
+                    standard->free(memory, size);
+                }
+            });
+    }
+
+    class header_parser
+    {
+    public:
+        header_parser(const string& header, size_t offset)
+            : m_header{header}
+            , m_offset{offset}
+        {
+        }
+
+        template <typename T>
+        T get()
+        {
+            check(sizeof(T));
+            T value = unpack<T>(m_header.data(), m_offset);
+            m_offset += sizeof(T);
+            return value;
+        }
+
+        string get_string()
+        {
+            size_t size = get<uint32_t>();
+            check(size);
+            string value = m_header.substr(m_offset, size);
+            m_offset += size;
+            return value;
+        }
+
+    private:
+        void check(size_t size) const
+        {
+            if (m_offset + size > m_header.size())
+            {
+                throw runtime_error("batch frame header is truncated");
+            }
+        }
+
+        const string& m_header;
+        size_t        m_offset;
+    };
+}
+
+batch_frame_writer::batch_frame_writer(const fixed_buffer_map& batch, uint64_t sequence)
+{
+    m_header.assign(magic, magic + magic_size);
+    put<uint16_t>(m_header, batch_frame::version);
+    put<uint32_t>(m_header, 0); // header size, known once all buffers are described
+    put<uint32_t>(m_header, batch.size());
+    put<uint64_t>(m_header, 0); // frame size
+    put<uint64_t>(m_header, sequence);
+
+    const vector<string>& names = batch.get_names();
+    vector<size_t>        offset_fields;
+    for (size_t slot = 0; slot < batch.size(); slot++)
+    {
+        const buffer_fixed_size_elements* buffer = batch.at(slot);
+        offset_fields.push_back(put_description(
+            m_header, names[slot], buffer->get_shape_type(), buffer->get_batch_size()));
+    }
+
+    size_t header_size = align(m_header.size());
+    m_header.resize(header_size, 0);
+    pack<uint32_t>(m_header.data(), header_size, header_size_field);
+    m_segments.push_back({m_header.data(), header_size});
+    m_size = header_size;
+
+    for (size_t slot = 0; slot < batch.size(); slot++)
+    {
+        const buffer_fixed_size_elements* buffer = batch.at(slot);
+        pack<uint64_t>(m_header.data(), m_size, offset_fields[slot]);
+        if (buffer->size() > 0)
+        {
+            m_segments.push_back({buffer->data(), buffer->size()});
+            m_size += buffer->size();
+        }
+        size_t aligned = align(m_size);
+        if (aligned > m_size)
+        {
+            m_segments.push_back({const_cast<char*>(padding), aligned - m_size});
+            m_size = aligned;
+        }
+    }
+    pack<uint64_t>(m_header.data(), m_size, frame_size_field);
+}
+
+size_t batch_frame_writer::max_size(const vector<pair<string, shape_type>>& names_and_shapes,
+                                    size_t                                  batch_size)
+{
+    // payloads of batches cut down to their extents only get smaller
+    vector<char> header(fixed_header_size);
+    size_t       payloads = 0;
+    for (const auto& buffer : names_and_shapes)
+    {
+        put_description(header, buffer.first, buffer.second, batch_size);
+        payloads += align(buffer.second.get_byte_size() * batch_size);
+    }
+    return align(header.size()) + payloads;
+}
+
+void batch_frame_writer::copy_to(char* destination) const
+{
+    for (const iovec& segment : m_segments)
+    {
+        memcpy(destination, segment.iov_base, segment.iov_len);
+        destination += segment.iov_len;
+    }
+}
+
+string batch_frame_writer::to_string() const
+{
+    string frame(m_size, '\0');
+    copy_to(&frame[0]);
+    return frame;
+}
+
+void batch_frame_writer::write_to(int fd) const
+{
+    vector<iovec> pending = m_segments;
+    size_t        first   = 0;
+    while (first < pending.size())
+    {
+        int     count   = static_cast<int>(min(pending.size() - first, size_t(IOV_MAX)));
+        ssize_t written = writev(fd, &pending[first], count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw runtime_error(string("cannot write batch frame: ") + strerror(errno));
+        }
+
+        // skip what was sent and resume a partially written segment where it stopped
+        size_t remaining = written;
+        while (first < pending.size() && remaining >= pending[first].iov_len)
+        {
+            remaining -= pending[first].iov_len;
+            first++;
+        }
+        if (remaining > 0)
+        {
+            pending[first].iov_base = static_cast<char*>(pending[first].iov_base) + remaining;
+            pending[first].iov_len -= remaining;
+        }
+    }
+}
+
+batch_frame_reader::batch_frame_reader(const shared_ptr<const host_allocator>& allocator)
+    : m_allocator{allocator}
+    , m_spares{make_shared<spare_list>()}
+{
+}
+
+void batch_frame_reader::begin()
+{
+    if (m_target)
+    {
+        lock_guard<mutex> lock(m_spares->mutex);
+        m_spares->batches.push_back(move(m_target));
+    }
+    m_state       = state::prefix;
+    m_header_size = 0;
+    m_frame_size  = 0;
+    m_sequence    = 0;
+    m_position    = 0;
+    m_current     = 0;
+    m_header.clear();
+    m_other.clear();
+    m_payloads.clear();
+}
+
+void batch_frame_reader::append(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t take = 0;
+        switch (m_state)
+        {
+        case state::prefix:
+        case state::header:
+        {
+            size_t wanted = m_state == state::prefix ? fixed_header_size : m_header_size;
+            take          = min(wanted - m_header.size(), size);
+            m_header.append(data, take);
+            if (m_state == state::prefix)
+            {
+                size_t checked = min(m_header.size(), magic_size);
+                if (m_header.compare(0, checked, magic, checked) != 0)
+                {
+                    m_state = state::other;
+                    m_other.swap(m_header);
+                }
+                else if (m_header.size() == fixed_header_size)
+                {
+                    parse_fixed_header(m_header, m_header_size, m_frame_size, m_sequence);
+                    m_state = state::header;
+                }
+            }
+            if (m_state == state::header && m_header.size() == m_header_size)
+            {
+                m_payloads = parse_payloads(m_header, m_header_size, m_frame_size);
+                prepare_target();
+                m_position = m_header_size;
+                m_state    = m_position == m_frame_size ? state::done : state::payload;
+            }
+            break;
+        }
+        case state::payload:
+        {
+            if (m_current < m_payloads.size() && m_position >= m_payloads[m_current].offset)
+            {
+                const payload& current = m_payloads[m_current];
+                size_t         written = m_position - current.offset;
+                take                   = min(current.size - written, size);
+                if (take > 0)
+                {
+                    memcpy(m_target->at(m_current)->data() + written, data, take);
+                }
+            }
+            else
+            {
+                size_t next = m_current < m_payloads.size() ? m_payloads[m_current].offset
+                                                            : m_frame_size;
+                take = min(next - m_position, size);
+            }
+            m_position += take;
+            while (m_current < m_payloads.size() &&
+                   m_position == m_payloads[m_current].offset + m_payloads[m_current].size)
+            {
+                m_current++;
+            }
+            if (m_position == m_frame_size)
+            {
+                m_state = state::done;
+            }
+            break;
+        }
+        case state::done:
+            // trailing bytes, transports with fixed size transfer buffers send more than a frame
+            take = size;
+            break;
+        case state::other:
+            m_other.append(data, size);
+            take = size;
+            break;
+        }
+        data += take;
+        size -= take;
+    }
+}
+
+shared_ptr<fixed_buffer_map> batch_frame_reader::finish()
+{
+    if (m_state != state::done)
+    {
+        throw runtime_error("batch frame is incomplete");
+    }
+
+    weak_ptr<spare_list> spares = m_spares;
+    fixed_buffer_map*    batch  = m_target.release();
+    begin();
+    return shared_ptr<fixed_buffer_map>(batch, [spares](fixed_buffer_map* returned) {
+        shared_ptr<spare_list> list = spares.lock();
+        if (list)
+        {
+            lock_guard<mutex> lock(list->mutex);
+            list->batches.emplace_back(returned);
+        }
+        else
+        {
+            delete returned;
+        }
+    });
+}
+
+shared_ptr<fixed_buffer_map> batch_frame_reader::map(char*                   frame,
+                                                     size_t                  size,
+                                                     const function<void()>& release,
+                                                     uint64_t*               sequence)
+{
+    if (size < fixed_header_size || memcmp(frame, magic, magic_size) != 0)
+    {
+        throw runtime_error("memory does not hold a batch frame");
+    }
+    if (reinterpret_cast<uintptr_t>(frame) % batch_frame::alignment != 0)
+    {
+        throw runtime_error("batch frame to map is not aligned");
+    }
+    size_t   header_size;
+    size_t   frame_size;
+    uint64_t frame_sequence;
+    parse_fixed_header(string(frame, fixed_header_size), header_size, frame_size, frame_sequence);
+    if (frame_size > size)
+    {
+        throw runtime_error("batch frame is incomplete");
+    }
+    vector<payload> payloads = parse_payloads(string(frame, header_size), header_size, frame_size);
+
+    unique_ptr<fixed_buffer_map> batch(new fixed_buffer_map());
+    for (const payload& current : payloads)
+    {
+        batch->add_item(current.name,
+                        current.shape,
+                        current.batch_size,
+                        mapped_allocator(frame + current.offset));
+    }
+    if (sequence)
+    {
+        *sequence = frame_sequence;
+    }
+    return shared_ptr<fixed_buffer_map>(batch.release(), [release](fixed_buffer_map* mapped) {
+        delete mapped;
+        release();
+    });
+}
+
+void batch_frame_reader::parse_fixed_header(const string& header,
+                                            size_t&       header_size,
+                                            size_t&       frame_size,
+                                            uint64_t&     sequence)
+{
+    uint16_t version = unpack<uint16_t>(header.data(), version_offset);
+    if (version != batch_frame::version)
+    {
+        throw runtime_error("unsupported batch frame version " + std::to_string(version));
+    }
+    header_size = unpack<uint32_t>(header.data(), header_size_field);
+    frame_size  = unpack<uint64_t>(header.data(), frame_size_field);
+    sequence    = unpack<uint64_t>(header.data(), sequence_field);
+    if (header_size < fixed_header_size || frame_size < header_size)
+    {
+        throw runtime_error("batch frame has inconsistent sizes");
+    }
+}
+
+vector<batch_frame_reader::payload> batch_frame_reader::parse_payloads(const string& header,
+                                                                      size_t header_size,
+                                                                      size_t frame_size)
+{
+    vector<payload> payloads;
+    header_parser   in(header, fixed_header_size);
+    size_t          count = unpack<uint32_t>(header.data(), count_field);
+    size_t          end   = header_size;
+    for (size_t slot = 0; slot < count; slot++)
+    {
+        payload current;
+        current.name       = in.get_string();
+        string type        = in.get_string();
+        current.batch_size = in.get<uint32_t>();
+
+        vector<size_t> dimensions(in.get<uint32_t>());
+        for (size_t& dimension : dimensions)
+        {
+            dimension = in.get<uint64_t>();
+        }
+        vector<string> axis_names(in.get<uint32_t>());
+        bool           positional = true;
+        for (size_t axis = 0; axis < axis_names.size(); axis++)
+        {
+            axis_names[axis] = in.get_string();
+            positional       = positional && axis_names[axis] == std::to_string(axis);
+        }
+        current.offset = in.get<uint64_t>();
+        current.size   = in.get<uint64_t>();
+
+        if (!output_type::is_valid_type(type))
+        {
+            throw runtime_error("batch frame buffer " + current.name + " has unknown type " +
+                                type);
+        }
+        current.shape = shape_type{dimensions, output_type{type}};
+        if (!positional)
+        {
+            current.shape.set_names(axis_names);
+        }
+        size_t shape_size = current.shape.get_otype().get_size();
+        for (size_t dimension : dimensions)
+        {
+            shape_size = checked_multiply(shape_size, dimension);
+        }
+        if (shape_size != current.shape.get_byte_size() ||
+            checked_multiply(shape_size, current.batch_size) != current.size)
+        {
+            throw runtime_error("batch frame payload size does not match the shape of " +
+                                current.name);
+        }
+        if (current.offset < end || current.size > frame_size ||
+            current.offset > frame_size - current.size)
+        {
+            throw runtime_error("batch frame payload of " + current.name + " is out of place");
+        }
+        end = current.offset + current.size;
+        payloads.push_back(move(current));
+    }
+    return payloads;
+}
+
+void batch_frame_reader::prepare_target()
+{
+    {
+        lock_guard<mutex> lock(m_spares->mutex);
+        auto&             spares = m_spares->batches;
+        auto fit = [this](const unique_ptr<fixed_buffer_map>& spare) { return fits(*spare); };
+        auto it  = find_if(spares.begin(), spares.end(), fit);
+        if (it != spares.end())
+        {
+            m_target = move(*it);
+            spares.erase(it);
+        }
+        else if (!spares.empty())
+        {
+            // the shapes grew, drop a spare rather than keep memory that no frame fits in
+            spares.pop_back();
+        }
+    }
+
+    if (m_target)
+    {
+        for (size_t slot = 0; slot < m_payloads.size(); slot++)
+        {
+            m_target->at(slot)->reshape(m_payloads[slot].shape, m_payloads[slot].batch_size);
+        }
+    }
+    else
+    {
+        m_target.reset(new fixed_buffer_map());
+        for (const payload& current : m_payloads)
+        {
+            m_target->add_item(current.name, current.shape, current.batch_size, m_allocator);
+        }
+        m_allocated++;
+    }
+}
+
+bool batch_frame_reader::fits(const fixed_buffer_map& batch) const
+{
+    if (batch.size() != m_payloads.size())
+    {
+        return false;
+    }
+    for (size_t slot = 0; slot < m_payloads.size(); slot++)
+    {
+        if (batch.get_names()[slot] != m_payloads[slot].name ||
+            batch.at(slot)->capacity() < m_payloads[slot].size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
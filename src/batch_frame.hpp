@@ -0,0 +1,179 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include "buffer_batch.hpp"
+
+namespace nervana
+{
+    class batch_frame_writer;
+    class batch_frame_reader;
+
+    namespace batch_frame
+    {
+        const uint16_t    version      = 1;
+        const size_t      alignment    = 64;
+        const std::string format_name  = "frame";
+        const std::string content_type = "application/x-aeon-batch";
+    }
+}
+
+/**
+ * \brief Binary framing of a batch for transfer between processes
+ *
+ * A frame is a header followed by the raw contents of every buffer. All integers are little
+ * endian.
+ *
+ * Header:
+ * - magic "AEONBF" and a uint16 version
+ * - uint32 header size, which is where the first payload starts
+ * - uint32 buffer count
+ * - uint64 frame size
+ * - uint64 sequence number the sender gave the batch
+ * - per buffer: name, output type, uint32 batch size, uint32 rank, uint64 dimensions, axis
+ *   names, uint64 payload offset and uint64 payload size. Strings are a uint32 length followed
+ *   by the characters.
+ *
+ * The header and every payload start on a batch_frame::alignment boundary and the gaps are
+ * zero filled, so a receiver can write payloads straight into aligned buffers.
+ */
+class nervana::batch_frame_writer
+{
+public:
+    explicit batch_frame_writer(const fixed_buffer_map& batch, uint64_t sequence = 0);
+    // Size of the frame of a batch with these buffers, batches cut down to their extents make
+    // smaller frames
+    static size_t max_size(const std::vector<std::pair<std::string, shape_type>>& names_and_shapes,
+                           size_t batch_size);
+    // the first segment points into the writer itself
+    batch_frame_writer(const batch_frame_writer&) = delete;
+    batch_frame_writer& operator=(const batch_frame_writer&) = delete;
+
+    size_t size() const { return m_size; }
+    // Header, payloads and padding in frame order. Payloads point into the batch, which must
+    // outlive the writer.
+    const std::vector<iovec>& segments() const { return m_segments; }
+
+    // Gathers the whole frame into destination, which must hold size() bytes
+    void copy_to(char* destination) const;
+    std::string to_string() const;
+    // Sends the frame with scatter gather writes, the payloads are not copied
+    void write_to(int fd) const;
+
+private:
+    std::vector<char>  m_header;
+    std::vector<iovec> m_segments;
+    size_t             m_size{0};
+};
+
+/**
+ * \brief Incremental decoder for frames written by batch_frame_writer
+ *
+ * Bytes are fed in the order they arrive and payloads are written directly into the buffers of
+ * the result, so a frame is never assembled in memory first. A batch returned by finish goes
+ * back to the reader when the last reference to it is dropped and its buffers are reused for a
+ * later frame that fits in them.
+ *
+ * Input that does not start with the frame magic is collected as is and is available from
+ * get_other_data, which lets callers fall back to other encodings and to error messages.
+ */
+class nervana::batch_frame_reader
+{
+public:
+    explicit batch_frame_reader(const std::shared_ptr<const host_allocator>& allocator =
+                                    host_allocator::standard());
+
+    // Forgets any partial input and starts a new frame
+    void begin();
+    // Throws std::runtime_error when the input is a malformed frame
+    void append(const char* data, size_t size);
+
+    bool is_frame() const { return m_state != state::other && m_state != state::prefix; }
+    bool complete() const { return m_state == state::done; }
+    // Returns the decoded batch. Throws when the frame is incomplete.
+    std::shared_ptr<fixed_buffer_map> finish();
+    const std::string&                get_other_data() const { return m_other; }
+    // sequence number of the current frame, valid once its header has arrived
+    uint64_t get_sequence() const { return m_sequence; }
+
+    // number of batches allocated by the reader so far, for tests and statistics
+    size_t allocated() const { return m_allocated; }
+
+    // Returns a batch whose buffers are the payloads of a complete frame in memory, for frames
+    // in shared memory. The frame must start on a batch_frame::alignment boundary and stay in
+    // place until release is called, which happens when the last reference to the batch is
+    // dropped. Throws std::runtime_error for malformed frames, release is not called then.
+    static std::shared_ptr<fixed_buffer_map> map(char*                        frame,
+                                                 size_t                       size,
+                                                 const std::function<void()>& release,
+                                                 uint64_t*                    sequence = nullptr);
+
+private:
+    enum class state
+    {
+        prefix,
+        header,
+        payload,
+        done,
+        other
+    };
+
+    struct payload
+    {
+        std::string name;
+        shape_type  shape;
+        size_t      batch_size;
+        size_t      offset;
+        size_t      size;
+    };
+
+    struct spare_list
+    {
+        std::mutex                                     mutex;
+        std::vector<std::unique_ptr<fixed_buffer_map>> batches;
+    };
+
+    static void parse_fixed_header(const std::string& header,
+                                   size_t&            header_size,
+                                   size_t&            frame_size,
+                                   uint64_t&          sequence);
+    static std::vector<payload>
+        parse_payloads(const std::string& header, size_t header_size, size_t frame_size);
+    void prepare_target();
+    bool fits(const fixed_buffer_map& batch) const;
+
+    std::shared_ptr<const host_allocator> m_allocator;
+    std::shared_ptr<spare_list>           m_spares;
+    state                                 m_state{state::prefix};
+    std::string                           m_header;
+    std::string                           m_other;
+    size_t                                m_header_size{0};
+    size_t                                m_frame_size{0};
+    uint64_t                              m_sequence{0};
+    size_t                                m_position{0};
+    size_t                                m_current{0};
+    std::vector<payload>                  m_payloads;
+    std::unique_ptr<fixed_buffer_map>     m_target;
+    size_t                                m_allocated{0};
+};
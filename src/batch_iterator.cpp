@@ -25,7 +25,8 @@
 using namespace nervana;
 using namespace std;
 
-batch_iterator::batch_iterator(shared_ptr<block_manager> blkl, size_t batch_size)
+batch_iterator::batch_iterator(shared_ptr<async_manager_source<encoded_record_list>> blkl,
+                               size_t                                                batch_size)
     : async_manager<encoded_record_list, encoded_record_list>(blkl, "batch_iterator")
     , m_batch_size(batch_size)
     , m_element_count(blkl->elements_per_record())
@@ -85,74 +86,37 @@ encoded_record_list* batch_iterator::filler()
     return rc;
 }
 
-batch_iterator_fbm::batch_iterator_fbm(shared_ptr<batch_decoder>                  blkl,
-                                       size_t                                     batch_size,
-                                       const std::shared_ptr<provider_interface>& prov,
-                                       bool                                       transpose)
-    : async_manager<fixed_buffer_map, fixed_buffer_map>(blkl, "batch_iterator")
-    , m_batch_size(batch_size)
-    , m_transpose(transpose)
-    , m_element_count(blkl->elements_per_record())
+decoded_batch_iterator::decoded_batch_iterator(shared_ptr<batch_decoder> decoder,
+                                               bool                      shrink_to_extents)
+    : m_source(decoder)
+    , m_shrink_to_extents(shrink_to_extents)
 {
-    m_element_count = elements_per_record();
-    auto oshapes    = prov->get_output_shapes();
-
-    for (unsigned int k = 0; k < 2; ++k)
-    {
-        for (auto& sz : oshapes)
-        {
-            m_containers[k].add_item(sz.first, sz.second, batch_size, false);
-        }
-    }
 }
 
-fixed_buffer_map* batch_iterator_fbm::filler()
+fixed_buffer_map* decoded_batch_iterator::next()
 {
-    m_state              = async_state::wait_for_buffer;
-    fixed_buffer_map* rc = get_pending_buffer();
-    m_state              = async_state::processing;
-
-    // This is for the first pass
-    if (m_input_ptr == nullptr)
+    if (m_batches == nullptr || m_next == m_batches->size())
     {
-        m_state     = async_state::fetching_data;
-        m_input_ptr = m_source->next();
-        m_src_index = 0;
-        m_state     = async_state::processing;
-    }
-
-    m_dst_index      = 0;
-    size_t remainder = m_batch_size;
-    while (remainder > 0)
-    {
-        if (m_input_ptr == nullptr)
+        m_batches = m_source->next();
+        m_next    = 0;
+        if (m_batches == nullptr)
         {
-            rc = nullptr;
-            break;
-        }
-
-        const string first_name         = (m_input_ptr->get_names())[0];
-        size_t       input_size         = ((*m_input_ptr)[first_name])->get_item_count();
-        size_t       current_input_size = input_size - m_src_index;
-        size_t move_count = (current_input_size <= remainder) ? current_input_size : remainder;
-
-        rc->copy(*m_input_ptr, m_src_index, m_dst_index, move_count, m_batch_size, m_transpose);
-
-        m_src_index += move_count;
-        m_dst_index += move_count;
-
-        remainder -= move_count;
-
-        if (remainder > 0 || input_size == m_src_index)
-        {
-            m_state     = async_state::fetching_data;
-            m_input_ptr = m_source->next();
-            m_src_index = 0;
-            m_state     = async_state::processing;
+            return nullptr;
         }
     }
 
-    m_state = async_state::idle;
-
+    fixed_buffer_map* rc = &(*m_batches)[m_next++];
+    // bucketed batches are cut down to their longest item
+    if (m_shrink_to_extents)
+    {
+        rc->shrink_to_extents(m_source->transposed());
+    }
     return rc;
 }
+
+void decoded_batch_iterator::reset()
+{
+    m_source->reset();
+    m_batches = nullptr;
+    m_next    = 0;
+}
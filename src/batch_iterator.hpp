@@ -18,6 +18,7 @@
 #include <string>
 #include "async_manager.hpp"
 #include "buffer_batch.hpp"
+#include "batch_decoder.hpp"
 #include "provider_interface.hpp"
 #include "util.hpp"
 
@@ -30,7 +31,7 @@
 namespace nervana
 {
     class batch_iterator;
-    class batch_iterator_fbm; // batch iterator for fixed_buffer_map type
+    class decoded_batch_iterator;
     class block_manager;
     class batch_decoder;
 }
@@ -38,7 +39,7 @@ namespace nervana
 class nervana::batch_iterator : public async_manager<encoded_record_list, encoded_record_list>
 {
 public:
-    batch_iterator(std::shared_ptr<block_manager>, size_t batch_size);
+    batch_iterator(std::shared_ptr<async_manager_source<encoded_record_list>>, size_t batch_size);
     ~batch_iterator() { finalize(); }
     encoded_record_list* filler() override;
 
@@ -56,29 +57,22 @@ private:
     encoded_record_list* m_input_ptr{nullptr};
 };
 
-class nervana::batch_iterator_fbm : public async_manager<fixed_buffer_map, fixed_buffer_map>
+// Hands out the batches a batch_decoder wrote in place, one at a time. It runs on the caller's
+// thread: the decoded batches go back to the decoder only when the next pass is requested,
+// which is after the caller has let go of the last batch of this pass.
+class nervana::decoded_batch_iterator : public async_manager_source<fixed_buffer_map>
 {
 public:
-    batch_iterator_fbm(std::shared_ptr<batch_decoder>             blkl,
-                       size_t                                     batch_size,
-                       const std::shared_ptr<provider_interface>& prov,
-                       bool                                       transpose);
-    ~batch_iterator_fbm() { finalize(); }
-    fixed_buffer_map* filler() override;
+    decoded_batch_iterator(std::shared_ptr<batch_decoder> decoder, bool shrink_to_extents = false);
+    fixed_buffer_map* next() override;
 
-    size_t record_count() const override { return m_batch_size; }
-    size_t elements_per_record() const override { return m_element_count; }
-    void   initialize() override
-    {
-        m_input_ptr = nullptr;
-        async_manager<fixed_buffer_map, fixed_buffer_map>::initialize();
-    }
+    size_t record_count() const override { return m_source->output_batch_size(); }
+    size_t elements_per_record() const override { return m_source->elements_per_record(); }
+    void   reset() override;
 
 private:
-    size_t            m_batch_size;
-    bool              m_transpose;
-    size_t            m_element_count;
-    fixed_buffer_map* m_input_ptr{nullptr};
-    size_t            m_src_index = 0;
-    size_t            m_dst_index = 0;
+    std::shared_ptr<batch_decoder> m_source;
+    bool                           m_shrink_to_extents;
+    decoded_batches*               m_batches{nullptr};
+    size_t                         m_next{0};
 };
@@ -0,0 +1,108 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "bucket_iterator.hpp"
+
+using namespace nervana;
+using namespace std;
+
+bucket_iterator::bucket_iterator(shared_ptr<async_manager_source<encoded_record_list>> source,
+                                 shared_ptr<provider_interface>                        provider,
+                                 const vector<uint32_t>&                               boundaries,
+                                 size_t                                                element,
+                                 size_t group_size)
+    : async_manager<encoded_record_list, encoded_record_list>(source, "bucket_iterator")
+    , m_provider(provider)
+    , m_boundaries(boundaries)
+    , m_element(element)
+    , m_group_size(group_size)
+    , m_element_count(source->elements_per_record())
+    , m_buckets(boundaries.size() + 1)
+{
+    if (m_group_size == 0)
+    {
+        throw invalid_argument("bucket_iterator group size must be positive");
+    }
+    if (!is_sorted(m_boundaries.begin(), m_boundaries.end()) ||
+        adjacent_find(m_boundaries.begin(), m_boundaries.end()) != m_boundaries.end())
+    {
+        throw invalid_argument("bucket_boundaries must be strictly increasing");
+    }
+}
+
+size_t bucket_iterator::bucket_index(const vector<uint32_t>& boundaries, uint32_t key)
+{
+    return lower_bound(boundaries.begin(), boundaries.end(), key) - boundaries.begin();
+}
+
+size_t bucket_iterator::bucket_of(const encoded_record& record) const
+{
+    uint32_t key = UINT32_MAX;
+    try
+    {
+        if (!m_provider->get_length_key(record, m_element, key))
+        {
+            key = UINT32_MAX;
+        }
+    }
+    catch (const exception&)
+    {
+        // records that fail to probe are passed on, the decoder reports the error
+        key = UINT32_MAX;
+    }
+    return bucket_index(m_boundaries, key);
+}
+
+encoded_record_list* bucket_iterator::filler()
+{
+    m_state                 = async_state::wait_for_buffer;
+    encoded_record_list* rc = get_pending_buffer();
+    m_state                 = async_state::processing;
+
+    rc->clear();
+
+    // Drain whole input blocks until at least one bucket has a full group. Records left in
+    // partially filled buckets carry over to later blocks and epochs.
+    while (rc->size() == 0)
+    {
+        m_state                    = async_state::fetching_data;
+        encoded_record_list* input = m_source->next();
+        m_state                    = async_state::processing;
+        if (input == nullptr)
+        {
+            rc = nullptr;
+            break;
+        }
+
+        for (encoded_record& record : *input)
+        {
+            encoded_record_list& bucket = m_buckets[bucket_of(record)];
+            bucket.add_record(std::move(record));
+            if (bucket.size() == m_group_size)
+            {
+                bucket.move_to(*rc, m_group_size);
+            }
+        }
+        input->clear();
+    }
+
+    m_state = async_state::idle;
+
+    return rc;
+}
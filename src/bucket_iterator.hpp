@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "async_manager.hpp"
+#include "buffer_batch.hpp"
+#include "provider_interface.hpp"
+
+/* bucket_iterator
+ *
+ * Groups records of similar length so that each batch can be cut down to the length
+ * of its longest record instead of the longest record in the dataset.
+ *
+ */
+
+namespace nervana
+{
+    class bucket_iterator;
+}
+
+class nervana::bucket_iterator : public async_manager<encoded_record_list, encoded_record_list>
+{
+public:
+    // Records are keyed by the provider for record element 'element' and sorted into the buckets
+    // [0, boundaries[0]], (boundaries[0], boundaries[1]], ... with one more bucket for longer or
+    // unknown lengths. Each output holds whole groups of group_size records from one bucket.
+    bucket_iterator(std::shared_ptr<async_manager_source<encoded_record_list>> source,
+                    std::shared_ptr<provider_interface>                        provider,
+                    const std::vector<uint32_t>&                               boundaries,
+                    size_t                                                     element,
+                    size_t                                                     group_size);
+    ~bucket_iterator() { finalize(); }
+    encoded_record_list* filler() override;
+
+    size_t record_count() const override { return m_source->record_count(); }
+    size_t elements_per_record() const override { return m_element_count; }
+    void   initialize() override
+    {
+        for (encoded_record_list& bucket : m_buckets)
+        {
+            bucket.clear();
+        }
+        async_manager<encoded_record_list, encoded_record_list>::initialize();
+    }
+
+    static size_t bucket_index(const std::vector<uint32_t>& boundaries, uint32_t key);
+
+private:
+    size_t bucket_of(const encoded_record& record) const;
+
+    std::shared_ptr<provider_interface> m_provider;
+    std::vector<uint32_t>               m_boundaries;
+    size_t                              m_element;
+    size_t                              m_group_size;
+    size_t                              m_element_count;
+    std::vector<encoded_record_list>    m_buckets;
+};
@@ -21,12 +21,6 @@
 #include "log.hpp"
 #include "transpose.hpp"
 
-enum TransposeType
-{
-    REGULAR,
-    SSE
-};
-
 using namespace std;
 using namespace nervana;
 
@@ -51,22 +45,36 @@ const variable_record_field& encoded_record::element(size_t index) const
 buffer_fixed_size_elements::buffer_fixed_size_elements(const shape_type& shp_tp,
                                                        size_t            batch_size,
                                                        bool              pinned)
+    : buffer_fixed_size_elements(shp_tp, batch_size, host_allocator::from_pinned(pinned))
+{
+}
+
+buffer_fixed_size_elements::buffer_fixed_size_elements(
+    const shape_type&                       shp_tp,
+    size_t                                  batch_size,
+    const shared_ptr<const host_allocator>& allocator)
     : m_shape_type{shp_tp}
+    , m_full_shape_type{shp_tp}
     , m_size{m_shape_type.get_byte_size() * batch_size}
+    , m_capacity{m_size}
     , m_batch_size{batch_size}
     , m_stride{m_shape_type.get_byte_size()}
-    , m_pinned{pinned}
+    , m_allocator{allocator}
 {
     allocate();
+    restore_shape();
 }
 
 buffer_fixed_size_elements::buffer_fixed_size_elements(const buffer_fixed_size_elements& rhs)
     : m_data{nullptr}
     , m_shape_type{rhs.m_shape_type}
+    , m_full_shape_type{rhs.m_full_shape_type}
     , m_size{rhs.m_size}
+    , m_capacity{rhs.m_capacity}
     , m_batch_size{rhs.m_batch_size}
     , m_stride{rhs.m_stride}
-    , m_pinned{rhs.m_pinned}
+    , m_extents{rhs.m_extents}
+    , m_allocator{rhs.m_allocator}
 {
     allocate();
     memcpy(m_data, rhs.m_data, m_size);
@@ -93,10 +101,13 @@ void buffer_fixed_size_elements::move(buffer_fixed_size_elements& second)
 
     using std::swap;
     swap(m_shape_type, second.m_shape_type);
+    swap(m_full_shape_type, second.m_full_shape_type);
     swap(m_size, second.m_size);
+    swap(m_capacity, second.m_capacity);
     swap(m_batch_size, second.m_batch_size);
     swap(m_stride, second.m_stride);
-    swap(m_pinned, second.m_pinned);
+    swap(m_extents, second.m_extents);
+    swap(m_allocator, second.m_allocator);
 }
 
 char* buffer_fixed_size_elements::get_item(size_t index)
@@ -149,98 +160,100 @@ const char* buffer_fixed_size_elements::get_item(size_t index) const
 
 void buffer_fixed_size_elements::allocate()
 {
-#if HAS_GPU
-    if (m_pinned)
-    {
-        CUresult status = cuMemAllocHost((void**)&m_data, m_size);
-        if (status != CUDA_SUCCESS)
-        {
-            throw std::bad_alloc();
-        }
-    }
-    else
+    if (!m_allocator)
     {
-        m_data = new char[m_size];
+        m_allocator = host_allocator::standard();
     }
-#else
-    m_data = new char[m_size];
-#endif
+    m_data = static_cast<char*>(m_allocator->allocate(m_capacity));
 }
 
 void buffer_fixed_size_elements::deallocate()
 {
     if (m_data == nullptr)
         return;
-#if HAS_GPU
-    if (m_pinned)
-    {
-        cuMemFreeHost(m_data);
-    }
-    else
+    m_allocator->free(m_data, m_capacity);
+}
+
+void buffer_fixed_size_elements::set_item_extent(size_t index, size_t extent)
+{
+    const std::vector<size_t>& shape = m_full_shape_type.get_shape();
+    if (index >= m_extents.size())
     {
-        delete[] m_data;
+        throw invalid_argument("buffer_fixed_size: index out-of-range");
     }
-#else
-    delete[] m_data;
-#endif
+    m_extents[index] = shape.empty() ? 1 : std::min(extent, shape.back());
 }
 
-// Transposes the rows and columns of a matrix
-template <typename T>
-static void transpose_regular(T* dest, const T* src, int rows, int cols)
+size_t buffer_fixed_size_elements::get_max_extent() const
 {
-    int dst_indx = 0;
-    int src_indx = 0;
-    for (int c = 0; c < cols; ++c)
+    size_t rc = 0;
+    for (size_t extent : m_extents)
     {
-        src_indx = c;
-        for (int r = 0; r < rows; ++r)
-        {
-            dest[dst_indx++] = src[src_indx];
-            src_indx += cols;
-        }
+        rc = std::max(rc, extent);
     }
+    return rc;
 }
 
-static void transpose_buf(
-    char* dest, char* src, size_t rows, size_t cols, size_t element_size, TransposeType type)
+void buffer_fixed_size_elements::shrink_last_axis(size_t length, bool transposed)
 {
-    switch (element_size)
+    std::vector<size_t> shape = m_shape_type.get_shape();
+    if (shape.empty() || length >= shape.back())
     {
-    case 1:
+        return;
+    }
+    // keep at least one entry so that items never have a zero stride
+    length = std::max<size_t>(length, 1);
+
+    size_t element_size = m_shape_type.get_otype().get_size();
+    size_t old_length   = shape.back();
+    size_t outer        = m_shape_type.get_element_count() / old_length;
+
+    // Every run moves to an offset at or below its source, so runs are packed front to back
+    if (transposed)
     {
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint8_t>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<1>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
+        // one row of batch_size values per element of an item
+        size_t row = m_batch_size * element_size;
+        for (size_t o = 0; o < outer; o++)
+        {
+            memmove(m_data + o * length * row, m_data + o * old_length * row, length * row);
+        }
     }
-    case 2:
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint16_t>(
-                reinterpret_cast<uint16_t*>(dest), reinterpret_cast<uint16_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<2>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
-    case 4:
+    else
     {
-        if (type == TransposeType::REGULAR)
-            transpose_regular<uint32_t>(
-                reinterpret_cast<uint32_t*>(dest), reinterpret_cast<uint32_t*>(src), rows, cols);
-        else if (type == TransposeType::SSE)
-            transpose::sse::transpose<4>(
-                reinterpret_cast<uint8_t*>(dest), reinterpret_cast<uint8_t*>(src), rows, cols);
-        break;
+        size_t old_run = old_length * element_size;
+        size_t new_run = length * element_size;
+        for (size_t r = 0; r < outer * m_batch_size; r++)
+        {
+            memmove(m_data + r * new_run, m_data + r * old_run, new_run);
+        }
     }
-    case 8:
-        transpose_regular<uint64_t>(
-            reinterpret_cast<uint64_t*>(dest), reinterpret_cast<uint64_t*>(src), rows, cols);
-        break;
-    default: throw "unsupported datatype for transpose";
+
+    shape.back() = length;
+    shape_type shrunk{shape, m_shape_type.get_otype()};
+    shrunk.set_names(m_shape_type.get_names());
+    m_shape_type = shrunk;
+    m_stride     = m_shape_type.get_byte_size();
+    m_size       = m_stride * m_batch_size;
+}
+
+void buffer_fixed_size_elements::restore_shape()
+{
+    const std::vector<size_t>& shape = m_full_shape_type.get_shape();
+    m_shape_type                     = m_full_shape_type;
+    m_stride                         = m_shape_type.get_byte_size();
+    m_size                           = m_stride * m_batch_size;
+    m_extents.assign(m_batch_size, shape.empty() ? 1 : shape.back());
+}
+
+void buffer_fixed_size_elements::reshape(const shape_type& shp_tp, size_t batch_size)
+{
+    if (shp_tp.get_byte_size() * batch_size > m_capacity)
+    {
+        throw invalid_argument("buffer_fixed_size: shape does not fit the allocated buffer");
     }
+    m_full_shape_type = shp_tp;
+    m_batch_size      = batch_size;
+    restore_shape();
 }
 
 buffer_fixed_size_elements::~buffer_fixed_size_elements()
@@ -266,16 +279,33 @@ void fixed_buffer_map::copy(fixed_buffer_map& src,
             (count + dst_index > dst_fbm->get_item_count()))
             throw invalid_argument("buffer_fixed_size: count out-of-range");
 
-        int element_size = (this->operator[](name))->get_shape_type().get_otype().get_size();
-        int cols         = count * src_fbm->get_stride() / batch_size / element_size;
+        size_t element_size = dst_fbm->get_shape_type().get_otype().get_size();
+        size_t cols         = count * src_fbm->get_stride() / batch_size / element_size;
         if (transpose && batch_size > 1 && cols > 1)
-            if ((cols % 16) ||
-                (batch_size % 16)) //data must be bounded to 16 elements for using SSE
-                transpose_buf(p_dst, p_src, batch_size, cols, element_size, TransposeType::REGULAR);
-            else
-                transpose_buf(p_dst, p_src, batch_size, cols, element_size, TransposeType::SSE);
+            transpose::block(p_dst, batch_size, p_src, cols, batch_size, cols, element_size);
         else
             memcpy(p_dst, p_src, count * src_fbm->get_stride());
+
+        for (size_t i = 0; i < count; i++)
+        {
+            dst_fbm->set_item_extent(dst_index + i, src_fbm->get_item_extent(src_index + i));
+        }
+    }
+}
+
+void fixed_buffer_map::shrink_to_extents(bool transposed)
+{
+    for (auto& data : m_data)
+    {
+        data.second->shrink_last_axis(data.second->get_max_extent(), transposed);
+    }
+}
+
+void fixed_buffer_map::restore_shapes()
+{
+    for (auto& data : m_data)
+    {
+        data.second->restore_shape();
     }
 }
 
@@ -284,7 +314,7 @@ std::ostream& buffer_fixed_size_elements::serialize(std::ostream& out) const
     const char separator = ',';
     out << m_shape_type;
     out << m_batch_size << separator;
-    out << m_pinned << separator;
+    out << host_allocator::is_pinned(m_allocator) << separator;
     out.write(m_data, m_size);
     return out;
 }
@@ -357,6 +387,73 @@ std::istream& fixed_buffer_map::deserialize(std::istream& in)
     return in;
 }
 
+batch_pool::batch_pool(const vector<pair<string, shape_type>>& shapes,
+                       size_t                                  batch_size,
+                       const shared_ptr<const host_allocator>& allocator,
+                       size_t                                  capacity)
+    : m_shapes{shapes}
+    , m_batch_size{batch_size}
+    , m_allocator{allocator}
+    , m_capacity{capacity}
+{
+}
+
+shared_ptr<const fixed_buffer_map> batch_pool::borrow(fixed_buffer_map& batch)
+{
+    unique_ptr<fixed_buffer_map> spare;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_spares.empty())
+        {
+            spare = move(m_spares.back());
+            m_spares.pop_back();
+        }
+        else if (m_allocated < m_capacity)
+        {
+            // spares are only allocated once that many batches are held at the same time
+            m_allocated++;
+        }
+        else
+        {
+            throw runtime_error("all " + std::to_string(m_capacity) +
+                                " borrowed batches are still in use");
+        }
+    }
+
+    if (!spare)
+    {
+        try
+        {
+            spare.reset(new fixed_buffer_map(m_shapes, m_batch_size, m_allocator));
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_allocated--;
+            throw;
+        }
+    }
+
+    spare->swap(batch);
+    shared_ptr<batch_pool> self = shared_from_this();
+    return shared_ptr<const fixed_buffer_map>(
+        spare.release(), [self](const fixed_buffer_map* p) {
+            self->give_back(const_cast<fixed_buffer_map*>(p));
+        });
+}
+
+size_t batch_pool::borrowed() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_allocated - m_spares.size();
+}
+
+void batch_pool::give_back(fixed_buffer_map* batch)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_spares.emplace_back(batch);
+}
+
 std::ostream& operator<<(std::ostream& out, const nervana::fixed_buffer_map& obj)
 {
     return obj.serialize(out);
@@ -23,17 +23,18 @@
 #include <initializer_list>
 #include <opencv2/core/core.hpp>
 #include <tuple>
+#include <memory>
+#include <mutex>
 
+#include "host_allocator.hpp"
 #include "typemap.hpp"
 #include "util.hpp"
-#if HAS_GPU
-#include <cuda.h>
-#endif
 
 namespace nervana
 {
     class buffer_fixed_size_elements;
     class fixed_buffer_map;
+    class batch_pool;
     class encoded_record;
     class encoded_record_list;
 
@@ -157,6 +158,9 @@ public:
     explicit buffer_fixed_size_elements(const shape_type& shp_tp,
                                         size_t            batch_size,
                                         bool              pinned = false);
+    buffer_fixed_size_elements(const shape_type&                            shp_tp,
+                               size_t                                       batch_size,
+                               const std::shared_ptr<const host_allocator>& allocator);
     virtual ~buffer_fixed_size_elements();
 
     explicit buffer_fixed_size_elements(const buffer_fixed_size_elements&);
@@ -172,18 +176,38 @@ public:
     char*             data() const { return m_data; }
     size_t            get_item_count() const { return m_size / m_stride; }
     size_t            size() const { return m_size; }
+    size_t            capacity() const { return m_capacity; }
+    size_t            get_batch_size() const { return m_batch_size; }
     size_t            get_stride() const { return m_stride; }
     const shape_type& get_shape_type() const { return m_shape_type; }
     std::ostream& serialize(std::ostream& out) const;
     std::istream& deserialize(std::istream& in);
 
+    // Number of valid entries along the last axis of an item, the rest is padding. Items
+    // are fully valid unless a provider says otherwise.
+    void set_item_extent(size_t index, size_t extent);
+    size_t get_item_extent(size_t index) const { return m_extents.at(index); }
+    size_t get_max_extent() const;
+
+    // Cuts the last axis of every item down to length and packs the items in place. transposed
+    // selects the batch minor layout, one row of batch_size values per element of an item.
+    void shrink_last_axis(size_t length, bool transposed);
+    // Returns to the shape the buffer was allocated with, the contents are not preserved
+    void restore_shape();
+    // Takes on a new shape and batch size in the memory already allocated, for receivers that
+    // reuse buffers. The contents are not preserved. Throws when they need more than capacity().
+    void reshape(const shape_type& shp_tp, size_t batch_size);
+
 protected:
-    char*      m_data{nullptr};
-    shape_type m_shape_type;
-    size_t     m_size{0};
-    size_t     m_batch_size{0};
-    size_t     m_stride{0};
-    bool       m_pinned{false};
+    char*                                 m_data{nullptr};
+    shape_type                            m_shape_type;
+    shape_type                            m_full_shape_type;
+    size_t                                m_size{0};
+    size_t                                m_capacity{0};
+    size_t                                m_batch_size{0};
+    size_t                                m_stride{0};
+    std::vector<size_t>                   m_extents;
+    std::shared_ptr<const host_allocator> m_allocator;
 };
 
 class nervana::fixed_buffer_map
@@ -191,10 +215,11 @@ class nervana::fixed_buffer_map
 public:
     fixed_buffer_map() {}
     fixed_buffer_map(const std::vector<std::pair<std::string, shape_type>>& write_sizes,
-                     size_t batch_size,
-                     bool   pinned = false)
+                     size_t                                                  batch_size,
+                     const std::shared_ptr<const host_allocator>&            allocator =
+                         host_allocator::standard())
     {
-        add_items(write_sizes, batch_size, pinned);
+        add_items(write_sizes, batch_size, allocator);
     }
 
     fixed_buffer_map(fixed_buffer_map&& buffer)
@@ -215,23 +240,32 @@ public:
     }
 
     void add_items(const std::vector<std::pair<std::string, shape_type>>& write_sizes,
-                   size_t batch_size,
-                   bool   pinned = false)
+                   size_t                                                  batch_size,
+                   const std::shared_ptr<const host_allocator>&            allocator =
+                       host_allocator::standard())
     {
         for (auto sz : write_sizes)
         {
-            add_item(std::get<0>(sz), std::get<1>(sz), batch_size, pinned);
+            add_item(std::get<0>(sz), std::get<1>(sz), batch_size, allocator);
         }
     }
 
-    void add_item(const std::string& name,
-                  const shape_type&  shp_tp,
-                  size_t             batch_size,
-                  bool               pinned = false)
+    void add_item(const std::string&                           name,
+                  const shape_type&                            shp_tp,
+                  size_t                                       batch_size,
+                  const std::shared_ptr<const host_allocator>& allocator =
+                      host_allocator::standard())
     {
         m_names.push_back(name);
         m_data.emplace_back(
-            std::make_pair(name, new buffer_fixed_size_elements(shp_tp, batch_size, pinned)));
+            std::make_pair(name, new buffer_fixed_size_elements(shp_tp, batch_size, allocator)));
+    }
+
+    // Exchanges the buffers of two batches without touching their contents
+    void swap(fixed_buffer_map& other)
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_names, other.m_names);
     }
 
     void clear()
@@ -260,6 +294,10 @@ public:
         return (it == m_data.end() ? nullptr : it->second);
     }
 
+    // Buffers by position in the order they were added, for callers that resolve names once
+    const buffer_fixed_size_elements* at(size_t slot) const { return m_data[slot].second; }
+    buffer_fixed_size_elements*       at(size_t slot) { return m_data[slot].second; }
+
     void copy(fixed_buffer_map& src,
               size_t            src_index,
               size_t            dst_index,
@@ -267,6 +305,10 @@ public:
               size_t            batch_size,
               bool              transpose);
 
+    // Shrinks the last axis of every buffer to the largest item extent in the batch
+    void shrink_to_extents(bool transposed);
+    void restore_shapes();
+
     size_t        size() const { return m_data.size(); }
     std::ostream& serialize(std::ostream& out) const;
     std::istream& deserialize(std::istream& in);
@@ -281,5 +323,37 @@ private:
     std::vector<std::pair<std::string, buffer_fixed_size_elements*>> m_data;
 };
 
+// Spare batches that stand in for batches lent out of a pipeline. borrow swaps the buffers of a
+// batch with those of a spare of the same shapes, so the pipeline goes on writing to the spare
+// while the borrower reads the original without a copy. The buffers return to the pool when the
+// last reference to the borrowed batch is dropped, which may be after the pipeline is gone.
+class nervana::batch_pool : public std::enable_shared_from_this<batch_pool>
+{
+public:
+    batch_pool(const std::vector<std::pair<std::string, shape_type>>& shapes,
+               size_t                                                  batch_size,
+               const std::shared_ptr<const host_allocator>&            allocator,
+               size_t                                                  capacity);
+
+    // Takes the contents of batch, which is left holding spare buffers of unspecified contents.
+    // Throws when capacity batches are already borrowed.
+    std::shared_ptr<const fixed_buffer_map> borrow(fixed_buffer_map& batch);
+
+    size_t capacity() const { return m_capacity; }
+    // number of batches currently borrowed
+    size_t borrowed() const;
+
+private:
+    void give_back(fixed_buffer_map* batch);
+
+    std::vector<std::pair<std::string, shape_type>> m_shapes;
+    size_t                                          m_batch_size;
+    std::shared_ptr<const host_allocator>           m_allocator;
+    size_t                                          m_capacity;
+    size_t                                          m_allocated{0};
+    std::vector<std::unique_ptr<fixed_buffer_map>>  m_spares;
+    mutable std::mutex                              m_mutex;
+};
+
 std::ostream& operator<<(std::ostream& out, const nervana::fixed_buffer_map& obj);
 std::istream& operator>>(std::istream& in, nervana::fixed_buffer_map& obj);
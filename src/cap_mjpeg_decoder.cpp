@@ -39,13 +39,53 @@
 //
 //M*/
 
+#include <map>
+#include <mutex>
+
 #include "cap_mjpeg_decoder.hpp"
 #include "avi.hpp"
+#include "crc.hpp"
 #include "log.hpp"
 
 using namespace std;
 using namespace cv;
 
+namespace
+{
+    // Parsed chunk indices of recently seen clips. Records are read into fresh buffers every
+    // epoch, so clips are recognized by their size and a checksum of the headers at the start
+    // and the index at the end of the file.
+    struct cached_index
+    {
+        frame_list frames;
+        uint32_t   width;
+        uint32_t   height;
+        double     fps;
+    };
+
+    typedef pair<size_t, uint32_t> index_key;
+
+    const size_t                 index_cache_capacity = 4096;
+    const size_t                 fingerprint_bytes    = 1024;
+    mutex                        index_cache_mutex;
+    map<index_key, cached_index> index_cache;
+
+    index_key fingerprint(const char* buffer, size_t size)
+    {
+        CryptoPP::CRC32 crc;
+        size_t          head = min(size, fingerprint_bytes);
+        crc.Update((const uint8_t*)buffer, head);
+        if (size > head)
+        {
+            size_t tail = min(size - head, fingerprint_bytes);
+            crc.Update((const uint8_t*)buffer + size - tail, tail);
+        }
+        uint32_t digest;
+        crc.TruncatedFinal((uint8_t*)&digest, sizeof(digest));
+        return index_key(size, digest);
+    }
+}
+
 uint64_t nervana::MotionJpegCapture::getFramePos() const
 {
     if (m_is_first_frame)
@@ -111,6 +151,54 @@ std::vector<char> nervana::MotionJpegCapture::readFrame(frame_iterator it)
     return result;
 }
 
+std::vector<char> nervana::MotionJpegCapture::readFrame(size_t index)
+{
+    if (index >= m_mjpeg_frames.size())
+    {
+        throw std::out_of_range("MotionJpegCapture frame index out of range");
+    }
+    const char* data;
+    size_t      size;
+    if (getFrameSpan(index, data, size))
+    {
+        return std::vector<char>(data, data + size);
+    }
+    return readFrame(m_mjpeg_frames.begin() + index);
+}
+
+bool nervana::MotionJpegCapture::getFrameSpan(size_t index, const char*& data, size_t& size) const
+{
+    if (m_buffer == nullptr || index >= m_mjpeg_frames.size())
+    {
+        return false;
+    }
+    uint64_t offset = m_mjpeg_frames[index].first;
+    if (offset + sizeof(RiffChunk) > m_buffer_size)
+    {
+        return false;
+    }
+    size = unpack<uint32_t>(m_buffer, offset + offsetof(RiffChunk, m_size));
+    data = m_buffer + offset + sizeof(RiffChunk);
+    return size <= m_buffer_size - offset - sizeof(RiffChunk);
+}
+
+bool nervana::MotionJpegCapture::decodeFrame(size_t index, cv::Mat& output_frame) const
+{
+    const char* data;
+    size_t      size;
+    if (!getFrameSpan(index, data, size))
+    {
+        return false;
+    }
+    if (size > 0)
+    {
+        // a header over the record buffer, imdecode only reads it
+        cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<char*>(data));
+        output_frame = imdecode(encoded, CV_LOAD_IMAGE_ANYDEPTH | CV_LOAD_IMAGE_COLOR);
+    }
+    return true;
+}
+
 bool nervana::MotionJpegCapture::grabFrame()
 {
     if (isOpened())
@@ -133,6 +221,11 @@ bool nervana::MotionJpegCapture::retrieveFrame(int, cv::Mat& output_frame)
 {
     if (m_frame_iterator != m_mjpeg_frames.end())
     {
+        if (m_buffer != nullptr)
+        {
+            return decodeFrame(m_frame_iterator - m_mjpeg_frames.begin(), output_frame);
+        }
+
         std::vector<char> data = readFrame(m_frame_iterator);
 
         if (data.size())
@@ -157,10 +250,61 @@ nervana::MotionJpegCapture::MotionJpegCapture(const string& filename)
     open();
 }
 
-nervana::MotionJpegCapture::MotionJpegCapture(char* buffer, size_t size)
+nervana::MotionJpegCapture::MotionJpegCapture(const char* buffer, size_t size)
+    : m_buffer{buffer}
+    , m_buffer_size{size}
 {
     m_file_stream = make_shared<memory_stream>(buffer, size);
-    open();
+    if (loadCachedIndex())
+    {
+        m_frame_iterator = m_mjpeg_frames.end();
+        m_is_first_frame = true;
+    }
+    else if (open())
+    {
+        storeCachedIndex();
+    }
+}
+
+bool nervana::MotionJpegCapture::loadCachedIndex()
+{
+    index_key key = fingerprint(m_buffer, m_buffer_size);
+    {
+        lock_guard<mutex> lock(index_cache_mutex);
+        auto              it = index_cache.find(key);
+        if (it == index_cache.end())
+        {
+            return false;
+        }
+        m_mjpeg_frames = it->second.frames;
+        m_frame_width  = it->second.width;
+        m_frame_height = it->second.height;
+        m_fps          = it->second.fps;
+    }
+
+    // guard against a fingerprint collision, the first and last chunks must match the index
+    const char* data;
+    size_t      size;
+    for (size_t index : {size_t(0), m_mjpeg_frames.size() - 1})
+    {
+        if (!getFrameSpan(index, data, size) || size != m_mjpeg_frames[index].second)
+        {
+            m_mjpeg_frames.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void nervana::MotionJpegCapture::storeCachedIndex() const
+{
+    index_key         key = fingerprint(m_buffer, m_buffer_size);
+    lock_guard<mutex> lock(index_cache_mutex);
+    if (index_cache.size() >= index_cache_capacity)
+    {
+        index_cache.clear();
+    }
+    index_cache[key] = cached_index{m_mjpeg_frames, m_frame_width, m_frame_height, m_fps};
 }
 
 bool nervana::MotionJpegCapture::isOpened() const
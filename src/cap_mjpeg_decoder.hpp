@@ -25,7 +25,8 @@ class nervana::MotionJpegCapture
 {
 public:
     MotionJpegCapture(const std::string&);
-    MotionJpegCapture(char* buffer, size_t size);
+    // Parses the AVI in place, the buffer must outlive the capture
+    MotionJpegCapture(const char* buffer, size_t size);
     virtual ~MotionJpegCapture();
     virtual double getProperty(int) const;
     virtual bool   setProperty(int, double);
@@ -33,6 +34,16 @@ public:
     virtual bool   retrieveFrame(int, cv::Mat&);
     virtual bool   isOpened() const;
 
+    size_t getFrameCount() const { return m_mjpeg_frames.size(); }
+    // Encoded JPEG data of frame 'index' in the stream index
+    std::vector<char> readFrame(size_t index);
+    // Location of the encoded JPEG data of frame 'index' inside the buffer of an in memory
+    // capture, returns false for file captures or chunks that run past the buffer
+    bool getFrameSpan(size_t index, const char*& data, size_t& size) const;
+    // Decodes frame 'index' of an in memory capture straight from the buffer. It does not touch
+    // the stream, so different frames may be decoded concurrently.
+    bool decodeFrame(size_t index, cv::Mat& output_frame) const;
+
     // Return the type of the capture object: CAP_VFW, etc...
     virtual int getCaptureDomain() { return CV_CAP_ANY; }
     bool        open();
@@ -40,11 +51,15 @@ public:
 
 protected:
     bool parseRiff(std::istream& in_str);
+    bool loadCachedIndex();
+    void storeCachedIndex() const;
 
     inline uint64_t   getFramePos() const;
     std::vector<char> readFrame(frame_iterator it);
 
     std::shared_ptr<std::istream> m_file_stream;
+    const char*                   m_buffer{nullptr};
+    size_t                        m_buffer_size{0};
     bool                          m_is_first_frame;
     frame_list                    m_mjpeg_frames;
 
@@ -14,6 +14,7 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <exception>
 #include <sstream>
 
 #include "curl_connector.hpp"
@@ -27,26 +28,29 @@ using nervana::http::merge_http_paths;
 namespace
 {
     string address_with_port(const string& address, int port);
+
+    // exceptions must not unwind through curl, so the callback keeps them for later
+    struct streaming_target
+    {
+        const nervana::http_body_sink* sink;
+        std::exception_ptr             error;
+    };
 }
 
 namespace nervana
 {
-    curl_connector::curl_connector(const string& address, unsigned int port)
+    curl_connector::curl_connector(const string&                     address,
+                                   unsigned int                      port,
+                                   const std::shared_ptr<curl_pool>& pool)
+        : m_pool(pool ? pool : std::make_shared<curl_pool>())
     {
         m_address = address_with_port(address, port);
-
-        // curl_global_init is supposed to be called only once globally
-        curl_global_init(CURL_GLOBAL_ALL);
     }
 
-    curl_connector::~curl_connector() { curl_global_cleanup(); }
     http_response curl_connector::get(const string& endpoint, const http_query_t& query)
     {
-        CURL* curl_handle = curl_easy_init();
-        if (NULL == curl_handle)
-        {
-            throw std::runtime_error("curl init error");
-        }
+        curl_pool::lease handle      = m_pool->acquire();
+        CURL*            curl_handle = handle.get();
 
         // given a url, make an HTTP GET request and fill stream with
         // the body of the response
@@ -61,23 +65,50 @@ namespace nervana
 
         string call = "[GET] " + url;
         INFO << call;
-        CURLcode res = curl_easy_perform(curl_handle);
+        CURLcode res = m_pool->perform(handle);
         check_response(res, call);
 
         long http_code = get_http_code(curl_handle);
 
-        curl_easy_cleanup(curl_handle);
-
         return http_response(http_code, stream.str());
     }
 
-    http_response curl_connector::post(const string& endpoint, const string& body)
+    http_response curl_connector::get_streaming(const string&         endpoint,
+                                                const http_query_t&   query,
+                                                const http_body_sink& sink)
     {
-        CURL* curl_handle = curl_easy_init();
-        if (NULL == curl_handle)
+        curl_pool::lease handle      = m_pool->acquire();
+        CURL*            curl_handle = handle.get();
+
+        // given a url, make an HTTP GET request and pass the body of the response
+        // on to sink while it is received
+        streaming_target target{&sink, nullptr};
+
+        string url = merge_http_paths(m_address, endpoint);
+        url        = url_with_query(url, query);
+        curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, sink_callback);
+        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &target);
+        curl_easy_setopt(curl_handle, CURLOPT_NOPROXY, "*");
+
+        string call = "[GET] " + url;
+        INFO << call;
+        CURLcode res       = m_pool->perform(handle);
+        long     http_code = get_http_code(curl_handle);
+
+        if (target.error)
         {
-            throw std::runtime_error("curl init error");
+            std::rethrow_exception(target.error);
         }
+        check_response(res, call);
+
+        return http_response(http_code, "");
+    }
+
+    http_response curl_connector::post(const string& endpoint, const string& body)
+    {
+        curl_pool::lease handle      = m_pool->acquire();
+        CURL*            curl_handle = handle.get();
 
         // given a url, make an HTTP POST request and fill stream with
         // the body of the response
@@ -97,23 +128,18 @@ namespace nervana
 
         string call = "[POST] " + url;
         INFO << call;
-        CURLcode res = curl_easy_perform(curl_handle);
+        CURLcode res = m_pool->perform(handle);
         check_response(res, call);
 
         long http_code = get_http_code(curl_handle);
 
-        curl_easy_cleanup(curl_handle);
-
         return http_response(http_code, stream.str());
     }
 
     http_response curl_connector::post(const string& endpoint, const http_query_t& query)
     {
-        CURL* curl_handle = curl_easy_init();
-        if (NULL == curl_handle)
-        {
-            throw std::runtime_error("curl init error");
-        }
+        curl_pool::lease handle      = m_pool->acquire();
+        CURL*            curl_handle = handle.get();
 
         // given a url, make an HTTP POST request and fill stream with
         // the body of the response
@@ -130,23 +156,18 @@ namespace nervana
 
         string call = "[POST] " + url;
         INFO << call;
-        CURLcode res = curl_easy_perform(curl_handle);
+        CURLcode res = m_pool->perform(handle);
         check_response(res, call);
 
         long http_code = get_http_code(curl_handle);
 
-        curl_easy_cleanup(curl_handle);
-
         return http_response(http_code, stream.str());
     }
 
     http_response curl_connector::del(const string& endpoint, const http_query_t& query)
     {
-        CURL* curl_handle = curl_easy_init();
-        if (NULL == curl_handle)
-        {
-            throw std::runtime_error("curl init error");
-        }
+        curl_pool::lease handle      = m_pool->acquire();
+        CURL*            curl_handle = handle.get();
 
         // given a url, make an HTTP DELETE request and fill stream with
         // the body of the response
@@ -162,13 +183,11 @@ namespace nervana
 
         string call = "[DELETE] " + url;
         INFO << call;
-        CURLcode res = curl_easy_perform(curl_handle);
+        CURLcode res = m_pool->perform(handle);
         check_response(res, call);
 
         long http_code = get_http_code(curl_handle);
 
-        curl_easy_cleanup(curl_handle);
-
         return http_response(http_code, stream.str());
     }
 
@@ -182,6 +201,22 @@ namespace nervana
         return size * nmemb;
     }
 
+    size_t curl_connector::sink_callback(void* ptr, size_t size, size_t nmemb, void* target)
+    {
+        streaming_target& st = *(streaming_target*)target;
+        try
+        {
+            (*st.sink)((const char*)ptr, size * nmemb);
+        }
+        catch (...)
+        {
+            // returning less than was received makes curl abort the transfer
+            st.error = std::current_exception();
+            return 0;
+        }
+        return size * nmemb;
+    }
+
     size_t curl_connector::read_callback(void* ptr, size_t size, size_t nmemb, void* stream)
     {
         stringstream& ss = *(stringstream*)stream;
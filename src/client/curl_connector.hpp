@@ -16,7 +16,10 @@
 
 #pragma once
 
+#include <memory>
+
 #include "http_connector.hpp"
+#include "../curl_pool.hpp"
 #include <curl/curl.h>
 #include <curl/easy.h>
 
@@ -25,21 +28,30 @@ namespace nervana
     class curl_connector : public http_connector
     {
     public:
-        explicit curl_connector(const std::string& address, unsigned int port);
+        // Connectors sharing a pool share its connections, without one a connector makes its own
+        explicit curl_connector(const std::string&                address,
+                                unsigned int                      port,
+                                const std::shared_ptr<curl_pool>& pool = nullptr);
         curl_connector() = delete;
-        ~curl_connector();
 
         http_response get(const std::string&  endpoint,
                           const http_query_t& query = http_query_t()) override;
+        http_response get_streaming(const std::string&    endpoint,
+                                    const http_query_t&   query,
+                                    const http_body_sink& sink) override;
         http_response post(const std::string& endpoint, const std::string& body = "") override;
         http_response post(const std::string& endpoint, const http_query_t& query) override;
 
         http_response del(const std::string&  endpoint,
                           const http_query_t& query = http_query_t()) override;
 
+        const std::shared_ptr<curl_pool>& get_pool() const { return m_pool; }
+
     private:
         // used for retrieving response body
         static size_t write_callback(void* ptr, size_t size, size_t nmemb, void* stream);
+        // used for passing the response body on as it arrives
+        static size_t sink_callback(void* ptr, size_t size, size_t nmemb, void* target);
         // used for sending body
         static size_t read_callback(void* ptr, size_t size, size_t nmemb, void* stream);
 
@@ -49,6 +61,7 @@ namespace nervana
         std::string query_to_string(const http_query_t& query);
         std::string escape(const std::string& value);
 
-        std::string m_address;
+        std::string                m_address;
+        std::shared_ptr<curl_pool> m_pool;
     };
 }
@@ -16,11 +16,16 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <map>
 
 namespace nervana
 {
+    class fixed_buffer_map;
+
     namespace http
     {
         const int status_ok       = 200;
@@ -71,6 +76,8 @@ namespace nervana
     };
 
     using http_query_t = std::map<std::string, std::string>;
+    // receives a response body piece by piece as it arrives
+    using http_body_sink = std::function<void(const char* data, size_t size)>;
 
     class http_connector
     {
@@ -78,10 +85,28 @@ namespace nervana
         virtual ~http_connector() {}
         virtual http_response get(const std::string&  endpoint,
                                   const http_query_t& query = http_query_t()) = 0;
+        // Hands the body to sink instead of returning it in the response. Connectors that can
+        // stream override this, the default passes on the body of get in one piece.
+        virtual http_response get_streaming(const std::string&    endpoint,
+                                            const http_query_t&   query,
+                                            const http_body_sink& sink)
+        {
+            http_response response = get(endpoint, query);
+            sink(response.data.data(), response.data.size());
+            response.data.clear();
+            return response;
+        }
         virtual http_response post(const std::string& endpoint, const std::string& body = "") = 0;
         virtual http_response post(const std::string& endpoint, const http_query_t& query)    = 0;
 
         virtual http_response del(const std::string&  endpoint,
                                   const http_query_t& query = http_query_t()) = 0;
+
+        // Returns the batch of the last get_streaming call when it arrived some other way than
+        // in the body, nullptr otherwise
+        virtual std::shared_ptr<fixed_buffer_map> take_mapped_batch(uint64_t& sequence)
+        {
+            return nullptr;
+        }
     };
 }
@@ -48,6 +48,11 @@ namespace nervana
         {
             return m_output_buffer_ptr.get();
         }
+        // every batch arrives in a buffer of its own, so it only has to be shared
+        std::shared_ptr<const fixed_buffer_map> borrow_output_buffer() override
+        {
+            return m_output_buffer_ptr;
+        }
         const size_t&  position() override { return m_position; }
         void           reset() override;
         nlohmann::json get_current_config() const override { return m_config; }
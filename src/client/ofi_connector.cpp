@@ -17,6 +17,7 @@
 #include <json.hpp>
 
 #include "ofi_connector.hpp"
+#include "../batch_frame.hpp"
 #include "../log.hpp"
 
 using std::string;
@@ -25,6 +26,7 @@ nervana::ofi_connector::ofi_connector(const string&                   address,
                                       unsigned int                    port,
                                       std::shared_ptr<http_connector> connector)
     : m_base_connector(connector)
+    , m_ring(std::make_shared<region_ring>())
 {
     connect(address, port);
 }
@@ -87,28 +89,67 @@ void nervana::ofi_connector::disconnect()
     m_ofi.disconnect();
 }
 
-void nervana::ofi_connector::register_rdma_memory(size_t size)
+std::shared_ptr<nervana::fixed_buffer_map>
+    nervana::ofi_connector::take_mapped_batch(uint64_t& sequence)
 {
-    if (m_rdma_memory.is_allocated())
+    sequence = m_sequence;
+    std::shared_ptr<fixed_buffer_map> mapped;
+    mapped.swap(m_mapped);
+    return mapped;
+}
+
+nervana::ofi_connector::region& nervana::ofi_connector::acquire_region(size_t size)
+{
+    std::vector<std::unique_ptr<region>>& regions = m_ring->regions;
+    if (regions.empty())
     {
-        if (m_rdma_memory.get_buffer_size() < size)
-            throw std::runtime_error("allocated RDMA memory size is too small!");
+        // registered once with the size of the first batch
+        for (size_t i = 0; i < initial_regions; i++)
+        {
+            regions.emplace_back(new region());
+        }
     }
-    else
+
+    region* free_region = nullptr;
+    for (auto& candidate : regions)
+    {
+        bool expected = false;
+        if (candidate->busy.compare_exchange_strong(expected, true))
+        {
+            free_region = candidate.get();
+            break;
+        }
+    }
+    if (free_region == nullptr)
+    {
+        regions.emplace_back(new region());
+        free_region       = regions.back().get();
+        free_region->busy = true;
+        INFO << "caller holds every RDMA region, registering region " << regions.size();
+    }
+
+    ofi::rdma_memory& memory = free_region->memory;
+    if (memory.get_buffer_size() < size)
     {
-        m_rdma_memory.allocate(size);
+        if (memory.is_registered())
+            m_ofi.unregister_memory(memory);
+        memory.allocate(size);
     }
-    if (!m_rdma_memory.is_registered())
+    if (!memory.is_registered())
     {
-        m_ofi.register_memory(m_rdma_memory);
+        m_ofi.register_memory(memory);
     }
+    return *free_region;
 }
 
 void nervana::ofi_connector::unregister_rdma_memory()
 {
-    if (m_rdma_memory.is_registered())
-        m_ofi.unregister_memory(m_rdma_memory);
-    m_rdma_memory.deallocate();
+    // batches still in use keep their memory, only the registration goes
+    for (auto& item : m_ring->regions)
+    {
+        if (item->memory.is_registered())
+            m_ofi.unregister_memory(item->memory);
+    }
 }
 
 nervana::http_response nervana::ofi_connector::receive_data(const string&       endpoint,
@@ -117,32 +158,53 @@ nervana::http_response nervana::ofi_connector::receive_data(const string&
     http_query_t modified_query     = query;
     modified_query["connection_id"] = m_connection_id;
 
+    m_mapped      = nullptr;
     auto response = m_base_connector->get(endpoint, modified_query);
 
     if (response.code != http::status_ok)
         return response;
 
     auto     json_response = nlohmann::json::parse(response.data);
-    int      size;
+    size_t   size;
     uint64_t key, remote_address;
+    bool     framed;
     try
     {
         auto data      = json_response.at("data");
         size           = data.at("size");
         remote_address = data.at("address");
         key            = data.at("key");
+        framed         = data.count("format") > 0 && data.at("format") == batch_frame::format_name;
     }
-    catch (const std::out_of_range& ex)
+    catch (const std::exception& ex)
     {
         throw std::runtime_error(string("wrong remote response: ") + ex.what());
     }
 
-    if (!m_rdma_memory.is_registered())
+    region& target = acquire_region(size);
+    try
     {
-        register_rdma_memory(size);
+        m_ofi.read_from_remote_host(target.memory, remote_address, size, key);
+        char* buffer = static_cast<char*>(target.memory.get_buffer());
+        if (framed)
+        {
+            // the batch stays in the region, which is free again once the batch is dropped
+            std::shared_ptr<region_ring> ring   = m_ring;
+            region*                      mapped = &target;
+            m_mapped                            = batch_frame_reader::map(
+                buffer, size, [ring, mapped]() { mapped->busy = false; }, &m_sequence);
+            response.data.clear();
+        }
+        else
+        {
+            response.data = string(buffer, size);
+            target.busy   = false;
+        }
+    }
+    catch (...)
+    {
+        target.busy = false;
+        throw;
     }
-    m_ofi.read_from_remote_host(m_rdma_memory, remote_address, size, key);
-
-    response.data = string(reinterpret_cast<char*>(m_rdma_memory.get_buffer()), size);
     return response;
 }
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include "http_connector.hpp"
 #include "../rdma/ofi.hpp"
@@ -46,20 +48,40 @@ namespace nervana
         http_response del(const std::string&  endpoint,
                           const http_query_t& query = http_query_t()) override;
 
+        std::shared_ptr<fixed_buffer_map> take_mapped_batch(uint64_t& sequence) override;
+
+        // number of registered regions, for tests and statistics
+        size_t regions() const { return m_ring->regions.size(); }
+
     private:
+        // regions registered up front, more are added only when the caller holds every batch
+        static const size_t initial_regions = 4;
+
+        struct region
+        {
+            ofi::rdma_memory  memory;
+            std::atomic<bool> busy{false};
+        };
+        // Batches are read into the regions and used in place. A batch holds its region until it
+        // is dropped, so the next batch is read while the caller still works on the last one.
+        // Batches keep the ring alive, the regions are unregistered with the connector.
+        struct region_ring
+        {
+            std::vector<std::unique_ptr<region>> regions;
+        };
+
         void connect(const std::string& address, unsigned int port);
         void disconnect();
 
-        void register_rdma_memory(size_t size);
+        region&       acquire_region(size_t size);
         void          unregister_rdma_memory();
-        bool          is_rdma_registered() { return m_rdma_memory.is_registered(); }
         http_response receive_data(const std::string& endpoint, const http_query_t& query);
-        http_response receive_message_data(const std::string& endpoint, const http_query_t& query);
-        http_response receive_rdma_data(const std::string& endpoint, const http_query_t& query);
 
-        std::shared_ptr<http_connector> m_base_connector;
-        std::string                     m_connection_id;
-        ofi::ofi                        m_ofi;
-        ofi::rdma_memory                m_rdma_memory;
+        std::shared_ptr<http_connector>   m_base_connector;
+        std::string                       m_connection_id;
+        ofi::ofi                          m_ofi;
+        std::shared_ptr<region_ring>      m_ring;
+        std::shared_ptr<fixed_buffer_map> m_mapped;
+        uint64_t                          m_sequence{0};
     };
 }
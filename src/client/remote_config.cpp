@@ -14,6 +14,8 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <stdexcept>
+
 #include "remote_config.hpp"
 
 nervana::remote_config::remote_config(const nlohmann::json& js)
@@ -27,4 +29,14 @@ nervana::remote_config::remote_config(const nlohmann::json& js)
     {
         info->parse(js);
     }
+
+    validate();
+}
+
+void nervana::remote_config::validate()
+{
+    if (prefetch_depth == 0)
+    {
+        throw std::invalid_argument("prefetch_depth must be at least 1");
+    }
 }
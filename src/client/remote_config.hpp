@@ -34,17 +34,28 @@ public:
     unsigned int port{0};
     std::string  session_id;
     bool         async{true};
+    // next requests kept in flight, each over a connection of its own, when async is set
+    unsigned int prefetch_depth{1};
+    // offer HTTP/2 and multiplex concurrent requests over one connection
+    bool         http2{false};
+    // take batches from a service on the same host out of shared memory
+    bool         shared_memory{false};
     bool         close_session{true};
     std::string  rdma_address;
     unsigned int rdma_port{0};
     std::string  debug_output_directory;
 
 private:
+    void validate();
+
     std::vector<std::shared_ptr<nervana::interface::config_info_interface>> config_list = {
         ADD_SCALAR(address, mode::REQUIRED),
         ADD_SCALAR(port, mode::REQUIRED),
         ADD_SCALAR(session_id, mode::OPTIONAL),
         ADD_SCALAR(async, mode::OPTIONAL),
+        ADD_SCALAR(prefetch_depth, mode::OPTIONAL),
+        ADD_SCALAR(http2, mode::OPTIONAL),
+        ADD_SCALAR(shared_memory, mode::OPTIONAL),
         ADD_SCALAR(close_session, mode::OPTIONAL),
         ADD_SCALAR(rdma_address, mode::OPTIONAL),
         ADD_SCALAR(rdma_port, mode::OPTIONAL),
@@ -15,7 +15,11 @@
 *******************************************************************************/
 
 #include "service.hpp"
+#include <algorithm>
+#include <chrono>
+
 #include "../base64.hpp"
+#include "../log.hpp"
 
 using nlohmann::json;
 using std::exception;
@@ -119,7 +123,21 @@ service_status nervana::service_connector::close_session(const std::string& id)
 
 service_response<nervana::next_response> nervana::service_connector::get_next(const string& id)
 {
-    http_response response = m_http->get(full_endpoint(id + "/next"));
+    http_query_t query{{"format", batch_frame::format_name}};
+    m_frame_reader.begin();
+    http_response response = m_http->get_streaming(
+        full_endpoint(id + "/next"), query, [this](const char* data, size_t size) {
+            m_frame_reader.append(data, size);
+        });
+
+    // batches in shared memory bypass the frame reader
+    uint64_t sequence;
+    auto     mapped = m_http->take_mapped_batch(sequence);
+    if (mapped)
+    {
+        return service_response<next_response>(service_status(service_status_type::SUCCESS, ""),
+                                               next_response(mapped, sequence));
+    }
     return process_data_json(response);
 }
 
@@ -135,21 +153,36 @@ service_status nervana::service_connector::reset_session(const string& id)
 service_response<nervana::next_response>
     nervana::service_connector::process_data_json(const http_response& response)
 {
-    string         serialized_buffer_map;
     service_status status;
 
     if (response.code == http::status_ok)
     {
-        serialized_buffer_map = response.data;
-        status.type           = service_status_type::SUCCESS;
+        status.type = service_status_type::SUCCESS;
     }
     else
     {
         json json_response;
-        extract_status_and_json(response.data, status, json_response);
+        extract_status_and_json(m_frame_reader.get_other_data(), status, json_response);
         return service_response<next_response>(status, next_response());
     }
 
+    return service_response<next_response>(status, read_batch());
+}
+
+nervana::next_response nervana::service_connector::read_batch()
+{
+    if (m_frame_reader.is_frame())
+    {
+        uint64_t sequence = m_frame_reader.get_sequence();
+        return next_response(m_frame_reader.finish(), sequence);
+    }
+
+    // services that predate batch frames answer with a serialized fixed_buffer_map
+    const string& serialized_buffer_map = m_frame_reader.get_other_data();
+    if (serialized_buffer_map.empty())
+    {
+        throw runtime_error("cannot deserialize fixed_buffer_map: service returned no data");
+    }
     auto fbm = make_shared<fixed_buffer_map>();
     try
     {
@@ -160,8 +193,7 @@ service_response<nervana::next_response>
     {
         throw runtime_error(string("cannot deserialize fixed_buffer_map: ") + ex.what());
     }
-
-    return service_response<next_response>(status, next_response(fbm));
+    return next_response(fbm);
 }
 
 service_response<names_and_shapes>
@@ -309,6 +341,195 @@ nervana::service_response<nervana::next_response>* nervana::service_async::fille
     return rc;
 }
 
+nervana::service_prefetch::service_prefetch(
+    const std::vector<std::shared_ptr<service>>& connections, bool shared_session)
+    : m_connections{connections}
+    , m_shared_session{shared_session}
+{
+    if (m_connections.empty())
+    {
+        throw invalid_argument("service_prefetch needs at least one connection");
+    }
+}
+
+nervana::service_prefetch::~service_prefetch()
+{
+    stop();
+}
+
+nervana::service_status nervana::service_prefetch::close_session(const std::string& id)
+{
+    stop();
+    return m_connections[0]->close_session(id);
+}
+
+nervana::service_status nervana::service_prefetch::reset_session(const std::string& id)
+{
+    // batches still on the wire belong to the old epoch and are dropped
+    stop();
+    return m_connections[0]->reset_session(id);
+}
+
+nervana::service_response<nervana::next_response>
+    nervana::service_prefetch::get_next(const std::string& id)
+{
+    if (!m_running || id != m_session_id)
+    {
+        stop();
+        start(id);
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto                         wait_start = std::chrono::steady_clock::now();
+    m_result_ready.wait(lock, [this] { return ready(); });
+    m_stats.wait_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - wait_start)
+                                    .count();
+
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+    if (m_results.empty())
+    {
+        return m_final_response;
+    }
+
+    auto                            first  = m_results.begin();
+    service_response<next_response> result = std::move(first->second);
+    m_expected                             = first->first + 1;
+    m_results.erase(first);
+    m_consumed++;
+    m_stats.batches++;
+    m_request_ready.notify_all();
+    return result;
+}
+
+nervana::service_prefetch::stats nervana::service_prefetch::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+bool nervana::service_prefetch::ready() const
+{
+    if (m_error)
+    {
+        return true;
+    }
+    if (!m_results.empty())
+    {
+        // A gap in the sequence is a batch still on the wire, unless nothing is. Sessions shared
+        // with other clients have gaps that never fill, waiting on them would leave every batch
+        // a full round trip behind.
+        return m_shared_session || m_results.begin()->first == m_expected || m_in_flight == 0;
+    }
+    return m_finished && m_in_flight == 0;
+}
+
+void nervana::service_prefetch::start(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_session_id = id;
+    m_running    = true;
+    m_stopping   = false;
+    m_finished   = false;
+    m_requested  = 0;
+    m_consumed   = 0;
+    m_expected   = 0;
+    m_error      = nullptr;
+    for (auto& connection : m_connections)
+    {
+        m_workers.emplace_back(&service_prefetch::run, this, std::ref(*connection));
+    }
+}
+
+void nervana::service_prefetch::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+        {
+            return;
+        }
+        m_stopping = true;
+    }
+    m_request_ready.notify_all();
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = false;
+    m_results.clear();
+    INFO << "prefetched " << m_stats.batches << " batches over " << depth()
+         << " connections, wire time " << m_stats.wire_nanoseconds / 1000000
+         << " ms, consumer wait " << m_stats.wait_nanoseconds / 1000000 << " ms";
+}
+
+void nervana::service_prefetch::run(service& connection)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        // requested and not yet consumed batches are limited to the depth
+        m_request_ready.wait(lock, [this] {
+            return m_stopping || (!m_finished && !m_error && m_requested - m_consumed < depth());
+        });
+        if (m_stopping)
+        {
+            return;
+        }
+        uint64_t request = m_requested++;
+        m_in_flight++;
+        m_stats.max_in_flight = std::max(m_stats.max_in_flight, m_in_flight);
+        lock.unlock();
+
+        service_response<next_response> response;
+        std::exception_ptr              error;
+        auto                            request_start = std::chrono::steady_clock::now();
+        try
+        {
+            response = connection.get_next(m_session_id);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - request_start;
+
+        lock.lock();
+        m_in_flight--;
+        m_stats.wire_nanoseconds +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        if (error)
+        {
+            if (!m_error)
+            {
+                m_error = error;
+            }
+        }
+        else if (response.status.type == service_status_type::SUCCESS)
+        {
+            // services without batch numbers are taken to answer in the order they were asked
+            uint64_t sequence = response.data.sequence == next_response::no_sequence
+                                    ? request
+                                    : response.data.sequence;
+            m_results.emplace(sequence, std::move(response));
+        }
+        else if (!m_finished)
+        {
+            // end of data or a failure, handed out once the batches before it are gone
+            m_finished       = true;
+            m_final_response = std::move(response);
+        }
+        m_result_ready.notify_all();
+        m_request_ready.notify_all();
+    }
+}
+
 namespace
 {
     string full_endpoint(const string& resource)
@@ -16,8 +16,14 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 
+#include "../batch_frame.hpp"
 #include "../buffer_batch.hpp"
 #include "../async_manager.hpp"
 #include "http_connector.hpp"
@@ -86,9 +92,14 @@ namespace nervana
     class next_response
     {
     public:
+        // sequence of a batch from a service that does not number them
+        static const uint64_t no_sequence = UINT64_MAX;
+
         next_response() {}
-        next_response(std::shared_ptr<fixed_buffer_map> buffer_map)
+        next_response(std::shared_ptr<fixed_buffer_map> buffer_map,
+                      uint64_t                          _sequence = no_sequence)
             : data(buffer_map)
+            , sequence(_sequence)
         {
         }
 
@@ -106,6 +117,8 @@ namespace nervana
         }
 
         std::shared_ptr<fixed_buffer_map> data;
+        // order in which the service produced the batch since the session was last reset
+        uint64_t sequence{no_sequence};
     };
 
     class service
@@ -142,6 +155,7 @@ namespace nervana
 
     private:
         service_response<next_response> process_data_json(const nervana::http_response& data);
+        next_response read_batch();
 
         void handle_request_failure(const http_response& response);
         service_response<int> handle_single_int_response(http_response      response,
@@ -151,6 +165,8 @@ namespace nervana
                                      nlohmann::json&    output_json);
 
         std::shared_ptr<http_connector> m_http;
+        // batches are requested as frames and decoded into buffers that are reused
+        batch_frame_reader m_frame_reader;
     };
 
     class service_async_source : public service,
@@ -267,4 +283,79 @@ namespace nervana
         std::shared_ptr<service_async_source> m_base_service;
         service_response<next_response>*      m_current_next_response;
     };
+
+    // Keeps several next requests in flight, one per connection, and hands the batches out in
+    // the order the service produced them. Session calls go over the first connection. On a
+    // session shared with other clients the sequence has gaps that never fill, batches are
+    // handed out as soon as they arrive, lowest number first.
+    class service_prefetch : public service
+    {
+    public:
+        struct stats
+        {
+            size_t   batches          = 0; // batches handed to the consumer
+            uint64_t wire_nanoseconds = 0; // time next requests took, summed over connections
+            uint64_t wait_nanoseconds = 0; // time the consumer spent waiting for a batch
+            size_t   max_in_flight    = 0; // most next requests on the wire at once
+        };
+
+        // Every connection needs a service of its own, the number of them is the prefetch depth
+        explicit service_prefetch(const std::vector<std::shared_ptr<service>>& connections,
+                                  bool shared_session = false);
+        ~service_prefetch() override;
+
+        // service methods
+        service_response<std::string> create_session(const std::string& config) override
+        {
+            return m_connections[0]->create_session(config);
+        }
+        service_status close_session(const std::string& id) override;
+        service_status reset_session(const std::string& id) override;
+
+        service_response<next_response> get_next(const std::string& id) override;
+        service_response<names_and_shapes> get_names_and_shapes(const std::string& id) override
+        {
+            return m_connections[0]->get_names_and_shapes(id);
+        }
+        service_response<int> get_record_count(const std::string& id) override
+        {
+            return m_connections[0]->get_record_count(id);
+        }
+        service_response<int> get_batch_size(const std::string& id) override
+        {
+            return m_connections[0]->get_batch_size(id);
+        }
+        service_response<int> get_batch_count(const std::string& id) override
+        {
+            return m_connections[0]->get_batch_count(id);
+        }
+
+        size_t depth() const { return m_connections.size(); }
+        stats  get_stats() const;
+
+    private:
+        void start(const std::string& id);
+        void stop();
+        void run(service& connection);
+        bool ready() const;
+
+        std::vector<std::shared_ptr<service>>               m_connections;
+        std::vector<std::thread>                            m_workers;
+        mutable std::mutex                                  m_mutex;
+        std::condition_variable                             m_request_ready;
+        std::condition_variable                             m_result_ready;
+        std::string                                         m_session_id;
+        bool                                                m_shared_session;
+        bool                                                m_running{false};
+        bool                                                m_stopping{false};
+        bool                                                m_finished{false};
+        size_t                                              m_requested{0};
+        size_t                                              m_consumed{0};
+        size_t                                              m_in_flight{0};
+        uint64_t                                            m_expected{0};
+        std::map<uint64_t, service_response<next_response>> m_results;
+        service_response<next_response>                     m_final_response;
+        std::exception_ptr                                  m_error;
+        stats                                               m_stats;
+    };
 }
@@ -0,0 +1,176 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <json.hpp>
+
+#include "shm_connector.hpp"
+#include "../batch_frame.hpp"
+#include "../log.hpp"
+
+using nlohmann::json;
+using std::shared_ptr;
+using std::string;
+
+namespace
+{
+    const string next_resource = "next";
+    const string transport     = "shared_memory";
+
+    bool ends_with(const string& text, const string& suffix)
+    {
+        return text.size() >= suffix.size() &&
+               text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+namespace nervana
+{
+    shm_connector::shm_connector(shared_ptr<http_connector> base_connector, size_t slot_count)
+        : m_base_connector(base_connector)
+        , m_slot_count(slot_count)
+    {
+        if (!m_base_connector)
+        {
+            throw std::invalid_argument("shm_connector needs a base connector");
+        }
+    }
+
+    http_response shm_connector::get_streaming(const string&         endpoint,
+                                               const http_query_t&   query,
+                                               const http_body_sink& sink)
+    {
+        m_mapped = nullptr;
+        if (!ends_with(endpoint, next_resource))
+        {
+            return m_base_connector->get_streaming(endpoint, query, sink);
+        }
+        string session_endpoint = endpoint.substr(0, endpoint.size() - next_resource.size());
+        shared_ptr<shm_ring> session_ring = ring(session_endpoint);
+        if (!session_ring)
+        {
+            return m_base_connector->get_streaming(endpoint, query, sink);
+        }
+
+        http_query_t shared_query = query;
+        shared_query["transport"] = transport;
+        shared_query["format"]    = batch_frame::format_name;
+
+        // a reply that points at a slot is JSON, a frame in the body goes straight to the sink
+        string         reply;
+        bool           is_json = false;
+        bool           started = false;
+        http_body_sink tee     = [&](const char* data, size_t size) {
+            if (!started && size > 0)
+            {
+                started = true;
+                is_json = data[0] == '{';
+            }
+            if (is_json)
+                reply.append(data, size);
+            else
+                sink(data, size);
+        };
+        http_response response = m_base_connector->get_streaming(endpoint, shared_query, tee);
+        if (!is_json)
+        {
+            return response;
+        }
+
+        if (response.code == http::status_ok)
+        {
+            json reply_json = json::parse(reply);
+            auto data       = reply_json.find("data");
+            if (data != reply_json.end() && data->count("slot") > 0)
+            {
+                size_t slot      = data->at("slot").get<size_t>();
+                size_t size      = data->at("size").get<size_t>();
+                char*  slot_data = session_ring->slot(slot);
+                // the slot is ours until it is released, also when the reply turns out bad
+                try
+                {
+                    if (size > session_ring->slot_size())
+                    {
+                        throw std::runtime_error("batch of " + std::to_string(size) +
+                                                 " bytes does not fit a slot of " +
+                                                 std::to_string(session_ring->slot_size()));
+                    }
+                    m_mapped = batch_frame_reader::map(slot_data,
+                                                       size,
+                                                       [session_ring, slot]() {
+                                                           session_ring->release(slot);
+                                                       },
+                                                       &m_sequence);
+                }
+                catch (...)
+                {
+                    session_ring->release(slot);
+                    throw;
+                }
+                return response;
+            }
+        }
+        // end of data and errors are handled by the caller
+        sink(reply.data(), reply.size());
+        return response;
+    }
+
+    http_response shm_connector::del(const string& endpoint, const http_query_t& query)
+    {
+        // batches still in use keep the mapping of their ring
+        m_rings.erase(endpoint + "/");
+        return m_base_connector->del(endpoint, query);
+    }
+
+    shared_ptr<fixed_buffer_map> shm_connector::take_mapped_batch(uint64_t& sequence)
+    {
+        sequence = m_sequence;
+        shared_ptr<fixed_buffer_map> mapped;
+        mapped.swap(m_mapped);
+        return mapped;
+    }
+
+    shared_ptr<shm_ring> shm_connector::ring(const string& session_endpoint)
+    {
+        auto it = m_rings.find(session_endpoint);
+        if (it != m_rings.end())
+        {
+            return it->second;
+        }
+
+        shared_ptr<shm_ring> session_ring;
+        try
+        {
+            http_response response =
+                m_base_connector->get(session_endpoint + transport,
+                                      {{"slots", std::to_string(m_slot_count)}});
+            if (response.code != http::status_ok)
+            {
+                throw std::runtime_error("service answered " + std::to_string(response.code));
+            }
+            json reply_json = json::parse(response.data);
+            session_ring    = shm_ring::open(reply_json.at("data").at("name").get<string>());
+            INFO << "receiving batches through shared memory " << session_ring->name() << " with "
+                 << session_ring->slot_count() << " slots";
+        }
+        catch (const std::exception& ex)
+        {
+            // a service on another host or one that predates shared memory
+            WARN << "shared memory is not available, batches come over HTTP: " << ex.what();
+        }
+        m_rings[session_endpoint] = session_ring;
+        return session_ring;
+    }
+}
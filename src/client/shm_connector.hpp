@@ -0,0 +1,71 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include "http_connector.hpp"
+#include "../shm_ring.hpp"
+
+namespace nervana
+{
+    // Takes batches from a service on the same host out of a shared memory ring instead of the
+    // response body. Every other request goes to the wrapped connector. The ring is negotiated
+    // on the first batch of a session, when the service cannot be reached through shared memory
+    // the batches keep coming in response bodies.
+    class shm_connector final : public http_connector
+    {
+    public:
+        explicit shm_connector(std::shared_ptr<http_connector> base_connector,
+                               size_t                          slot_count);
+        shm_connector() = delete;
+
+        http_response get(const std::string&  endpoint,
+                          const http_query_t& query = http_query_t()) override
+        {
+            return m_base_connector->get(endpoint, query);
+        }
+        http_response get_streaming(const std::string&    endpoint,
+                                    const http_query_t&   query,
+                                    const http_body_sink& sink) override;
+        http_response post(const std::string& endpoint, const std::string& body = "") override
+        {
+            return m_base_connector->post(endpoint, body);
+        }
+        http_response post(const std::string& endpoint, const http_query_t& query) override
+        {
+            return m_base_connector->post(endpoint, query);
+        }
+
+        http_response del(const std::string&  endpoint,
+                          const http_query_t& query = http_query_t()) override;
+
+        std::shared_ptr<fixed_buffer_map> take_mapped_batch(uint64_t& sequence) override;
+
+    private:
+        // returns the ring of the session, nullptr when shared memory is not available
+        std::shared_ptr<shm_ring> ring(const std::string& session_endpoint);
+
+        std::shared_ptr<http_connector> m_base_connector;
+        size_t                          m_slot_count;
+        // rings by session endpoint, nullptr for sessions that could not get one
+        std::map<std::string, std::shared_ptr<shm_ring>> m_rings;
+        std::shared_ptr<fixed_buffer_map>                m_mapped;
+        uint64_t                                         m_sequence{0};
+    };
+}
@@ -0,0 +1,296 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <chrono>
+#include <stdexcept>
+
+#include "curl_pool.hpp"
+#include "log.hpp"
+
+using std::pair;
+using std::vector;
+
+// HTTP/2 multiplexing needs curl 7.43, curl_multi_poll and curl_multi_wakeup need 7.68
+#define CURL_POOL_MULTIPLEX (LIBCURL_VERSION_NUM >= 0x072b00)
+#define CURL_POOL_WAKEUP (LIBCURL_VERSION_NUM >= 0x074400)
+
+namespace
+{
+#if CURL_POOL_WAKEUP
+    // how long the driving thread sleeps in curl_multi_poll when nothing happens
+    const int poll_timeout_ms = 1000;
+#else
+    // new transfers are only added when curl_multi_wait returns, so it must not wait long
+    const int poll_timeout_ms = 10;
+#endif
+}
+
+nervana::curl_pool::curl_pool(const options& opts)
+    : m_options(opts)
+{
+    // curl_global_init is reference counted, every pool balances it in the destructor
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    if (m_options.http2)
+    {
+#if CURL_POOL_MULTIPLEX
+        m_multi = curl_multi_init();
+        if (m_multi == nullptr)
+        {
+            curl_global_cleanup();
+            throw std::runtime_error("curl multi init error");
+        }
+        curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#else
+        WARN << "curl " << LIBCURL_VERSION << " cannot multiplex HTTP/2, http2 is ignored";
+        m_options.http2 = false;
+#endif
+    }
+}
+
+nervana::curl_pool::~curl_pool()
+{
+    // leases hold a raw pointer to the pool, they must all be gone by now
+    for (auto& handle : m_entries)
+    {
+        curl_easy_cleanup(handle->easy);
+    }
+    if (m_multi)
+    {
+        curl_multi_cleanup(m_multi);
+    }
+    curl_global_cleanup();
+}
+
+nervana::curl_pool::lease nervana::curl_pool::acquire()
+{
+    entry* handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty())
+        {
+            handle = m_idle.back();
+            m_idle.pop_back();
+        }
+    }
+
+    if (handle == nullptr)
+    {
+        CURL* easy = curl_easy_init();
+        if (easy == nullptr)
+        {
+            throw std::runtime_error("curl init error");
+        }
+        std::unique_ptr<entry> created(new entry{easy, connection_stats()});
+        handle = created.get();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.push_back(std::move(created));
+    }
+    else
+    {
+        // keeps the open connections and the DNS cache of the handle
+        curl_easy_reset(handle->easy);
+    }
+
+    set_defaults(handle->easy);
+    return lease(this, handle);
+}
+
+CURLcode nervana::curl_pool::perform(lease& handle)
+{
+    CURL* easy  = handle.get();
+    auto  start = std::chrono::steady_clock::now();
+
+    CURLcode result = m_multi ? perform_multiplexed(easy) : curl_easy_perform(easy);
+
+    auto elapsed  = std::chrono::steady_clock::now() - start;
+    long connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t bytes = 0;
+    curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+#else
+    double bytes = 0;
+    curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD, &bytes);
+#endif
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    connection_stats&           stats = handle.m_entry->stats;
+    stats.requests++;
+    stats.connects += connects;
+    stats.bytes_received += uint64_t(bytes);
+    stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return result;
+}
+
+vector<nervana::curl_pool::connection_stats> nervana::curl_pool::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    vector<connection_stats>    result;
+    for (const auto& handle : m_entries)
+    {
+        result.push_back(handle->stats);
+    }
+    return result;
+}
+
+size_t nervana::curl_pool::idle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle.size();
+}
+
+void nervana::curl_pool::release(entry* handle)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_idle.push_back(handle);
+}
+
+void nervana::curl_pool::set_defaults(CURL* easy)
+{
+    if (m_options.keep_alive)
+    {
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    }
+#if CURL_POOL_MULTIPLEX
+    if (m_options.http2)
+    {
+        // plain http upgrades to h2c when the server agrees and stays on HTTP/1.1 otherwise
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+        // a request waits for a connection that can be multiplexed rather than opening another
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    }
+#endif
+}
+
+CURLcode nervana::curl_pool::perform_multiplexed(CURL* easy)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_incoming.push_back(easy);
+#if CURL_POOL_WAKEUP
+    // wakes the driving thread up from curl_multi_poll to add the transfer
+    curl_multi_wakeup(m_multi);
+#endif
+
+    for (;;)
+    {
+        auto done = m_done.find(easy);
+        if (done != m_done.end())
+        {
+            CURLcode result = done->second;
+            m_done.erase(done);
+            return result;
+        }
+        if (m_driving)
+        {
+            m_progress.wait(lock);
+            continue;
+        }
+
+        m_driving = true;
+        for (CURL* added : m_incoming)
+        {
+            curl_multi_add_handle(m_multi, added);
+            m_active.push_back(added);
+        }
+        m_incoming.clear();
+        lock.unlock();
+
+        vector<pair<CURL*, CURLcode>> finished;
+        drive(finished);
+
+        lock.lock();
+        for (const auto& result : finished)
+        {
+            m_done[result.first] = result.second;
+        }
+        // another waiting thread takes over when this one has its result
+        m_driving = false;
+        m_progress.notify_all();
+    }
+}
+
+void nervana::curl_pool::drive(vector<pair<CURL*, CURLcode>>& finished)
+{
+    int       running = 0;
+    CURLMcode status  = curl_multi_perform(m_multi, &running);
+    if (status == CURLM_OK && running > 0)
+    {
+#if CURL_POOL_WAKEUP
+        status = curl_multi_poll(m_multi, nullptr, 0, poll_timeout_ms, nullptr);
+#else
+        status = curl_multi_wait(m_multi, nullptr, 0, poll_timeout_ms, nullptr);
+#endif
+        if (status == CURLM_OK)
+        {
+            status = curl_multi_perform(m_multi, &running);
+        }
+    }
+
+    if (status != CURLM_OK)
+    {
+        // the multi handle is broken, fail every transfer on it rather than wait forever
+        for (CURL* easy : m_active)
+        {
+            curl_multi_remove_handle(m_multi, easy);
+            finished.emplace_back(easy, CURLE_FAILED_INIT);
+        }
+        m_active.clear();
+        return;
+    }
+
+    int      queued = 0;
+    CURLMsg* message;
+    while ((message = curl_multi_info_read(m_multi, &queued)) != nullptr)
+    {
+        if (message->msg == CURLMSG_DONE)
+        {
+            CURL* easy = message->easy_handle;
+            curl_multi_remove_handle(m_multi, easy);
+            finished.emplace_back(easy, message->data.result);
+            for (auto it = m_active.begin(); it != m_active.end(); ++it)
+            {
+                if (*it == easy)
+                {
+                    m_active.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+nervana::curl_pool::lease::lease(curl_pool* pool, entry* handle)
+    : m_pool(pool)
+    , m_entry(handle)
+{
+}
+
+nervana::curl_pool::lease::lease(lease&& other)
+    : m_pool(other.m_pool)
+    , m_entry(other.m_entry)
+{
+    other.m_entry = nullptr;
+}
+
+nervana::curl_pool::lease::~lease()
+{
+    if (m_entry)
+    {
+        m_pool->release(m_entry);
+    }
+}
@@ -0,0 +1,130 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace nervana
+{
+    class curl_pool;
+}
+
+/**
+ * \brief Reusable curl handles and the connections they keep open
+ *
+ * A curl easy handle keeps the connections of its finished transfers open, so a request on a
+ * handle that talked to the same host before goes out without TCP or TLS setup. The pool hands
+ * out idle handles, creating new ones only when every handle is busy, which makes the number of
+ * handles the peak number of concurrent requests.
+ *
+ * With http2 set, transfers run on a curl multi handle that offers HTTP/2 and multiplexes
+ * concurrent requests to one host over a single connection. Servers that only speak HTTP/1.1
+ * get a connection per concurrent request, taken from the cache of the multi handle.
+ * Multiplexing needs curl 7.43, older versions ignore http2.
+ *
+ * The pool is thread safe. Every thread waiting for a multiplexed transfer takes turns driving
+ * the multi handle, so no thread of its own is needed.
+ */
+class nervana::curl_pool
+{
+public:
+    struct options
+    {
+        bool keep_alive = true;  // TCP keep alive probes on idle connections
+        bool http2      = false; // HTTP/2 multiplexing over a curl multi handle
+    };
+
+    // Counters of one pooled handle, which is one connection unless it talks to several hosts
+    struct connection_stats
+    {
+        size_t   requests       = 0; // transfers performed
+        size_t   connects       = 0; // connections opened, none for a reused connection
+        uint64_t bytes_received = 0; // response bodies
+        uint64_t nanoseconds    = 0; // time spent in transfers
+    };
+
+    class lease;
+
+    curl_pool()
+        : curl_pool(options())
+    {
+    }
+    explicit curl_pool(const options& opts);
+    ~curl_pool();
+    curl_pool(const curl_pool&) = delete;
+    curl_pool& operator=(const curl_pool&) = delete;
+
+    // Returns an idle handle with its options reset to the pool defaults. Throws
+    // std::runtime_error when curl cannot create a handle.
+    lease acquire();
+    // Runs the transfer set up on the handle and returns the result of curl_easy_perform
+    CURLcode perform(lease& handle);
+
+    std::vector<connection_stats> get_stats() const;
+    size_t idle() const;
+
+private:
+    struct entry
+    {
+        CURL*            easy;
+        connection_stats stats;
+    };
+
+    void release(entry* handle);
+    void set_defaults(CURL* easy);
+    CURLcode perform_multiplexed(CURL* easy);
+    void drive(std::vector<std::pair<CURL*, CURLcode>>& finished);
+
+    options                             m_options;
+    mutable std::mutex                  m_mutex;
+    std::vector<std::unique_ptr<entry>> m_entries;
+    std::vector<entry*>                 m_idle;
+
+    // multiplexing state, the multi handle itself is only touched by the driving thread
+    CURLM*                    m_multi{nullptr};
+    std::condition_variable   m_progress;
+    bool                      m_driving{false};
+    std::vector<CURL*>        m_incoming;
+    std::vector<CURL*>        m_active;
+    std::map<CURL*, CURLcode> m_done;
+};
+
+// A handle taken from the pool, returned to it on destruction
+class nervana::curl_pool::lease
+{
+public:
+    lease(lease&& other);
+    ~lease();
+    lease(const lease&) = delete;
+    lease& operator=(const lease&) = delete;
+
+    CURL* get() const { return m_entry->easy; }
+
+private:
+    friend class curl_pool;
+    lease(curl_pool* pool, entry* handle);
+
+    curl_pool* m_pool;
+    entry*     m_entry;
+};
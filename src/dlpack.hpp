@@ -0,0 +1,69 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+// The DLPack tensor ABI (https://github.com/dmlc/dlpack). Frameworks agree on this layout rather
+// than on a library, so only the structures that are handed out are declared here.
+extern "C" {
+enum DLDeviceType
+{
+    kDLCPU      = 1,
+    kDLCUDA     = 2,
+    kDLCUDAHost = 3
+};
+
+enum DLDataTypeCode
+{
+    kDLInt   = 0,
+    kDLUInt  = 1,
+    kDLFloat = 2
+};
+
+typedef struct
+{
+    int32_t device_type;
+    int32_t device_id;
+} DLDevice;
+
+typedef struct
+{
+    uint8_t  code;
+    uint8_t  bits;
+    uint16_t lanes;
+} DLDataType;
+
+typedef struct
+{
+    void*      data;
+    DLDevice   device;
+    int32_t    ndim;
+    DLDataType dtype;
+    int64_t*   shape;
+    // in elements, not bytes
+    int64_t* strides;
+    uint64_t byte_offset;
+} DLTensor;
+
+typedef struct DLManagedTensor
+{
+    DLTensor dl_tensor;
+    void*    manager_ctx;
+    void (*deleter)(struct DLManagedTensor* self);
+} DLManagedTensor;
+}
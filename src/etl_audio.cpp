@@ -15,14 +15,17 @@
 *******************************************************************************/
 
 #include "etl_audio.hpp"
+#include "pcm.hpp"
 
 using namespace std;
 using namespace nervana;
 
-/** \brief Extract audio data from a wav file using sox */
+/** \brief Extract audio data, reading 16 bit PCM wav directly and anything else using sox */
 std::shared_ptr<audio::decoded> audio::extractor::extract(const void* item, size_t itemSize) const
 {
-    return make_shared<audio::decoded>(nervana::read_audio_from_mem((const char*)item, itemSize));
+    bool    borrowed = false;
+    cv::Mat samples  = pcm::read((const char*)item, itemSize, m_sample_rate_hz, borrowed);
+    return make_shared<audio::decoded>(samples, borrowed);
 }
 
 audio::transformer::transformer(const audio::config& config)
@@ -30,9 +33,16 @@ audio::transformer::transformer(const audio::config& config)
 {
     if (_cfg.feature_type != "samples")
     {
+        _fft_plan = specgram::get_fft_plan(_cfg.frame_length_tn);
         specgram::create_window(_cfg.window_type, _cfg.frame_length_tn, _window);
+    }
+    if (_cfg.feature_type == "mfsc" || _cfg.feature_type == "mfcc")
+    {
+        cv::Mat fbank;
         specgram::create_filterbanks(
-            _cfg.num_filters, _cfg.frame_length_tn, _cfg.sample_freq_hz, _filterbank);
+            _cfg.num_filters, _cfg.frame_length_tn, _cfg.sample_freq_hz, fbank);
+        _filterbank = make_shared<mel_filterbank>(
+            fbank, _cfg.feature_type == "mfcc" ? _cfg.num_cepstra : 0);
     }
     _noisemaker = make_shared<noise_clips>(_cfg.noise_index_file, _cfg.noise_root);
 }
@@ -55,6 +65,10 @@ std::shared_ptr<audio::decoded>
     audio::transformer::transform(std::shared_ptr<augment::audio::params> params,
                                   std::shared_ptr<audio::decoded>         decoded) const
 {
+    if (params->add_noise)
+    {
+        decoded->own_time_data();
+    }
     cv::Mat& samples_mat = decoded->get_time_data();
     _noisemaker->addNoise(samples_mat,
                           params->add_noise,
@@ -70,24 +84,24 @@ std::shared_ptr<audio::decoded>
     else
     {
         // convert from time domain to frequency domain into the freq mat
-        specgram::wav_to_specgram(samples_mat,
-                                  _cfg.frame_length_tn,
-                                  _cfg.frame_stride_tn,
-                                  _cfg.time_steps,
-                                  _window,
-                                  decoded->get_freq_data());
-        if (_cfg.feature_type != "specgram")
+        if (_filterbank)
+        {
+            specgram::wav_to_features(samples_mat,
+                                      *_fft_plan,
+                                      *_filterbank,
+                                      _cfg.frame_stride_tn,
+                                      _cfg.time_steps,
+                                      _window,
+                                      decoded->get_freq_data());
+        }
+        else
         {
-            cv::Mat tmpmat;
-            specgram::specgram_to_cepsgram(decoded->get_freq_data(), _filterbank, tmpmat);
-            if (_cfg.feature_type == "mfcc")
-            {
-                specgram::cepsgram_to_mfcc(tmpmat, _cfg.num_cepstra, decoded->get_freq_data());
-            }
-            else
-            {
-                decoded->get_freq_data() = tmpmat;
-            }
+            specgram::wav_to_specgram(samples_mat,
+                                      *_fft_plan,
+                                      _cfg.frame_stride_tn,
+                                      _cfg.time_steps,
+                                      _window,
+                                      decoded->get_freq_data());
         }
 
         // place into a destination with the appropriate time dimensions
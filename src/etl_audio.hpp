@@ -98,6 +98,8 @@ public:
 
     /** Sample rate of input audio in hertz */
     uint32_t sample_freq_hz{16000};
+    /** Resample input audio recorded at another rate to sample_freq_hz */
+    bool resample{false};
 
     /** Simple linear time-warping */
     std::uniform_real_distribution<float> time_scale_fraction{1.0f, 1.0f};
@@ -237,6 +239,7 @@ private:
         ADD_SCALAR(noise_root, mode::OPTIONAL),
         ADD_SCALAR(add_noise_probability, mode::OPTIONAL),
         ADD_SCALAR(sample_freq_hz, mode::OPTIONAL),
+        ADD_SCALAR(resample, mode::OPTIONAL),
         ADD_DISTRIBUTION(time_scale_fraction,
                          mode::OPTIONAL,
                          [](decltype(time_scale_fraction) v) { return v.a() <= v.b(); }),
@@ -280,8 +283,9 @@ private:
 class nervana::audio::decoded : public interface::decoded_media
 {
 public:
-    decoded(cv::Mat raw)
+    decoded(cv::Mat raw, bool borrowed = false)
         : time_rep{raw}
+        , time_borrowed{borrowed}
     {
     }
     size_t   size() { return time_rep.rows; }
@@ -289,19 +293,36 @@ public:
     cv::Mat& get_freq_data() { return freq_rep; }
     uint32_t valid_frames{0};
 
+    // Time data may point into the encoded record. Call own_time_data before modifying it.
+    bool borrows_time_data() const { return time_borrowed; }
+    void own_time_data()
+    {
+        if (time_borrowed)
+        {
+            time_rep      = time_rep.clone();
+            time_borrowed = false;
+        }
+    }
+
 protected:
     cv::Mat time_rep{};
     cv::Mat freq_rep{};
+    bool    time_borrowed{false};
 };
 
 class nervana::audio::extractor : public interface::extractor<audio::decoded>
 {
 public:
     extractor() {}
+    extractor(const audio::config& cfg)
+        : m_sample_rate_hz{cfg.resample ? cfg.sample_freq_hz : 0}
+    {
+    }
     ~extractor() {}
     std::shared_ptr<audio::decoded> extract(const void*, size_t) const override;
 
 private:
+    uint32_t m_sample_rate_hz{0};
 };
 
 class nervana::audio::transformer
@@ -317,10 +338,11 @@ private:
     transformer() = delete;
     void scale_time(cv::Mat& img, float scale_fraction);
 
-    std::shared_ptr<noise_clips> _noisemaker{nullptr};
-    const audio::config&         _cfg;
-    cv::Mat                      _window{};
-    cv::Mat                      _filterbank{};
+    std::shared_ptr<noise_clips>     _noisemaker{nullptr};
+    const audio::config&             _cfg;
+    std::shared_ptr<const rfft_plan> _fft_plan{nullptr};
+    std::shared_ptr<mel_filterbank>  _filterbank{nullptr};
+    cv::Mat                          _window{};
 };
 
 class nervana::audio::loader : public interface::loader<audio::decoded>
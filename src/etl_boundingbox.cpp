@@ -15,6 +15,8 @@
 *******************************************************************************/
 
 #include <sstream>
+#include <cstring>
+#include <immintrin.h>
 #include "etl_boundingbox.hpp"
 #include "log.hpp"
 
@@ -64,6 +66,65 @@ boundingbox::extractor::extractor(const std::unordered_map<std::string, int>& ma
 void boundingbox::extractor::extract(const void*                            data,
                                      size_t                                 size,
                                      std::shared_ptr<boundingbox::decoded>& rc) const
+{
+    if (is_binary(data, size))
+    {
+        extract_binary(data, size, rc);
+    }
+    else
+    {
+        extract_json(data, size, rc);
+    }
+}
+
+bool boundingbox::extractor::is_binary(const void* data, size_t size)
+{
+    return size >= binary_header_size && memcmp(data, binary_magic, 4) == 0;
+}
+
+void boundingbox::extractor::extract_binary(const void*                            data,
+                                            size_t                                 size,
+                                            std::shared_ptr<boundingbox::decoded>& rc) const
+{
+    const char* p       = static_cast<const char*>(data);
+    uint32_t    version = unpack<uint32_t>(p, 4);
+    if (version != binary_version)
+    {
+        throw invalid_argument("unsupported binary annotation version " + to_string(version));
+    }
+    rc->m_width    = unpack<uint32_t>(p, 8);
+    rc->m_height   = unpack<uint32_t>(p, 12);
+    rc->m_depth    = unpack<uint32_t>(p, 16);
+    uint32_t count = unpack<uint32_t>(p, 20);
+    if (size != binary_header_size + size_t(count) * binary_box_size)
+    {
+        throw invalid_argument("binary annotation size does not match its box count");
+    }
+
+    rc->m_boxes.reserve(rc->m_boxes.size() + count);
+    p += binary_header_size;
+    for (uint32_t i = 0; i < count; i++, p += binary_box_size)
+    {
+        int32_t  label = unpack<int32_t>(p, 16);
+        uint32_t flags = unpack<uint32_t>(p, 20);
+        if (label < 0 || size_t(label) >= label_map.size())
+        {
+            throw invalid_argument("label id " + to_string(label) +
+                                   " not found in metadata label list");
+        }
+        rc->m_boxes.emplace_back(unpack<float>(p, 0),
+                                 unpack<float>(p, 4),
+                                 unpack<float>(p, 8),
+                                 unpack<float>(p, 12),
+                                 label,
+                                 (flags & binary_difficult) != 0,
+                                 (flags & binary_truncated) != 0);
+    }
+}
+
+void boundingbox::extractor::extract_json(const void*                            data,
+                                          size_t                                 size,
+                                          std::shared_ptr<boundingbox::decoded>& rc) const
 {
     string buffer((const char*)data, size);
     json   j = json::parse(buffer);
@@ -139,36 +200,42 @@ shared_ptr<boundingbox::decoded> boundingbox::extractor::extract(const void* dat
     return rc;
 }
 
-boundingbox::transformer::transformer(const boundingbox::config&)
+vector<char> boundingbox::extractor::to_binary(const void* data, size_t size) const
 {
+    shared_ptr<decoded> annotation = make_shared<decoded>();
+    extract(data, size, annotation);
+    return to_binary(*annotation);
 }
 
-bool boundingbox::transformer::meet_emit_constraint(const cv::Rect& cropbox,
-                                                    const bbox&     input_bbox,
-                                                    const emit_type emit_constraint_type,
-                                                    const float     emit_min_overlap)
+vector<char> boundingbox::extractor::to_binary(const boundingbox::decoded& annotation)
 {
-    bbox crop_bbox(
-        cropbox.x, cropbox.y, cropbox.x + cropbox.width - 1, cropbox.y + cropbox.height - 1, false);
-    if (emit_constraint_type == emit_type::center)
+    const vector<bbox>& boxes = annotation.boxes();
+    vector<char>        rc(binary_header_size + boxes.size() * binary_box_size);
+    char*               p = rc.data();
+    memcpy(p, binary_magic, 4);
+    pack<uint32_t>(p, binary_version, 4);
+    pack<uint32_t>(p, annotation.width(), 8);
+    pack<uint32_t>(p, annotation.height(), 12);
+    pack<uint32_t>(p, annotation.depth(), 16);
+    pack<uint32_t>(p, boxes.size(), 20);
+    p += binary_header_size;
+    for (const bbox& b : boxes)
     {
-        float x_center = input_bbox.xcenter();
-        float y_center = input_bbox.ycenter();
-        if (x_center >= crop_bbox.xmin() && x_center <= crop_bbox.xmax() &&
-            y_center >= crop_bbox.ymin() && y_center <= crop_bbox.ymax())
-        {
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-    else if (emit_constraint_type == emit_type::min_overlap)
-    {
-        return input_bbox.coverage(crop_bbox) >= emit_min_overlap;
+        uint32_t flags = (b.difficult() ? binary_difficult : 0) |
+                         (b.truncated() ? binary_truncated : 0);
+        pack<float>(p, b.xmin(), 0);
+        pack<float>(p, b.ymin(), 4);
+        pack<float>(p, b.xmax(), 8);
+        pack<float>(p, b.ymax(), 12);
+        pack<int32_t>(p, b.label(), 16);
+        pack<uint32_t>(p, flags, 20);
+        p += binary_box_size;
     }
-    return true;
+    return rc;
+}
+
+boundingbox::transformer::transformer(const boundingbox::config&)
+{
 }
 
 vector<bbox> boundingbox::transformer::transform_box(const std::vector<bbox>&           boxes,
@@ -185,76 +252,144 @@ vector<bbox> boundingbox::transformer::transform_box(const std::vector<bbox>&
     * scale
     */
 
-    vector<bbox> rc;
-    for (bbox b : boxes)
-    {
-        if (pptr->expand_ratio > 1.)
-        {
-            b = b.expand(pptr->expand_offset, pptr->expand_size, pptr->expand_ratio);
-        }
+    const __m128 zero        = _mm_setzero_ps();
+    const __m128 one         = _mm_set1_ps(1.0f);
+    const __m128 half        = _mm_set1_ps(0.5f);
+    const __m128 crop_xmin   = _mm_set1_ps(crop.x);
+    const __m128 crop_ymin   = _mm_set1_ps(crop.y);
+    const __m128 crop_xmax   = _mm_set1_ps(crop.x + crop.width - 1);
+    const __m128 crop_ymax   = _mm_set1_ps(crop.y + crop.height - 1);
+    const __m128 crop_xend   = _mm_set1_ps(crop.x + crop.width);
+    const __m128 crop_yend   = _mm_set1_ps(crop.y + crop.height);
+    const __m128 crop_width  = _mm_set1_ps(crop.width);
+    const __m128 crop_height = _mm_set1_ps(crop.height);
+    const __m128 min_overlap = _mm_set1_ps(pptr->emit_min_overlap);
+    const __m128 xs          = _mm_set1_ps(x_scale);
+    const __m128 ys          = _mm_set1_ps(y_scale);
 
-        if (pptr->emit_constraint_type != emit_type::undefined &&
-            !meet_emit_constraint(crop, b, pptr->emit_constraint_type, pptr->emit_min_overlap))
-            continue;
+    // Boxes are transformed in groups with four boxes per vector; the group is padded to a
+    // multiple of four with empty boxes.
+    const size_t      group_size = 64;
+    alignas(16) float xmin[group_size];
+    alignas(16) float ymin[group_size];
+    alignas(16) float xmax[group_size];
+    alignas(16) float ymax[group_size];
+    uint8_t           keep[group_size];
 
-        if (b.xmax() < crop.x)
-        { // outside left
-        }
-        else if (b.xmin() >= crop.x + crop.width)
-        { // outside right
-        }
-        else if (b.ymax() < crop.y)
-        { // outside above
-        }
-        else if (b.ymin() >= crop.y + crop.height)
-        { // outside below
-        }
-        else
+    vector<bbox> rc;
+    rc.reserve(boxes.size());
+    for (size_t base = 0; base < boxes.size(); base += group_size)
+    {
+        size_t count  = std::min(group_size, boxes.size() - base);
+        size_t padded = (count + 3) & ~size_t(3);
+        for (size_t i = 0; i < count; i++)
         {
-            if (b.xmin() < crop.x)
-            {
-                b.set_xmin(0);
-            }
-            else
+            const bbox& b = boxes[base + i];
+            if (pptr->expand_ratio > 1.)
             {
-                b.set_xmin(b.xmin() - crop.x);
-            }
-            if (b.ymin() < crop.y)
-            {
-                b.set_ymin(0);
+                bbox e  = b.expand(pptr->expand_offset, pptr->expand_size, pptr->expand_ratio);
+                xmin[i] = e.xmin();
+                ymin[i] = e.ymin();
+                xmax[i] = e.xmax();
+                ymax[i] = e.ymax();
             }
             else
             {
-                b.set_ymin(b.ymin() - crop.y);
-            }
-            if (b.xmax() >= crop.x + crop.width)
-            {
-                b.set_xmax(crop.width - 1);
+                xmin[i] = b.xmin();
+                ymin[i] = b.ymin();
+                xmax[i] = b.xmax();
+                ymax[i] = b.ymax();
             }
-            else
-            {
-                b.set_xmax(b.xmax() - crop.x);
-            }
-            if (b.ymax() >= crop.y + crop.height)
+        }
+        fill(xmin + count, xmin + padded, 0.0f);
+        fill(ymin + count, ymin + padded, 0.0f);
+        fill(xmax + count, xmax + padded, -1.0f);
+        fill(ymax + count, ymax + padded, -1.0f);
+
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 x0 = _mm_load_ps(xmin + i);
+            __m128 y0 = _mm_load_ps(ymin + i);
+            __m128 x1 = _mm_load_ps(xmax + i);
+            __m128 y1 = _mm_load_ps(ymax + i);
+
+            __m128 emit = _mm_cmpeq_ps(zero, zero);
+            if (pptr->emit_constraint_type == emit_type::center)
             {
-                b.set_ymax(crop.height - 1);
+                __m128 x_center = _mm_add_ps(x0, _mm_mul_ps(_mm_sub_ps(x1, x0), half));
+                __m128 y_center = _mm_add_ps(y0, _mm_mul_ps(_mm_sub_ps(y1, y0), half));
+                emit            = _mm_and_ps(emit, _mm_cmpge_ps(x_center, crop_xmin));
+                emit            = _mm_and_ps(emit, _mm_cmple_ps(x_center, crop_xmax));
+                emit            = _mm_and_ps(emit, _mm_cmpge_ps(y_center, crop_ymin));
+                emit            = _mm_and_ps(emit, _mm_cmple_ps(y_center, crop_ymax));
             }
-            else
+            else if (pptr->emit_constraint_type == emit_type::min_overlap)
             {
-                b.set_ymax(b.ymax() - crop.y);
+                // coverage of the box by the crop, box sizes count the end pixel
+                __m128 disjoint = _mm_or_ps(
+                    _mm_or_ps(_mm_cmpgt_ps(crop_xmin, x1), _mm_cmplt_ps(crop_xmax, x0)),
+                    _mm_or_ps(_mm_cmpgt_ps(crop_ymin, y1), _mm_cmplt_ps(crop_ymax, y0)));
+                __m128 ix0 = _mm_max_ps(x0, crop_xmin);
+                __m128 iy0 = _mm_max_ps(y0, crop_ymin);
+                __m128 ix1 = _mm_min_ps(x1, crop_xmax);
+                __m128 iy1 = _mm_min_ps(y1, crop_ymax);
+                disjoint   = _mm_or_ps(disjoint,
+                                     _mm_or_ps(_mm_cmplt_ps(ix1, ix0), _mm_cmplt_ps(iy1, iy0)));
+                __m128 intersect = _mm_andnot_ps(
+                    disjoint,
+                    _mm_mul_ps(_mm_add_ps(_mm_sub_ps(ix1, ix0), one),
+                               _mm_add_ps(_mm_sub_ps(iy1, iy0), one)));
+                __m128 invalid = _mm_or_ps(_mm_cmplt_ps(x1, x0), _mm_cmplt_ps(y1, y0));
+                __m128 size    = _mm_andnot_ps(invalid,
+                                            _mm_mul_ps(_mm_add_ps(_mm_sub_ps(x1, x0), one),
+                                                       _mm_add_ps(_mm_sub_ps(y1, y0), one)));
+                __m128 coverage =
+                    _mm_and_ps(_mm_cmpgt_ps(intersect, zero), _mm_div_ps(intersect, size));
+                emit = _mm_cmpge_ps(coverage, min_overlap);
             }
 
+            // drop boxes entirely outside the crop
+            __m128 outside = _mm_or_ps(
+                _mm_or_ps(_mm_cmplt_ps(x1, crop_xmin), _mm_cmpge_ps(x0, crop_xend)),
+                _mm_or_ps(_mm_cmplt_ps(y1, crop_ymin), _mm_cmpge_ps(y0, crop_yend)));
+            int mask = _mm_movemask_ps(_mm_andnot_ps(outside, emit));
+
+            // clip to the crop
+            x0 = _mm_blendv_ps(_mm_sub_ps(x0, crop_xmin), zero, _mm_cmplt_ps(x0, crop_xmin));
+            y0 = _mm_blendv_ps(_mm_sub_ps(y0, crop_ymin), zero, _mm_cmplt_ps(y0, crop_ymin));
+            x1 = _mm_blendv_ps(_mm_sub_ps(x1, crop_xmin),
+                               _mm_sub_ps(crop_width, one),
+                               _mm_cmpge_ps(x1, crop_xend));
+            y1 = _mm_blendv_ps(_mm_sub_ps(y1, crop_ymin),
+                               _mm_sub_ps(crop_height, one),
+                               _mm_cmpge_ps(y1, crop_yend));
+
             if (pptr->flip)
             {
-                auto xmax = b.xmax();
-                b.set_xmax(crop.width - b.xmin() - 1);
-                b.set_xmin(crop.width - xmax - 1);
+                __m128 flipped_xmin = _mm_sub_ps(_mm_sub_ps(crop_width, x1), one);
+                x1                  = _mm_sub_ps(_mm_sub_ps(crop_width, x0), one);
+                x0                  = flipped_xmin;
             }
 
             // now rescale box
-            b = b.rescale(x_scale, y_scale);
+            _mm_store_ps(xmin + i, _mm_mul_ps(x0, xs));
+            _mm_store_ps(ymin + i, _mm_mul_ps(y0, ys));
+            _mm_store_ps(xmax + i, _mm_sub_ps(_mm_mul_ps(_mm_add_ps(x1, one), xs), one));
+            _mm_store_ps(ymax + i, _mm_sub_ps(_mm_mul_ps(_mm_add_ps(y1, one), ys), one));
+            for (size_t j = 0; j < 4; j++)
+            {
+                keep[i + j] = (mask >> j) & 1;
+            }
+        }
 
-            rc.push_back(b);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (keep[i])
+            {
+                const bbox& b = boxes[base + i];
+                rc.emplace_back(
+                    xmin[i], ymin[i], xmax[i], ymax[i], b.label(), b.difficult(), b.truncated());
+            }
         }
     }
 #ifdef PYTHON_PLUGIN
@@ -97,8 +97,28 @@ public:
     virtual std::shared_ptr<boundingbox::decoded> extract(const void*, size_t) const override;
     void extract(const void*, size_t, std::shared_ptr<boundingbox::decoded>&) const;
 
+    // Converts a JSON annotation to the binary annotation format. Class names are resolved
+    // to ids with this extractor's label map, so the result is only valid for that class list.
+    std::vector<char> to_binary(const void*, size_t) const;
+    static std::vector<char> to_binary(const boundingbox::decoded&);
+    static bool is_binary(const void*, size_t);
+
+    // The binary annotation format is a 24 byte header
+    //     char magic[4] = "ABOX", uint32 version, uint32 width, height, depth, box_count
+    // followed by box_count 24 byte boxes
+    //     float xmin, ymin, xmax, ymax, int32 label, uint32 flags (difficult, truncated)
+    // with all values little endian.
+    static constexpr const char* binary_magic       = "ABOX";
+    static constexpr uint32_t    binary_version     = 1;
+    static constexpr size_t      binary_header_size = 24;
+    static constexpr size_t      binary_box_size    = 24;
+    static constexpr uint32_t    binary_difficult   = 1 << 0;
+    static constexpr uint32_t    binary_truncated   = 1 << 1;
+
 private:
     extractor() = delete;
+    void extract_binary(const void*, size_t, std::shared_ptr<boundingbox::decoded>&) const;
+    void extract_json(const void*, size_t, std::shared_ptr<boundingbox::decoded>&) const;
     std::unordered_map<std::string, int> label_map;
     int get_label(const nlohmann::json& object) const;
 };
@@ -116,12 +136,6 @@ public:
     static std::vector<boundingbox::box>
         transform_box(const std::vector<boundingbox::box>&    b,
                       std::shared_ptr<augment::image::params> pptr);
-
-private:
-    static bool meet_emit_constraint(const cv::Rect&         cropbox,
-                                     const boundingbox::box& input_bbox,
-                                     const emit_type         emit_constraint_type,
-                                     const float             emit_min_overlap);
 };
 
 class nervana::boundingbox::loader
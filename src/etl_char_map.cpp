@@ -14,6 +14,10 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <cstring>
+#include <algorithm>
+#include <cwctype>
+
 #include "etl_char_map.hpp"
 
 using namespace std;
@@ -49,40 +53,169 @@ nervana::char_map::config::config(nlohmann::json js)
     {
         _cmap.insert({std::towupper(c), index++});
     }
+    _table = lookup_table(_cmap);
 
     validate();
 }
 
-std::shared_ptr<char_map::decoded> char_map::extractor::extract(const void* in_array,
-                                                                size_t      in_sz) const
+const uint32_t char_map::lookup_table::not_found;
+
+char_map::lookup_table::lookup_table(const cmap_t& cmap)
+    : m_cmap{cmap}
+    , m_dense(dense_size)
 {
-    uint32_t         nvalid = std::min((uint32_t)in_sz, _max_length);
-    string           transcript((const char*)in_array);
-    wstring          wtranscript = to_wstring(transcript, nvalid);
-    vector<uint32_t> char_ints(_max_length, 0);
+    auto lookup = [&](uint32_t code) {
+        auto it = m_cmap.find(std::towupper(static_cast<wchar_t>(code)));
+        return it == m_cmap.end() ? not_found : it->second;
+    };
 
-    uint32_t j = 0;
-    for (uint32_t i = 0; i < nvalid; i++)
+    for (uint32_t code = 0; code < dense_size; code++)
     {
-        auto l = _cmap.find(std::towupper(wtranscript[i]));
-        if (l == _cmap.end())
+        m_dense[code] = lookup(code);
+    }
+
+    // Precompute the upper case keys and their lower case forms, which covers nearly every
+    // character of a transcript that is in the alphabet.
+    vector<pair<uint32_t, uint32_t>> entries;
+    for (const auto& key : m_cmap)
+    {
+        for (wchar_t c : {key.first, static_cast<wchar_t>(std::towlower(key.first))})
         {
-            if (_unknown_value > 0)
+            uint32_t code  = static_cast<uint32_t>(c);
+            uint32_t value = lookup(code);
+            if (code >= dense_size && value != not_found &&
+                find_if(entries.begin(), entries.end(), [&](const pair<uint32_t, uint32_t>& e) {
+                    return e.first == code;
+                }) == entries.end())
             {
-                char_ints[j++] = _unknown_value;
-                continue;
+                entries.emplace_back(code, value);
             }
-            else
+        }
+    }
+    if (entries.empty())
+    {
+        return;
+    }
+
+    // Multiplicative hashing into a table of at least twice the number of keys. Multipliers
+    // are tried until one places every key in its own slot, growing the table if none does.
+    uint32_t multiplier = 2654435761u;
+    for (uint32_t bits = 1; bits <= 24; bits++)
+    {
+        uint32_t slots = 1u << bits;
+        if (slots < 2 * entries.size())
+        {
+            continue;
+        }
+        for (int attempt = 0; attempt < 64; attempt++)
+        {
+            vector<uint32_t> keys(slots, 0);
+            bool             collision = false;
+            for (const auto& e : entries)
+            {
+                uint32_t slot = (e.first * multiplier) >> (32 - bits);
+                if (keys[slot] != 0)
+                {
+                    collision = true;
+                    break;
+                }
+                keys[slot] = e.first;
+            }
+            if (!collision)
             {
-                continue;
+                m_keys       = move(keys);
+                m_values     = vector<uint32_t>(slots, not_found);
+                m_multiplier = multiplier;
+                m_shift      = 32 - bits;
+                for (const auto& e : entries)
+                {
+                    m_values[(e.first * multiplier) >> m_shift] = e.second;
+                }
+                return;
             }
+            multiplier = (multiplier * 1664525u + 1013904223u) | 1u;
         }
-        char_ints[j++] = l->second;
     }
+    throw runtime_error("unable to build char_map lookup table");
+}
+
+uint32_t char_map::lookup_table::find_sparse(uint32_t code) const
+{
+    uint32_t value = probe(code);
+    if (value == not_found)
+    {
+        auto it = m_cmap.find(std::towupper(static_cast<wchar_t>(code)));
+        if (it != m_cmap.end())
+        {
+            value = it->second;
+        }
+    }
+    return value;
+}
+
+std::shared_ptr<char_map::decoded> char_map::extractor::extract(const void* in_array,
+                                                                size_t      in_sz) const
+{
+    const char*      transcript = static_cast<const char*>(in_array);
+    vector<uint32_t> char_ints(_max_length);
+    uint32_t         nvalid = convert(transcript,
+                                      strlen(transcript),
+                                      std::min(static_cast<size_t>(_max_length), in_sz),
+                                      char_ints.data());
     auto rc = make_shared<char_map::decoded>(char_ints, nvalid);
     return rc;
 }
 
+uint32_t char_map::extractor::extract(const char* in_array, size_t in_sz, uint32_t* out) const
+{
+    return convert(in_array, in_sz, _max_length, out);
+}
+
+uint32_t char_map::extractor::convert(const char* in_array,
+                                      size_t      in_sz,
+                                      size_t      max_chars,
+                                      uint32_t*   out) const
+{
+    // Unknown characters are written as unknown_value. When that is 0 they are discarded by
+    // not advancing the output, so the next character overwrites them.
+    const uint32_t unknown = _unknown_value;
+    const uint32_t keep    = _unknown_value > 0 ? 1 : 0;
+
+    // ASCII is its own code point in every multibyte encoding the locale may use, so runs
+    // of it are mapped straight from the bytes.
+    size_t   i = 0;
+    uint32_t n = 0;
+    uint32_t j = 0;
+    for (; i < in_sz && n < max_chars; i++, n++)
+    {
+        uint8_t c = static_cast<uint8_t>(in_array[i]);
+        if (c == 0 || c >= 0x80)
+        {
+            break;
+        }
+        uint32_t value = _table.find(c);
+        bool     found = value != lookup_table::not_found;
+        out[j]         = found ? value : unknown;
+        j += found ? 1 : keep;
+    }
+
+    if (i < in_sz && n < max_chars && in_array[i] != 0)
+    {
+        wstring rest = to_wstring(string(in_array + i, in_sz - i), max_chars - n);
+        for (wchar_t c : rest)
+        {
+            uint32_t value = _table.find(c);
+            bool     found = value != lookup_table::not_found;
+            out[j]         = found ? value : unknown;
+            j += found ? 1 : keep;
+        }
+        n += rest.size();
+    }
+
+    fill(out + j, out + _max_length, 0);
+    return n;
+}
+
 void char_map::loader::load(const vector<void*>&               outlist,
                             std::shared_ptr<char_map::decoded> dc) const
 {
@@ -32,11 +32,52 @@ namespace nervana
         class extractor;
         class loader;
         class config;
+        class lookup_table;
 
         using cmap_t = std::unordered_map<wchar_t, uint32_t>;
     }
 }
 
+/**
+ * \brief Alphabet index of every character, compiled from a character map
+ *
+ * Characters are looked up by their raw code point; the upper casing applied to the map keys
+ * is folded into the table when it is built. Code points below 256 index a dense table, any
+ * other code point is found with a perfect hash over the characters that map into the
+ * alphabet. Characters without a precomputed entry fall back to upper casing and a second probe.
+ */
+class nervana::char_map::lookup_table
+{
+public:
+    lookup_table() = default;
+    explicit lookup_table(const cmap_t& cmap);
+
+    static const uint32_t not_found = UINT32_MAX;
+
+    uint32_t find(wchar_t c) const
+    {
+        uint32_t code = static_cast<uint32_t>(c);
+        return code < dense_size ? m_dense[code] : find_sparse(code);
+    }
+
+private:
+    static const uint32_t dense_size = 256;
+
+    uint32_t find_sparse(uint32_t code) const;
+    uint32_t probe(uint32_t code) const
+    {
+        uint32_t slot = (code * m_multiplier) >> m_shift;
+        return m_keys[slot] == code ? m_values[slot] : not_found;
+    }
+
+    cmap_t                m_cmap;
+    std::vector<uint32_t> m_dense;
+    std::vector<uint32_t> m_keys{0, 0};
+    std::vector<uint32_t> m_values{not_found, not_found};
+    uint32_t              m_multiplier = 1;
+    uint32_t              m_shift      = 31;
+};
+
 class nervana::char_map::config : public interface::config
 {
     friend class extractor;
@@ -60,7 +101,8 @@ public:
 
     config(nlohmann::json js);
 
-    const cmap_t& get_cmap() const { return _cmap; }
+    const cmap_t&       get_cmap() const { return _cmap; }
+    const lookup_table& get_table() const { return _table; }
 private:
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
         ADD_SCALAR(max_length, mode::REQUIRED),
@@ -71,7 +113,8 @@ private:
         ADD_SCALAR(output_type, mode::OPTIONAL, [](const std::string& v) {
             return output_type::is_valid_type(v);
         })};
-    cmap_t _cmap;
+    cmap_t       _cmap;
+    lookup_table _table;
 
     config() {}
     void validate()
@@ -132,7 +175,7 @@ class nervana::char_map::extractor : public interface::extractor<char_map::decod
 {
 public:
     extractor(const char_map::config& cfg)
-        : _cmap{cfg.get_cmap()}
+        : _table{cfg.get_table()}
         , _max_length{cfg.max_length}
         , _unknown_value{cfg.unknown_value}
     {
@@ -144,10 +187,16 @@ public:
     virtual std::shared_ptr<char_map::decoded> extract(const void* in_array,
                                                        size_t      in_sz) const override;
 
+    // Writes the max_length character values of the in_sz bytes of UTF-8 at in_array to out
+    // and returns the number of characters consumed, which is at most max_length.
+    uint32_t extract(const char* in_array, size_t in_sz, uint32_t* out) const;
+
 private:
-    const cmap_t&  _cmap; // This comes from config
-    uint32_t       _max_length;
-    const uint32_t _unknown_value;
+    uint32_t convert(const char* in_array, size_t in_sz, size_t max_chars, uint32_t* out) const;
+
+    const lookup_table& _table; // This comes from config
+    uint32_t            _max_length;
+    const uint32_t      _unknown_value;
 };
 
 class nervana::char_map::loader : public interface::loader<char_map::decoded>
@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include "etl_depthmap.hpp"
+#include "mat_pool.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -29,7 +30,7 @@ depthmap::extractor::~extractor()
 
 shared_ptr<image::decoded> depthmap::extractor::extract(const void* inbuf, size_t insize) const
 {
-    cv::Mat image;
+    cv::Mat image = nervana::image::pooled_mat();
 
     // It is bad to cast away const, but opencv does not support a const Mat
     // The Mat is only used for imdecode on the next line so it is OK here
@@ -41,8 +42,9 @@ shared_ptr<image::decoded> depthmap::extractor::extract(const void* inbuf, size_
     {
         // copy channel 0 from source image to channel 0 of target image where
         // target is a single channel image
-        cv::Mat target(image.rows, image.cols, CV_8UC1);
-        int     from_to[] = {0, 0};
+        cv::Mat target = nervana::image::pooled_mat();
+        target.create(image.rows, image.cols, CV_8UC1);
+        int from_to[] = {0, 0};
         cv::mixChannels(&image, 1, &target, 1, from_to, 1);
         image = target;
     }
@@ -65,30 +67,17 @@ std::shared_ptr<image::decoded>
     if (image_list->get_image_count() != 1)
         throw invalid_argument("depthmap transform only supports a single image");
 
-    cv::Mat    rotatedImage;
-    cv::Scalar border{0, 0, 0};
-    image::rotate(image_list->get_image(0), rotatedImage, img_xform->angle, false, border);
+    // depth is continuous so it is sampled bilinearly, unlike the labels of a pixel mask
+    cv::Mat warpedImage = image::pooled_mat();
+    image::warp(image_list->get_image(0), warpedImage, *img_xform, true);
 
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size, false);
-
-    cv::Mat flippedImage;
-    if (img_xform->flip)
-    {
-        cv::flip(resizedImage, flippedImage, 1);
-    }
-    else
-        flippedImage = resizedImage;
-
-    cv::Mat* finalImage = &flippedImage;
+    cv::Mat* finalImage = &warpedImage;
 
 #ifdef PYTHON_PLUGIN
     cv::Mat pluginImage;
     if (img_xform->user_plugin)
     {
-        pluginImage = img_xform->user_plugin->augment_depthmap(flippedImage);
+        pluginImage = img_xform->user_plugin->augment_depthmap(warpedImage);
         finalImage  = &pluginImage;
     }
 #endif
@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include "etl_image.hpp"
+#include "mat_pool.hpp"
 #ifdef PYTHON_PLUGIN
 #include "python_plugin.hpp"
 #endif
@@ -80,7 +81,7 @@ image::extractor::extractor(const image::config& cfg)
 
 shared_ptr<image::decoded> image::extractor::extract(const void* inbuf, size_t insize) const
 {
-    cv::Mat output_img;
+    cv::Mat output_img = image::pooled_mat();
 
     // It is bad to cast away const, but opencv does not support a const Mat
     // The Mat is only used for imdecode on the next line so it is OK here
@@ -140,10 +141,10 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
                                                    cv::Mat& single_img) const
 {
     // img_xform->dump(cout);
-    cv::Mat rotatedImage;
+    cv::Mat rotatedImage = image::pooled_mat();
     image::rotate(single_img, rotatedImage, img_xform->angle);
 
-    cv::Mat expandedImage;
+    cv::Mat expandedImage = image::pooled_mat();
     if (img_xform->expand_ratio > 1.0)
         image::expand(
             rotatedImage, expandedImage, img_xform->expand_offset, img_xform->expand_size);
@@ -153,7 +154,7 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
     cv::Mat croppedImage = expandedImage(img_xform->cropbox);
     image::add_padding(croppedImage, img_xform->padding, img_xform->padding_crop_offset);
 
-    cv::Mat resizedImage;
+    cv::Mat resizedImage = image::pooled_mat();
     image::resize(croppedImage, resizedImage, img_xform->output_size);
     photo.cbsjitter(resizedImage,
                     img_xform->contrast,
@@ -162,7 +163,7 @@ cv::Mat image::transformer::transform_single_image(shared_ptr<augment::image::pa
                     img_xform->hue);
     photo.lighting(resizedImage, img_xform->lighting, img_xform->color_noise_std);
 
-    cv::Mat flippedImage;
+    cv::Mat flippedImage = image::pooled_mat();
     if (img_xform->flip)
     {
         cv::flip(resizedImage, flippedImage, 1);
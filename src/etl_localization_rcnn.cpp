@@ -14,6 +14,8 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <immintrin.h>
+
 #include "etl_localization_rcnn.hpp"
 #include "box.hpp"
 
@@ -117,86 +119,28 @@ shared_ptr<localization::rcnn::decoded>
     mp->image_scale       = im_scale;
     mp->output_image_size = im_size;
 
-    vector<int> idx_inside =
-        anchor::inside_image_bounds(im_size.width, im_size.height, all_anchors);
-    vector<box> anchors_inside;
-    for (int i : idx_inside)
-        anchors_inside.push_back(all_anchors[i]);
-
-    // compute bbox overlaps
-    mp->gt_boxes     = boundingbox::transformer::transform_box(mp->boxes(), settings);
-    cv::Mat overlaps = bbox_overlaps(anchors_inside, mp->gt_boxes);
-
-    vector<int> labels(overlaps.rows, -1.0);
-
-    // assign bg labels first
-    vector<float> row_max(overlaps.rows, 0.0);
-    vector<float> column_max(overlaps.cols, 0.0);
-    for (int row = 0; row < overlaps.rows; row++)
-    {
-        for (int col = 0; col < overlaps.cols; col++)
-        {
-            auto value      = overlaps.at<float>(row, col);
-            row_max[row]    = std::max(row_max[row], value);
-            column_max[col] = std::max(column_max[col], value);
-        }
-    }
+    shared_ptr<const anchor_set> inside     = inside_anchors(im_size);
+    const vector<int>&           idx_inside = inside->index;
 
-    for (int row = 0; row < overlaps.rows; row++)
-    {
-        if (row_max[row] < cfg.negative_overlap)
-        {
-            labels[row] = 0;
-        }
-    }
-
-    // assigning fg labels
-    // 1. for each gt box, anchor with higher overlaps [including ties]
-    for (int row = 0; row < overlaps.rows; row++)
-    {
-        for (int col = 0; col < overlaps.cols; col++)
-        {
-            // This should be fixed as it is comparing floats
-            if (overlaps.at<float>(row, col) == column_max[col])
-            {
-                labels[row] = 1;
-            }
-        }
-    }
-
-    // 2. any anchor above the overlap threshold with any gt box
-    for (int row = 0; row < overlaps.rows; row++)
-    {
-        if (row_max[row] >= cfg.positive_overlap)
-        {
-            labels[row] = 1;
-        }
-    }
+    mp->gt_boxes = boundingbox::transformer::transform_box(mp->boxes(), settings);
+    vector<int> labels;
+    vector<int> argmax_index;
+    assign_labels(*inside, mp->gt_boxes, labels, argmax_index);
 
     // For every anchor, compute the regression target compared
     // to the gt box that it has the highest overlap with
     // the indicies of labels should match these targets
     vector<box> argmax;
-    for (int row = 0; row < overlaps.rows; row++)
+    if (!mp->gt_boxes.empty())
     {
-        int   index = 0;
-        float max   = 0;
-        for (int col = 0; col < overlaps.cols; col++)
-        {
-            auto value = overlaps.at<float>(row, col);
-            if (value > max)
-            {
-                index = col;
-                max   = value;
-            }
-        }
-        if (index < mp->gt_boxes.size())
+        argmax.reserve(argmax_index.size());
+        for (int index : argmax_index)
         {
             argmax.push_back(mp->gt_boxes[index]);
         }
     }
 
-    auto bbox_targets = compute_targets(argmax, anchors_inside);
+    auto bbox_targets = compute_targets(argmax, inside->boxes);
 
     // map lists to original canvas
     {
@@ -292,42 +236,158 @@ vector<localization::rcnn::target>
     return targets;
 }
 
-cv::Mat localization::rcnn::transformer::bbox_overlaps(
-    const vector<box>& boxes, const vector<boundingbox::box>& bounding_boxes) const
+shared_ptr<const localization::rcnn::transformer::anchor_set>
+    localization::rcnn::transformer::inside_anchors(const cv::Size& image_size) const
+{
+    // the anchors only depend on the config and the scaled image size
+    const size_t       cache_capacity = 256;
+    pair<int, int>     key{image_size.width, image_size.height};
+    unique_lock<mutex> lock(m_anchor_mutex);
+    auto               it = m_anchor_cache.find(key);
+    if (it != m_anchor_cache.end())
+    {
+        return it->second;
+    }
+    lock.unlock();
+
+    auto rc   = make_shared<anchor_set>();
+    rc->index = anchor::inside_image_bounds(image_size.width, image_size.height, all_anchors);
+    for (int i : rc->index)
+    {
+        const box& b = all_anchors[i];
+        rc->boxes.push_back(b);
+        rc->xmin.push_back(b.xmin());
+        rc->ymin.push_back(b.ymin());
+        rc->xmax.push_back(b.xmax());
+        rc->ymax.push_back(b.ymax());
+        rc->area.push_back(b.width() * b.height());
+    }
+
+    lock.lock();
+    if (m_anchor_cache.size() >= cache_capacity)
+    {
+        m_anchor_cache.clear();
+    }
+    m_anchor_cache[key] = rc;
+    return rc;
+}
+
+void localization::rcnn::transformer::assign_labels(const anchor_set&               anchors,
+                                                    const vector<boundingbox::box>& gt_boxes,
+                                                    vector<int>&                    labels,
+                                                    vector<int>&                    argmax) const
 {
-    // Parameters
-    // ----------
-    // boxes: (N, 4) ndarray of float
-    // query_boxes: (K, 4) ndarray of float
-    // Returns
-    // -------
-    // overlaps: (N, K) ndarray of overlap between boxes and query_boxes
-    uint32_t N = boxes.size();
-    uint32_t K = bounding_boxes.size();
-    cv::Mat  overlaps(N, K, CV_32FC1);
-    overlaps = 0.;
-    float iw, ih, box_area;
-    float ua;
-    for (uint32_t k = 0; k < bounding_boxes.size(); k++)
+    // Overlaps are computed one gt box at a time over four anchors per step. The running row
+    // maximum and argmax are updated in the same pass, and the column of overlaps is kept just
+    // long enough to find the anchors that tie with its maximum. Every lane performs the same
+    // float operations in the same order as the scalar tail.
+    const size_t  count = anchors.boxes.size();
+    vector<float> row_max(count, 0.0f);
+    vector<float> column(count);
+    labels.assign(count, -1);
+    argmax.assign(count, 0);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+    for (size_t k = 0; k < gt_boxes.size(); k++)
     {
-        const box& bounding_box = bounding_boxes[k];
-        box_area                = bounding_box.width() * bounding_box.height();
-        for (uint32_t n = 0; n < boxes.size(); n++)
+        const boundingbox::box& gt = gt_boxes[k];
+
+        const float gt_xmin = gt.xmin();
+        const float gt_ymin = gt.ymin();
+        const float gt_xmax = gt.xmax();
+        const float gt_ymax = gt.ymax();
+        const float gt_area = gt.width() * gt.height();
+
+        const __m128  v_xmin = _mm_set1_ps(gt_xmin);
+        const __m128  v_ymin = _mm_set1_ps(gt_ymin);
+        const __m128  v_xmax = _mm_set1_ps(gt_xmax);
+        const __m128  v_ymax = _mm_set1_ps(gt_ymax);
+        const __m128  v_area = _mm_set1_ps(gt_area);
+        const __m128i v_k    = _mm_set1_epi32(static_cast<int>(k));
+
+        __m128 v_column_max = zero;
+        size_t n            = 0;
+        for (; n + 4 <= count; n += 4)
+        {
+            __m128 iw = _mm_sub_ps(_mm_min_ps(_mm_loadu_ps(&anchors.xmax[n]), v_xmax),
+                                   _mm_max_ps(_mm_loadu_ps(&anchors.xmin[n]), v_xmin));
+            __m128 ih = _mm_sub_ps(_mm_min_ps(_mm_loadu_ps(&anchors.ymax[n]), v_ymax),
+                                   _mm_max_ps(_mm_loadu_ps(&anchors.ymin[n]), v_ymin));
+            iw = _mm_add_ps(iw, one);
+            ih = _mm_add_ps(ih, one);
+
+            __m128 intersection = _mm_mul_ps(iw, ih);
+            __m128 area_union =
+                _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&anchors.area[n]), v_area), intersection);
+            __m128 valid   = _mm_and_ps(_mm_cmpgt_ps(iw, zero), _mm_cmpgt_ps(ih, zero));
+            __m128 overlap = _mm_and_ps(_mm_div_ps(intersection, area_union), valid);
+            _mm_storeu_ps(&column[n], overlap);
+
+            __m128  best   = _mm_loadu_ps(&row_max[n]);
+            __m128  better = _mm_cmpgt_ps(overlap, best);
+            __m128i index  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&argmax[n]));
+            index          = _mm_blendv_epi8(index, v_k, _mm_castps_si128(better));
+            _mm_storeu_ps(&row_max[n], _mm_max_ps(best, overlap));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&argmax[n]), index);
+
+            v_column_max = _mm_max_ps(v_column_max, overlap);
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, v_column_max);
+        float column_max = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+        for (; n < count; n++)
         {
-            const box& b = boxes[n];
-            iw = min(b.xmax(), bounding_box.xmax()) - max(b.xmin(), bounding_box.xmin()) + 1;
-            if (iw > 0)
+            float overlap = 0.0f;
+            float iw = std::min(anchors.xmax[n], gt_xmax) - std::max(anchors.xmin[n], gt_xmin) + 1;
+            float ih = std::min(anchors.ymax[n], gt_ymax) - std::max(anchors.ymin[n], gt_ymin) + 1;
+            if (iw > 0 && ih > 0)
+            {
+                float intersection = iw * ih;
+                overlap            = intersection / (anchors.area[n] + gt_area - intersection);
+            }
+            column[n] = overlap;
+            if (overlap > row_max[n])
             {
-                ih = min(b.ymax(), bounding_box.ymax()) - max(b.ymin(), bounding_box.ymin()) + 1;
-                if (ih > 0)
-                {
-                    ua = b.width() * b.height() + box_area - iw * ih;
-                    overlaps.at<float>(n, k) = iw * ih / ua;
-                }
+                row_max[n] = overlap;
+                argmax[n]  = k;
             }
+            column_max = std::max(column_max, overlap);
+        }
+
+        // fg: for each gt box, the anchors with its highest overlap [including ties]
+        const __m128 v_max = _mm_set1_ps(column_max);
+        n                  = 0;
+        for (; n + 4 <= count; n += 4)
+        {
+            int ties = _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(&column[n]), v_max));
+            for (; ties != 0; ties &= ties - 1)
+            {
+                labels[n + __builtin_ctz(ties)] = 1;
+            }
+        }
+        for (; n < count; n++)
+        {
+            if (column[n] == column_max)
+            {
+                labels[n] = 1;
+            }
+        }
+    }
+
+    for (size_t n = 0; n < count; n++)
+    {
+        if (row_max[n] >= cfg.positive_overlap)
+        {
+            // fg: any anchor above the overlap threshold with any gt box
+            labels[n] = 1;
+        }
+        else if (row_max[n] < cfg.negative_overlap && labels[n] != 1)
+        {
+            labels[n] = 0;
         }
     }
-    return overlaps;
 }
 
 localization::rcnn::loader::loader(const localization::rcnn::config& cfg)
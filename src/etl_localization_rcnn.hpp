@@ -19,6 +19,8 @@
 #include <vector>
 #include <tuple>
 #include <random>
+#include <map>
+#include <mutex>
 
 #include "interface.hpp"
 #include "etl_boundingbox.hpp"
@@ -195,9 +197,27 @@ public:
                   std::shared_ptr<localization::rcnn::decoded> mp) const override;
 
 private:
+    // Anchors that lie inside an image of a given size, also kept as structure of arrays for
+    // the overlap kernel
+    struct anchor_set
+    {
+        std::vector<int>   index;
+        std::vector<box>   boxes;
+        std::vector<float> xmin;
+        std::vector<float> ymin;
+        std::vector<float> xmax;
+        std::vector<float> ymax;
+        std::vector<float> area;
+    };
+
     transformer() = delete;
-    cv::Mat bbox_overlaps(const std::vector<box>&              boxes,
-                          const std::vector<boundingbox::box>& query_boxes) const;
+    std::shared_ptr<const anchor_set> inside_anchors(const cv::Size& image_size) const;
+    // Computes the IoU of every anchor with every gt box and returns for each anchor its label
+    // (1 fg, 0 bg, -1 ignored) and the first gt box with the highest overlap
+    void assign_labels(const anchor_set&                    anchors,
+                       const std::vector<boundingbox::box>& gt_boxes,
+                       std::vector<int>&                    labels,
+                       std::vector<int>&                    argmax) const;
     static std::vector<target> compute_targets(const std::vector<box>& gt_bb,
                                                const std::vector<box>& anchors);
     std::vector<int> sample_anchors(const std::vector<int>& labels, bool debug = false) const;
@@ -205,6 +225,9 @@ private:
     const localization::rcnn::config& cfg;
     const std::vector<box>            all_anchors;
     float                             m_fixed_scaling_factor;
+
+    mutable std::mutex m_anchor_mutex;
+    mutable std::map<std::pair<int, int>, std::shared_ptr<const anchor_set>> m_anchor_cache;
 };
 
 class nervana::localization::rcnn::loader : public interface::loader<localization::rcnn::decoded>
@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include "etl_pixel_mask.hpp"
+#include "mat_pool.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -29,7 +30,7 @@ pixel_mask::extractor::~extractor()
 
 shared_ptr<image::decoded> pixel_mask::extractor::extract(const void* inbuf, size_t insize) const
 {
-    cv::Mat image;
+    cv::Mat image = nervana::image::pooled_mat();
 
     // It is bad to cast away const, but opencv does not support a const Mat
     // The Mat is only used for imdecode on the next line so it is OK here
@@ -41,8 +42,9 @@ shared_ptr<image::decoded> pixel_mask::extractor::extract(const void* inbuf, siz
     {
         // copy channel 0 from source image to channel 0 of target image where
         // target is a single channel image
-        cv::Mat target(image.rows, image.cols, CV_8UC1);
-        int     from_to[] = {0, 0};
+        cv::Mat target = nervana::image::pooled_mat();
+        target.create(image.rows, image.cols, CV_8UC1);
+        int from_to[] = {0, 0};
         cv::mixChannels(&image, 1, &target, 1, from_to, 1);
         image = target;
     }
@@ -65,33 +67,26 @@ std::shared_ptr<image::decoded>
     if (image_list->get_image_count() != 1)
         throw invalid_argument("pixel_mask transform only supports a single image");
 
-    cv::Mat    rotatedImage;
-    cv::Scalar border{0, 0, 0};
-    image::rotate(image_list->get_image(0), rotatedImage, img_xform->angle, false, border);
+    cv::Mat warpedImage = image::pooled_mat();
+    transform(*img_xform, image_list->get_image(0), warpedImage);
 
-    cv::Mat croppedImage = rotatedImage(img_xform->cropbox);
-
-    cv::Mat resizedImage;
-    image::resize(croppedImage, resizedImage, img_xform->output_size, false);
-
-    cv::Mat flippedImage;
-    if (img_xform->flip)
-    {
-        cv::flip(resizedImage, flippedImage, 1);
-    }
-    else
-        flippedImage = resizedImage;
-
-    cv::Mat* finalImage = &flippedImage;
+    cv::Mat* finalImage = &warpedImage;
 
 #ifdef PYTHON_PLUGIN
     cv::Mat pluginImage;
     if (img_xform->user_plugin)
     {
-        pluginImage = img_xform->user_plugin->augment_pixel_mask(flippedImage);
+        pluginImage = img_xform->user_plugin->augment_pixel_mask(warpedImage);
         finalImage  = &pluginImage;
     }
 #endif
 
     return make_shared<image::decoded>(*finalImage);
 }
+
+void pixel_mask::transformer::transform(const augment::image::params& img_xform,
+                                        const cv::Mat&                input,
+                                        cv::Mat&                      output) const
+{
+    image::warp(input, output, img_xform, false);
+}
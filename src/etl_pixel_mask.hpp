@@ -56,6 +56,12 @@ public:
     ~transformer();
     std::shared_ptr<image::decoded> transform(std::shared_ptr<augment::image::params> txs,
                                               std::shared_ptr<image::decoded> mp) const override;
+
+    // Warps a single mask into output with nearest sampling. output is written in place when
+    // it already has the output size and the type of input.
+    void transform(const augment::image::params& txs,
+                   const cv::Mat&                input,
+                   cv::Mat&                      output) const;
 };
 
 //-------------------------------------------------------------------------
@@ -20,26 +20,99 @@
 using namespace std;
 using namespace nervana;
 
+namespace
+{
+    // Decodes independent JPEG frames on the OpenCV worker threads
+    class frame_decoder : public cv::ParallelLoopBody
+    {
+    public:
+        frame_decoder(const MotionJpegCapture& capture,
+                      const vector<size_t>&    selected,
+                      vector<cv::Mat>&         frames)
+            : m_capture(capture)
+            , m_selected(selected)
+            , m_frames(frames)
+        {
+        }
+
+        void operator()(const cv::Range& range) const override
+        {
+            for (int i = range.start; i < range.end; i++)
+            {
+                m_capture.decodeFrame(m_selected[i], m_frames[i]);
+            }
+        }
+
+    private:
+        const MotionJpegCapture& m_capture;
+        const vector<size_t>&    m_selected;
+        vector<cv::Mat>&         m_frames;
+    };
+}
+
 std::shared_ptr<image::decoded> video::extractor::extract(const void* item, size_t itemSize) const
 {
-    // Very bad -- need to circle back and make an imemstream so we don't have to strip
-    // constness from item
-    char*                         bare_item = (char*)item;
-    shared_ptr<MotionJpegCapture> mjdecoder = make_shared<MotionJpegCapture>(bare_item, itemSize);
+    // the container is parsed in place and frames are decoded straight from the record
+    MotionJpegCapture mjdecoder(static_cast<const char*>(item), itemSize);
 
-    if (!mjdecoder->isOpened())
+    if (!mjdecoder.isOpened())
     {
         return nullptr;
     }
-    auto    out_img = make_shared<image::decoded>();
-    cv::Mat image;
-    while (mjdecoder->grabFrame() && mjdecoder->retrieveFrame(0, image))
+
+    vector<size_t> selected = select_frames(m_frame_sampling,
+                                            mjdecoder.getFrameCount(),
+                                            m_max_frame_count,
+                                            get_thread_local_random_engine());
+
+    vector<cv::Mat> frames(selected.size());
+    cv::parallel_for_(cv::Range(0, frames.size()), frame_decoder(mjdecoder, selected, frames));
+
+    auto out_img = make_shared<image::decoded>();
+    for (const cv::Mat& frame : frames)
     {
-        out_img->add(image.clone());
+        if (!frame.empty())
+        {
+            out_img->add(frame);
+        }
     }
     return out_img;
 }
 
+vector<size_t> video::extractor::select_frames(const string&    sampling,
+                                               size_t           frame_count,
+                                               size_t           max_frame_count,
+                                               random_engine_t& random)
+{
+    size_t         count = std::min(frame_count, max_frame_count);
+    size_t         first = 0;
+    vector<size_t> rc(count);
+    if (sampling == "uniform" && count < frame_count)
+    {
+        // the center of each of count equal parts of the clip
+        for (size_t i = 0; i < count; i++)
+        {
+            rc[i] = (2 * i + 1) * frame_count / (2 * count);
+        }
+        return rc;
+    }
+    else if (sampling == "random" && count < frame_count)
+    {
+        std::uniform_int_distribution<size_t> offset{0, frame_count - count};
+        first = offset(random);
+    }
+    else if (sampling != "first" && sampling != "uniform" && sampling != "random")
+    {
+        throw invalid_argument("unknown video frame_sampling " + sampling);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        rc[i] = first + i;
+    }
+    return rc;
+}
+
 video::transformer::transformer(const video::config& config)
     : frame_transformer(config.frame)
     , max_frame_count(config.max_frame_count)
@@ -36,6 +36,10 @@ public:
     uint32_t               max_frame_count;
     nervana::image::config frame;
     std::string            name;
+    /** Which frames of a longer clip are decoded: "first" takes the first max_frame_count
+    * frames, "uniform" spreads them evenly over the clip and "random" takes a contiguous window
+    * at a random offset. */
+    std::string frame_sampling{"first"};
 
     config(nlohmann::json js)
         : frame(js["frame"])
@@ -62,20 +66,38 @@ private:
     std::vector<std::shared_ptr<interface::config_info_interface>> config_list = {
         ADD_SCALAR(max_frame_count, mode::REQUIRED),
         ADD_SCALAR(name, mode::OPTIONAL),
+        ADD_SCALAR(frame_sampling,
+                   mode::OPTIONAL,
+                   [](const std::string& v) {
+                       return v == "first" || v == "uniform" || v == "random";
+                   }),
         ADD_IGNORE(frame)};
 };
 
 class nervana::video::extractor : public interface::extractor<image::decoded>
 {
 public:
-    extractor(const video::config&) {}
+    extractor(const video::config& cfg)
+        : m_max_frame_count{cfg.max_frame_count}
+        , m_frame_sampling{cfg.frame_sampling}
+    {
+    }
     virtual ~extractor() {}
+    // Decodes only the frames chosen by the sampling policy, looked up in the AVI index
     virtual std::shared_ptr<image::decoded> extract(const void* item,
                                                     size_t      itemSize) const override;
 
+    // Indices of the frames to decode, in increasing order
+    static std::vector<size_t> select_frames(const std::string& sampling,
+                                             size_t             frame_count,
+                                             size_t             max_frame_count,
+                                             random_engine_t&   random);
+
 protected:
 private:
     extractor() = delete;
+    uint32_t    m_max_frame_count;
+    std::string m_frame_sampling;
 };
 
 // simple wrapper around image::transformer for now
@@ -0,0 +1,253 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cmath>
+#include <stdexcept>
+
+#include "fft.hpp"
+
+using namespace std;
+using namespace nervana;
+
+nervana::rfft_plan::rfft_plan(int n)
+    : m_size{n}
+{
+    if (n < 1)
+    {
+        throw invalid_argument("fft length must be positive");
+    }
+
+    bool split     = n % 2 == 0;
+    m_complex_size = split ? n / 2 : n;
+
+    // factor into radix 4 first, then 2, then odd factors
+    int remaining = m_complex_size;
+    int radix     = 4;
+    while (remaining > 1)
+    {
+        while (remaining % radix != 0)
+        {
+            switch (radix)
+            {
+            case 4: radix = 2; break;
+            case 2: radix = 3; break;
+            default: radix += 2; break;
+            }
+            if (radix * radix > remaining)
+            {
+                radix = remaining;
+            }
+        }
+        remaining /= radix;
+        m_factors.push_back(radix);
+        m_factors.push_back(remaining);
+    }
+    if (m_factors.empty())
+    {
+        m_factors.push_back(1);
+        m_factors.push_back(1);
+    }
+
+    const double pi = acos(-1.0);
+    m_twiddles.resize(m_complex_size);
+    for (int k = 0; k < m_complex_size; k++)
+    {
+        double phase  = -2.0 * pi * k / m_complex_size;
+        m_twiddles[k] = {float(cos(phase)), float(sin(phase))};
+    }
+    if (split)
+    {
+        m_split_twiddles.resize(m_complex_size + 1);
+        for (int k = 0; k <= m_complex_size; k++)
+        {
+            double phase        = -2.0 * pi * k / m_size;
+            m_split_twiddles[k] = {float(cos(phase)), float(sin(phase))};
+        }
+    }
+}
+
+size_t nervana::rfft_plan::scratch_size() const
+{
+    // even lengths read the frame in place as packed complex values and need only the output,
+    // odd lengths need a complex copy of the input as well
+    return m_size % 2 == 0 ? 2 * m_complex_size : 4 * m_complex_size;
+}
+
+void nervana::rfft_plan::magnitude(const float* frame, float* mag, float* scratch) const
+{
+    cpx* out = reinterpret_cast<cpx*>(scratch);
+    if (m_size % 2 != 0)
+    {
+        cpx* in = out + m_complex_size;
+        for (int k = 0; k < m_size; k++)
+        {
+            in[k] = {frame[k], 0.0f};
+        }
+        transform(out, in);
+        for (int k = 0; k < bins(); k++)
+        {
+            mag[k] = sqrt(out[k].r * out[k].r + out[k].i * out[k].i);
+        }
+        return;
+    }
+
+    // Even samples are the real parts and odd samples the imaginary parts of a half length
+    // complex sequence z. The spectra of both halves are recovered from Z using its conjugate
+    // symmetry and recombined with one more twiddle per bin.
+    transform(out, reinterpret_cast<const cpx*>(frame));
+    const int m = m_complex_size;
+    for (int k = 0; k <= m; k++)
+    {
+        const cpx& zk = out[k == m ? 0 : k];
+        const cpx& zc = out[k == 0 ? 0 : m - k];
+        // even = (Z[k] + conj(Z[m-k])) / 2, odd = (Z[k] - conj(Z[m-k])) / 2i
+        float even_r = 0.5f * (zk.r + zc.r);
+        float even_i = 0.5f * (zk.i - zc.i);
+        float odd_r  = 0.5f * (zk.i + zc.i);
+        float odd_i  = -0.5f * (zk.r - zc.r);
+
+        const cpx& w = m_split_twiddles[k];
+        float      r = even_r + odd_r * w.r - odd_i * w.i;
+        float      i = even_i + odd_r * w.i + odd_i * w.r;
+        mag[k]       = sqrt(r * r + i * i);
+    }
+}
+
+void nervana::rfft_plan::transform(cpx* out, const cpx* in) const
+{
+    work(out, in, 1, m_factors.data());
+}
+
+void nervana::rfft_plan::work(cpx* out, const cpx* in, size_t fstride, const int* factors) const
+{
+    const int p   = factors[0];
+    const int m   = factors[1];
+    cpx*      end = out + p * m;
+    cpx*      dst = out;
+    if (m == 1)
+    {
+        for (; dst != end; dst++, in += fstride)
+        {
+            *dst = *in;
+        }
+    }
+    else
+    {
+        for (; dst != end; dst += m, in += fstride)
+        {
+            work(dst, in, fstride * p, factors + 2);
+        }
+    }
+
+    switch (p)
+    {
+    case 1: break;
+    case 2: butterfly2(out, fstride, m); break;
+    case 4: butterfly4(out, fstride, m); break;
+    default: butterfly_generic(out, fstride, m, p); break;
+    }
+}
+
+void nervana::rfft_plan::butterfly2(cpx* out, size_t fstride, int m) const
+{
+    cpx*       out2 = out + m;
+    const cpx* tw   = m_twiddles.data();
+    for (int k = 0; k < m; k++)
+    {
+        cpx t   = {out2->r * tw->r - out2->i * tw->i, out2->r * tw->i + out2->i * tw->r};
+        out2->r = out->r - t.r;
+        out2->i = out->i - t.i;
+        out->r += t.r;
+        out->i += t.i;
+        tw += fstride;
+        out++;
+        out2++;
+    }
+}
+
+void nervana::rfft_plan::butterfly4(cpx* out, size_t fstride, int m) const
+{
+    const cpx* tw1 = m_twiddles.data();
+    const cpx* tw2 = tw1;
+    const cpx* tw3 = tw1;
+    for (int k = 0; k < m; k++)
+    {
+        cpx& a = out[0];
+        cpx& b = out[m];
+        cpx& c = out[2 * m];
+        cpx& d = out[3 * m];
+
+        cpx s0 = {b.r * tw1->r - b.i * tw1->i, b.r * tw1->i + b.i * tw1->r};
+        cpx s1 = {c.r * tw2->r - c.i * tw2->i, c.r * tw2->i + c.i * tw2->r};
+        cpx s2 = {d.r * tw3->r - d.i * tw3->i, d.r * tw3->i + d.i * tw3->r};
+
+        cpx s5 = {a.r - s1.r, a.i - s1.i};
+        a.r += s1.r;
+        a.i += s1.i;
+        cpx s3 = {s0.r + s2.r, s0.i + s2.i};
+        cpx s4 = {s0.r - s2.r, s0.i - s2.i};
+
+        c   = {a.r - s3.r, a.i - s3.i};
+        a.r += s3.r;
+        a.i += s3.i;
+        b   = {s5.r + s4.i, s5.i - s4.r};
+        d   = {s5.r - s4.i, s5.i + s4.r};
+
+        tw1 += fstride;
+        tw2 += 2 * fstride;
+        tw3 += 3 * fstride;
+        out++;
+    }
+}
+
+void nervana::rfft_plan::butterfly_generic(cpx* out, size_t fstride, int m, int p) const
+{
+    const cpx*  tw = m_twiddles.data();
+    const int   n  = m_complex_size;
+    cpx         stack_scratch[16];
+    vector<cpx> heap_scratch;
+    cpx*        scratch = stack_scratch;
+    if (p > 16)
+    {
+        heap_scratch.resize(p);
+        scratch = heap_scratch.data();
+    }
+
+    for (int u = 0; u < m; u++)
+    {
+        for (int q = 0, k = u; q < p; q++, k += m)
+        {
+            scratch[q] = out[k];
+        }
+        for (int q1 = 0, k = u; q1 < p; q1++, k += m)
+        {
+            size_t index = 0;
+            cpx    sum   = scratch[0];
+            for (int q = 1; q < p; q++)
+            {
+                index += fstride * k;
+                if (index >= size_t(n))
+                {
+                    index -= n;
+                }
+                const cpx& w = tw[index];
+                sum.r += scratch[q].r * w.r - scratch[q].i * w.i;
+                sum.i += scratch[q].r * w.i + scratch[q].i * w.r;
+            }
+            out[k] = sum;
+        }
+    }
+}
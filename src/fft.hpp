@@ -0,0 +1,69 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace nervana
+{
+    class rfft_plan;
+}
+
+/**
+ * \brief Precomputed real-input FFT of a fixed length
+ *
+ * A plan is built once per frame length and is immutable afterwards, so a single plan can be
+ * shared by all decode threads. Even lengths are computed as a complex FFT of half the length
+ * followed by a split step; odd lengths fall back to a full complex FFT. The complex FFT is a
+ * mixed-radix decimation in time with specialized radix 2 and 4 butterflies and a generic
+ * butterfly for any other factor, so every length is supported.
+ */
+class nervana::rfft_plan
+{
+public:
+    explicit rfft_plan(int n);
+
+    int size() const { return m_size; }
+    // number of non-redundant output bins, n / 2 + 1
+    int bins() const { return m_size / 2 + 1; }
+    // number of floats of scratch memory required by magnitude()
+    size_t scratch_size() const;
+
+    // Writes the magnitude of the unnormalized DFT of the n real values in frame to
+    // mag[0 .. bins()). scratch must hold scratch_size() floats and must not alias frame.
+    void magnitude(const float* frame, float* mag, float* scratch) const;
+
+private:
+    struct cpx
+    {
+        float r;
+        float i;
+    };
+
+    void transform(cpx* out, const cpx* in) const;
+    void work(cpx* out, const cpx* in, size_t fstride, const int* factors) const;
+    void butterfly2(cpx* out, size_t fstride, int m) const;
+    void butterfly4(cpx* out, size_t fstride, int m) const;
+    void butterfly_generic(cpx* out, size_t fstride, int m, int p) const;
+
+    int              m_size;            // real input length
+    int              m_complex_size;    // length of the complex FFT
+    std::vector<int> m_factors;         // (radix, remaining length) pairs
+    std::vector<cpx> m_twiddles;        // exp(-2 pi i k / m_complex_size)
+    std::vector<cpx> m_split_twiddles;  // exp(-2 pi i k / m_size), even lengths only
+};
@@ -0,0 +1,253 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if HAS_GPU
+#include <cuda.h>
+#endif
+
+#include "host_allocator.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+const size_t host_allocator::alignment;
+const size_t host_allocator::huge_page_size;
+
+namespace
+{
+    size_t round_up(size_t size, size_t multiple)
+    {
+        return (size + multiple - 1) / multiple * multiple;
+    }
+
+    // Small buffers, such as labels, stay on regular pages rather than taking a huge page each
+    bool use_huge_pages(size_t size, bool huge)
+    {
+        return huge && size >= host_allocator::huge_page_size / 2;
+    }
+
+    size_t mapped_length(size_t size, bool huge)
+    {
+        return round_up(max<size_t>(size, 1),
+                        use_huge_pages(size, huge) ? host_allocator::huge_page_size
+                                                   : size_t(sysconf(_SC_PAGESIZE)));
+    }
+
+    void* map_pages(size_t size, bool huge, bool lock)
+    {
+        const int protection = PROT_READ | PROT_WRITE;
+        const int flags      = MAP_PRIVATE | MAP_ANONYMOUS;
+        size_t    length     = mapped_length(size, huge);
+        void*     memory     = MAP_FAILED;
+
+        if (use_huge_pages(size, huge))
+        {
+#ifdef MAP_HUGETLB
+            memory = mmap(nullptr, length, protection, flags | MAP_HUGETLB, -1, 0);
+#endif
+            if (memory == MAP_FAILED)
+            {
+                // No reserved huge pages are left. Map one huge page more than needed and trim
+                // it to a huge page boundary so that transparent huge pages can back all of it.
+                const size_t huge_page = host_allocator::huge_page_size;
+                size_t       padded    = length + huge_page;
+                char* base = static_cast<char*>(mmap(nullptr, padded, protection, flags, -1, 0));
+                if (base != MAP_FAILED)
+                {
+                    char* aligned = reinterpret_cast<char*>(
+                        round_up(reinterpret_cast<uintptr_t>(base), huge_page));
+                    if (aligned != base)
+                    {
+                        munmap(base, aligned - base);
+                    }
+                    munmap(aligned + length, base + padded - (aligned + length));
+                    memory = aligned;
+#ifdef MADV_HUGEPAGE
+                    madvise(memory, length, MADV_HUGEPAGE);
+#endif
+                }
+            }
+        }
+        else
+        {
+            memory = mmap(nullptr, length, protection, flags, -1, 0);
+        }
+
+        if (memory == MAP_FAILED)
+        {
+            throw bad_alloc();
+        }
+        if (lock && mlock(memory, length) != 0)
+        {
+            munmap(memory, length);
+            throw runtime_error("unable to lock " + to_string(length) +
+                                " bytes of output memory, check RLIMIT_MEMLOCK (ulimit -l)");
+        }
+        return memory;
+    }
+
+    void unmap_pages(void* memory, size_t size, bool huge)
+    {
+        // munmap also drops the lock
+        munmap(memory, mapped_length(size, huge));
+    }
+
+    shared_ptr<const host_allocator> mapped_allocator(bool huge, bool lock)
+    {
+        return make_shared<host_allocator>(
+            [huge, lock](size_t size) { return map_pages(size, huge, lock); },
+            [huge](void* memory, size_t size) { unmap_pages(memory, size, huge); },
+            lock);
+    }
+
+    struct registry
+    {
+        mutex                                         lock;
+        map<string, shared_ptr<const host_allocator>> allocators;
+    };
+
+    registry& get_registry()
+    {
+        static registry instance;
+        static once_flag built_in;
+        call_once(built_in, [] {
+            instance.allocators["default"] = make_shared<host_allocator>(
+                [](size_t size) {
+                    void* memory = nullptr;
+                    return posix_memalign(&memory, host_allocator::alignment, size) == 0
+                               ? memory
+                               : nullptr;
+                },
+                [](void* memory, size_t) { ::free(memory); });
+            instance.allocators["locked"]            = mapped_allocator(false, true);
+            instance.allocators["huge_pages"]        = mapped_allocator(true, false);
+            instance.allocators["huge_pages_locked"] = mapped_allocator(true, true);
+#if HAS_GPU
+            instance.allocators["cuda_host"] = make_shared<host_allocator>(
+                [](size_t size) {
+                    void* memory = nullptr;
+                    return cuMemAllocHost(&memory, size) == CUDA_SUCCESS ? memory : nullptr;
+                },
+                [](void* memory, size_t) { cuMemFreeHost(memory); },
+                true);
+#endif
+        });
+        return instance;
+    }
+}
+
+host_allocator::host_allocator(const allocate_function& allocate,
+                               const free_function&     free,
+                               bool                     page_locked)
+    : m_allocate{allocate}
+    , m_free{free}
+    , m_page_locked{page_locked}
+{
+    if (!m_allocate || !m_free)
+    {
+        throw invalid_argument("host_allocator needs both an allocate and a free function");
+    }
+}
+
+void* host_allocator::allocate(size_t size) const
+{
+    void* memory = m_allocate(size);
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    if (reinterpret_cast<uintptr_t>(memory) % alignment != 0)
+    {
+        m_free(memory, size);
+        throw runtime_error("host_allocator returned memory that is not " + to_string(alignment) +
+                            " byte aligned");
+    }
+    return memory;
+}
+
+void host_allocator::free(void* memory, size_t size) const
+{
+    if (memory != nullptr)
+    {
+        m_free(memory, size);
+    }
+}
+
+void host_allocator::register_allocator(const string&                           name,
+                                        const shared_ptr<const host_allocator>& allocator)
+{
+    if (!allocator)
+    {
+        throw invalid_argument("host_allocator '" + name + "' is null");
+    }
+    registry&         r = get_registry();
+    lock_guard<mutex> lock(r.lock);
+    r.allocators[name] = allocator;
+}
+
+shared_ptr<const host_allocator> host_allocator::get(const string& name)
+{
+    {
+        registry&         r = get_registry();
+        lock_guard<mutex> lock(r.lock);
+        auto              it = r.allocators.find(name);
+        if (it != r.allocators.end())
+        {
+            return it->second;
+        }
+    }
+    throw invalid_argument("unknown host allocator '" + name + "', registered are " +
+                           join(registered_names(), ", "));
+}
+
+vector<string> host_allocator::registered_names()
+{
+    registry&         r = get_registry();
+    lock_guard<mutex> lock(r.lock);
+    vector<string>    names;
+    for (auto& entry : r.allocators)
+    {
+        names.push_back(entry.first);
+    }
+    return names;
+}
+
+shared_ptr<const host_allocator> host_allocator::from_pinned(bool pinned)
+{
+#if HAS_GPU
+    return get(pinned ? "cuda_host" : "default");
+#else
+    return standard();
+#endif
+}
+
+bool host_allocator::is_pinned(const shared_ptr<const host_allocator>& allocator)
+{
+#if HAS_GPU
+    return allocator && allocator == get("cuda_host");
+#else
+    return false;
+#endif
+}
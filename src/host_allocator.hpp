@@ -0,0 +1,84 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nervana
+{
+    class host_allocator;
+}
+
+/**
+ * \brief Source of the host memory behind output buffers
+ *
+ * Every allocation is aligned to at least host_allocator::alignment bytes. Allocators are kept
+ * in a registry by name and a loader picks one with its output_allocator option, which lets NIC
+ * or accelerator runtimes that must own the memory of the output ring register their own
+ * allocation callbacks before the loader is created.
+ *
+ * Built in allocators:
+ * - default: pageable memory
+ * - locked: page locked (mlocked) pages
+ * - huge_pages: 2MB huge pages, reserved ones when available and transparent ones otherwise
+ * - huge_pages_locked: huge_pages, mlocked
+ * - cuda_host: cuMemAllocHost, only in builds with GPU support
+ */
+class nervana::host_allocator
+{
+public:
+    static const size_t alignment      = 64;
+    static const size_t huge_page_size = 2 * 1024 * 1024;
+
+    typedef std::function<void*(size_t size)> allocate_function;
+    typedef std::function<void(void* memory, size_t size)> free_function;
+
+    // page_locked tells consumers that the memory will not be paged out
+    host_allocator(const allocate_function& allocate,
+                   const free_function&     free,
+                   bool                     page_locked = false);
+
+    // Throws std::bad_alloc when the callback returns nothing and std::runtime_error when it
+    // returns memory that is not aligned.
+    void* allocate(size_t size) const;
+    void free(void* memory, size_t size) const;
+    bool page_locked() const { return m_page_locked; }
+
+    // Registering a name twice replaces the earlier allocator, buffers that were allocated by it
+    // keep it alive until they are freed.
+    static void register_allocator(const std::string&                           name,
+                                   const std::shared_ptr<const host_allocator>& allocator);
+    // Throws std::invalid_argument for names that were never registered
+    static std::shared_ptr<const host_allocator> get(const std::string& name);
+    static std::vector<std::string> registered_names();
+
+    static std::shared_ptr<const host_allocator> standard() { return get("default"); }
+    // The memory the pinned option has always meant, cuda_host with GPU support and pageable
+    // memory otherwise
+    static std::shared_ptr<const host_allocator> from_pinned(bool pinned);
+    // The reverse of from_pinned, true only for the cuda_host allocator. Page locked memory of
+    // other allocators is not what the pinned flag of serialized buffers records.
+    static bool is_pinned(const std::shared_ptr<const host_allocator>& allocator);
+
+private:
+    allocate_function m_allocate;
+    free_function     m_free;
+    bool              m_page_locked;
+};
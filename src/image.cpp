@@ -17,6 +17,8 @@
 #include <iostream>
 
 #include "image.hpp"
+#include "augment_image.hpp"
+#include "mat_pool.hpp"
 #include "util.hpp"
 #include "log.hpp"
 
@@ -47,6 +49,237 @@ void image::rotate(
     }
 }
 
+namespace
+{
+    // Position along one axis of the rotated input for each output pixel. The image transform
+    // flips the resized crop, resizes the padded crop and crops the expanded image. The crop
+    // is padded in place, so like cv::copyMakeBorder on an ROI the padding shows the pixels
+    // around the crop and only positions outside the input frame or in the expand fill are
+    // marked invalid. Nearest positions follow cv::resize with INTER_NEAREST so they match
+    // the separate steps exactly.
+    void map_axis(vector<double>&  position,
+                  vector<uint8_t>& valid,
+                  int              output_size,
+                  int              crop_origin,
+                  int              crop_size,
+                  int              pad_shift,
+                  int              expand_offset,
+                  int              frame_size,
+                  bool             flip,
+                  bool             interpolate)
+    {
+        position.resize(output_size);
+        valid.resize(output_size);
+        double scale = 1.0 / (double(output_size) / crop_size);
+        for (int i = 0; i < output_size; i++)
+        {
+            int    resized = flip ? output_size - 1 - i : i;
+            double c;
+            if (interpolate)
+            {
+                c = min(max((resized + 0.5) * scale - 0.5, 0.0), double(crop_size - 1));
+            }
+            else
+            {
+                c = min(floor(resized * scale), double(crop_size - 1));
+            }
+            double e    = c + pad_shift + crop_origin - expand_offset;
+            position[i] = e;
+            valid[i]    = e >= 0 && e <= frame_size - 1;
+        }
+    }
+
+    template <typename T>
+    void sample_linear(const cv::Mat& input, double x, double y, T* out)
+    {
+        const int cn = input.channels();
+        int       x0 = cvFloor(x);
+        int       y0 = cvFloor(y);
+        double    fx = x - x0;
+        double    fy = y - y0;
+        for (int c = 0; c < cn; c++)
+        {
+            double sum = 0;
+            for (int dy = 0; dy < 2; dy++)
+            {
+                int yi = y0 + dy;
+                if (yi < 0 || yi >= input.rows)
+                {
+                    continue;
+                }
+                const T* row = input.ptr<T>(yi);
+                double   wy  = dy ? fy : 1 - fy;
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int xi = x0 + dx;
+                    if (xi >= 0 && xi < input.cols)
+                    {
+                        sum += wy * (dx ? fx : 1 - fx) * row[xi * cn + c];
+                    }
+                }
+            }
+            out[c] = cv::saturate_cast<T>(sum);
+        }
+    }
+
+    template <typename T>
+    void warp_pixels(const cv::Mat&         input,
+                     cv::Mat&               output,
+                     const vector<double>&  xs,
+                     const vector<uint8_t>& x_valid,
+                     const vector<double>&  ys,
+                     const vector<uint8_t>& y_valid,
+                     const cv::Matx23d*     rotation,
+                     bool                   interpolate)
+    {
+        const int cn = input.channels();
+        if (rotation == nullptr && !interpolate)
+        {
+            // Separable nearest sampling, a gather through a column index table.
+            vector<int> columns(output.cols);
+            for (int x = 0; x < output.cols; x++)
+            {
+                columns[x] = x_valid[x] ? int(xs[x]) * cn : -1;
+            }
+            for (int y = 0; y < output.rows; y++)
+            {
+                T* out = output.ptr<T>(y);
+                if (!y_valid[y])
+                {
+                    fill(out, out + output.cols * cn, T(0));
+                    continue;
+                }
+                const T* row = input.ptr<T>(int(ys[y]));
+                for (int x = 0; x < output.cols; x++)
+                {
+                    for (int c = 0; c < cn; c++)
+                    {
+                        *out++ = columns[x] < 0 ? T(0) : row[columns[x] + c];
+                    }
+                }
+            }
+            return;
+        }
+
+        for (int y = 0; y < output.rows; y++)
+        {
+            T* out = output.ptr<T>(y);
+            for (int x = 0; x < output.cols; x++, out += cn)
+            {
+                if (!x_valid[x] || !y_valid[y])
+                {
+                    fill(out, out + cn, T(0));
+                    continue;
+                }
+                double sx = xs[x];
+                double sy = ys[y];
+                if (rotation)
+                {
+                    const cv::Matx23d& m = *rotation;
+                    double             rx = m(0, 0) * sx + m(0, 1) * sy + m(0, 2);
+                    sy                    = m(1, 0) * sx + m(1, 1) * sy + m(1, 2);
+                    sx                    = rx;
+                }
+                if (interpolate)
+                {
+                    sample_linear(input, sx, sy, out);
+                    continue;
+                }
+                int xi = cvRound(sx);
+                int yi = cvRound(sy);
+                if (xi < 0 || xi >= input.cols || yi < 0 || yi >= input.rows)
+                {
+                    fill(out, out + cn, T(0));
+                }
+                else
+                {
+                    copy_n(input.ptr<T>(yi) + xi * cn, cn, out);
+                }
+            }
+        }
+    }
+}
+
+void image::warp(const cv::Mat&                input,
+                 cv::Mat&                      output,
+                 const augment::image::params& params,
+                 bool                          interpolate)
+{
+    // padding moves the crop by the difference of its offset into the padded crop and the
+    // padding, add_padding() does nothing without padding
+    const cv::Rect& crop = params.cropbox;
+    cv::Size2i      pad_shift;
+    if (params.padding != 0)
+    {
+        pad_shift = params.padding_crop_offset - cv::Size2i(params.padding, params.padding);
+    }
+    cv::Size2i expand_offset = params.expand_ratio > 1.0 ? params.expand_offset : cv::Size2i();
+
+    vector<double>  xs;
+    vector<double>  ys;
+    vector<uint8_t> x_valid;
+    vector<uint8_t> y_valid;
+    map_axis(xs,
+             x_valid,
+             params.output_size.width,
+             crop.x,
+             crop.width,
+             pad_shift.width,
+             expand_offset.width,
+             input.cols,
+             params.flip,
+             interpolate);
+    map_axis(ys,
+             y_valid,
+             params.output_size.height,
+             crop.y,
+             crop.height,
+             pad_shift.height,
+             expand_offset.height,
+             input.rows,
+             false,
+             interpolate);
+
+    // rotate() turns the image about its center within the input frame; sampling needs
+    // the inverse, from the rotated frame back to the input
+    cv::Matx23d  inverse_rotation;
+    cv::Matx23d* rotation = nullptr;
+    if (params.angle != 0)
+    {
+        cv::Point2i center(input.cols / 2, input.rows / 2);
+        cv::invertAffineTransform(cv::getRotationMatrix2D(center, params.angle, 1.0),
+                                  inverse_rotation);
+        rotation = &inverse_rotation;
+    }
+
+    output.create(params.output_size, input.type());
+    switch (input.depth())
+    {
+    case CV_8U:
+        warp_pixels<uint8_t>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_8S:
+        warp_pixels<int8_t>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_16U:
+        warp_pixels<uint16_t>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_16S:
+        warp_pixels<int16_t>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_32S:
+        warp_pixels<int32_t>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_32F:
+        warp_pixels<float>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    case CV_64F:
+        warp_pixels<double>(input, output, xs, x_valid, ys, y_valid, rotation, interpolate);
+        break;
+    default: throw invalid_argument("unsupported depth for image::warp");
+    }
+}
+
 void image::add_padding(cv::Mat& input, int padding, cv::Size2i crop_offset)
 {
     // crop overlaps completely with input image
@@ -55,7 +288,7 @@ void image::add_padding(cv::Mat& input, int padding, cv::Size2i crop_offset)
         return;
     }
 
-    cv::Mat    paddedImage;
+    cv::Mat    paddedImage = image::pooled_mat();
     cv::Scalar blackPixel{0, 0, 0};
     cv::copyMakeBorder(
         input, paddedImage, padding, padding, padding, padding, cv::BORDER_CONSTANT, blackPixel);
@@ -286,7 +519,7 @@ void image::photometric::cbsjitter(
         /*************
         *  HUE SHIFT *
         **************/
-        cv::Mat hsv;
+        cv::Mat hsv = image::pooled_mat();
         // Convert to HSV colorspae.
         cv::cvtColor(inout, hsv, CV_BGR2HSV);
 
@@ -307,7 +540,7 @@ void image::photometric::cbsjitter(
         /*************
         *  CONTRAST  *
         **************/
-        cv::Mat dst_img;
+        cv::Mat dst_img = image::pooled_mat();
         inout.convertTo(dst_img, CV_32FC3, contrast);
         dst_img += (1.0 - contrast) * cv::mean(inout);
         dst_img.convertTo(inout, CV_8UC3);
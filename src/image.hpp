@@ -23,8 +23,25 @@
 
 namespace nervana
 {
+    namespace augment
+    {
+        namespace image
+        {
+            class params;
+        }
+    }
+
     namespace image
     {
+        // Resamples a target that is aligned with the image, such as a segmentation mask or
+        // a depth map, with the geometry of the image transform (rotate, expand, crop, pad,
+        // resize and flip) in a single pass. Areas the image transform fills are set to 0.
+        // output is written in place when it already has the output size and input type.
+        void warp(const cv::Mat&                input,
+                  cv::Mat&                      output,
+                  const augment::image::params& params,
+                  bool                          interpolate);
+
         // These functions may be common across different transformers
         void resize(const cv::Mat&, cv::Mat&, const cv::Size2i&, bool interpolate = true);
         void expand(const cv::Mat& input, cv::Mat& output, cv::Size offset, cv::Size size);
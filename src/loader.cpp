@@ -32,6 +32,7 @@
 #include "client/loader_remote.hpp"
 #include "client/curl_connector.hpp"
 #include "client/remote_config.hpp"
+#include "client/shm_connector.hpp"
 #if defined(ENABLE_OPENFABRICS_CONNECTOR)
 #include "client/ofi_connector.hpp"
 #endif
@@ -82,6 +83,23 @@ void loader_config::validate()
     {
         throw invalid_argument("iteration_mode must be one of ONCE, COUNT, or INFINITE");
     }
+
+    if (augmentation_view_layout == "batch" && batch_size % augmentation_views != 0)
+    {
+        throw invalid_argument("batch_size must be a multiple of augmentation_views");
+    }
+
+    for (size_t i = 1; i < bucket_boundaries.size(); i++)
+    {
+        if (bucket_boundaries[i] <= bucket_boundaries[i - 1])
+        {
+            throw invalid_argument("bucket_boundaries must be strictly increasing");
+        }
+    }
+    if (!bucket_boundaries.empty() && bucket_element >= etl.size())
+    {
+        throw invalid_argument("bucket_element must index an etl entry");
+    }
 }
 
 loader_local::loader_local(const std::string& config_string)
@@ -153,8 +171,11 @@ void loader_local::initialize(const json& config_json)
                                                  lcfg.shuffle_enable,
                                                  lcfg.random_seed);
 
-    // Default ceil div to get number of batches
-    m_batch_count_value = (record_count() + m_batch_size - 1) / m_batch_size;
+    m_provider = provider_factory::create(config_json);
+
+    // Default ceil div to get number of batches, each record may fill several batch items
+    const size_t multiplier = m_provider->get_batch_multiplier();
+    m_batch_count_value     = (record_count() * multiplier + m_batch_size - 1) / m_batch_size;
     if (lcfg.iteration_mode == "ONCE")
     {
         m_batch_mode = BatchMode::ONCE;
@@ -169,26 +190,51 @@ void loader_local::initialize(const json& config_json)
         m_batch_count_value = lcfg.iteration_mode_count;
     }
 
-    m_provider = provider_factory::create(config_json);
-
     unsigned int threads_num = lcfg.decode_thread_count != 0 ? lcfg.decode_thread_count
                                                              : std::thread::hardware_concurrency();
 
     const int decode_size =
         lcfg.batch_size * ((threads_num * m_input_multiplier - 1) / lcfg.batch_size + 1);
-    m_batch_iterator = make_shared<batch_iterator>(m_block_manager, decode_size);
 
+    // Bucketing hands whole groups of one batch worth of records from a single bucket to the
+    // batch iterator. decode_size is a multiple of the batch size, so groups never straddle
+    // batches and every batch is drawn from one bucket.
+    const bool bucketing = !lcfg.bucket_boundaries.empty();
+
+    shared_ptr<async_manager_source<encoded_record_list>> records = m_block_manager;
+    if (bucketing)
+    {
+        m_bucket_iterator = make_shared<bucket_iterator>(m_block_manager,
+                                                         m_provider,
+                                                         lcfg.bucket_boundaries,
+                                                         lcfg.bucket_element,
+                                                         lcfg.batch_size / multiplier);
+        records = m_bucket_iterator;
+    }
+    m_batch_iterator = make_shared<batch_iterator>(records, decode_size / multiplier);
+
+    // output_allocator names a registered host_allocator and takes precedence over pinned
+    shared_ptr<const host_allocator> allocator = lcfg.output_allocator.empty()
+                                                     ? host_allocator::from_pinned(lcfg.pinned)
+                                                     : host_allocator::get(lcfg.output_allocator);
+
+    // Batch major output is decoded straight into the batches handed to the caller. Batch
+    // minor output is transposed into them by the decoder.
     m_decoder = make_shared<batch_decoder>(m_batch_iterator,
                                            decode_size,
+                                           lcfg.batch_size,
+                                           !lcfg.batch_major,
                                            lcfg.decode_thread_count,
-                                           lcfg.pinned,
+                                           allocator,
                                            m_provider,
                                            lcfg.random_seed);
 
-    m_final_stage =
-        make_shared<batch_iterator_fbm>(m_decoder, lcfg.batch_size, m_provider, !lcfg.batch_major);
+    m_final_stage = make_shared<decoded_batch_iterator>(m_decoder, bucketing);
+    m_batch_pool  = make_shared<batch_pool>(
+        m_provider->get_output_shapes(), lcfg.batch_size, allocator, lcfg.batch_pool_size);
 
     m_output_buffer_ptr = m_final_stage->next();
+    update_batch_shapes();
 
     if (lcfg.web_server_port != 0)
     {
@@ -197,6 +243,15 @@ void loader_local::initialize(const json& config_json)
     }
 }
 
+shared_ptr<const fixed_buffer_map> loader_local::borrow_output_buffer()
+{
+    if (m_output_buffer_ptr == nullptr)
+    {
+        throw runtime_error("empty buffer");
+    }
+    return m_batch_pool->borrow(*m_output_buffer_ptr);
+}
+
 const vector<string>& loader_local::get_buffer_names() const
 {
     return m_provider->get_buffer_names();
@@ -204,14 +259,45 @@ const vector<string>& loader_local::get_buffer_names() const
 
 const vector<pair<string, shape_type>>& loader_local::get_names_and_shapes() const
 {
-    return m_provider->get_output_shapes();
+    // bucketed batches have their own shapes
+    return m_bucket_iterator ? m_batch_shapes : m_provider->get_output_shapes();
 }
 
 const shape_t& loader_local::get_shape(const string& name) const
 {
+    if (m_bucket_iterator)
+    {
+        for (const auto& item : m_batch_shapes)
+        {
+            if (item.first == name)
+            {
+                return item.second.get_shape();
+            }
+        }
+    }
     return m_provider->get_output_shape(name).get_shape();
 }
 
+void loader_local::update_batch_shapes()
+{
+    if (!m_bucket_iterator)
+    {
+        return;
+    }
+    m_batch_shapes = m_provider->get_output_shapes();
+    if (m_output_buffer_ptr)
+    {
+        for (auto& item : m_batch_shapes)
+        {
+            const buffer_fixed_size_elements* buffer = (*m_output_buffer_ptr)[item.first];
+            if (buffer)
+            {
+                item.second = buffer->get_shape_type();
+            }
+        }
+    }
+}
+
 loader::iterator::iterator(loader& ld, bool is_end)
     : m_current_loader(ld)
     , m_is_end{is_end}
@@ -267,6 +353,7 @@ void loader_local::increment_position()
 {
     m_output_buffer_ptr = m_final_stage->next();
     m_position++;
+    update_batch_shapes();
 
     // Wrap around if this is an infinite iterator
     if (m_batch_mode == BatchMode::INFINITE && m_position == m_batch_count_value)
@@ -312,27 +399,61 @@ unique_ptr<loader> loader_factory::create_loader_remote(const json& js)
 {
     remote_config config(js.at("remote"));
 
-    shared_ptr<http_connector> http_connector_obj =
-        make_shared<curl_connector>(config.address, config.port);
+    // all connections of the loader come from one pool, so they are kept across requests
+    curl_pool::options pool_options;
+    pool_options.http2 = config.http2;
+    auto pool          = make_shared<curl_pool>(pool_options);
+
+    auto make_connector = [&config, &pool]() {
+        shared_ptr<http_connector> http_connector_obj =
+            make_shared<curl_connector>(config.address, config.port, pool);
+        if (config.shared_memory)
+        {
+            // a slot for every batch in flight and a few held by the caller and the async
+            // buffers; shared memory takes the place of RDMA on one host
+            return shared_ptr<http_connector>(
+                make_shared<shm_connector>(http_connector_obj, config.prefetch_depth + 4));
+        }
+#if defined(ENABLE_OPENFABRICS_CONNECTOR)
+        if (!config.rdma_address.empty() && config.rdma_port != 0)
+        {
+            auto ofi_ptr =
+                new ofi_connector(config.rdma_address, config.rdma_port, http_connector_obj);
+            http_connector_obj = shared_ptr<ofi_connector>(ofi_ptr);
+        }
+#endif
+        return http_connector_obj;
+    };
 #if defined(ENABLE_OPENFABRICS_CONNECTOR)
     if (!config.rdma_address.empty() && config.rdma_port != 0)
     {
         INFO << "Using OFI library to fetch batches via RDMA.";
-        auto ofi_ptr = new ofi_connector(config.rdma_address, config.rdma_port, http_connector_obj);
-        http_connector_obj = shared_ptr<ofi_connector>(ofi_ptr);
     }
 #endif
     shared_ptr<service> service_obj;
-    if (config.async)
+    if (config.async && config.prefetch_depth > 1)
+    {
+        vector<shared_ptr<service>> connections;
+        for (unsigned int i = 0; i < config.prefetch_depth; i++)
+        {
+            connections.push_back(make_shared<service_connector>(make_connector()));
+        }
+        // other clients of a session that was passed in take batches from the same sequence
+        bool shared_session = !config.session_id.empty();
+        service_obj         = make_shared<service_prefetch>(connections, shared_session);
+        INFO << "Using asynchronous batch fetching with " << config.prefetch_depth
+             << " requests in flight.";
+    }
+    else if (config.async)
     {
-        auto service_connector_obj    = make_shared<service_connector>(http_connector_obj);
+        auto service_connector_obj    = make_shared<service_connector>(make_connector());
         auto service_async_source_obj = make_shared<service_async_source>(service_connector_obj);
         service_obj                   = make_shared<service_async>(service_async_source_obj);
         INFO << "Using asynchronous batch fetching.";
     }
     else
     {
-        service_obj = make_shared<service_connector>(http_connector_obj);
+        service_obj = make_shared<service_connector>(make_connector());
     }
 
     loader_remote* new_loader = new loader_remote(service_obj, js);
@@ -32,6 +32,7 @@
 #include "buffer_batch.hpp"
 #include "batch_iterator.hpp"
 #include "batch_decoder.hpp"
+#include "bucket_iterator.hpp"
 #include "block_loader_file.hpp"
 #include "block_loader_nds.hpp"
 #include "block_manager.hpp"
@@ -56,18 +57,24 @@ public:
     std::string manifest_root;
     int         batch_size;
 
-    std::string                 cache_directory      = "";
-    int                         block_size           = 5000;
-    float                       subset_fraction      = 1.0;
-    bool                        shuffle_enable       = false;
-    bool                        shuffle_manifest     = false;
-    bool                        pinned               = false;
-    bool                        batch_major          = true;
-    uint32_t                    random_seed          = 0;
-    uint32_t                    decode_thread_count  = 0;
-    std::string                 iteration_mode       = "ONCE";
-    int                         iteration_mode_count = 0;
-    uint16_t                    web_server_port      = 0;
+    std::string                 cache_directory          = "";
+    int                         block_size               = 5000;
+    float                       subset_fraction          = 1.0;
+    bool                        shuffle_enable           = false;
+    bool                        shuffle_manifest         = false;
+    bool                        pinned                   = false;
+    std::string                 output_allocator         = "";
+    bool                        batch_major              = true;
+    uint32_t                    random_seed              = 0;
+    uint32_t                    decode_thread_count      = 0;
+    std::string                 iteration_mode           = "ONCE";
+    int                         iteration_mode_count     = 0;
+    uint16_t                    web_server_port          = 0;
+    uint32_t                    augmentation_views       = 1;
+    std::string                 augmentation_view_layout = "batch";
+    std::vector<uint32_t>       bucket_boundaries;
+    uint32_t                    bucket_element  = 0;
+    uint32_t                    batch_pool_size = 4;
     std::vector<nlohmann::json> etl;
     std::vector<nlohmann::json> augmentation;
 #if defined(ENABLE_AEON_SERVICE)
@@ -91,10 +98,18 @@ private:
         ADD_SCALAR(shuffle_manifest, mode::OPTIONAL),
         ADD_SCALAR(decode_thread_count, mode::OPTIONAL),
         ADD_SCALAR(pinned, mode::OPTIONAL),
+        ADD_SCALAR(output_allocator, mode::OPTIONAL),
         ADD_SCALAR(random_seed, mode::OPTIONAL),
         ADD_SCALAR(iteration_mode, mode::OPTIONAL),
         ADD_SCALAR(iteration_mode_count, mode::OPTIONAL),
         ADD_SCALAR(web_server_port, mode::OPTIONAL),
+        ADD_SCALAR(augmentation_views, mode::OPTIONAL, [](uint32_t v) { return v > 0; }),
+        ADD_SCALAR(augmentation_view_layout,
+                   mode::OPTIONAL,
+                   [](const std::string& v) { return v == "batch" || v == "slots"; }),
+        ADD_SCALAR(bucket_boundaries, mode::OPTIONAL),
+        ADD_SCALAR(bucket_element, mode::OPTIONAL),
+        ADD_SCALAR(batch_pool_size, mode::OPTIONAL, [](uint32_t v) { return v > 0; }),
         ADD_OBJECT(etl, mode::REQUIRED),
         ADD_OBJECT(augmentation, mode::OPTIONAL),
         // ssd_config is a json key that contains a detection part of
@@ -167,6 +182,10 @@ public:
     virtual iterator& get_end_iter()     = 0;
 
     virtual const fixed_buffer_map* get_output_buffer() const  = 0;
+    // Takes the current batch out of the pipeline, which will not write to it again until
+    // every copy of the returned pointer is gone. This lets callers hold several batches at
+    // once without copying them. The loader's own current batch is left unspecified.
+    virtual std::shared_ptr<const fixed_buffer_map> borrow_output_buffer() = 0;
     virtual const size_t&           position()                 = 0;
     virtual void                    reset()                    = 0;
     virtual nlohmann::json          get_current_config() const = 0;
@@ -224,8 +243,11 @@ public:
         m_final_stage->reset();
         m_output_buffer_ptr = m_final_stage->next();
         m_position          = 0;
+        update_batch_shapes();
     }
 
+    std::shared_ptr<const fixed_buffer_map> borrow_output_buffer() override;
+
     nlohmann::json get_current_config() const override { return m_current_config; }
     const char*    get_session_id() const override { return ""; }
 private:
@@ -234,6 +256,7 @@ private:
     loader_local() = delete;
     void initialize(const nlohmann::json& config_json);
     void increment_position() override;
+    void update_batch_shapes();
 
     iterator                                                m_current_iter;
     iterator                                                m_end_iter;
@@ -241,15 +264,18 @@ private:
     std::shared_ptr<manifest_nds>                           m_manifest_nds;
     std::shared_ptr<block_loader_source>                    m_block_loader;
     std::shared_ptr<block_manager>                          m_block_manager;
+    std::shared_ptr<bucket_iterator>                        m_bucket_iterator;
     std::shared_ptr<batch_iterator>                         m_batch_iterator;
     std::shared_ptr<provider_interface>                     m_provider;
     std::shared_ptr<batch_decoder>                          m_decoder;
     std::shared_ptr<async_manager_source<fixed_buffer_map>> m_final_stage;
+    std::shared_ptr<batch_pool>                             m_batch_pool;
     int                                                     m_batch_size;
     BatchMode                                               m_batch_mode;
     int                                                     m_batch_count_value;
     size_t                                                  m_position{0};
     fixed_buffer_map*                                       m_output_buffer_ptr{nullptr};
+    std::vector<std::pair<std::string, shape_type>>         m_batch_shapes;
     nlohmann::json                                          m_current_config;
     std::shared_ptr<web_app>                                m_debug_web_app;
 
@@ -41,13 +41,8 @@ network_client::network_client(const std::string& baseurl,
     , m_shard_count(shard_count)
     , m_shard_index(shard_index)
     , m_macrobatch_size(block_size)
+    , m_pool(std::make_shared<curl_pool>())
 {
-    curl_global_init(CURL_GLOBAL_ALL);
-}
-
-network_client::~network_client()
-{
-    curl_global_cleanup();
 }
 
 size_t network_client::callback(void* ptr, size_t size, size_t nmemb, void* stream)
@@ -62,22 +57,23 @@ size_t network_client::callback(void* ptr, size_t size, size_t nmemb, void* stre
 void network_client::get(const string& url, stringstream& stream)
 {
     // reuse curl connection across requests
-    void* m_curl = curl_easy_init();
+    curl_pool::lease handle = m_pool->acquire();
+    CURL*            curl   = handle.get();
 
     // given a url, make an HTTP GET request and fill stream with
     // the body of the response
 
-    curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, callback);
-    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &stream);
-    curl_easy_setopt(m_curl, CURLOPT_NOPROXY, "127.0.0.1,localhost");
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &stream);
+    curl_easy_setopt(curl, CURLOPT_NOPROXY, "127.0.0.1,localhost");
 
     // Perform the request, res will get the return code
-    CURLcode res = curl_easy_perform(m_curl);
+    CURLcode res = m_pool->perform(handle);
 
     // Check for errors
     long http_code = 0;
-    curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
     if (http_code != 200 || res != CURLE_OK)
     {
         stringstream ss;
@@ -88,11 +84,8 @@ void network_client::get(const string& url, stringstream& stream)
             ss << " curl return: " << curl_easy_strerror(res);
         }
 
-        curl_easy_cleanup(m_curl);
         throw std::runtime_error(ss.str());
     }
-
-    curl_easy_cleanup(m_curl);
 }
 
 string network_client::load_block_url(size_t block_num)
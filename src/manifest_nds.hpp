@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 
+#include "curl_pool.hpp"
 #include "manifest.hpp"
 #include "async_manager.hpp"
 #include "buffer_batch.hpp"
@@ -38,10 +40,9 @@ public:
                    size_t             block_size,
                    size_t             shard_count,
                    size_t             shard_index);
+    // copies share the connections of the original
     network_client(const network_client&) = default;
 
-    ~network_client();
-
     static size_t callback(void* ptr, size_t size, size_t nmemb, void* stream);
 
     void get(const std::string& url, std::stringstream& stream);
@@ -50,6 +51,11 @@ public:
 
     std::string metadata_url();
 
+    std::vector<curl_pool::connection_stats> get_connection_stats() const
+    {
+        return m_pool->get_stats();
+    }
+
 private:
     const std::string m_baseurl;
     const std::string m_token;
@@ -57,6 +63,8 @@ private:
     const int         m_shard_count;
     const int         m_shard_index;
     uint32_t          m_macrobatch_size;
+
+    std::shared_ptr<curl_pool> m_pool;
 };
 
 class nervana::manifest_nds_builder
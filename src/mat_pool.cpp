@@ -0,0 +1,281 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include "mat_pool.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// Every buffer is preceded by a small header that remembers its bucket capacity and, for
+// OpenCV 2, holds the Mat reference count. The header size keeps the pixel data aligned.
+namespace
+{
+    struct block_header
+    {
+        size_t capacity;
+        int    refcount;
+    };
+
+    block_header* header_from_data(uchar* data, size_t header_size)
+    {
+        return reinterpret_cast<block_header*>(data - header_size);
+    }
+
+    size_t compute_steps(int dims, const int* sizes, int type, size_t* step)
+    {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--)
+        {
+            if (step)
+            {
+                step[i] = total;
+            }
+            total *= sizes[i];
+        }
+        return total;
+    }
+}
+
+std::atomic<size_t> image::mat_pool::m_global_allocations{0};
+std::atomic<size_t> image::mat_pool::m_global_reuses{0};
+std::atomic<size_t> image::mat_pool::m_global_releases{0};
+
+// The pool outlives its thread if Mats allocated from it are still referenced when the
+// thread exits. In that case the last released buffer deletes the pool.
+class image::mat_pool::thread_holder
+{
+public:
+    thread_holder()
+        : pool{new mat_pool()}
+    {
+    }
+    ~thread_holder() { pool->retire(); }
+    mat_pool* pool;
+};
+
+cv::Mat image::pooled_mat()
+{
+    cv::Mat rc;
+    rc.allocator = &mat_pool::thread_instance();
+    return rc;
+}
+
+image::mat_pool& image::mat_pool::thread_instance()
+{
+    thread_local static thread_holder holder;
+    return *holder.pool;
+}
+
+image::mat_pool::stats image::mat_pool::get_global_stats()
+{
+    stats rc;
+    rc.allocations = m_global_allocations;
+    rc.reuses      = m_global_reuses;
+    rc.releases    = m_global_releases;
+    return rc;
+}
+
+image::mat_pool::mat_pool()
+{
+}
+
+image::mat_pool::~mat_pool()
+{
+    clear();
+}
+
+image::mat_pool::stats image::mat_pool::get_stats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void image::mat_pool::clear()
+{
+    lock_guard<mutex> lock(m_mutex);
+    for (vector<uchar*>& bucket : m_free)
+    {
+        for (uchar* data : bucket)
+        {
+            m_stats.bytes_reserved -= header_from_data(data, m_header_size)->capacity;
+            cv::fastFree(data - m_header_size);
+        }
+        bucket.clear();
+    }
+}
+
+void image::mat_pool::retire()
+{
+    clear();
+    bool destroy;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_retired = true;
+        destroy   = m_outstanding == 0;
+    }
+    if (destroy)
+    {
+        delete this;
+    }
+}
+
+size_t image::mat_pool::bucket_capacity(size_t size)
+{
+    if (size <= m_min_capacity)
+    {
+        return m_min_capacity;
+    }
+    // largest power of two strictly below size, split into four steps
+    size_t octave = size_t(1) << (63 - __builtin_clzll(size - 1));
+    size_t step   = octave / 4;
+    return (size + step - 1) / step * step;
+}
+
+size_t image::mat_pool::bucket_index(size_t capacity)
+{
+    size_t octave = size_t(1) << (63 - __builtin_clzll(capacity - 1));
+    size_t step   = octave / 4;
+    return 4 * (63 - __builtin_clzll(octave)) + (capacity / step - 5);
+}
+
+uchar* image::mat_pool::acquire(size_t size) const
+{
+    size_t capacity = bucket_capacity(size);
+    size_t index    = bucket_index(capacity);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_outstanding++;
+        vector<uchar*>& bucket = m_free[index];
+        if (!bucket.empty())
+        {
+            uchar* data = bucket.back();
+            bucket.pop_back();
+            m_stats.reuses++;
+            m_global_reuses++;
+            return data;
+        }
+        m_stats.allocations++;
+        m_stats.bytes_reserved += capacity;
+        m_global_allocations++;
+        if (bucket.capacity() == 0)
+        {
+            bucket.reserve(m_max_cached_buffers);
+        }
+    }
+
+    uchar*        block  = static_cast<uchar*>(cv::fastMalloc(capacity + m_header_size));
+    block_header* header = reinterpret_cast<block_header*>(block);
+    header->capacity     = capacity;
+    header->refcount     = 0;
+    return block + m_header_size;
+}
+
+void image::mat_pool::release(uchar* data) const
+{
+    size_t capacity = header_from_data(data, m_header_size)->capacity;
+    bool   destroy  = false;
+    bool   cached   = false;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_outstanding--;
+        m_stats.releases++;
+        m_global_releases++;
+        vector<uchar*>& bucket = m_free[bucket_index(capacity)];
+        if (!m_retired && bucket.size() < m_max_cached_buffers)
+        {
+            bucket.push_back(data);
+            cached = true;
+        }
+        else
+        {
+            m_stats.bytes_reserved -= capacity;
+            destroy = m_retired && m_outstanding == 0;
+        }
+    }
+    if (!cached)
+    {
+        cv::fastFree(data - m_header_size);
+    }
+    if (destroy)
+    {
+        delete this;
+    }
+}
+
+#if CV_MAJOR_VERSION == 2
+void image::mat_pool::allocate(int        dims,
+                               const int* sizes,
+                               int        type,
+                               int*&      refcount,
+                               uchar*&    datastart,
+                               uchar*&    data,
+                               size_t*    step)
+{
+    size_t total = compute_steps(dims, sizes, type, step);
+    data = datastart = acquire(total);
+    refcount         = &header_from_data(data, m_header_size)->refcount;
+    *refcount        = 1;
+}
+
+void image::mat_pool::deallocate(int* refcount, uchar* datastart, uchar* data)
+{
+    if (datastart)
+    {
+        release(datastart);
+    }
+}
+#else
+cv::UMatData* image::mat_pool::allocate(int                dims,
+                                        const int*         sizes,
+                                        int                type,
+                                        void*              data,
+                                        size_t*            step,
+                                        int                flags,
+                                        cv::UMatUsageFlags usage_flags) const
+{
+    if (data != nullptr)
+    {
+        // user supplied memory is never pooled
+        return cv::Mat::getStdAllocator()->allocate(
+            dims, sizes, type, data, step, flags, usage_flags);
+    }
+
+    size_t        total = compute_steps(dims, sizes, type, step);
+    cv::UMatData* u     = new cv::UMatData(this);
+    u->data = u->origdata = acquire(total);
+    u->size               = total;
+    return u;
+}
+
+bool image::mat_pool::allocate(cv::UMatData*      u,
+                               int                access_flags,
+                               cv::UMatUsageFlags usage_flags) const
+{
+    return u != nullptr;
+}
+
+void image::mat_pool::deallocate(cv::UMatData* u) const
+{
+    if (!u)
+    {
+        return;
+    }
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    release(u->origdata);
+    delete u;
+}
+#endif
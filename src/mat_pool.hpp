@@ -0,0 +1,116 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace nervana
+{
+    namespace image
+    {
+        class mat_pool;
+
+        // Returns an empty Mat whose storage, once created, is drawn from the calling
+        // thread's mat_pool. Pass it as the destination of any OpenCV call.
+        cv::Mat pooled_mat();
+    }
+}
+
+/**
+ * \brief Thread-local, size-bucketed pixel buffer pool for cv::Mat
+ *
+ * The image, pixel_mask and depthmap ETL create several Mats per record. Routing them
+ * through this allocator keeps released buffers in per-thread free lists so that in
+ * steady state decoding does not touch malloc at all. Buffer sizes are rounded up to
+ * one of four steps per power of two so that slightly different image sizes share a
+ * bucket. A buffer released on a thread other than the one that allocated it is
+ * returned to the owning pool.
+ */
+class nervana::image::mat_pool : public cv::MatAllocator
+{
+public:
+    struct stats
+    {
+        size_t allocations    = 0; // buffers obtained from the system allocator
+        size_t reuses         = 0; // buffers served from a free list
+        size_t releases       = 0; // buffers returned to a free list or freed
+        size_t bytes_reserved = 0; // bytes of buffers currently owned by the pool
+    };
+
+    static mat_pool& thread_instance();
+    static stats     get_global_stats();
+
+    stats get_stats() const;
+    void  clear();
+
+    static size_t bucket_capacity(size_t size);
+
+#if CV_MAJOR_VERSION == 2
+    void allocate(int        dims,
+                  const int* sizes,
+                  int        type,
+                  int*&      refcount,
+                  uchar*&    datastart,
+                  uchar*&    data,
+                  size_t*    step) override;
+    void deallocate(int* refcount, uchar* datastart, uchar* data) override;
+#else
+    cv::UMatData* allocate(int                dims,
+                           const int*         sizes,
+                           int                type,
+                           void*              data,
+                           size_t*            step,
+                           int                flags,
+                           cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* u, int access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* u) const override;
+#endif
+
+private:
+    class thread_holder;
+
+    mat_pool();
+    ~mat_pool();
+    mat_pool(const mat_pool&) = delete;
+    mat_pool& operator=(const mat_pool&) = delete;
+
+    uchar* acquire(size_t size) const;
+    void   release(uchar* data) const;
+    void   retire();
+
+    static size_t bucket_index(size_t capacity);
+
+    static const size_t m_min_capacity       = 4096;
+    static const size_t m_max_cached_buffers = 8;
+    static const size_t m_bucket_count       = 4 * 64;
+    static const size_t m_header_size        = 64;
+
+    mutable std::mutex                                      m_mutex;
+    mutable std::array<std::vector<uchar*>, m_bucket_count> m_free;
+    mutable stats                                           m_stats;
+    mutable size_t                                          m_outstanding = 0;
+    mutable bool                                            m_retired     = false;
+
+    static std::atomic<size_t> m_global_allocations;
+    static std::atomic<size_t> m_global_reuses;
+    static std::atomic<size_t> m_global_releases;
+};
@@ -14,9 +14,17 @@
 * limitations under the License.
 *******************************************************************************/
 
-#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <smmintrin.h>
+#include <sstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "noise_clips.hpp"
 #include "file_util.hpp"
@@ -24,24 +32,131 @@
 using namespace std;
 using namespace nervana;
 
+// Packed file layout: a header, a table of (byte offset, sample count) per clip, then the
+// 16 bit samples of each clip starting on a 64 byte boundary.
+namespace
+{
+    const char     pack_magic[8]  = {'A', 'E', 'O', 'N', 'N', 'O', 'I', 'S'};
+    const uint32_t pack_version   = 1;
+    const size_t   pack_alignment = 64;
+
+    struct pack_header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t clip_count;
+    };
+
+    struct pack_entry
+    {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    // nanoseconds since the epoch, st_mtime alone cannot order files written within a second
+    int64_t modification_time(const string& filename)
+    {
+        struct stat stats;
+        if (stat(filename.c_str(), &stats) != 0)
+        {
+            return 0;
+        }
+        return int64_t(stats.st_mtim.tv_sec) * 1000000000 + stats.st_mtim.tv_nsec;
+    }
+
+    // Write to a temporary file in the same directory and rename so that concurrent loaders
+    // never map a partially written pack
+    void write_file_atomic(const string& filename, const vector<char>& data)
+    {
+        string       tmp_template = filename + ".XXXXXX";
+        vector<char> tmp_name(tmp_template.begin(), tmp_template.end());
+        tmp_name.push_back(0);
+
+        int fd = mkstemp(tmp_name.data());
+        if (fd == -1)
+        {
+            throw std::runtime_error("noise_clips: could not create " + tmp_template);
+        }
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t rc = write(fd, data.data() + written, data.size() - written);
+            if (rc <= 0)
+            {
+                close(fd);
+                unlink(tmp_name.data());
+                throw std::runtime_error("noise_clips: could not write " + filename);
+            }
+            written += rc;
+        }
+        // mkstemp creates the file private to this user, the pack is shared with other users'
+        // loaders reading the same index
+        if (fchmod(fd, 0644) != 0)
+        {
+            close(fd);
+            unlink(tmp_name.data());
+            throw std::runtime_error("noise_clips: could not write " + filename);
+        }
+        close(fd);
+        if (rename(tmp_name.data(), filename.c_str()) != 0)
+        {
+            unlink(tmp_name.data());
+            throw std::runtime_error("noise_clips: could not rename to " + filename);
+        }
+    }
+}
+
 noise_clips::noise_clips(const std::string noiseIndexFile, const std::string noiseRoot)
 {
-    if (!noiseIndexFile.empty())
+    if (noiseIndexFile.empty())
     {
-        load_index(noiseIndexFile, noiseRoot);
-        load_data();
+        return;
+    }
+
+    if (is_pack(noiseIndexFile))
+    {
+        map_pack(noiseIndexFile);
+        return;
+    }
+
+    // The pack is stale unless it was written after the index and every clip it lists. A tie
+    // means a file system with coarse timestamps and the source may have changed after the pack.
+    string         pack_file   = noiseIndexFile + ".pack";
+    vector<string> noise_files = load_index(noiseIndexFile, noiseRoot);
+    int64_t        newest      = modification_time(noiseIndexFile);
+    for (const string& noise_file : noise_files)
+    {
+        newest = max(newest, modification_time(noise_file));
+    }
+    if (is_pack(pack_file) && modification_time(pack_file) > newest)
+    {
+        map_pack(pack_file);
+        return;
+    }
+
+    m_owned = build_pack(noise_files);
+    try
+    {
+        write_file_atomic(pack_file, m_owned);
+        map_pack(pack_file);
+        vector<char>().swap(m_owned);
+    }
+    catch (const std::exception&)
+    {
+        // read only location, keep the packed clips in this process
+        attach(m_owned.data(), m_owned.size());
     }
 }
 
 noise_clips::~noise_clips()
 {
-    if (_bufLen != 0)
+    if (m_mapped != nullptr)
     {
-        delete[] _buf;
+        munmap(m_mapped, m_mapped_size);
     }
 }
 
-void noise_clips::load_index(const std::string& index_file, const std::string& root_dir)
+vector<string> noise_clips::load_index(const std::string& index_file, const std::string& root_dir)
 {
     ifstream ifs(index_file);
 
@@ -50,24 +165,142 @@ void noise_clips::load_index(const std::string& index_file, const std::string& r
         throw std::runtime_error("Could not open " + index_file);
     }
 
-    string line;
+    vector<string> noise_files;
+    string         line;
     while (getline(ifs, line))
     {
         if (!root_dir.empty())
             line = file_util::path_join(root_dir, line);
-        _noise_files.push_back(line);
+        noise_files.push_back(line);
     }
 
-    if (_noise_files.empty())
+    if (noise_files.empty())
     {
         throw std::runtime_error("No noise files provided in " + index_file);
     }
+    return noise_files;
+}
+
+vector<char> noise_clips::build_pack(const vector<string>& noise_files)
+{
+    vector<cv::Mat> clips;
+    for (const string& noise_file : noise_files)
+    {
+        if (!file_util::exists(noise_file))
+        {
+            throw std::runtime_error("noise_clips: Could not find " + noise_file);
+        }
+        vector<char> contents = file_util::read_file_contents(noise_file);
+        if (contents.empty())
+        {
+            throw std::runtime_error("noise_clips:  Could not read " + noise_file);
+        }
+        clips.push_back(read_audio_from_mem(contents.data(), contents.size()));
+        affirm(clips.back().type() == CV_16SC1, "noise type is not 16 bit signed");
+        affirm(clips.back().total() > 0, "noise clip is empty: " + noise_file);
+    }
+
+    size_t             offset = sizeof(pack_header) + clips.size() * sizeof(pack_entry);
+    vector<pack_entry> entries;
+    for (const cv::Mat& clip : clips)
+    {
+        offset = (offset + pack_alignment - 1) / pack_alignment * pack_alignment;
+        entries.push_back({offset, clip.total()});
+        offset += clip.total() * sizeof(int16_t);
+    }
+
+    vector<char> pack(offset, 0);
+    pack_header  header;
+    memcpy(header.magic, pack_magic, sizeof(pack_magic));
+    header.version    = pack_version;
+    header.clip_count = clips.size();
+    memcpy(pack.data(), &header, sizeof(header));
+    memcpy(pack.data() + sizeof(header), entries.data(), entries.size() * sizeof(pack_entry));
+    for (size_t i = 0; i < clips.size(); i++)
+    {
+        cv::Mat clip = clips[i].isContinuous() ? clips[i] : clips[i].clone();
+        memcpy(pack.data() + entries[i].offset, clip.data, entries[i].count * sizeof(int16_t));
+    }
+    return pack;
+}
+
+void noise_clips::write_pack(const std::string& index_file,
+                             const std::string& root_dir,
+                             const std::string& pack_file)
+{
+    write_file_atomic(pack_file, build_pack(load_index(index_file, root_dir)));
+}
+
+bool noise_clips::is_pack(const std::string& filename)
+{
+    char     magic[sizeof(pack_magic)];
+    ifstream ifs(filename, ios::binary);
+    return ifs.read(magic, sizeof(magic)) && memcmp(magic, pack_magic, sizeof(magic)) == 0;
+}
+
+void noise_clips::map_pack(const std::string& pack_file)
+{
+    int fd = open(pack_file.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        throw std::runtime_error("noise_clips: Could not open " + pack_file);
+    }
+    struct stat stats;
+    if (fstat(fd, &stats) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("noise_clips: Could not stat " + pack_file);
+    }
+    size_t size = stats.st_size;
+    void*  data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("noise_clips: Could not map " + pack_file);
+    }
+
+    try
+    {
+        attach(static_cast<const char*>(data), size);
+    }
+    catch (const std::exception&)
+    {
+        munmap(data, size);
+        throw;
+    }
+    m_mapped      = data;
+    m_mapped_size = size;
+}
+
+void noise_clips::attach(const char* data, size_t size)
+{
+    affirm(size >= sizeof(pack_header), "noise pack is truncated");
+    pack_header header;
+    memcpy(&header, data, sizeof(header));
+    affirm(memcmp(header.magic, pack_magic, sizeof(pack_magic)) == 0, "not a noise pack");
+    affirm(header.version == pack_version, "unsupported noise pack version");
+    affirm(header.clip_count > 0, "noise pack has no clips");
+    affirm(size >= sizeof(header) + header.clip_count * sizeof(pack_entry),
+           "noise pack is truncated");
+
+    const pack_entry* entries = reinterpret_cast<const pack_entry*>(data + sizeof(header));
+    vector<clip>      clips;
+    for (uint32_t i = 0; i < header.clip_count; i++)
+    {
+        const pack_entry& entry = entries[i];
+        affirm(entry.count > 0 && entry.offset % sizeof(int16_t) == 0 &&
+                   entry.offset + entry.count * sizeof(int16_t) <= size,
+               "noise pack entry out of range");
+        clips.push_back({reinterpret_cast<const int16_t*>(data + entry.offset), entry.count});
+    }
+    m_clips.swap(clips);
 }
 
 // From Factory, get add_noise, offset (frac), noise index, noise level
 /** \brief Add noise to a sound waveform
 *
-*
+* Noise is mixed directly into wav_mat, wrapping around the noise clip as often as needed
+* to cover the whole input.
 */
 void noise_clips::addNoise(cv::Mat& wav_mat,
                            bool     add_noise,
@@ -76,7 +309,7 @@ void noise_clips::addNoise(cv::Mat& wav_mat,
                            float    noise_level)
 {
     // No-op if we have no noise files or randomly not adding noise on this datum
-    if (!add_noise || _noise_data.empty())
+    if (!add_noise || m_clips.empty())
     {
         return;
     }
@@ -84,75 +317,56 @@ void noise_clips::addNoise(cv::Mat& wav_mat,
     // Assume a single channel with 16 bit samples for now.
     affirm(wav_mat.cols == 1, "wav samples more than one column");
     affirm(wav_mat.type() == CV_16SC1, "wav not 16 bit signed");
+    affirm(wav_mat.isContinuous(), "wav samples not continuous");
 
-    // Collect enough noise data to cover the entire input clip.
-    cv::Mat        noise_dst = cv::Mat::zeros(wav_mat.size(), wav_mat.type());
-    const cv::Mat& noise_src = _noise_data[noise_index % _noise_data.size()];
-
-    affirm(noise_src.type() == wav_mat.type(), "noise type does not match wav type");
-
-    uint32_t src_offset = noise_src.rows * noise_offset_fraction;
-    uint32_t src_left   = noise_src.rows - src_offset;
-    uint32_t dst_offset = 0;
-    uint32_t dst_left   = wav_mat.rows;
+    const clip& noise      = m_clips[noise_index % m_clips.size()];
+    size_t      src_offset = std::min<size_t>(noise.count * noise_offset_fraction, noise.count);
+    int16_t*    dst        = wav_mat.ptr<int16_t>();
+    size_t      dst_left   = wav_mat.rows;
 
     while (dst_left > 0)
     {
-        uint32_t copy_size = std::min(dst_left, src_left);
-        cv::Rect src_roi   = cv::Rect(cv::Point2i(0, src_offset), cv::Size2i(1, copy_size));
-        cv::Rect dst_roi   = cv::Rect(cv::Point2i(0, dst_offset), cv::Size2i(1, copy_size));
-
-        noise_src(src_roi).copyTo(noise_dst(dst_roi));
-
-        if (src_left > dst_left)
+        if (src_offset == noise.count)
         {
-            dst_left = 0;
-        }
-        else
-        {
-            dst_left -= copy_size;
-            dst_offset += copy_size;
-            src_left   = noise_src.rows;
             src_offset = 0; // loop around
         }
-    }
-    // Superimpose noise without overflowing (opencv handles saturation cast for non CV_32S)
-    cv::addWeighted(wav_mat, 1.0f, noise_dst, noise_level, 0.0f, wav_mat);
-}
-
-void noise_clips::load_data()
-{
-    for (auto nfile : _noise_files)
-    {
-        int len = 0;
-        read_noise(nfile, &len);
-        _noise_data.push_back(read_audio_from_mem(_buf, len));
+        size_t count = std::min(dst_left, noise.count - src_offset);
+        mix(dst, noise.samples + src_offset, count, noise_level);
+        dst += count;
+        dst_left -= count;
+        src_offset += count;
     }
 }
 
-void noise_clips::read_noise(std::string& noise_file, int* dataLen)
+void noise_clips::mix(int16_t* dst, const int16_t* noise, size_t count, float level)
 {
-    struct stat stats;
-    int         result = stat(noise_file.c_str(), &stats);
-    if (result == -1)
+    // Same result as cv::addWeighted(dst, 1, noise, level, 0, dst) on 16 bit samples
+    const __m128 scale = _mm_set1_ps(level);
+    const __m128 lower = _mm_set1_ps(INT16_MIN);
+    const __m128 upper = _mm_set1_ps(INT16_MAX);
+    size_t       i     = 0;
+    for (; i + 8 <= count; i += 8)
     {
-        throw std::runtime_error("noise_clips: Could not find " + noise_file);
-    }
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i*>(noise + i));
 
-    off_t size = stats.st_size;
-    if (_bufLen < size)
-    {
-        delete[] _buf;
-        _buf    = new char[size + size / 8];
-        _bufLen = size + size / 8;
-    }
+        __m128 w_lo = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(w));
+        __m128 w_hi = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(w, 8)));
+        __m128 n_lo = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(n));
+        __m128 n_hi = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(n, 8)));
 
-    std::ifstream ifs(noise_file, std::ios::binary);
-    ifs.read(_buf, size);
+        __m128 lo = _mm_add_ps(w_lo, _mm_mul_ps(n_lo, scale));
+        __m128 hi = _mm_add_ps(w_hi, _mm_mul_ps(n_hi, scale));
+        lo        = _mm_min_ps(_mm_max_ps(lo, lower), upper);
+        hi        = _mm_min_ps(_mm_max_ps(hi, lower), upper);
 
-    if (size == 0)
+        __m128i mixed = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), mixed);
+    }
+    for (; i < count; i++)
     {
-        throw std::runtime_error("noise_clips:  Could not read " + noise_file);
+        float value = dst[i] + noise[i] * level;
+        value       = std::min<float>(std::max<float>(value, INT16_MIN), INT16_MAX);
+        dst[i]      = static_cast<int16_t>(lrintf(value));
     }
-    *dataLen = size;
 }
@@ -24,6 +24,17 @@ namespace nervana
     class noise_clips;
 }
 
+/**
+ * \brief Library of noise clips mixed into audio records
+ *
+ * All clips live in one packed file of 16 bit samples that is memory mapped read only, so
+ * every loader and process on a host shares the same page cache copy and no loader but the
+ * first decodes audio. noise_index_file may name a packed file directly, which is mapped
+ * without further checks. If it is a text index of audio files instead, the clips are decoded
+ * once and the packed file is written next to the index as <noise_index_file>.pack; later
+ * loaders map that file as long as it is newer than the index and every clip it lists, which
+ * costs a stat of each clip at startup.
+ */
 class nervana::noise_clips
 {
 public:
@@ -35,14 +46,34 @@ public:
                   float    noise_offset_fraction,
                   float    noise_level);
 
-private:
-    void load_index(const std::string& index_file, const std::string& root_dir);
-    void load_data();
-    void read_noise(std::string& noise_file, int* dataLen);
+    size_t size() const { return m_clips.size(); }
+    // true when the clips are served from a memory mapped packed file
+    bool is_mapped() const { return m_mapped != nullptr; }
+
+    // Decodes the audio files listed in index_file and writes them as a packed file
+    static void write_pack(const std::string& index_file,
+                           const std::string& root_dir,
+                           const std::string& pack_file);
+    static bool is_pack(const std::string& filename);
+
+    // dst[i] = saturate(dst[i] + noise[i] * level), rounding to nearest
+    static void mix(int16_t* dst, const int16_t* noise, size_t count, float level);
 
 private:
-    std::vector<cv::Mat>     _noise_data;
-    std::vector<std::string> _noise_files;
-    char*                    _buf    = 0;
-    int                      _bufLen = 0;
+    struct clip
+    {
+        const int16_t* samples;
+        size_t         count;
+    };
+
+    static std::vector<std::string> load_index(const std::string& index_file,
+                                               const std::string& root_dir);
+    static std::vector<char> build_pack(const std::vector<std::string>& noise_files);
+    void map_pack(const std::string& pack_file);
+    void attach(const char* data, size_t size);
+
+    std::vector<clip> m_clips;
+    std::vector<char> m_owned;                 // packed clips when the pack could not be written
+    void*             m_mapped      = nullptr; // mmap of the packed file
+    size_t            m_mapped_size = 0;
 };
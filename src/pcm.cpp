@@ -0,0 +1,223 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <smmintrin.h>
+
+#include "pcm.hpp"
+#include "util.hpp"
+#include "wav_data.hpp"
+
+using namespace std;
+using namespace nervana;
+
+bool pcm::parse_wav(const char* buf, size_t size, format& fmt)
+{
+    RiffMainHeader rh;
+    if (size < sizeof(rh))
+    {
+        return false;
+    }
+    memcpy(&rh, buf, sizeof(rh));
+    if (rh.dwRiffCC != FOURCC('R', 'I', 'F', 'F') || rh.dwWaveID != FOURCC('W', 'A', 'V', 'E'))
+    {
+        return false;
+    }
+
+    bool   have_fmt = false;
+    size_t pos      = sizeof(rh);
+    while (pos + sizeof(DataHeader) <= size)
+    {
+        DataHeader chunk;
+        memcpy(&chunk, buf + pos, sizeof(chunk));
+        size_t body   = pos + sizeof(chunk);
+        size_t length = min<size_t>(chunk.dwDataLen, size - body);
+
+        if (chunk.dwDataCC == FOURCC('f', 'm', 't', ' '))
+        {
+            FmtHeader fh;
+            if (pos + sizeof(fh) > size || chunk.dwDataLen < 16)
+            {
+                return false;
+            }
+            memcpy(&fh, buf + pos, sizeof(fh));
+            uint16_t tag = fh.hwFmtTag;
+            if (tag == wav_data::WAVE_FORMAT_EXTENSIBLE && chunk.dwDataLen >= 40 &&
+                body + 24 + sizeof(tag) <= size)
+            {
+                // the sub format GUID starts with the format tag
+                memcpy(&tag, buf + body + 24, sizeof(tag));
+            }
+            if (tag != wav_data::WAVE_FORMAT_PCM || fh.hwBitDepth != 16 || fh.hwChannels == 0 ||
+                fh.hwBlockAlign != 2 * fh.hwChannels || fh.dwSampleRate == 0)
+            {
+                return false;
+            }
+            fmt.channels    = fh.hwChannels;
+            fmt.sample_rate = fh.dwSampleRate;
+            have_fmt        = true;
+        }
+        else if (chunk.dwDataCC == FOURCC('d', 'a', 't', 'a'))
+        {
+            if (!have_fmt)
+            {
+                return false;
+            }
+            fmt.samples = buf + body;
+            fmt.frames  = length / (2 * fmt.channels);
+            return true;
+        }
+        // chunks are padded to an even size
+        pos = body + chunk.dwDataLen + (chunk.dwDataLen & 1);
+    }
+    return false;
+}
+
+cv::Mat pcm::read(const char* buf, size_t size, uint32_t sample_rate_hz, bool& borrowed)
+{
+    borrowed = false;
+
+    format fmt;
+    if (!parse_wav(buf, size, fmt))
+    {
+        uint32_t rate    = 0;
+        cv::Mat  samples = read_audio_from_mem(buf, size, &rate);
+        if (sample_rate_hz == 0 || rate == sample_rate_hz || rate == 0)
+        {
+            return samples;
+        }
+        cv::Mat resampled(resampled_length(samples.rows, rate, sample_rate_hz), 1, CV_16SC1);
+        resample(samples.ptr<int16_t>(),
+                 samples.rows,
+                 rate,
+                 sample_rate_hz,
+                 resampled.ptr<int16_t>());
+        return resampled;
+    }
+
+    bool    same_rate = sample_rate_hz == 0 || sample_rate_hz == fmt.sample_rate;
+    bool    aligned   = reinterpret_cast<uintptr_t>(fmt.samples) % alignof(int16_t) == 0;
+    cv::Mat interleaved(fmt.frames, fmt.channels, CV_16SC1, const_cast<char*>(fmt.samples));
+    if (!aligned)
+    {
+        interleaved = interleaved.clone();
+    }
+    else if (fmt.channels == 1 && same_rate)
+    {
+        borrowed = true;
+        return interleaved;
+    }
+
+    cv::Mat mono = interleaved;
+    if (fmt.channels > 1)
+    {
+        mono.create(fmt.frames, 1, CV_16SC1);
+        downmix(interleaved.ptr<int16_t>(), fmt.channels, fmt.frames, mono.ptr<int16_t>());
+    }
+    if (same_rate)
+    {
+        return mono;
+    }
+
+    size_t  length = resampled_length(fmt.frames, fmt.sample_rate, sample_rate_hz);
+    cv::Mat resampled(length, 1, CV_16SC1);
+    resample(mono.ptr<int16_t>(),
+             fmt.frames,
+             fmt.sample_rate,
+             sample_rate_hz,
+             resampled.ptr<int16_t>());
+    return resampled;
+}
+
+void pcm::downmix(const int16_t* in, int channels, size_t frames, int16_t* out)
+{
+    size_t i = 0;
+    if (channels == 2)
+    {
+        // madd against ones sums each left/right pair into 32 bits
+        const __m128i ones = _mm_set1_epi16(1);
+        for (; i + 8 <= frames; i += 8)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 8));
+            a         = _mm_srai_epi32(_mm_madd_epi16(a, ones), 1);
+            b         = _mm_srai_epi32(_mm_madd_epi16(b, ones), 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+        }
+    }
+    for (; i < frames; i++)
+    {
+        const int16_t* frame = in + i * channels;
+        int32_t        sum   = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            sum += frame[c];
+        }
+        out[i] = static_cast<int16_t>(floor(double(sum) / channels));
+    }
+}
+
+size_t pcm::resampled_length(size_t frames, uint32_t from_hz, uint32_t to_hz)
+{
+    return static_cast<size_t>(uint64_t(frames) * to_hz / from_hz);
+}
+
+void pcm::resample(
+    const int16_t* in, size_t frames, uint32_t from_hz, uint32_t to_hz, int16_t* out)
+{
+    size_t out_frames = resampled_length(frames, from_hz, to_hz);
+    if (frames == 0 || out_frames == 0)
+    {
+        return;
+    }
+
+    // Output sample i sits at input position i * from_hz / to_hz. Positions are kept as exact
+    // integer fractions so long clips do not drift.
+    auto sample_at = [&](size_t i, float& a, float& b, float& frac) {
+        uint64_t pos   = uint64_t(i) * from_hz;
+        size_t   index = pos / to_hz;
+        size_t   next  = min(index + 1, frames - 1);
+        a              = in[index];
+        b              = in[next];
+        frac           = float(pos % to_hz) / to_hz;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= out_frames; i += 8)
+    {
+        alignas(16) float a[8], b[8], frac[8];
+        for (int k = 0; k < 8; k++)
+        {
+            sample_at(i + k, a[k], b[k], frac[k]);
+        }
+        __m128 a_lo = _mm_load_ps(a);
+        __m128 a_hi = _mm_load_ps(a + 4);
+        __m128 d_lo = _mm_sub_ps(_mm_load_ps(b), a_lo);
+        __m128 d_hi = _mm_sub_ps(_mm_load_ps(b + 4), a_hi);
+        __m128 lo   = _mm_add_ps(a_lo, _mm_mul_ps(_mm_load_ps(frac), d_lo));
+        __m128 hi   = _mm_add_ps(a_hi, _mm_mul_ps(_mm_load_ps(frac + 4), d_hi));
+
+        __m128i mixed = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), mixed);
+    }
+    for (; i < out_frames; i++)
+    {
+        float a, b, frac;
+        sample_at(i, a, b, frac);
+        out[i] = static_cast<int16_t>(lrintf(a + frac * (b - a)));
+    }
+}
@@ -0,0 +1,66 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <opencv2/core/core.hpp>
+
+namespace nervana
+{
+    class pcm;
+}
+
+/**
+ * \brief Audio decoding with a native path for 16 bit PCM WAV
+ *
+ * 16 bit PCM WAV payloads are read straight from the record buffer; a mono payload at the
+ * requested rate is wrapped in a Mat without copying. Multichannel audio is down-mixed and
+ * audio at another rate is resampled with SIMD kernels. Every other codec goes through sox.
+ */
+class nervana::pcm
+{
+public:
+    pcm()          = delete;
+    virtual ~pcm() = delete;
+
+    struct format
+    {
+        uint16_t    channels    = 0;
+        uint32_t    sample_rate = 0;
+        const char* samples     = nullptr; // interleaved 16 bit samples
+        size_t      frames      = 0;
+    };
+
+    // Parses a RIFF/WAVE buffer holding 16 bit integer PCM. Returns false for any other
+    // content so that the caller can fall back to sox.
+    static bool parse_wav(const char* buf, size_t size, format& fmt);
+
+    // Decodes audio into a single column CV_16SC1 Mat, resampled to sample_rate_hz unless it
+    // is zero. borrowed is set when the Mat points into buf rather than owning its samples.
+    static cv::Mat read(const char* buf, size_t size, uint32_t sample_rate_hz, bool& borrowed);
+
+    // out[i] is the mean of the channels of frame i, rounded toward negative infinity
+    static void downmix(const int16_t* in, int channels, size_t frames, int16_t* out);
+
+    // Linear interpolation from from_hz to to_hz, out must hold resampled_length() samples
+    static void resample(const int16_t* in,
+                         size_t         frames,
+                         uint32_t       from_hz,
+                         uint32_t       to_hz,
+                         int16_t*       out);
+    static size_t resampled_length(size_t frames, uint32_t from_hz, uint32_t to_hz);
+};
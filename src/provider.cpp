@@ -15,17 +15,38 @@
 *******************************************************************************/
 
 #include <sstream>
+#include <cstring>
 
 #include "provider.hpp"
+#include "pcm.hpp"
 
 using namespace std;
 using namespace nervana;
 
 provider::provider_base::provider_base(nlohmann::json                     js,
                                        const std::vector<nlohmann::json>& etl,
-                                       nlohmann::json                     augmentation)
+                                       nlohmann::json                     augmentation,
+                                       uint32_t                           view_count,
+                                       const std::string&                 view_layout)
     : provider_interface(js, etl.size())
+    , m_view_count{view_count}
+    , m_views_in_batch{view_layout == "batch"}
 {
+    if (m_view_count == 0)
+    {
+        throw invalid_argument("augmentation_views must be at least 1");
+    }
+    if (view_layout != "batch" && view_layout != "slots")
+    {
+        throw invalid_argument("augmentation_view_layout must be one of batch or slots");
+    }
+    vector<string> view_suffixes;
+    for (uint32_t k = 0; k < m_view_count; k++)
+    {
+        // in batch layout all views share the buffers of the record
+        view_suffixes.push_back(m_views_in_batch ? "" : "_view" + to_string(k));
+    }
+
     for (nlohmann::json j : etl)
     {
         string type;
@@ -91,11 +112,6 @@ provider::provider_base::provider_base(nlohmann::json                     js,
         {
             prov = static_pointer_cast<provider::interface>(make_shared<provider::label_map>(j));
         }
-        // else if (type == "multicrop")
-        // {
-        //     prov = static_pointer_cast<provider::interface>(
-        //         make_shared<provider::multicrop>(j, augmentation));
-        // }
         else
         {
             stringstream ss;
@@ -104,23 +120,95 @@ provider::provider_base::provider_base(nlohmann::json                     js,
         }
         if (prov)
         {
+            // Output buffer maps are built from m_output_shapes, so the position of a shape is
+            // the slot of its buffer
+            const auto& shapes = prov->get_output_shapes();
+            size_t      first  = m_output_shapes.size();
+            binding     bound{prov.get(), shapes.size(), {}};
+            bound.slots.resize(m_view_count * shapes.size());
+            for (uint32_t k = 0; k < m_view_count; k++)
+            {
+                for (size_t n = 0; n < shapes.size(); n++)
+                {
+                    bound.slots[k * shapes.size() + n] =
+                        m_views_in_batch ? first + n : first + n * m_view_count + k;
+                }
+            }
             m_providers.push_back(prov);
-            auto os = prov->get_output_shapes();
-            m_output_shapes.insert(m_output_shapes.end(), os.begin(), os.end());
+            m_bindings.push_back(bound);
+
+            if (m_views_in_batch)
+            {
+                m_output_shapes.insert(m_output_shapes.end(), shapes.begin(), shapes.end());
+            }
+            else
+            {
+                for (auto& os : shapes)
+                {
+                    for (const string& suffix : view_suffixes)
+                    {
+                        m_output_shapes.emplace_back(os.first + suffix, os.second);
+                    }
+                }
+            }
         }
     }
 }
 
 void provider::provider_base::provide(int                           idx,
                                       nervana::encoded_record_list& in_buf,
-                                      nervana::fixed_buffer_map&    out_buf) const
+                                      nervana::fixed_buffer_map&    out_buf,
+                                      int                           out_idx) const
+{
+    if (m_checked_buffers.load() != &out_buf)
+    {
+        check_buffer_names(out_buf);
+        m_checked_buffers.store(&out_buf);
+    }
+
+    vector<provider::view> views;
+    views.reserve(m_view_count);
+    for (uint32_t k = 0; k < m_view_count; k++)
+    {
+        views.emplace_back(m_views_in_batch ? out_idx * m_view_count + k : out_idx);
+    }
+
+    encoded_record& record = in_buf.record(idx);
+    for (size_t element = 0; element < m_bindings.size(); element++)
+    {
+        const binding& bound = m_bindings[element];
+        for (uint32_t k = 0; k < m_view_count; k++)
+        {
+            views[k].slots = &bound.slots[k * bound.output_count];
+        }
+        bound.provider->provide(record.element(element), out_buf, views);
+    }
+}
+
+void provider::provider_base::check_buffer_names(const fixed_buffer_map& out_buf) const
+{
+    // buffers are written by position, a map in another order would get data in the wrong slots
+    const vector<string>& names   = out_buf.get_names();
+    bool                  matches = names.size() == m_output_shapes.size();
+    for (size_t slot = 0; matches && slot < names.size(); slot++)
+    {
+        matches = names[slot] == m_output_shapes[slot].first;
+    }
+    if (!matches)
+    {
+        throw invalid_argument("output buffers must be built from the provider output shapes");
+    }
+}
+
+bool provider::provider_base::get_length_key(const encoded_record& record,
+                                             size_t                element,
+                                             uint32_t&             key) const
 {
-    augmentation aug;
-    int          index = 0;
-    for (const shared_ptr<provider::interface>& provider : m_providers)
+    if (element >= m_providers.size() || element >= record.size())
     {
-        provider->provide(idx, in_buf.record(idx).element(index++), out_buf, aug);
+        return false;
     }
+    return m_providers[element]->probe_length(record.element(element), key);
 }
 
 //=================================================================================================
@@ -159,29 +247,30 @@ provider::image::image(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::image::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
+void provider::image::provide(const std::vector<char>&   datum_in,
                               nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+                              vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received encoded image with size 0, at idx " << idx;
+        ss << "received encoded image with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     // Process image data
     auto decoded    = m_extractor.extract(datum_in.data(), datum_in.size());
     auto input_size = decoded->get_image_size();
-    if (aug.m_image_augmentations == nullptr)
+    for (view& v : views)
     {
-        aug.m_image_augmentations = m_augmentation_factory.make_params(
-            input_size.width, input_size.height, m_config.width, m_config.height);
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        if (v.aug.m_image_augmentations == nullptr)
+        {
+            v.aug.m_image_augmentations = m_augmentation_factory.make_params(
+                input_size.width, input_size.height, m_config.width, m_config.height);
+        }
+        m_loader.load({datum_out}, m_transformer.transform(v.aug.m_image_augmentations, decoded));
     }
-    m_loader.load({datum_out}, m_transformer.transform(aug.m_image_augmentations, decoded));
 }
 
 //=================================================================================================
@@ -198,22 +287,39 @@ provider::label::label(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::label::provide(int                        idx,
-                              const vector<char>&        datum_in,
+void provider::label::provide(const vector<char>&        datum_in,
                               nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+                              vector<view>&              views) const
 {
-    char* target_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received encoded image with size 0, at idx " << idx;
+        ss << "received encoded image with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto label_dec = m_extractor.extract(datum_in.data(), datum_in.size());
-    m_loader.load({target_out}, label_dec);
+    for (const view& v : views)
+    {
+        char* target_out = out_buf.at(v.slots[0])->get_item(v.index);
+        m_loader.load({target_out}, label_dec);
+    }
+}
+
+bool provider::label::probe_length(const vector<char>& datum_in, uint32_t& length) const
+{
+    // a label column may carry a precomputed length, e.g. the duration of an utterance
+    if (datum_in.size() == 0)
+    {
+        return false;
+    }
+    int value = m_extractor.extract(datum_in.data(), datum_in.size())->get_index();
+    if (value < 0)
+    {
+        return false;
+    }
+    length = value;
+    return true;
 }
 
 //=================================================================================================
@@ -223,7 +329,7 @@ void provider::label::provide(int                        idx,
 provider::audio::audio(nlohmann::json js, nlohmann::json aug)
     : interface(js, 1)
     , m_config{js}
-    , m_extractor{}
+    , m_extractor{m_config}
     , m_transformer{m_config}
     , m_loader{m_config}
     , m_augmentation_factory{aug}
@@ -238,35 +344,70 @@ provider::audio::audio(nlohmann::json js, nlohmann::json aug)
     }
 }
 
-void provider::audio::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
+void provider::audio::provide(const std::vector<char>&   datum_in,
                               nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+                              vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     // Process audio data
     auto decoded = m_extractor.extract(datum_in.data(), datum_in.size());
-    shared_ptr<augment::audio::params> params;
-    if (aug.m_audio_augmentations)
+    for (size_t i = 0; i < views.size(); i++)
     {
-        params = aug.m_audio_augmentations;
+        view&                       v         = views[i];
+        buffer_fixed_size_elements* buffer    = out_buf.at(v.slots[0]);
+        char*                       datum_out = buffer->get_item(v.index);
+
+        shared_ptr<augment::audio::params> params;
+        if (v.aug.m_audio_augmentations)
+        {
+            params = v.aug.m_audio_augmentations;
+        }
+        else
+        {
+            params                      = m_augmentation_factory.make_params();
+            v.aug.m_audio_augmentations = params;
+        }
+
+        // the transformer works in place, so every view but the last gets its own samples
+        auto source = decoded;
+        if (i + 1 < views.size())
+        {
+            source = make_shared<nervana::audio::decoded>(decoded->get_time_data().clone());
+        }
+        auto transformed = m_transformer.transform(params, source);
+        buffer->set_item_extent(v.index, transformed->valid_frames);
+        if (m_config.emit_length)
+        {
+            char* length_out = out_buf.at(v.slots[1])->get_item(v.index);
+            m_loader.load({datum_out, length_out}, transformed);
+        }
+        else
+        {
+            m_loader.load({datum_out}, transformed);
+        }
     }
-    else
+}
+
+bool provider::audio::probe_length(const vector<char>& datum_in, uint32_t& length) const
+{
+    // only the WAV header is read; other codecs would need a full decode
+    pcm::format fmt;
+    if (!pcm::parse_wav(datum_in.data(), datum_in.size(), fmt))
     {
-        params                    = m_augmentation_factory.make_params();
-        aug.m_audio_augmentations = params;
+        return false;
     }
-    auto transformed = m_transformer.transform(params, decoded);
-    if (m_config.emit_length)
+    size_t samples = fmt.frames;
+    if (m_config.resample && fmt.sample_rate != m_config.sample_freq_hz)
     {
-        char* length_out = out_buf[m_length_name]->get_item(idx);
-        m_loader.load({datum_out, length_out}, transformed);
+        samples = pcm::resampled_length(fmt.frames, fmt.sample_rate, m_config.sample_freq_hz);
     }
-    else
+
+    size_t steps = 0;
+    if (samples >= m_config.frame_length_tn)
     {
-        m_loader.load({datum_out}, transformed);
+        steps = (samples - m_config.frame_length_tn) / m_config.frame_stride_tn + 1;
     }
+    length = std::min<size_t>(steps, m_config.time_steps);
+    return true;
 }
 
 //=================================================================================================
@@ -304,39 +445,43 @@ provider::localization::rcnn::rcnn(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_difficult_flag_buffer_name, os[9]));
 }
 
-void provider::localization::rcnn::provide(int                        idx,
-                                           const std::vector<char>&   datum_in,
+void provider::localization::rcnn::provide(const std::vector<char>&   datum_in,
                                            nervana::fixed_buffer_map& out_buf,
-                                           augmentation&              aug) const
+                                           vector<view>&              views) const
 {
-    vector<void*> output_list = {out_buf[m_bbtargets_buffer_name]->get_item(idx),
-                                 out_buf[m_bbtargets_mask_buffer_name]->get_item(idx),
-                                 out_buf[m_labels_flat_buffer_name]->get_item(idx),
-                                 out_buf[m_labels_mask_buffer_name]->get_item(idx),
-                                 out_buf[m_image_shape_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_boxes_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_box_count_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_class_count_buffer_name]->get_item(idx),
-                                 out_buf[m_image_scale_buffer_name]->get_item(idx),
-                                 out_buf[m_difficult_flag_buffer_name]->get_item(idx)};
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received localization_rcnn data with size 0, at idx " << idx;
+        ss << "received localization_rcnn data with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded = m_extractor.extract(datum_in.data(), datum_in.size());
     if (decoded)
     {
-        if (aug.m_image_augmentations == nullptr)
+        for (view& v : views)
         {
-            auto input_size           = decoded->input_image_size;
-            aug.m_image_augmentations = m_augmentation_factory.make_params(
-                input_size.width, input_size.height, m_config.width, m_config.height);
+            vector<void*> output_list = {
+                out_buf.at(v.slots[0])->get_item(v.index),
+                out_buf.at(v.slots[1])->get_item(v.index),
+                out_buf.at(v.slots[2])->get_item(v.index),
+                out_buf.at(v.slots[3])->get_item(v.index),
+                out_buf.at(v.slots[4])->get_item(v.index),
+                out_buf.at(v.slots[5])->get_item(v.index),
+                out_buf.at(v.slots[6])->get_item(v.index),
+                out_buf.at(v.slots[7])->get_item(v.index),
+                out_buf.at(v.slots[8])->get_item(v.index),
+                out_buf.at(v.slots[9])->get_item(v.index)};
+
+            if (v.aug.m_image_augmentations == nullptr)
+            {
+                auto input_size             = decoded->input_image_size;
+                v.aug.m_image_augmentations = m_augmentation_factory.make_params(
+                    input_size.width, input_size.height, m_config.width, m_config.height);
+            }
+            m_loader.load(output_list,
+                          m_transformer.transform(v.aug.m_image_augmentations, decoded));
         }
-        m_loader.load(output_list, m_transformer.transform(aug.m_image_augmentations, decoded));
     }
 }
 
@@ -365,21 +510,14 @@ provider::localization::ssd::ssd(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_difficult_flag_buffer_name, os[4]));
 }
 
-void provider::localization::ssd::provide(int                        idx,
-                                          const std::vector<char>&   datum_in,
+void provider::localization::ssd::provide(const std::vector<char>&   datum_in,
                                           nervana::fixed_buffer_map& out_buf,
-                                          augmentation&              aug) const
+                                          vector<view>&              views) const
 {
-    vector<void*> output_list = {out_buf[m_image_shape_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_boxes_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_box_count_buffer_name]->get_item(idx),
-                                 out_buf[m_gt_class_count_buffer_name]->get_item(idx),
-                                 out_buf[m_difficult_flag_buffer_name]->get_item(idx)};
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received localization_ssd data with size 0, at idx " << idx;
+        ss << "received localization_ssd data with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
@@ -387,16 +525,28 @@ void provider::localization::ssd::provide(int                        idx,
         m_extractor.extract(datum_in.data(), datum_in.size());
     if (decoded)
     {
-        if (aug.m_image_augmentations == nullptr)
+        for (view& v : views)
         {
-            auto input_size           = decoded->input_image_size;
-            aug.m_image_augmentations = m_augmentation_factory.make_ssd_params(input_size.width,
-                                                                               input_size.height,
-                                                                               m_config.width,
-                                                                               m_config.height,
-                                                                               decoded->boxes());
+            vector<void*> output_list = {
+                out_buf.at(v.slots[0])->get_item(v.index),
+                out_buf.at(v.slots[1])->get_item(v.index),
+                out_buf.at(v.slots[2])->get_item(v.index),
+                out_buf.at(v.slots[3])->get_item(v.index),
+                out_buf.at(v.slots[4])->get_item(v.index)};
+
+            if (v.aug.m_image_augmentations == nullptr)
+            {
+                auto input_size             = decoded->input_image_size;
+                v.aug.m_image_augmentations = m_augmentation_factory.make_ssd_params(
+                    input_size.width,
+                    input_size.height,
+                    m_config.width,
+                    m_config.height,
+                    decoded->boxes());
+            }
+            m_loader.load(output_list,
+                          m_transformer.transform(v.aug.m_image_augmentations, decoded));
         }
-        m_loader.load(output_list, m_transformer.transform(aug.m_image_augmentations, decoded));
     }
 }
 
@@ -416,34 +566,54 @@ provider::pixelmask::pixelmask(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::pixelmask::provide(int                        idx,
-                                  const std::vector<char>&   datum_in,
+void provider::pixelmask::provide(const std::vector<char>&   datum_in,
                                   nervana::fixed_buffer_map& out_buf,
-                                  augmentation&              aug) const
+                                  vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received pixelmask with size 0, at idx " << idx;
+        ss << "received pixelmask with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded    = m_extractor.extract(datum_in.data(), datum_in.size());
     auto input_size = decoded->get_image_size();
-    shared_ptr<augment::image::params> params;
-    if (aug.m_image_augmentations)
+    for (view& v : views)
     {
-        params = aug.m_image_augmentations;
-    }
-    else
-    {
-        params = m_augmentation_factory.make_params(
-            input_size.width, input_size.height, m_config.width, m_config.height);
-        aug.m_image_augmentations = params;
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        shared_ptr<augment::image::params> params;
+        if (v.aug.m_image_augmentations)
+        {
+            params = v.aug.m_image_augmentations;
+        }
+        else
+        {
+            params = m_augmentation_factory.make_params(
+                input_size.width, input_size.height, m_config.width, m_config.height);
+            v.aug.m_image_augmentations = params;
+        }
+
+        // A single channel mask that already has the output type is warped straight into the
+        // output buffer, which has the same layout in either channel order.
+        const cv::Mat& mask    = decoded->get_image(0);
+        int            cv_type = m_config.get_shape_type().get_otype().get_cv_type();
+        bool           direct  = !m_augmentation_factory.fixed_aspect_ratio &&
+                        m_config.channels == 1 && mask.type() == cv_type &&
+                        params->output_size == cv::Size2i(m_config.width, m_config.height);
+#ifdef PYTHON_PLUGIN
+        direct = direct && !params->user_plugin;
+#endif
+        if (direct)
+        {
+            cv::Mat target(params->output_size, cv_type, datum_out);
+            m_transformer.transform(*params, mask, target);
+        }
+        else
+        {
+            m_loader.load({datum_out}, m_transformer.transform(params, decoded));
+        }
     }
-    m_loader.load({datum_out}, m_transformer.transform(params, decoded));
 }
 
 //=================================================================================================
@@ -462,34 +632,35 @@ provider::boundingbox::boundingbox(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::boundingbox::provide(int                        idx,
-                                    const std::vector<char>&   datum_in,
+void provider::boundingbox::provide(const std::vector<char>&   datum_in,
                                     nervana::fixed_buffer_map& out_buf,
-                                    augmentation&              aug) const
+                                    vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received boundingbox with size 0, at idx " << idx;
+        ss << "received boundingbox with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded    = m_extractor.extract(datum_in.data(), datum_in.size());
     auto input_size = decoded->image_size();
-    shared_ptr<augment::image::params> params;
-    if (aug.m_image_augmentations)
-    {
-        params = aug.m_image_augmentations;
-    }
-    else
+    for (view& v : views)
     {
-        params = m_augmentation_factory.make_params(
-            input_size.width, input_size.height, m_config.width, m_config.height);
-        aug.m_image_augmentations = params;
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        shared_ptr<augment::image::params> params;
+        if (v.aug.m_image_augmentations)
+        {
+            params = v.aug.m_image_augmentations;
+        }
+        else
+        {
+            params = m_augmentation_factory.make_params(
+                input_size.width, input_size.height, m_config.width, m_config.height);
+            v.aug.m_image_augmentations = params;
+        }
+        m_loader.load({datum_out}, m_transformer.transform(params, decoded));
     }
-    m_loader.load({datum_out}, m_transformer.transform(params, decoded));
 }
 
 //=================================================================================================
@@ -506,22 +677,23 @@ provider::blob::blob(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::blob::provide(int                        idx,
-                             const std::vector<char>&   datum_in,
+void provider::blob::provide(const std::vector<char>&   datum_in,
                              nervana::fixed_buffer_map& out_buf,
-                             augmentation&) const
+                             vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received blob with size 0, at idx " << idx;
+        ss << "received blob with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded = m_extractor.extract(datum_in.data(), datum_in.size());
-    m_loader.load({datum_out}, decoded);
+    for (const view& v : views)
+    {
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        m_loader.load({datum_out}, decoded);
+    }
 }
 
 //=================================================================================================
@@ -540,34 +712,35 @@ provider::video::video(nlohmann::json js, nlohmann::json aug)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::video::provide(int                        idx,
-                              const std::vector<char>&   datum_in,
+void provider::video::provide(const std::vector<char>&   datum_in,
                               nervana::fixed_buffer_map& out_buf,
-                              augmentation&              aug) const
+                              vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received encoded video with size 0, at idx " << idx;
+        ss << "received encoded video with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded    = m_extractor.extract(datum_in.data(), datum_in.size());
-    auto image_size = decoded->get_image_size();
-    shared_ptr<augment::image::params> params;
-    if (aug.m_image_augmentations)
-    {
-        params = aug.m_image_augmentations;
-    }
-    else
+    auto input_size = decoded->get_image_size();
+    for (view& v : views)
     {
-        params = m_augmentation_factory.make_params(
-            image_size.width, image_size.height, m_config.frame.width, m_config.frame.height);
-        aug.m_image_augmentations = params;
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        shared_ptr<augment::image::params> params;
+        if (v.aug.m_image_augmentations)
+        {
+            params = v.aug.m_image_augmentations;
+        }
+        else
+        {
+            params = m_augmentation_factory.make_params(
+                input_size.width, input_size.height, m_config.frame.width, m_config.frame.height);
+            v.aug.m_image_augmentations = params;
+        }
+        m_loader.load({datum_out}, m_transformer.transform(params, decoded));
     }
-    m_loader.load({datum_out}, m_transformer.transform(params, decoded));
 }
 
 //=================================================================================================
@@ -578,7 +751,6 @@ provider::char_map::char_map(nlohmann::json js)
     : interface(js, 1)
     , m_config{js}
     , m_extractor{m_config}
-    , m_loader{m_config}
     , m_buffer_name{create_name(m_config.name, "char_map")}
     , m_length_name{create_name(m_config.name, "char_map_length")}
 {
@@ -590,33 +762,50 @@ provider::char_map::char_map(nlohmann::json js)
     }
 }
 
-void provider::char_map::provide(int                        idx,
-                                 const std::vector<char>&   datum_in,
+void provider::char_map::provide(const std::vector<char>&   datum_in,
                                  nervana::fixed_buffer_map& out_buf,
-                                 augmentation&) const
+                                 vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received char_map with size 0, at idx " << idx;
+        ss << "received char_map with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
-    size_t datum_in_size = wstring_length(string(datum_in.data(), datum_in.size()));
-    auto   decoded       = m_extractor.extract(datum_in.data(), datum_in_size);
-    if (m_config.emit_length)
-    {
-        char* length_out = out_buf[m_length_name]->get_item(idx);
-        m_loader.load({datum_out, length_out}, decoded);
-    }
-    else
+    // the first view is extracted in place, any others are copies of it
+    const char* first_out = nullptr;
+    uint32_t    length    = 0;
+    for (const view& v : views)
     {
-        m_loader.load({datum_out}, decoded);
+        buffer_fixed_size_elements* buffer    = out_buf.at(v.slots[0]);
+        char*                       datum_out = buffer->get_item(v.index);
+        if (first_out == nullptr)
+        {
+            length = m_extractor.extract(
+                datum_in.data(), datum_in.size(), reinterpret_cast<uint32_t*>(datum_out));
+            first_out = datum_out;
+        }
+        else
+        {
+            memcpy(datum_out, first_out, buffer->get_stride());
+        }
+        buffer->set_item_extent(v.index, length);
+        if (m_config.emit_length)
+        {
+            char* length_out = out_buf.at(v.slots[1])->get_item(v.index);
+            memcpy(length_out, &length, sizeof(length));
+        }
     }
 }
 
+bool provider::char_map::probe_length(const vector<char>& datum_in, uint32_t& length) const
+{
+    size_t characters = wstring_length(string(datum_in.data(), datum_in.size()));
+    length            = std::min<size_t>(characters, m_config.max_length);
+    return true;
+}
+
 //=================================================================================================
 // label_map
 //=================================================================================================
@@ -631,24 +820,21 @@ provider::label_map::label_map(nlohmann::json js)
     m_output_shapes.emplace_back(make_pair(m_buffer_name, m_config.get_shape_type()));
 }
 
-void provider::label_map::provide(int                        idx,
-                                  const std::vector<char>&   datum_in,
+void provider::label_map::provide(const std::vector<char>&   datum_in,
                                   nervana::fixed_buffer_map& out_buf,
-                                  augmentation&) const
+                                  vector<view>&              views) const
 {
-    char* datum_out = out_buf[m_buffer_name]->get_item(idx);
-
     if (datum_in.size() == 0)
     {
         std::stringstream ss;
-        ss << "received label_map with size 0, at idx " << idx;
+        ss << "received label_map with size 0, at idx " << views.front().index;
         throw std::runtime_error(ss.str());
     }
 
     auto decoded = m_extractor.extract(datum_in.data(), datum_in.size());
-    m_loader.load({datum_out}, decoded);
+    for (const view& v : views)
+    {
+        char* datum_out = out_buf.at(v.slots[0])->get_item(v.index);
+        m_loader.load({datum_out}, decoded);
+    }
 }
-
-//=================================================================================================
-// multicrop
-//=================================================================================================
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <memory>
@@ -41,6 +42,7 @@ namespace nervana
     {
         class interface;
         class provider_base;
+        class view;
         class image;
         class label;
         class audio;
@@ -55,7 +57,6 @@ namespace nervana
         class video;
         class char_map;
         class label_map;
-        class multicrop;
     }
     class augmentation;
 }
@@ -69,12 +70,37 @@ class nervana::provider::provider_base : public provider_interface
 public:
     provider_base(nlohmann::json                     js,
                   const std::vector<nlohmann::json>& etl,
-                  nlohmann::json                     augmentation);
-
-    void provide(int idx, encoded_record_list& in_buf, fixed_buffer_map& out_buf) const override;
+                  nlohmann::json                     augmentation,
+                  uint32_t                           view_count  = 1,
+                  const std::string&                 view_layout = "batch");
+
+    using provider_interface::provide;
+    void provide(int                  idx,
+                 encoded_record_list& in_buf,
+                 fixed_buffer_map&    out_buf,
+                 int                  out_idx) const override;
+    size_t get_batch_multiplier() const override { return m_views_in_batch ? m_view_count : 1; }
+    bool get_length_key(const encoded_record& record,
+                        size_t                element,
+                        uint32_t&             key) const override;
 
 private:
+    // A provider and the output buffer slots it writes, view by view
+    struct binding
+    {
+        const provider::interface* provider;
+        size_t                     output_count;
+        std::vector<size_t>        slots;
+    };
+
+    void check_buffer_names(const fixed_buffer_map& out_buf) const;
+
     std::vector<std::shared_ptr<provider::interface>> m_providers;
+    std::vector<binding>                              m_bindings;
+    uint32_t                                          m_view_count;
+    bool                                              m_views_in_batch;
+    // the last output buffer map whose names matched the output shapes
+    mutable std::atomic<const fixed_buffer_map*> m_checked_buffers{nullptr};
 };
 
 //=================================================================================================
@@ -88,6 +114,27 @@ public:
     std::shared_ptr<augment::audio::params> m_audio_augmentations;
 };
 
+//=================================================================================================
+// view
+//=================================================================================================
+
+// One independently augmented copy of a record. A provider decodes its input once and then
+// writes every view to item 'index' of its output buffers. The buffers are bound to slots of
+// the output buffer map when the provider is built; slots[n] is the slot of output n of the
+// provider being run, in the order of its output shapes.
+class nervana::provider::view
+{
+public:
+    view(int _index)
+        : index{_index}
+    {
+    }
+
+    int           index;
+    const size_t* slots{nullptr};
+    augmentation  aug;
+};
+
 //=================================================================================================
 // provider_interface
 //=================================================================================================
@@ -97,10 +144,14 @@ class nervana::provider::interface : public nervana::provider_interface
 public:
     interface(nlohmann::json, size_t);
     virtual ~interface() {}
-    virtual void provide(int                        idx,
-                         const std::vector<char>&   datum_in,
+    virtual void provide(const std::vector<char>&   datum_in,
                          nervana::fixed_buffer_map& out_buf,
-                         augmentation&) const = 0;
+                         std::vector<view>&         views) const = 0;
+    // Length of the encoded datum along the variable axis of its output, read from headers only
+    virtual bool probe_length(const std::vector<char>& datum_in, uint32_t& length) const
+    {
+        return false;
+    }
 
     static std::string create_name(const std::string& name, const std::string& base_name);
 
@@ -121,10 +172,9 @@ class nervana::provider::image : public provider::interface
 public:
     image(nlohmann::json config, nlohmann::json aug);
     virtual ~image() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     const nervana::image::config           m_config;
@@ -144,10 +194,10 @@ class nervana::provider::label : public provider::interface
 public:
     label(nlohmann::json config);
     virtual ~label() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
+    bool probe_length(const std::vector<char>& datum_in, uint32_t& length) const override;
 
 private:
     nervana::label::config    m_config;
@@ -165,10 +215,10 @@ class nervana::provider::audio : public provider::interface
 public:
     audio(nlohmann::json js, nlohmann::json aug);
     virtual ~audio() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
+    bool probe_length(const std::vector<char>& datum_in, uint32_t& length) const override;
 
 private:
     nervana::audio::config        m_config;
@@ -189,10 +239,9 @@ class nervana::provider::localization::rcnn : public provider::interface
 public:
     rcnn(nlohmann::json js, nlohmann::json aug);
     virtual ~rcnn() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     nervana::localization::rcnn::config      m_config;
@@ -221,10 +270,9 @@ class nervana::provider::localization::ssd : public provider::interface
 public:
     ssd(nlohmann::json js, nlohmann::json aug);
     virtual ~ssd() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     nervana::localization::ssd::config      m_config;
@@ -248,10 +296,9 @@ class nervana::provider::pixelmask : public provider::interface
 public:
     pixelmask(nlohmann::json js, nlohmann::json aug);
     virtual ~pixelmask() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     nervana::image::config                 m_config;
@@ -271,10 +318,9 @@ class nervana::provider::boundingbox : public provider::interface
 public:
     boundingbox(nlohmann::json js, nlohmann::json aug);
     virtual ~boundingbox() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     boundingbox() = delete;
@@ -295,10 +341,9 @@ class nervana::provider::blob : public provider::interface
 public:
     blob(nlohmann::json js);
     virtual ~blob() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     blob() = delete;
@@ -316,10 +361,9 @@ class nervana::provider::video : public provider::interface
 {
 public:
     video(nlohmann::json js, nlohmann::json aug);
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     nervana::video::config        m_config;
@@ -339,16 +383,15 @@ class nervana::provider::char_map : public provider::interface
 public:
     char_map(nlohmann::json js);
     virtual ~char_map() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
+    bool probe_length(const std::vector<char>& datum_in, uint32_t& length) const override;
 
 private:
     char_map() = delete;
     nervana::char_map::config    m_config;
     nervana::char_map::extractor m_extractor;
-    nervana::char_map::loader    m_loader;
     const std::string            m_buffer_name;
     const std::string            m_length_name;
 };
@@ -362,10 +405,9 @@ class nervana::provider::label_map : public provider::interface
 public:
     label_map(nlohmann::json js);
     virtual ~label_map() {}
-    void provide(int                        idx,
-                 const std::vector<char>&   datum_in,
+    void provide(const std::vector<char>&   datum_in,
                  nervana::fixed_buffer_map& out_buf,
-                 augmentation&) const override;
+                 std::vector<view>&         views) const override;
 
 private:
     label_map() = delete;
@@ -374,7 +416,3 @@ private:
     nervana::label_map::loader    m_loader;
     const std::string             m_buffer_name;
 };
-
-//=================================================================================================
-// multicrop
-//=================================================================================================
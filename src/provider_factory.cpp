@@ -45,7 +45,8 @@ shared_ptr<nervana::provider_interface> nervana::provider_factory::create(nlohma
     // {
     //     aug_config = nlohmann::json::object();
     // }
-    rc = make_shared<provider::provider_base>(configJs, cc.etl, aug_config);
+    rc = make_shared<provider::provider_base>(
+        configJs, cc.etl, aug_config, cc.augmentation_views, cc.augmentation_view_layout);
 
     return rc;
 }
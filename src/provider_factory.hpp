@@ -48,8 +48,13 @@ public:
 
     std::vector<nlohmann::json> etl;
     std::vector<nlohmann::json> augmentation;
+    uint32_t                    augmentation_views       = 1;
+    std::string                 augmentation_view_layout = "batch";
 
 private:
     std::vector<std::shared_ptr<nervana::interface::config_info_interface>> config_list = {
-        ADD_OBJECT(etl, mode::REQUIRED), ADD_OBJECT(augmentation, mode::OPTIONAL)};
+        ADD_OBJECT(etl, mode::REQUIRED),
+        ADD_OBJECT(augmentation, mode::OPTIONAL),
+        ADD_SCALAR(augmentation_views, mode::OPTIONAL),
+        ADD_SCALAR(augmentation_view_layout, mode::OPTIONAL)};
 };
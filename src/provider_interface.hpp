@@ -40,11 +40,28 @@ public:
     }
 
     virtual ~provider_interface() {}
+    // Decodes record idx of in_buf into item out_idx of out_buf. A provider with a batch
+    // multiplier m writes items out_idx * m through out_idx * m + m - 1.
     virtual void provide(int                           idx,
                          nervana::encoded_record_list& in_buf,
-                         nervana::fixed_buffer_map&    out_buf) const = 0;
+                         nervana::fixed_buffer_map&    out_buf,
+                         int                           out_idx) const = 0;
+    void provide(int                           idx,
+                 nervana::encoded_record_list& in_buf,
+                 nervana::fixed_buffer_map&    out_buf) const
+    {
+        provide(idx, in_buf, out_buf, idx);
+    }
 
     size_t       get_input_count() const { return m_input_count; }
+    // Number of output batch items written for every input record
+    virtual size_t get_batch_multiplier() const { return 1; }
+    // Cheap length of element 'element' of a record without decoding it, used to bucket records
+    // of similar length into the same batch. Returns false when the length is not known.
+    virtual bool get_length_key(const encoded_record& record, size_t element, uint32_t& key) const
+    {
+        return false;
+    }
     virtual void post_process(fixed_buffer_map& out_buf) {}
     const shape_type& get_output_shape(const std::string& name) const
     {
@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
 #include <cassert>
 #include <stdexcept>
@@ -98,12 +99,17 @@ nervana::ofi::ofi::ofi()
     , m_fid_cq_tx(NULL)
     , m_fid_ep(NULL)
 {
-    m_fi_hints                    = fi_allocinfo();
-    m_fi_hints->ep_attr->type     = FI_EP_MSG;
-    m_fi_hints->ep_attr->protocol = FI_PROTO_RDMA_CM_IB_RC;
-    m_fi_hints->caps              = FI_MSG;
-    m_fi_hints->mode              = FI_LOCAL_MR;
-    m_fi_hints->addr_format       = FI_SOCKADDR_IN;
+    m_fi_hints                = fi_allocinfo();
+    m_fi_hints->ep_attr->type = FI_EP_MSG;
+    // A provider named in FI_PROVIDER is used as is, which lets the sockets and tcp providers
+    // stand in for RDMA hardware. Otherwise only InfiniBand reliable connections are taken.
+    if (getenv("FI_PROVIDER") == nullptr)
+    {
+        m_fi_hints->ep_attr->protocol = FI_PROTO_RDMA_CM_IB_RC;
+    }
+    m_fi_hints->caps        = FI_MSG | FI_RMA;
+    m_fi_hints->mode        = FI_LOCAL_MR;
+    m_fi_hints->addr_format = FI_SOCKADDR_IN;
 
     memset(&m_fid_eq_attr, 0, sizeof(fi_eq_attr));
     m_fid_eq_attr.wait_obj = FI_WAIT_FD;
@@ -2,8 +2,10 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unistd.h>
 
 #include "service.hpp"
+#include "batch_frame.hpp"
 #include "json.hpp"
 #include "loader.hpp"
 #include "typemap.hpp"
@@ -21,7 +23,8 @@ namespace nervana
     {
         namespace
         {
-            constexpr char not_found_loader[] = "loader doesn't exist";
+            constexpr char not_found_loader[]        = "loader doesn't exist";
+            constexpr char shared_memory_transport[] = "shared_memory";
 
             web::json::value success_json()
             {
@@ -98,23 +101,27 @@ namespace nervana
                 request.reply(status_codes::OK, success_json().serialize());
                 return;
             }
-            statused_response<next_tuple> reply = m_parser.get(path);
+            statused_response<next_tuple> reply = m_parser.get(path, query);
             if (std::get<1>(reply.value).empty())
                 request.reply(reply.status_code, get<0>(reply.value));
             else
             {
+                // the batch is moved into the response body rather than copied once more
+                const bool   framed       = query["format"] == batch_frame::format_name;
+                const string content_type =
+                    framed ? batch_frame::content_type : "application/octet-stream";
 #if !defined(ENABLE_OPENFABRICS_CONNECTOR)
-                request.reply(reply.status_code, get<1>(reply.value));
+                request.reply(reply.status_code, move(get<1>(reply.value)), content_type);
 #else
                 // batch data sending
                 string connection_id = query["connection_id"];
                 if (connection_id.empty() || reply.status_code != http::status_ok)
                 {
-                    request.reply(reply.status_code, get<1>(reply.value));
+                    request.reply(reply.status_code, move(get<1>(reply.value)), content_type);
                 }
                 else
                 {
-                    reply_data_with_ofi(request, connection_id, reply);
+                    reply_data_with_ofi(request, connection_id, framed, reply);
                 }
 #endif /* ENABLE_OPENFABRICS_CONNECTOR */
             }
@@ -140,6 +147,7 @@ namespace nervana
 #if defined(ENABLE_OPENFABRICS_CONNECTOR)
         void service::reply_data_with_ofi(http_request&                  request,
                                           const string&                  connection_id,
+                                          bool                           framed,
                                           statused_response<next_tuple>& reply)
         {
             if (m_ofi_connections == nullptr)
@@ -152,45 +160,51 @@ namespace nervana
             }
 
             const string&     data   = get<1>(reply.value);
-            ofi::rdma_memory& memory = m_ofi_connections->get_rdma_memory(connection_id);
-            if (!memory.is_registered())
-            {
-                m_ofi_connections->register_memory(connection_id, data.size());
-            }
-            if (memory.is_allocated() && memory.get_buffer_size() < data.size())
-            {
-                static const string error_msg = "allocated RDMA buffer is too small";
-                log::warning(error_msg);
-                request.reply(status_codes::InternalError, failure_json(error_msg));
-                return;
-            }
-
+            ofi::rdma_memory& memory = m_ofi_connections->next_region(connection_id, data.size());
             std::memcpy(memory.get_buffer(), data.c_str(), data.size());
 
             web::json::value reply_json   = web::json::value::object();
             reply_json["status"]["type"]  = web::json::value::string("SUCCESS");
             reply_json["data"]["address"] = reinterpret_cast<uint64_t>(memory.get_buffer());
-            reply_json["data"]["size"]    = memory.get_buffer_size();
+            reply_json["data"]["size"]    = data.size();
             reply_json["data"]["key"]     = memory.get_key();
+            if (framed)
+            {
+                // the client maps frames in place, anything else it copies out
+                reply_json["data"]["format"] = web::json::value::string(batch_frame::format_name);
+            }
             request.reply(status_codes::OK, reply_json);
         }
 #endif /* ENABLE_OPENFABRICS_CONNECTOR */
 
         // /////////////////////////////////////////////////////////////////////////////
 
-        string loader_adapter::next()
+        bool loader_adapter::advance()
         {
-            unique_lock<mutex> lock(m_mutex);
-
             if (m_is_reset)
                 m_is_reset = false;
             else
                 m_loader.get_current_iter()++;
 
-            if (m_loader.get_current_iter().positional_end())
+            return !m_loader.get_current_iter().positional_end();
+        }
+
+        string loader_adapter::next(bool framed)
+        {
+            unique_lock<mutex> lock(m_mutex);
+
+            // The lock is held until the batch is copied out. Clients keep several requests in
+            // flight and the next one would otherwise advance the loader over this batch.
+            if (!advance())
             {
                 return string("");
             }
+            else if (framed)
+            {
+                // the frame is gathered straight into the string that becomes the response body
+                auto iter = m_loader.get_current_iter();
+                return batch_frame_writer(*iter, m_sequence++).to_string();
+            }
             else
             {
                 // stringstream initialization is very costly, so we have to avoid it by using thread_local.
@@ -198,18 +212,57 @@ namespace nervana
                 // If this is a problem, we can consider using sprintf and allocating memory on each request.
                 thread_local std::ostringstream ss;
                 auto                            iter = m_loader.get_current_iter();
-                lock.unlock();
                 ss.seekp(ios::beg);
                 ss << *iter;
                 return ss.str();
             }
         };
 
+        bool loader_adapter::next_shared(size_t& slot, size_t& size, string& fallback)
+        {
+            lock_guard<mutex> lg(m_mutex);
+
+            if (!advance())
+            {
+                return false;
+            }
+            auto               iter = m_loader.get_current_iter();
+            batch_frame_writer writer(*iter, m_sequence++);
+            if (m_ring && writer.size() <= m_ring->slot_size() && m_ring->claim(slot))
+            {
+                // the only copy of the batch on its way to a client on the same host
+                writer.copy_to(m_ring->slot(slot));
+                size = writer.size();
+            }
+            else
+            {
+                fallback = writer.to_string();
+            }
+            return true;
+        }
+
+        const shm_ring& loader_adapter::create_ring(const string& prefix, size_t slot_count)
+        {
+            lock_guard<mutex> lg(m_mutex);
+            if (!m_ring)
+            {
+                size_t slot_size = batch_frame_writer::max_size(m_loader.get_names_and_shapes(),
+                                                                m_loader.batch_size());
+                m_ring = shm_ring::create(prefix, slot_count, slot_size);
+                log::info("Created shared memory ring %s with %d slots of %d bytes",
+                          m_ring->name(),
+                          slot_count,
+                          m_ring->slot_size());
+            }
+            return *m_ring;
+        }
+
         void loader_adapter::reset()
         {
             lock_guard<mutex> lg(m_mutex);
             m_loader.reset();
             m_is_reset = true;
+            m_sequence = 0;
         };
 
         string loader_adapter::batch_size() const { return std::to_string(m_loader.batch_size()); };
@@ -271,7 +324,7 @@ namespace nervana
             }
         }
 
-        statused_response<next_tuple> parser::get(const std::string& msg)
+        statused_response<next_tuple> parser::get(const std::string& msg, const http_query_t& query)
         {
             static const auto notFound = statused_response<next_tuple>(
                 status_codes::NotFound, tuple<web::json::value, std::string>(not_found_json(), ""));
@@ -291,7 +344,19 @@ namespace nervana
 
                 if (paths[1] == "next")
                 {
-                    return next(m_loader_manager.loader(dataset_id));
+                    auto transport = query.find("transport");
+                    if (transport != query.end() && transport->second == shared_memory_transport)
+                    {
+                        return next_shared(m_loader_manager.loader(dataset_id));
+                    }
+                    auto format = query.find("format");
+                    bool framed =
+                        format != query.end() && format->second == batch_frame::format_name;
+                    return next(m_loader_manager.loader(dataset_id), framed);
+                }
+                else if (paths[1] == shared_memory_transport)
+                {
+                    return shared_memory(m_loader_manager.loader(dataset_id), dataset_id, query);
                 }
                 else
                 {
@@ -347,16 +412,16 @@ namespace nervana
             }
         }
 
-        statused_response<next_tuple> parser::next(loader_adapter& loader)
+        statused_response<next_tuple> parser::next(loader_adapter& loader, bool framed)
         {
             web::json::value response_json = web::json::value::object();
-            string           data          = loader.next();
+            string           data          = loader.next(framed);
 
             if (!data.empty())
             {
                 response_json["status"]["type"] = web::json::value::string("SUCCESS");
                 return statused_response<next_tuple>(status_codes::OK,
-                                                     make_tuple(response_json, data));
+                                                     make_tuple(response_json, move(data)));
             }
             else
             {
@@ -366,6 +431,56 @@ namespace nervana
             }
         }
 
+        statused_response<next_tuple> parser::next_shared(loader_adapter& loader)
+        {
+            web::json::value response_json = web::json::value::object();
+            size_t           slot;
+            size_t           size;
+            string           fallback;
+
+            if (!loader.next_shared(slot, size, fallback))
+            {
+                response_json["status"]["type"] = web::json::value::string("END_OF_DATASET");
+                return statused_response<next_tuple>(status_codes::NotFound,
+                                                     make_tuple(response_json, ""));
+            }
+            response_json["status"]["type"] = web::json::value::string("SUCCESS");
+            if (!fallback.empty())
+            {
+                // the frame is sent in the body like for any other client
+                return statused_response<next_tuple>(status_codes::OK,
+                                                     make_tuple(response_json, move(fallback)));
+            }
+            response_json["data"]["slot"] = web::json::value::number(uint64_t(slot));
+            response_json["data"]["size"] = web::json::value::number(uint64_t(size));
+            return statused_response<next_tuple>(status_codes::OK, make_tuple(response_json, ""));
+        }
+
+        statused_response<next_tuple> parser::shared_memory(loader_adapter&     loader,
+                                                            int                 dataset_id,
+                                                            const http_query_t& query)
+        {
+            const size_t max_slots = 64;
+            size_t       slots     = 4;
+            auto         requested = query.find("slots");
+            if (requested != query.end())
+            {
+                slots = std::min(max_slots, size_t(std::max(1, std::stoi(requested->second))));
+            }
+            // the ring adds a random suffix, the pid and dataset only help to tell rings apart
+            string prefix = "/aeon-" + std::to_string(getpid()) + "-" + std::to_string(dataset_id);
+            const shm_ring& ring = loader.create_ring(prefix, slots);
+
+            web::json::value response_json  = web::json::value::object();
+            response_json["status"]["type"] = web::json::value::string("SUCCESS");
+            response_json["data"]["name"]   = web::json::value::string(ring.name());
+            response_json["data"]["slot_count"] =
+                web::json::value::number(uint64_t(ring.slot_count()));
+            response_json["data"]["slot_size"] =
+                web::json::value::number(uint64_t(ring.slot_size()));
+            return statused_response<next_tuple>(status_codes::OK, make_tuple(response_json, ""));
+        }
+
         web::json::value parser::reset(loader_adapter& loader)
         {
             web::json::value response_json = web::json::value::object();
@@ -432,8 +547,7 @@ namespace nervana
             // unregister rdma memory
             for (auto& item : m_connections)
             {
-                ofi_connection& connection = item.second;
-                connection._ofi.unregister_memory(connection._rdma_memory);
+                unregister_memory(item.second);
             }
         }
 
@@ -443,41 +557,41 @@ namespace nervana
             return get_ofi_connection(connection_id)._ofi;
         }
 
-        nervana::ofi::rdma_memory& ofi_connection_pool::get_rdma_memory(const string& connection_id)
-        {
-            lock_guard<recursive_mutex> lock(m_connections_mutex);
-            return get_ofi_connection(connection_id)._rdma_memory;
-        }
-
-        void ofi_connection_pool::register_memory(const string& connection_id, size_t size)
+        nervana::ofi::rdma_memory& ofi_connection_pool::next_region(const string& connection_id,
+                                                                    size_t        size)
         {
             lock_guard<recursive_mutex> lock(m_connections_mutex);
             ofi_connection&             connection = get_ofi_connection(connection_id);
-            ofi::rdma_memory&           memory     = connection._rdma_memory;
-            if (memory.is_allocated())
+            if (connection._regions.empty())
             {
-                if (memory.get_buffer_size() < size)
-                    throw std::runtime_error("allocated RDMA memory size is too small!");
+                for (size_t i = 0; i < regions_per_connection; i++)
+                {
+                    unique_ptr<ofi::rdma_memory> memory(new ofi::rdma_memory(size));
+                    connection._ofi.register_memory(*memory);
+                    connection._regions.push_back(move(memory));
+                }
             }
-            else
+
+            ofi::rdma_memory& memory = *connection._regions[connection._next_region];
+            connection._next_region  = (connection._next_region + 1) % connection._regions.size();
+            if (memory.get_buffer_size() < size)
             {
+                log::info("RDMA region of connection %s grows to %d bytes", connection_id, size);
+                connection._ofi.unregister_memory(memory);
                 memory.allocate(size);
-            }
-            if (!memory.is_registered())
-            {
                 connection._ofi.register_memory(memory);
             }
+            return memory;
         }
 
-        void ofi_connection_pool::unregister_memory(const string& connection_id)
+        void ofi_connection_pool::unregister_memory(ofi_connection& connection)
         {
-            lock_guard<recursive_mutex> lock(m_connections_mutex);
-            ofi_connection&             connection = get_ofi_connection(connection_id);
-            ofi::rdma_memory&           memory     = connection._rdma_memory;
-
-            if (memory.is_registered())
-                connection._ofi.unregister_memory(memory);
-            memory.deallocate();
+            for (auto& memory : connection._regions)
+            {
+                if (memory->is_registered())
+                    connection._ofi.unregister_memory(*memory);
+            }
+            connection._regions.clear();
         }
 
         ofi_connection_pool::ofi_connection&
@@ -496,7 +610,7 @@ namespace nervana
         void ofi_connection_pool::remove_connection(const std::string& connection_id)
         {
             lock_guard<recursive_mutex> lock(m_connections_mutex);
-            unregister_memory(connection_id);
+            unregister_memory(get_ofi_connection(connection_id));
             m_connections.erase(connection_id);
         }
 
@@ -16,6 +16,7 @@
 #include "../rdma/ofi.hpp"
 #endif
 #include "../client/http_connector.hpp"
+#include "../shm_ring.hpp"
 
 namespace nervana
 {
@@ -31,6 +32,12 @@ namespace nervana
             {
             }
 
+            statused_response(web::http::status_code _status_code, T&& _value)
+                : status_code(_status_code)
+                , value(std::move(_value))
+            {
+            }
+
             web::http::status_code status_code;
             T                      value;
         };
@@ -48,7 +55,16 @@ namespace nervana
 
             void reset();
 
-            std::string next();
+            // framed selects the batch_frame encoding, otherwise the batch is serialized
+            std::string next(bool framed = false);
+            // Writes the next batch as a frame into a free slot of the shared memory ring and
+            // returns false at the end of the data. The frame goes to fallback instead when the
+            // session has no ring or the client holds every slot.
+            bool next_shared(size_t& slot, size_t& size, std::string& fallback);
+
+            // The shared memory ring of the session is created on first use, later calls return
+            // the same ring
+            const shm_ring& create_ring(const std::string& prefix, size_t slot_count);
 
             std::string batch_size() const;
             std::string names_and_shapes() const;
@@ -56,9 +72,15 @@ namespace nervana
             std::string record_count() const;
 
         private:
-            nervana::loader_local m_loader;
-            std::mutex            m_mutex;
-            bool                  m_is_reset{true};
+            // moves to the next batch, false at the end of the data
+            bool advance();
+
+            nervana::loader_local     m_loader;
+            std::mutex                m_mutex;
+            bool                      m_is_reset{true};
+            std::shared_ptr<shm_ring> m_ring;
+            // batches handed out since the last reset, numbers the frames
+            uint64_t m_sequence{0};
         };
 
         class loader_manager
@@ -87,7 +109,8 @@ namespace nervana
 
             json_response post(const std::string& msg, const std::string& msg_body);
             json_response del(const std::string& msg);
-            statused_response<next_tuple> get(const std::string& msg);
+            statused_response<next_tuple> get(const std::string&  msg,
+                                              const http_query_t& query = http_query_t());
 
         private:
             const std::string api             = "api";
@@ -99,7 +122,11 @@ namespace nervana
             std::map<std::string, msg_process_func_t> process_func;
             loader_manager m_loader_manager;
 
-            statused_response<next_tuple> next(loader_adapter& loader);
+            statused_response<next_tuple> next(loader_adapter& loader, bool framed);
+            statused_response<next_tuple> next_shared(loader_adapter& loader);
+            statused_response<next_tuple> shared_memory(loader_adapter&     loader,
+                                                        int                 dataset_id,
+                                                        const http_query_t& query);
 
             web::json::value batch_size(loader_adapter& loader);
             web::json::value reset(loader_adapter& loader);
@@ -118,21 +145,26 @@ namespace nervana
             ~ofi_connection_pool();
 
             ofi::ofi& get_ofi(const std::string& connection_id);
-            ofi::rdma_memory& get_rdma_memory(const std::string& connection_id);
-
-            void register_memory(const std::string& connection_id, size_t size);
-            void unregister_memory(const std::string& connection_id);
+            // Returns the next region of the ring of the connection, with room for size bytes.
+            // The regions are registered with the first batch and only registered again when a
+            // batch outgrows them.
+            ofi::rdma_memory& next_region(const std::string& connection_id, size_t size);
 
             void remove_connection(const std::string& connection_id);
 
         private:
+            // a region is written again two batches later, well after the client read it
+            static const size_t regions_per_connection = 2;
+
             struct ofi_connection
             {
-                ofi::ofi         _ofi;
-                ofi::rdma_memory _rdma_memory;
+                ofi::ofi                                       _ofi;
+                std::vector<std::unique_ptr<ofi::rdma_memory>> _regions;
+                size_t                                         _next_region{0};
             };
 
             ofi_connection& get_ofi_connection(const std::string& connection_id);
+            void unregister_memory(ofi_connection& connection);
             void accept_connections();
 
             std::atomic<bool> m_finish{false};
@@ -204,7 +236,8 @@ namespace nervana
 #if defined(ENABLE_OPENFABRICS_CONNECTOR)
             std::unique_ptr<ofi_connection_pool> m_ofi_connections;
             void reply_data_with_ofi(web::http::http_request&       request,
-                                     const std::string&             query,
+                                     const std::string&             connection_id,
+                                     bool                           framed,
                                      statused_response<next_tuple>& reply);
 #endif
             void handle_post(web::http::http_request r)
@@ -0,0 +1,248 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_ring.hpp"
+#include "util.hpp"
+
+using namespace std;
+using namespace nervana;
+
+// the state words are shared between processes, which only works for lock free atomics
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shm_ring needs lock free 32 bit atomics");
+
+namespace
+{
+    const char     magic[]       = {'A', 'E', 'O', 'N', 'S', 'H', 'M', 'R'};
+    const uint32_t version       = 1;
+    const size_t   version_field = sizeof(magic);
+    const size_t   count_field   = version_field + sizeof(uint32_t);
+    const size_t   size_field    = count_field + sizeof(uint32_t);
+    const size_t   states_offset = size_field + sizeof(uint64_t);
+    const uint32_t slot_free     = 0;
+    const uint32_t slot_used     = 1;
+
+    size_t page_align(size_t size)
+    {
+        size_t page = sysconf(_SC_PAGESIZE);
+        return (size + page - 1) / page * page;
+    }
+
+    size_t data_offset(size_t slot_count)
+    {
+        return page_align(states_offset + slot_count * sizeof(atomic<uint32_t>));
+    }
+
+    runtime_error shm_error(const string& what, const string& name)
+    {
+        return runtime_error(what + " shared memory '" + name + "': " + strerror(errno));
+    }
+
+    string random_suffix()
+    {
+        static const char digits[] = "0123456789abcdef";
+        random_device     source;
+        string            suffix;
+        for (int i = 0; i < 4; i++)
+        {
+            uint32_t bits = source();
+            for (int j = 0; j < 8; j++, bits >>= 4)
+            {
+                suffix += digits[bits & 0xf];
+            }
+        }
+        return suffix;
+    }
+}
+
+shared_ptr<shm_ring> shm_ring::create(const string& prefix, size_t slot_count, size_t slot_size)
+{
+    if (slot_count == 0 || slot_count > UINT32_MAX)
+    {
+        throw invalid_argument("shm_ring slot count out of range: " + std::to_string(slot_count));
+    }
+
+    // an object that exists belongs to someone else, even a stale one is left alone
+    const int attempts = 8;
+    string    name;
+    int       fd = -1;
+    for (int attempt = 0; attempt < attempts && fd < 0; attempt++)
+    {
+        name = prefix + "-" + random_suffix();
+        fd   = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd < 0 && errno != EEXIST)
+        {
+            break;
+        }
+    }
+    if (fd < 0)
+    {
+        throw shm_error("cannot create", name);
+    }
+
+    shared_ptr<shm_ring> ring(new shm_ring(name, true));
+    ring->m_slot_count  = slot_count;
+    ring->m_slot_size   = page_align(slot_size);
+    ring->m_data_offset = data_offset(slot_count);
+    size_t size         = ring->m_data_offset + slot_count * ring->m_slot_size;
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        throw shm_error("cannot size", name);
+    }
+    ring->map(fd, size);
+
+    // the header is written last, a reader that sees the magic sees a complete ring
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        new (&ring->state(i)) atomic<uint32_t>(slot_free);
+    }
+    pack<uint32_t>(ring->m_memory, version, version_field);
+    pack<uint32_t>(ring->m_memory, slot_count, count_field);
+    pack<uint64_t>(ring->m_memory, ring->m_slot_size, size_field);
+    memcpy(ring->m_memory, magic, sizeof(magic));
+    return ring;
+}
+
+shared_ptr<shm_ring> shm_ring::open(const string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        throw shm_error("cannot open", name);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        throw shm_error("cannot stat", name);
+    }
+
+    shared_ptr<shm_ring> ring(new shm_ring(name, false));
+    size_t               size = status.st_size;
+    if (size < states_offset)
+    {
+        close(fd);
+        throw runtime_error("shared memory '" + name + "' is not an aeon ring");
+    }
+    ring->map(fd, size);
+
+    if (memcmp(ring->m_memory, magic, sizeof(magic)) != 0)
+    {
+        throw runtime_error("shared memory '" + name + "' is not an aeon ring");
+    }
+    uint32_t ring_version = unpack<uint32_t>(ring->m_memory, version_field);
+    if (ring_version != version)
+    {
+        throw runtime_error("unsupported shm_ring version " + std::to_string(ring_version));
+    }
+    ring->m_slot_count  = unpack<uint32_t>(ring->m_memory, count_field);
+    ring->m_slot_size   = unpack<uint64_t>(ring->m_memory, size_field);
+    ring->m_data_offset = data_offset(ring->m_slot_count);
+    if (ring->m_data_offset + ring->m_slot_count * ring->m_slot_size > size)
+    {
+        throw runtime_error("shared memory '" + name + "' is smaller than its ring");
+    }
+    return ring;
+}
+
+shm_ring::shm_ring(const string& name, bool owner)
+    : m_name(name)
+    , m_owner(owner)
+{
+}
+
+shm_ring::~shm_ring()
+{
+    if (m_memory)
+    {
+        munmap(m_memory, m_mapped_size);
+    }
+    if (m_owner)
+    {
+        // processes that still have the ring mapped keep their mapping
+        shm_unlink(m_name.c_str());
+    }
+}
+
+void shm_ring::map(int fd, size_t size)
+{
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        throw shm_error("cannot map", m_name);
+    }
+    m_memory      = static_cast<char*>(memory);
+    m_mapped_size = size;
+}
+
+char* shm_ring::slot(size_t index) const
+{
+    check_index(index);
+    return m_memory + m_data_offset + index * m_slot_size;
+}
+
+bool shm_ring::claim(size_t& index)
+{
+    // round robin, so the slot the reader released last is reused last
+    for (size_t i = 0; i < m_slot_count; i++)
+    {
+        size_t   candidate = (m_next + i) % m_slot_count;
+        uint32_t expected  = slot_free;
+        if (state(candidate).compare_exchange_strong(expected, slot_used))
+        {
+            index  = candidate;
+            m_next = candidate + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void shm_ring::release(size_t index)
+{
+    check_index(index);
+    state(index).store(slot_free);
+}
+
+bool shm_ring::is_free(size_t index) const
+{
+    check_index(index);
+    return state(index).load() == slot_free;
+}
+
+void shm_ring::check_index(size_t index) const
+{
+    if (index >= m_slot_count)
+    {
+        throw out_of_range("shm_ring slot " + std::to_string(index) + " out of range");
+    }
+}
+
+atomic<uint32_t>& shm_ring::state(size_t index) const
+{
+    return reinterpret_cast<atomic<uint32_t>*>(m_memory + states_offset)[index];
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace nervana
+{
+    class shm_ring;
+}
+
+/**
+ * \brief Ring of fixed size slots in POSIX shared memory
+ *
+ * Moves batches between processes on one host. The process that creates the ring claims a free
+ * slot, writes a batch frame into it and tells the other side which slot it used. The other
+ * side opens the ring by name, reads the batch in place and releases the slot when it is done
+ * with it. Slot states live in the shared memory, so releasing a slot needs no message.
+ *
+ * Layout: a header with the magic, version, slot count and slot size and one state word per
+ * slot, followed by the slots. Every slot starts on a page boundary.
+ */
+class nervana::shm_ring
+{
+public:
+    // Creates the shared memory object, the ring removes it again when it is destroyed. The
+    // name is the prefix followed by a random suffix, a name that is taken is never removed but
+    // tried again with another suffix, so services that share /dev/shm with the same pid, as in
+    // containers, keep their rings apart.
+    static std::shared_ptr<shm_ring>
+        create(const std::string& prefix, size_t slot_count, size_t slot_size);
+    // Maps a ring created by another process. Throws std::runtime_error when there is no such
+    // ring or it is not one.
+    static std::shared_ptr<shm_ring> open(const std::string& name);
+
+    ~shm_ring();
+    shm_ring(const shm_ring&) = delete;
+    shm_ring& operator=(const shm_ring&) = delete;
+
+    const std::string& name() const { return m_name; }
+    size_t             slot_count() const { return m_slot_count; }
+    size_t             slot_size() const { return m_slot_size; }
+    char* slot(size_t index) const;
+
+    // Finds a free slot and marks it used, returns false when every slot is in use
+    bool claim(size_t& index);
+    void release(size_t index);
+    bool is_free(size_t index) const;
+
+private:
+    shm_ring(const std::string& name, bool owner);
+    void map(int fd, size_t size);
+    void check_index(size_t index) const;
+    std::atomic<uint32_t>& state(size_t index) const;
+
+    std::string m_name;
+    bool        m_owner;
+    char*       m_memory{nullptr};
+    size_t      m_mapped_size{0};
+    size_t      m_slot_count{0};
+    size_t      m_slot_size{0};
+    size_t      m_data_offset{0};
+    size_t      m_next{0};
+};
@@ -14,6 +14,9 @@
 * limitations under the License.
 *******************************************************************************/
 
+#include <map>
+#include <mutex>
+
 #include "specgram.hpp"
 #include "util.hpp"
 
@@ -22,67 +25,147 @@ using cv::Range;
 using namespace std;
 using namespace nervana;
 
-// These can all be static
-void specgram::wav_to_specgram(const Mat& wav_col_mat,
-                               const int  frame_length_tn,
-                               const int  frame_stride_tn,
-                               const int  max_time_steps,
-                               const Mat& window,
-                               Mat&       specgram)
+namespace
 {
-    // const Mat& wav_mat = wav.get_data();
-    // Read as a row vector
-    Mat wav_mat = wav_col_mat.reshape(1, 1);
-
-    // TODO: support more sample formats
-    if (wav_mat.elemSize1() != 2)
+    // Windows each frame straight out of the sample buffer. Magnitudes are written to the rows
+    // of out, or, when fbank is given, reduced to mel features before moving to the next frame.
+    template <typename T>
+    void frames_to_rows(const T*                       samples,
+                        const rfft_plan&               plan,
+                        const nervana::mel_filterbank* fbank,
+                        const int                      frame_stride_tn,
+                        const float*                   window,
+                        Mat&                           out)
     {
-        throw std::runtime_error("Unsupported number of bytes per sample: " +
-                                 std::to_string(wav_mat.elemSize1()));
+        const int     frame_length_tn = plan.size();
+        vector<float> frame(frame_length_tn);
+        vector<float> scratch(plan.scratch_size());
+        vector<float> magnitude(fbank ? plan.bins() : 0);
+        vector<float> fbank_scratch(fbank ? fbank->scratch_size() : 0);
+        for (int row = 0; row < out.rows; row++)
+        {
+            const T* src = samples + row * frame_stride_tn;
+            if (window)
+            {
+                for (int i = 0; i < frame_length_tn; i++)
+                {
+                    frame[i] = src[i] * window[i];
+                }
+            }
+            else
+            {
+                for (int i = 0; i < frame_length_tn; i++)
+                {
+                    frame[i] = src[i];
+                }
+            }
+            if (fbank)
+            {
+                plan.magnitude(frame.data(), magnitude.data(), scratch.data());
+                fbank->apply(magnitude.data(), out.ptr<float>(row), fbank_scratch.data());
+            }
+            else
+            {
+                plan.magnitude(frame.data(), out.ptr<float>(row), scratch.data());
+            }
+        }
     }
 
-    // Go from time domain to strided signal
-    Mat wav_frames;
+    void wav_to_rows(const Mat&                     wav_col_mat,
+                     const rfft_plan&               plan,
+                     const nervana::mel_filterbank* fbank,
+                     const int                      frame_stride_tn,
+                     const int                      max_time_steps,
+                     const Mat&                     window,
+                     Mat&                           out)
     {
-        int num_frames = ((wav_mat.cols - frame_length_tn) / frame_stride_tn) + 1;
-        num_frames     = std::min(num_frames, max_time_steps);
-        // ensure that there is enough data for at least one frame
-        affirm(num_frames >= 0, "number of frames is negative");
+        // Read as a row vector
+        Mat wav_mat = wav_col_mat.reshape(1, 1);
 
-        wav_frames.create(num_frames, frame_length_tn, wav_mat.type());
-        for (int frame = 0; frame < num_frames; frame++)
+        // TODO: support more sample formats
+        if (wav_mat.elemSize1() != 2)
         {
-            int start = frame * frame_stride_tn;
-            int end   = start + frame_length_tn;
-            wav_mat.colRange(start, end).copyTo(wav_frames.row(frame));
+            throw std::runtime_error("Unsupported number of bytes per sample: " +
+                                     std::to_string(wav_mat.elemSize1()));
         }
-    }
 
-    // Prepare for DFT by converting to float
-    Mat input;
-    wav_frames.convertTo(input, CV_32FC1);
+        // a clip shorter than one frame has no frames, the division below truncates toward zero
+        // and would count one frame reading past the end of the samples
+        const int frame_length_tn = plan.size();
+        int       num_frames      = 0;
+        if (wav_mat.cols >= frame_length_tn)
+        {
+            num_frames = ((wav_mat.cols - frame_length_tn) / frame_stride_tn) + 1;
+        }
+        num_frames = std::min(num_frames, max_time_steps);
+        affirm(num_frames >= 0, "number of frames is negative");
 
-    // Apply window if it has been created
-    if (window.cols == frame_length_tn)
-    {
-        input = input.mul(cv::repeat(window, input.rows, 1));
+        // Apply window if it has been created
+        const float* win = window.cols == frame_length_tn ? window.ptr<float>() : nullptr;
+
+        // NOTE: rows are in (time_steps, freq_steps) shape order.
+        out.create(num_frames, fbank ? fbank->outputs() : plan.bins(), CV_32FC1);
+        if (wav_mat.depth() == CV_16U)
+        {
+            frames_to_rows(wav_mat.ptr<uint16_t>(), plan, fbank, frame_stride_tn, win, out);
+        }
+        else
+        {
+            frames_to_rows(wav_mat.ptr<int16_t>(), plan, fbank, frame_stride_tn, win, out);
+        }
     }
+}
 
-    Mat planes[] = {input, Mat::zeros(input.size(), CV_32FC1)};
-    Mat compx;
-    cv::merge(planes, 2, compx);
-    cv::dft(compx, compx, cv::DFT_ROWS);
-    compx = compx(Range::all(), Range(0, frame_length_tn / 2 + 1));
+// These can all be static
+void specgram::wav_to_specgram(const Mat& wav_col_mat,
+                               const int  frame_length_tn,
+                               const int  frame_stride_tn,
+                               const int  max_time_steps,
+                               const Mat& window,
+                               Mat&       specgram)
+{
+    wav_to_specgram(wav_col_mat,
+                    *get_fft_plan(frame_length_tn),
+                    frame_stride_tn,
+                    max_time_steps,
+                    window,
+                    specgram);
+}
 
-    cv::split(compx, planes);
-    cv::magnitude(planes[0], planes[1], planes[0]);
+void specgram::wav_to_specgram(const Mat&       wav_col_mat,
+                               const rfft_plan& plan,
+                               const int        frame_stride_tn,
+                               const int        max_time_steps,
+                               const Mat&       window,
+                               Mat&             specgram)
+{
+    wav_to_rows(wav_col_mat, plan, nullptr, frame_stride_tn, max_time_steps, window, specgram);
+}
 
-    // NOTE: at this point we are returning the specgram representation in
-    // (time_steps, freq_steps) shape order.
+void specgram::wav_to_features(const Mat&            wav_col_mat,
+                               const rfft_plan&      plan,
+                               const mel_filterbank& fbank,
+                               const int             frame_stride_tn,
+                               const int             max_time_steps,
+                               const Mat&            window,
+                               Mat&                  features)
+{
+    affirm(fbank.bins() == plan.bins(), "filterbank does not match the fft length");
+    wav_to_rows(wav_col_mat, plan, &fbank, frame_stride_tn, max_time_steps, window, features);
+}
 
-    specgram = planes[0];
+std::shared_ptr<const rfft_plan> specgram::get_fft_plan(const int frame_length_tn)
+{
+    static mutex                                      plan_mutex;
+    static map<int, std::shared_ptr<const rfft_plan>> plans;
 
-    return;
+    lock_guard<mutex> lock(plan_mutex);
+    auto              it = plans.find(frame_length_tn);
+    if (it == plans.end())
+    {
+        it = plans.emplace(frame_length_tn, make_shared<rfft_plan>(frame_length_tn)).first;
+    }
+    return it->second;
 }
 
 /** \brief Create an array of frequency weights to convert from linear
@@ -136,6 +219,19 @@ void specgram::specgram_to_cepsgram(const Mat& specgram, const Mat& filter_bank,
     return;
 }
 
+void specgram::specgram_to_features(const Mat&            specgram,
+                                    const mel_filterbank& fbank,
+                                    Mat&                  features)
+{
+    affirm(specgram.cols == fbank.bins(), "filterbank does not match the specgram");
+    features.create(specgram.rows, fbank.outputs(), CV_32FC1);
+    vector<float> scratch(fbank.scratch_size());
+    for (int row = 0; row < specgram.rows; row++)
+    {
+        fbank.apply(specgram.ptr<float>(row), features.ptr<float>(row), scratch.data());
+    }
+}
+
 void specgram::cepsgram_to_mfcc(const Mat& cepsgram, const int num_cepstra, Mat& mfcc)
 {
     affirm(num_cepstra <= cepsgram.cols, "num_cepstra <= cepsgram.cols");
@@ -187,3 +283,80 @@ void specgram::create_window(const std::string& window_type, const int n, Mat& w
         }
     }
 }
+
+mel_filterbank::mel_filterbank(const Mat& fbank, int num_cepstra)
+    : m_bins{fbank.rows}
+    , m_num_cepstra{num_cepstra}
+    , m_power_scale{1.0f / (2 * (fbank.rows - 1))}
+{
+    affirm(fbank.type() == CV_32FC1, "filterbank must be CV_32FC1");
+    affirm(num_cepstra <= fbank.cols, "num_cepstra <= cepsgram.cols");
+
+    for (int j = 0; j < fbank.cols; j++)
+    {
+        int begin = 0;
+        while (begin < fbank.rows && fbank.at<float>(begin, j) == 0.0f)
+        {
+            begin++;
+        }
+        int end = fbank.rows;
+        while (end > begin && fbank.at<float>(end - 1, j) == 0.0f)
+        {
+            end--;
+        }
+        m_begin.push_back(begin);
+        m_end.push_back(end);
+        m_offset.push_back(m_weights.size());
+        for (int i = begin; i < end; i++)
+        {
+            m_weights.push_back(fbank.at<float>(i, j));
+        }
+    }
+
+    if (m_num_cepstra > 0)
+    {
+        // cv::dct on the log mel energies zero padded to an even length, keeping only the
+        // first num_cepstra outputs
+        int          n  = fbank.cols + fbank.cols % 2;
+        const double pi = acos(-1.0);
+        m_dct.resize(m_num_cepstra * fbank.cols);
+        for (int k = 0; k < m_num_cepstra; k++)
+        {
+            double scale = k == 0 ? sqrt(1.0 / n) : sqrt(2.0 / n);
+            for (int j = 0; j < fbank.cols; j++)
+            {
+                m_dct[k * fbank.cols + j] = scale * cos(pi * (2 * j + 1) * k / (2.0 * n));
+            }
+        }
+    }
+}
+
+void mel_filterbank::apply(const float* magnitude, float* out, float* scratch) const
+{
+    const int num_filters = filters();
+    float*    energies    = m_num_cepstra > 0 ? scratch : out;
+    for (int j = 0; j < num_filters; j++)
+    {
+        const float* weight = &m_weights[m_offset[j]];
+        float        sum    = 0.0f;
+        for (int i = m_begin[j]; i < m_end[j]; i++)
+        {
+            sum += magnitude[i] * magnitude[i] * *weight++;
+        }
+        energies[j] = std::log(sum * m_power_scale);
+    }
+
+    if (m_num_cepstra > 0)
+    {
+        const float* basis = m_dct.data();
+        for (int k = 0; k < m_num_cepstra; k++)
+        {
+            float sum = 0.0f;
+            for (int j = 0; j < num_filters; j++)
+            {
+                sum += energies[j] * *basis++;
+            }
+            out[k] = sum;
+        }
+    }
+}
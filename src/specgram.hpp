@@ -23,14 +23,53 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <cmath>
+#include <vector>
+
+#include "fft.hpp"
 
 static_assert(sizeof(short) == 2, "Unsupported platform");
 
 namespace nervana
 {
     class specgram;
+    class mel_filterbank;
 }
 
+/**
+ * \brief Band-limited mel filterbank with an optional DCT stage
+ *
+ * Each triangular filter only covers a handful of frequency bins, so only the non-zero run of
+ * every filter is stored. apply() takes one frame of magnitudes through power, mel weighting,
+ * log and, for MFCC, the DCT in a single pass so the frame stays in cache.
+ */
+class nervana::mel_filterbank
+{
+public:
+    // fbank is a dense (freq bins x filters) matrix as built by specgram::create_filterbanks.
+    // num_cepstra of zero produces log mel energies (MFSC), otherwise the first num_cepstra
+    // MFCC coefficients.
+    mel_filterbank(const cv::Mat& fbank, int num_cepstra = 0);
+
+    int bins() const { return m_bins; }
+    int filters() const { return static_cast<int>(m_begin.size()); }
+    int outputs() const { return m_num_cepstra > 0 ? m_num_cepstra : filters(); }
+    // number of floats of scratch memory required by apply()
+    size_t scratch_size() const { return filters(); }
+
+    // magnitude holds bins() values, out receives outputs() values
+    void apply(const float* magnitude, float* out, float* scratch) const;
+
+private:
+    int                 m_bins;
+    int                 m_num_cepstra;
+    float               m_power_scale;
+    std::vector<int>    m_begin;   // first non-zero bin of each filter
+    std::vector<int>    m_end;     // one past the last non-zero bin of each filter
+    std::vector<size_t> m_offset;  // start of each filter in m_weights
+    std::vector<float>  m_weights; // concatenated non-zero weights
+    std::vector<float>  m_dct;     // num_cepstra x filters orthonormal DCT-II basis
+};
+
 class nervana::specgram
 {
 public:
@@ -43,10 +82,37 @@ public:
                                 const cv::Mat& window,
                                 cv::Mat&       specgram);
 
+    // Same as above with the frame length taken from a prebuilt plan. Frames are windowed
+    // straight out of the sample buffer and their magnitudes written into the rows of specgram.
+    static void wav_to_specgram(const cv::Mat&   wav_mat,
+                                const rfft_plan& plan,
+                                const int        frame_stride_tn,
+                                const int        max_time_steps,
+                                const cv::Mat&   window,
+                                cv::Mat&         specgram);
+
+    // Fused spectrogram and mel features. Each frame goes from samples to MFSC or MFCC
+    // without materializing the spectrogram.
+    static void wav_to_features(const cv::Mat&        wav_mat,
+                                const rfft_plan&      plan,
+                                const mel_filterbank& fbank,
+                                const int             frame_stride_tn,
+                                const int             max_time_steps,
+                                const cv::Mat&        window,
+                                cv::Mat&              features);
+
+    // Returns the shared plan for frame_length_tn, building it on first use.
+    static std::shared_ptr<const rfft_plan> get_fft_plan(const int frame_length_tn);
+
     static void specgram_to_cepsgram(const cv::Mat& specgram,
                                      const cv::Mat& filter_bank,
                                      cv::Mat&       cepsgram);
 
+    // Applies fbank to every row of specgram, producing MFSC or MFCC depending on fbank.
+    static void specgram_to_features(const cv::Mat&        specgram,
+                                     const mel_filterbank& fbank,
+                                     cv::Mat&              features);
+
     static void cepsgram_to_mfcc(const cv::Mat& cepsgram, const int num_cepstra, cv::Mat& mfcc);
 
     static void create_window(const std::string& window_type, const int n, cv::Mat& win);
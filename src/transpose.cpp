@@ -0,0 +1,783 @@
+/*******************************************************************************
+* Copyright 2017-2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <immintrin.h>
+
+#include "transpose.hpp"
+
+using namespace std;
+
+// Kernels above the SSE2 baseline are compiled for their own instruction set and only run once
+// the CPU has been checked for it
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw,avx512vl")))
+
+namespace
+{
+    // Source rows are walked in chunks so that the cache lines one panel reads are still
+    // cached when the panel to its right reads the next bytes of the same lines
+    const size_t row_chunk = 256;
+
+    template <typename T>
+    inline void scalar_edge(T* dest, size_t ds, const T* src, size_t ss, size_t rows, size_t cols)
+    {
+        for (size_t c = 0; c < cols; c++)
+        {
+            for (size_t r = 0; r < rows; r++)
+            {
+                dest[c * ds + r] = src[r * ss + c];
+            }
+        }
+    }
+
+    inline uint64_t low_bits(size_t n) { return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1; }
+    inline __m128i  load128(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+    inline void     store128(void* p, __m128i v) { _mm_storeu_si128((__m128i*)p, v); }
+    TARGET_AVX2 inline __m256i load256(const void* p)
+    {
+        return _mm256_loadu_si256((const __m256i*)p);
+    }
+    TARGET_AVX2 inline void store256(void* p, __m256i v)
+    {
+        _mm256_storeu_si256((__m256i*)p, v);
+    }
+
+    // 16 rows of 16 bytes. Each stage interleaves pairs of registers with twice the width of
+    // the one before, after four stages register k holds column k.
+    inline void transpose_16x16_epi8(__m128i r[16])
+    {
+        __m128i a[16], b[16], c[16];
+        for (int k = 0; k < 8; k++)
+        {
+            a[2 * k]     = _mm_unpacklo_epi8(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm_unpackhi_epi8(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 4; g++)
+        {
+            b[4 * g]     = _mm_unpacklo_epi16(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm_unpackhi_epi16(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm_unpacklo_epi16(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm_unpackhi_epi16(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int h = 0; h < 2; h++)
+        {
+            for (int m = 0; m < 4; m++)
+            {
+                c[8 * h + 2 * m]     = _mm_unpacklo_epi32(b[8 * h + m], b[8 * h + 4 + m]);
+                c[8 * h + 2 * m + 1] = _mm_unpackhi_epi32(b[8 * h + m], b[8 * h + 4 + m]);
+            }
+        }
+        for (int j = 0; j < 8; j++)
+        {
+            r[2 * j]     = _mm_unpacklo_epi64(c[j], c[8 + j]);
+            r[2 * j + 1] = _mm_unpackhi_epi64(c[j], c[8 + j]);
+        }
+    }
+
+    // 8 rows of 8 words, register k ends up holding column k
+    inline void transpose_8x8_epi16(__m128i r[8])
+    {
+        __m128i a[8], b[8];
+        for (int k = 0; k < 4; k++)
+        {
+            a[2 * k]     = _mm_unpacklo_epi16(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm_unpackhi_epi16(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 2; g++)
+        {
+            b[4 * g]     = _mm_unpacklo_epi32(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm_unpackhi_epi32(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm_unpacklo_epi32(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm_unpackhi_epi32(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int m = 0; m < 4; m++)
+        {
+            r[2 * m]     = _mm_unpacklo_epi64(b[m], b[4 + m]);
+            r[2 * m + 1] = _mm_unpackhi_epi64(b[m], b[4 + m]);
+        }
+    }
+
+    // The same stages on both 128 bit lanes of a register at once, lane 0 transposes the left
+    // half of the rows and lane 1 the right half
+    TARGET_AVX2 inline void transpose_16x16_epi8_lanes(__m256i r[16])
+    {
+        __m256i a[16], b[16], c[16];
+        for (int k = 0; k < 8; k++)
+        {
+            a[2 * k]     = _mm256_unpacklo_epi8(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm256_unpackhi_epi8(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 4; g++)
+        {
+            b[4 * g]     = _mm256_unpacklo_epi16(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm256_unpackhi_epi16(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm256_unpacklo_epi16(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm256_unpackhi_epi16(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int h = 0; h < 2; h++)
+        {
+            for (int m = 0; m < 4; m++)
+            {
+                c[8 * h + 2 * m]     = _mm256_unpacklo_epi32(b[8 * h + m], b[8 * h + 4 + m]);
+                c[8 * h + 2 * m + 1] = _mm256_unpackhi_epi32(b[8 * h + m], b[8 * h + 4 + m]);
+            }
+        }
+        for (int j = 0; j < 8; j++)
+        {
+            r[2 * j]     = _mm256_unpacklo_epi64(c[j], c[8 + j]);
+            r[2 * j + 1] = _mm256_unpackhi_epi64(c[j], c[8 + j]);
+        }
+    }
+
+    TARGET_AVX2 inline void transpose_8x8_epi16_lanes(__m256i r[8])
+    {
+        __m256i a[8], b[8];
+        for (int k = 0; k < 4; k++)
+        {
+            a[2 * k]     = _mm256_unpacklo_epi16(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm256_unpackhi_epi16(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 2; g++)
+        {
+            b[4 * g]     = _mm256_unpacklo_epi32(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm256_unpackhi_epi32(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm256_unpacklo_epi32(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm256_unpackhi_epi32(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int m = 0; m < 4; m++)
+        {
+            r[2 * m]     = _mm256_unpacklo_epi64(b[m], b[4 + m]);
+            r[2 * m + 1] = _mm256_unpackhi_epi64(b[m], b[4 + m]);
+        }
+    }
+
+    // 8 rows of 8 dwords. After two in-lane stages lane l of b[4 * g + m] holds column
+    // 4 * l + m of rows 4 * g to 4 * g + 3, the lanes are then swapped across.
+    TARGET_AVX2 inline void transpose_8x8_epi32(__m256i r[8])
+    {
+        __m256i a[8], b[8];
+        for (int k = 0; k < 4; k++)
+        {
+            a[2 * k]     = _mm256_unpacklo_epi32(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm256_unpackhi_epi32(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 2; g++)
+        {
+            b[4 * g]     = _mm256_unpacklo_epi64(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm256_unpackhi_epi64(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm256_unpacklo_epi64(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm256_unpackhi_epi64(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int m = 0; m < 4; m++)
+        {
+            r[m]     = _mm256_permute2x128_si256(b[m], b[4 + m], 0x20);
+            r[4 + m] = _mm256_permute2x128_si256(b[m], b[4 + m], 0x31);
+        }
+    }
+
+    TARGET_AVX2 inline void transpose_4x4_epi64(__m256i r[4])
+    {
+        __m256i a0 = _mm256_unpacklo_epi64(r[0], r[1]);
+        __m256i a1 = _mm256_unpackhi_epi64(r[0], r[1]);
+        __m256i a2 = _mm256_unpacklo_epi64(r[2], r[3]);
+        __m256i a3 = _mm256_unpackhi_epi64(r[2], r[3]);
+        r[0]       = _mm256_permute2x128_si256(a0, a2, 0x20);
+        r[1]       = _mm256_permute2x128_si256(a1, a3, 0x20);
+        r[2]       = _mm256_permute2x128_si256(a0, a2, 0x31);
+        r[3]       = _mm256_permute2x128_si256(a1, a3, 0x31);
+    }
+
+    // 16 rows of 16 dwords. The in-lane stages leave lane l of b[4 * g + m] with column
+    // 4 * l + m of rows 4 * g to 4 * g + 3, two rounds of lane shuffles gather the columns.
+    TARGET_AVX512 inline void transpose_16x16_epi32(__m512i r[16])
+    {
+        __m512i a[16], b[16];
+        for (int k = 0; k < 8; k++)
+        {
+            a[2 * k]     = _mm512_unpacklo_epi32(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm512_unpackhi_epi32(r[2 * k], r[2 * k + 1]);
+        }
+        for (int g = 0; g < 4; g++)
+        {
+            b[4 * g]     = _mm512_unpacklo_epi64(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 1] = _mm512_unpackhi_epi64(a[4 * g], a[4 * g + 2]);
+            b[4 * g + 2] = _mm512_unpacklo_epi64(a[4 * g + 1], a[4 * g + 3]);
+            b[4 * g + 3] = _mm512_unpackhi_epi64(a[4 * g + 1], a[4 * g + 3]);
+        }
+        for (int m = 0; m < 4; m++)
+        {
+            __m512i u0 = _mm512_shuffle_i32x4(b[m], b[4 + m], 0x88);
+            __m512i u1 = _mm512_shuffle_i32x4(b[m], b[4 + m], 0xDD);
+            __m512i v0 = _mm512_shuffle_i32x4(b[8 + m], b[12 + m], 0x88);
+            __m512i v1 = _mm512_shuffle_i32x4(b[8 + m], b[12 + m], 0xDD);
+            r[m]       = _mm512_shuffle_i32x4(u0, v0, 0x88);
+            r[4 + m]   = _mm512_shuffle_i32x4(u1, v1, 0x88);
+            r[8 + m]   = _mm512_shuffle_i32x4(u0, v0, 0xDD);
+            r[12 + m]  = _mm512_shuffle_i32x4(u1, v1, 0xDD);
+        }
+    }
+
+    // 8 rows of 8 qwords, lane l of a[2 * k + m] holds column 2 * l + m of rows 2 * k and
+    // 2 * k + 1 after the first stage
+    TARGET_AVX512 inline void transpose_8x8_epi64(__m512i r[8])
+    {
+        __m512i a[8];
+        for (int k = 0; k < 4; k++)
+        {
+            a[2 * k]     = _mm512_unpacklo_epi64(r[2 * k], r[2 * k + 1]);
+            a[2 * k + 1] = _mm512_unpackhi_epi64(r[2 * k], r[2 * k + 1]);
+        }
+        for (int m = 0; m < 2; m++)
+        {
+            __m512i u0 = _mm512_shuffle_i64x2(a[m], a[2 + m], 0x88);
+            __m512i u1 = _mm512_shuffle_i64x2(a[m], a[2 + m], 0xDD);
+            __m512i v0 = _mm512_shuffle_i64x2(a[4 + m], a[6 + m], 0x88);
+            __m512i v1 = _mm512_shuffle_i64x2(a[4 + m], a[6 + m], 0xDD);
+            r[m]       = _mm512_shuffle_i64x2(u0, v0, 0x88);
+            r[2 + m]   = _mm512_shuffle_i64x2(u1, v1, 0x88);
+            r[4 + m]   = _mm512_shuffle_i64x2(u0, v0, 0xDD);
+            r[6 + m]   = _mm512_shuffle_i64x2(u1, v1, 0xDD);
+        }
+    }
+
+    // Every kernel transposes full tiles of rows x cols elements with tile() and the partial
+    // tiles at the bottom and right edges with edge()
+
+    struct sse2_1
+    {
+        typedef uint8_t     type;
+        static const size_t rows = 16;
+        static const size_t cols = 16;
+        static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m128i r[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                r[i] = load128(src + i * ss);
+            }
+            transpose_16x16_epi8(r);
+            for (size_t i = 0; i < 16; i++)
+            {
+                store128(dest + i * ds, r[i]);
+            }
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    struct sse2_2
+    {
+        typedef uint16_t    type;
+        static const size_t rows = 8;
+        static const size_t cols = 8;
+        static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m128i r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = load128(src + i * ss);
+            }
+            transpose_8x8_epi16(r);
+            for (size_t i = 0; i < 8; i++)
+            {
+                store128(dest + i * ds, r[i]);
+            }
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    struct sse2_4
+    {
+        typedef uint32_t    type;
+        static const size_t rows = 4;
+        static const size_t cols = 4;
+        static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m128i r0 = load128(src);
+            __m128i r1 = load128(src + ss);
+            __m128i r2 = load128(src + 2 * ss);
+            __m128i r3 = load128(src + 3 * ss);
+            __m128i a0 = _mm_unpacklo_epi32(r0, r1);
+            __m128i a1 = _mm_unpackhi_epi32(r0, r1);
+            __m128i a2 = _mm_unpacklo_epi32(r2, r3);
+            __m128i a3 = _mm_unpackhi_epi32(r2, r3);
+            store128(dest, _mm_unpacklo_epi64(a0, a2));
+            store128(dest + ds, _mm_unpackhi_epi64(a0, a2));
+            store128(dest + 2 * ds, _mm_unpacklo_epi64(a1, a3));
+            store128(dest + 3 * ds, _mm_unpackhi_epi64(a1, a3));
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    struct sse2_8
+    {
+        typedef uint64_t    type;
+        static const size_t rows = 2;
+        static const size_t cols = 2;
+        static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m128i r0 = load128(src);
+            __m128i r1 = load128(src + ss);
+            store128(dest, _mm_unpacklo_epi64(r0, r1));
+            store128(dest + ds, _mm_unpackhi_epi64(r0, r1));
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    // Two 16 x 16 byte tiles side by side, one per lane
+    struct avx2_1
+    {
+        typedef uint8_t     type;
+        static const size_t rows = 16;
+        static const size_t cols = 32;
+        TARGET_AVX2 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m256i r[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                r[i] = load256(src + i * ss);
+            }
+            transpose_16x16_epi8_lanes(r);
+            for (size_t i = 0; i < 16; i++)
+            {
+                store128(dest + i * ds, _mm256_castsi256_si128(r[i]));
+                store128(dest + (16 + i) * ds, _mm256_extracti128_si256(r[i], 1));
+            }
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    // Two 8 x 8 word tiles side by side, one per lane
+    struct avx2_2
+    {
+        typedef uint16_t    type;
+        static const size_t rows = 8;
+        static const size_t cols = 16;
+        TARGET_AVX2 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m256i r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = load256(src + i * ss);
+            }
+            transpose_8x8_epi16_lanes(r);
+            for (size_t i = 0; i < 8; i++)
+            {
+                store128(dest + i * ds, _mm256_castsi256_si128(r[i]));
+                store128(dest + (8 + i) * ds, _mm256_extracti128_si256(r[i], 1));
+            }
+        }
+        static void edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            scalar_edge(dest, ds, src, ss, rn, cn);
+        }
+    };
+
+    struct avx2_4
+    {
+        typedef uint32_t    type;
+        static const size_t rows = 8;
+        static const size_t cols = 8;
+        TARGET_AVX2 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m256i r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = load256(src + i * ss);
+            }
+            transpose_8x8_epi32(r);
+            for (size_t i = 0; i < 8; i++)
+            {
+                store256(dest + i * ds, r[i]);
+            }
+        }
+        TARGET_AVX2 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __m256i lane      = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i load_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(cn)), lane);
+            __m256i       r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = i < rn ? _mm256_maskload_epi32((const int*)(src + i * ss), load_mask)
+                              : _mm256_setzero_si256();
+            }
+            transpose_8x8_epi32(r);
+            const __m256i store_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(rn)), lane);
+            for (size_t i = 0; i < cn; i++)
+            {
+                _mm256_maskstore_epi32((int*)(dest + i * ds), store_mask, r[i]);
+            }
+        }
+    };
+
+    struct avx2_8
+    {
+        typedef uint64_t    type;
+        static const size_t rows = 4;
+        static const size_t cols = 4;
+        TARGET_AVX2 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m256i r[4];
+            for (size_t i = 0; i < 4; i++)
+            {
+                r[i] = load256(src + i * ss);
+            }
+            transpose_4x4_epi64(r);
+            for (size_t i = 0; i < 4; i++)
+            {
+                store256(dest + i * ds, r[i]);
+            }
+        }
+        TARGET_AVX2 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __m256i lane      = _mm256_setr_epi64x(0, 1, 2, 3);
+            const __m256i load_mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(cn), lane);
+            __m256i       r[4];
+            for (size_t i = 0; i < 4; i++)
+            {
+                r[i] = i < rn ? _mm256_maskload_epi64((const long long*)(src + i * ss), load_mask)
+                              : _mm256_setzero_si256();
+            }
+            transpose_4x4_epi64(r);
+            const __m256i store_mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(rn), lane);
+            for (size_t i = 0; i < cn; i++)
+            {
+                _mm256_maskstore_epi64((long long*)(dest + i * ds), store_mask, r[i]);
+            }
+        }
+    };
+
+    // The AVX2 byte and word tiles with edges that use the byte and word masks of AVX-512BW
+    struct avx512_1 : public avx2_1
+    {
+        TARGET_AVX512 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __mmask32 load_mask = __mmask32(low_bits(cn));
+            __m256i         r[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                r[i] = i < rn ? _mm256_maskz_loadu_epi8(load_mask, src + i * ss)
+                              : _mm256_setzero_si256();
+            }
+            transpose_16x16_epi8_lanes(r);
+            const __mmask16 store_mask = __mmask16(low_bits(rn));
+            for (size_t i = 0; i < cn; i++)
+            {
+                __m128i column = i < 16 ? _mm256_castsi256_si128(r[i])
+                                        : _mm256_extracti128_si256(r[i - 16], 1);
+                _mm_mask_storeu_epi8(dest + i * ds, store_mask, column);
+            }
+        }
+    };
+
+    struct avx512_2 : public avx2_2
+    {
+        TARGET_AVX512 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __mmask16 load_mask = __mmask16(low_bits(cn));
+            __m256i         r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = i < rn ? _mm256_maskz_loadu_epi16(load_mask, src + i * ss)
+                              : _mm256_setzero_si256();
+            }
+            transpose_8x8_epi16_lanes(r);
+            const __mmask8 store_mask = __mmask8(low_bits(rn));
+            for (size_t i = 0; i < cn; i++)
+            {
+                __m128i column = i < 8 ? _mm256_castsi256_si128(r[i])
+                                       : _mm256_extracti128_si256(r[i - 8], 1);
+                _mm_mask_storeu_epi16(dest + i * ds, store_mask, column);
+            }
+        }
+    };
+
+    struct avx512_4
+    {
+        typedef uint32_t    type;
+        static const size_t rows = 16;
+        static const size_t cols = 16;
+        TARGET_AVX512 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m512i r[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                r[i] = _mm512_loadu_si512(src + i * ss);
+            }
+            transpose_16x16_epi32(r);
+            for (size_t i = 0; i < 16; i++)
+            {
+                _mm512_storeu_si512(dest + i * ds, r[i]);
+            }
+        }
+        TARGET_AVX512 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __mmask16 load_mask = __mmask16(low_bits(cn));
+            __m512i         r[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                r[i] = i < rn ? _mm512_maskz_loadu_epi32(load_mask, src + i * ss)
+                              : _mm512_setzero_si512();
+            }
+            transpose_16x16_epi32(r);
+            const __mmask16 store_mask = __mmask16(low_bits(rn));
+            for (size_t i = 0; i < cn; i++)
+            {
+                _mm512_mask_storeu_epi32(dest + i * ds, store_mask, r[i]);
+            }
+        }
+    };
+
+    struct avx512_8
+    {
+        typedef uint64_t    type;
+        static const size_t rows = 8;
+        static const size_t cols = 8;
+        TARGET_AVX512 static void tile(type* dest, size_t ds, const type* src, size_t ss)
+        {
+            __m512i r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = _mm512_loadu_si512(src + i * ss);
+            }
+            transpose_8x8_epi64(r);
+            for (size_t i = 0; i < 8; i++)
+            {
+                _mm512_storeu_si512(dest + i * ds, r[i]);
+            }
+        }
+        TARGET_AVX512 static void
+            edge(type* dest, size_t ds, const type* src, size_t ss, size_t rn, size_t cn)
+        {
+            const __mmask8 load_mask = __mmask8(low_bits(cn));
+            __m512i        r[8];
+            for (size_t i = 0; i < 8; i++)
+            {
+                r[i] = i < rn ? _mm512_maskz_loadu_epi64(load_mask, src + i * ss)
+                              : _mm512_setzero_si512();
+            }
+            transpose_8x8_epi64(r);
+            const __mmask8 store_mask = __mmask8(low_bits(rn));
+            for (size_t i = 0; i < cn; i++)
+            {
+                _mm512_mask_storeu_epi64(dest + i * ds, store_mask, r[i]);
+            }
+        }
+    };
+
+    // A panel is one tile wide and runs down the rows, writing K::cols consecutive destination
+    // rows. There is one per instruction set so that the tile and edge code is inlined into it.
+    template <typename K>
+    void panel_sse2(typename K::type*       dest,
+                    size_t                  ds,
+                    const typename K::type* src,
+                    size_t                  ss,
+                    size_t                  rows,
+                    size_t                  cols)
+    {
+        size_t r = 0;
+        if (cols == K::cols)
+        {
+            for (; r + K::rows <= rows; r += K::rows)
+            {
+                K::tile(dest + r, ds, src + r * ss, ss);
+            }
+        }
+        for (; r < rows; r += K::rows)
+        {
+            K::edge(dest + r, ds, src + r * ss, ss, min(size_t(K::rows), rows - r), cols);
+        }
+    }
+
+    template <typename K>
+    TARGET_AVX2 void panel_avx2(typename K::type*       dest,
+                                size_t                  ds,
+                                const typename K::type* src,
+                                size_t                  ss,
+                                size_t                  rows,
+                                size_t                  cols)
+    {
+        size_t r = 0;
+        if (cols == K::cols)
+        {
+            for (; r + K::rows <= rows; r += K::rows)
+            {
+                K::tile(dest + r, ds, src + r * ss, ss);
+            }
+        }
+        for (; r < rows; r += K::rows)
+        {
+            K::edge(dest + r, ds, src + r * ss, ss, min(size_t(K::rows), rows - r), cols);
+        }
+    }
+
+    template <typename K>
+    TARGET_AVX512 void panel_avx512(typename K::type*       dest,
+                                    size_t                  ds,
+                                    const typename K::type* src,
+                                    size_t                  ss,
+                                    size_t                  rows,
+                                    size_t                  cols)
+    {
+        size_t r = 0;
+        if (cols == K::cols)
+        {
+            for (; r + K::rows <= rows; r += K::rows)
+            {
+                K::tile(dest + r, ds, src + r * ss, ss);
+            }
+        }
+        for (; r < rows; r += K::rows)
+        {
+            K::edge(dest + r, ds, src + r * ss, ss, min(size_t(K::rows), rows - r), cols);
+        }
+    }
+
+    template <typename K,
+              void (*panel)(typename K::type*,
+                            size_t,
+                            const typename K::type*,
+                            size_t,
+                            size_t,
+                            size_t)>
+    void walk(void* dest, size_t ds, const void* src, size_t ss, size_t rows, size_t cols)
+    {
+        typedef typename K::type T;
+        T*                       d = static_cast<T*>(dest);
+        const T*                 s = static_cast<const T*>(src);
+        for (size_t r = 0; r < rows; r += row_chunk)
+        {
+            size_t chunk = min(row_chunk, rows - r);
+            for (size_t c = 0; c < cols; c += K::cols)
+            {
+                size_t width = min(size_t(K::cols), cols - c);
+                panel(d + c * ds + r, ds, s + r * ss + c, ss, chunk, width);
+            }
+        }
+    }
+
+    typedef void (*kernel_function)(void*, size_t, const void*, size_t, size_t, size_t);
+
+    // Indexed by instruction set, then by log2 of the element size
+    const kernel_function kernels[3][4] = {
+        {walk<sse2_1, panel_sse2<sse2_1>>,
+         walk<sse2_2, panel_sse2<sse2_2>>,
+         walk<sse2_4, panel_sse2<sse2_4>>,
+         walk<sse2_8, panel_sse2<sse2_8>>},
+        {walk<avx2_1, panel_avx2<avx2_1>>,
+         walk<avx2_2, panel_avx2<avx2_2>>,
+         walk<avx2_4, panel_avx2<avx2_4>>,
+         walk<avx2_8, panel_avx2<avx2_8>>},
+        {walk<avx512_1, panel_avx512<avx512_1>>,
+         walk<avx512_2, panel_avx512<avx512_2>>,
+         walk<avx512_4, panel_avx512<avx512_4>>,
+         walk<avx512_8, panel_avx512<avx512_8>>}};
+
+    transpose::isa detect_isa()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+            __builtin_cpu_supports("avx512vl"))
+        {
+            return transpose::isa::avx512;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return transpose::isa::avx2;
+        }
+        return transpose::isa::sse2;
+    }
+}
+
+transpose::isa transpose::supported_isa()
+{
+    static const isa kernel = detect_isa();
+    return kernel;
+}
+
+const char* transpose::isa_name(isa kernel)
+{
+    switch (kernel)
+    {
+    case isa::sse2: return "sse2";
+    case isa::avx2: return "avx2";
+    case isa::avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+void transpose::block(void*       dest,
+                      size_t      dest_stride,
+                      const void* src,
+                      size_t      src_stride,
+                      size_t      rows,
+                      size_t      cols,
+                      size_t      element_size)
+{
+    block(dest, dest_stride, src, src_stride, rows, cols, element_size, supported_isa());
+}
+
+void transpose::block(void*       dest,
+                      size_t      dest_stride,
+                      const void* src,
+                      size_t      src_stride,
+                      size_t      rows,
+                      size_t      cols,
+                      size_t      element_size,
+                      isa         kernel)
+{
+    if (int(kernel) > int(supported_isa()))
+    {
+        throw invalid_argument(string("transpose kernel not supported by this cpu: ") +
+                               isa_name(kernel));
+    }
+
+    size_t width;
+    switch (element_size)
+    {
+    case 1: width = 0; break;
+    case 2: width = 1; break;
+    case 4: width = 2; break;
+    case 8: width = 3; break;
+    default:
+        throw invalid_argument("unsupported element size for transpose " +
+                               to_string(element_size));
+    }
+    kernels[int(kernel)][width](dest, dest_stride, src, src_stride, rows, cols);
+}
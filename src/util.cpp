@@ -271,7 +271,7 @@ nervana::random_engine_t& nervana::get_thread_local_random_engine()
     return local_random_engine;
 }
 
-cv::Mat nervana::read_audio_from_mem(const char* item, int itemSize)
+cv::Mat nervana::read_audio_from_mem(const char* item, int itemSize, uint32_t* sample_rate_hz)
 {
     SOX_SAMPLE_LOCALS;
     sox_format_t* in = sox_open_mem_read((void*)item, itemSize, NULL, NULL, NULL);
@@ -280,6 +280,10 @@ cv::Mat nervana::read_audio_from_mem(const char* item, int itemSize)
     {
         affirm(in->signal.channels == 1, "input audio must be single channel");
         affirm(in->signal.precision == 16, "input audio must be signed short");
+        if (sample_rate_hz)
+        {
+            *sample_rate_hz = in->signal.rate;
+        }
 
         sox_sample_t* sample_buffer = new sox_sample_t[in->signal.length];
         size_t        number_read   = sox_read(in, sample_buffer, in->signal.length);
@@ -169,6 +169,13 @@ namespace nervana
         {
         }
 
+        // An istream only reads the get area and memstream has no put back, so the data is
+        // never written through the stream buffer.
+        memory_stream(const char* data, size_t size)
+            : memory_stream{const_cast<char*>(data), size}
+        {
+        }
+
     private:
         memstream<char> wrapper;
     };
@@ -178,7 +185,9 @@ namespace nervana
     typedef std::minstd_rand0 random_engine_t;
     random_engine_t&          get_thread_local_random_engine();
 
-    cv::Mat read_audio_from_mem(const char* item, int itemSize);
+    cv::Mat read_audio_from_mem(const char* item,
+                                int         itemSize,
+                                uint32_t*   sample_rate_hz = nullptr);
     void write_audio_to_file(cv::Mat buffer, std::string path, sox_rate_t sample_rate_hz);
 
     std::vector<char> string2vector(const std::string& s);
@@ -17,8 +17,13 @@
 #include <fstream>
 #include "gtest/gtest.h"
 #include <sox.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <utime.h>
 
 #include "etl_audio.hpp"
+#include "file_util.hpp"
+#include "pcm.hpp"
 #include "wav_data.hpp"
 
 using namespace std;
@@ -99,6 +104,160 @@ TEST(audio, specgram)
     ASSERT_EQ(cv::countNonZero(diff), 0);
 }
 
+TEST(audio, pcm_fast_path)
+{
+    sinewave_generator sg{400, 500};
+    wav_data           mono(sg, 1, 16000, false);
+    wav_data           stereo(sg, 1, 16000, true);
+
+    vector<char> mono_buf(wav_data::HEADER_SIZE + mono.nbytes());
+    vector<char> stereo_buf(wav_data::HEADER_SIZE + stereo.nbytes());
+    mono.write_to_buffer(mono_buf.data(), mono_buf.size());
+    stereo.write_to_buffer(stereo_buf.data(), stereo_buf.size());
+
+    pcm::format fmt;
+    ASSERT_TRUE(pcm::parse_wav(stereo_buf.data(), stereo_buf.size(), fmt));
+    EXPECT_EQ(2, fmt.channels);
+    EXPECT_EQ(16000, fmt.sample_rate);
+    EXPECT_EQ(16000, fmt.frames);
+    EXPECT_FALSE(pcm::parse_wav(mono_buf.data(), 20, fmt));
+
+    // mono at the native rate is wrapped without a copy
+    bool    borrowed;
+    cv::Mat samples = pcm::read(mono_buf.data(), mono_buf.size(), 0, borrowed);
+    EXPECT_TRUE(borrowed);
+    EXPECT_EQ(static_cast<const void*>(mono_buf.data() + wav_data::HEADER_SIZE),
+              static_cast<const void*>(samples.data));
+    EXPECT_EQ(0, cv::countNonZero(samples != mono.get_data()));
+
+    // identical channels down-mix to the mono signal
+    cv::Mat downmixed = pcm::read(stereo_buf.data(), stereo_buf.size(), 16000, borrowed);
+    EXPECT_FALSE(borrowed);
+    EXPECT_EQ(0, cv::countNonZero(downmixed != mono.get_data()));
+
+    cv::Mat resampled = pcm::read(mono_buf.data(), mono_buf.size(), 8000, borrowed);
+    EXPECT_FALSE(borrowed);
+    ASSERT_EQ(8000, resampled.rows);
+    for (int i = 0; i < resampled.rows; i++)
+    {
+        ASSERT_EQ(mono.get_data().at<int16_t>(2 * i, 0), resampled.at<int16_t>(i, 0));
+    }
+
+    // the transformer copies borrowed samples before adding noise in place
+    auto decoded = make_shared<audio::decoded>(samples, true);
+    decoded->own_time_data();
+    EXPECT_FALSE(decoded->borrows_time_data());
+    EXPECT_NE(samples.data, decoded->get_time_data().data);
+}
+
+TEST(audio, pcm_downmix)
+{
+    vector<int16_t> interleaved = {-3, 0, 100, 101, INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN,
+                                   1,  2, 3,   4,   5,         6,         7,         8,
+                                   -1, -2};
+    vector<int16_t> expected = {-2, 100, INT16_MAX, INT16_MIN, 1, 3, 5, 7, -2};
+    vector<int16_t> out(expected.size());
+    pcm::downmix(interleaved.data(), 2, out.size(), out.data());
+    EXPECT_EQ(expected, out);
+
+    vector<int16_t> three = {1, 2, 4, -1, -1, -2};
+    out.resize(2);
+    pcm::downmix(three.data(), 3, 2, out.data());
+    EXPECT_EQ(2, out[0]);
+    EXPECT_EQ(-2, out[1]);
+}
+
+TEST(audio, rfft_plan)
+{
+    // Compare against the complex OpenCV DFT for power of two, mixed radix, prime and odd lengths
+    for (int n : {1, 2, 6, 64, 160, 256, 400, 441, 512, 1021})
+    {
+        cv::Mat input(1, n, CV_32FC1);
+        cv::randu(input, -1.0, 1.0);
+
+        cv::Mat planes[] = {input, cv::Mat::zeros(input.size(), CV_32FC1)};
+        cv::Mat compx;
+        cv::merge(planes, 2, compx);
+        cv::dft(compx, compx);
+        cv::split(compx, planes);
+        cv::Mat expected;
+        cv::magnitude(planes[0], planes[1], expected);
+
+        rfft_plan     plan(n);
+        vector<float> scratch(plan.scratch_size());
+        cv::Mat       actual(1, plan.bins(), CV_32FC1);
+        plan.magnitude(input.ptr<float>(), actual.ptr<float>(), scratch.data());
+
+        for (int k = 0; k < plan.bins(); k++)
+        {
+            EXPECT_NEAR(expected.at<float>(0, k), actual.at<float>(0, k), 1e-4 * n) << n;
+        }
+    }
+    EXPECT_THROW(rfft_plan(0), std::invalid_argument);
+}
+
+TEST(audio, specgram_short_clip)
+{
+    // a clip one sample shorter than a frame produces no frames instead of reading past its end
+    int                frame_length_tn = 400;
+    sinewave_generator sg{440};
+    wav_data           wav(sg, 1, frame_length_tn - 1, false);
+
+    cv::Mat spec;
+    specgram::wav_to_specgram(
+        wav.get_data(), *specgram::get_fft_plan(frame_length_tn), 160, 1000, cv::Mat(), spec);
+    EXPECT_EQ(0, spec.rows);
+}
+
+TEST(audio, specgram_windowed)
+{
+    sinewave_generator sg{440};
+    wav_data           wav(sg, 1, 16000, false);
+    const cv::Mat&     samples = wav.get_data();
+
+    int     frame_length_tn = 400;
+    int     frame_stride_tn = 160;
+    cv::Mat window;
+    specgram::create_window("hann", frame_length_tn, window);
+
+    cv::Mat spec;
+    specgram::wav_to_specgram(samples,
+                              *specgram::get_fft_plan(frame_length_tn),
+                              frame_stride_tn,
+                              1000,
+                              window,
+                              spec);
+    ASSERT_EQ((samples.rows - frame_length_tn) / frame_stride_tn + 1, spec.rows);
+    ASSERT_EQ(frame_length_tn / 2 + 1, spec.cols);
+
+    // plans are shared between callers
+    EXPECT_EQ(specgram::get_fft_plan(frame_length_tn), specgram::get_fft_plan(frame_length_tn));
+
+    for (int row = 0; row < spec.rows; row += 17)
+    {
+        cv::Mat frame;
+        samples.rowRange(row * frame_stride_tn, row * frame_stride_tn + frame_length_tn)
+            .reshape(1, 1)
+            .convertTo(frame, CV_32FC1);
+        frame = frame.mul(window);
+
+        cv::Mat planes[] = {frame, cv::Mat::zeros(frame.size(), CV_32FC1)};
+        cv::Mat compx;
+        cv::merge(planes, 2, compx);
+        cv::dft(compx, compx);
+        cv::split(compx, planes);
+        cv::Mat expected;
+        cv::magnitude(planes[0], planes[1], expected);
+
+        for (int k = 0; k < spec.cols; k++)
+        {
+            EXPECT_NEAR(expected.at<float>(0, k),
+                        spec.at<float>(row, k),
+                        1e-6 * INT16_MAX * frame_length_tn);
+        }
+    }
+}
+
 TEST(audio, transform)
 {
     auto js     = R"(
@@ -393,6 +552,147 @@ TEST(audio, filterbank)
     }
 }
 
+TEST(audio, sparse_filterbank)
+{
+    int sample_rate     = 16000;
+    int frame_length_tn = 320;
+    int frame_stride_tn = 160;
+
+    cv::Mat samples(sample_rate, 1, CV_16SC1);
+    cv::randu(samples, -8000, 8000);
+    cv::Mat window;
+    specgram::create_window("hann", frame_length_tn, window);
+    cv::Mat spec;
+    specgram::wav_to_specgram(samples, frame_length_tn, frame_stride_tn, 200, window, spec);
+
+    // odd filter count exercises the zero padding of the dct
+    for (int num_filters : {40, 41})
+    {
+        cv::Mat dense;
+        specgram::create_filterbanks(num_filters, frame_length_tn, sample_rate, dense);
+
+        cv::Mat expected_mfsc, expected_mfcc;
+        specgram::specgram_to_cepsgram(spec, dense, expected_mfsc);
+        specgram::cepsgram_to_mfcc(expected_mfsc, 13, expected_mfcc);
+
+        mel_filterbank mfsc(dense);
+        mel_filterbank mfcc(dense, 13);
+        cv::Mat        actual_mfsc, actual_mfcc, fused_mfcc;
+        specgram::specgram_to_features(spec, mfsc, actual_mfsc);
+        specgram::specgram_to_features(spec, mfcc, actual_mfcc);
+        specgram::wav_to_features(samples,
+                                  *specgram::get_fft_plan(frame_length_tn),
+                                  mfcc,
+                                  frame_stride_tn,
+                                  200,
+                                  window,
+                                  fused_mfcc);
+
+        ASSERT_EQ(expected_mfsc.size(), actual_mfsc.size());
+        ASSERT_EQ(expected_mfcc.size(), actual_mfcc.size());
+        ASSERT_EQ(expected_mfcc.size(), fused_mfcc.size());
+        EXPECT_LT(cv::norm(expected_mfsc, actual_mfsc, cv::NORM_INF), 1e-3);
+        EXPECT_LT(cv::norm(expected_mfcc, actual_mfcc, cv::NORM_INF), 1e-3);
+        EXPECT_LT(cv::norm(expected_mfcc, fused_mfcc, cv::NORM_INF), 1e-3);
+    }
+}
+
+TEST(audio, noise_mix)
+{
+    cv::Mat wav(1003, 1, CV_16SC1);
+    cv::Mat noise(1003, 1, CV_16SC1);
+    cv::randu(wav, INT16_MIN, INT16_MAX);
+    cv::randu(noise, INT16_MIN, INT16_MAX);
+
+    cv::Mat expected;
+    cv::addWeighted(wav, 1.0f, noise, 0.7f, 0.0f, expected);
+    noise_clips::mix(wav.ptr<int16_t>(), noise.ptr<int16_t>(), wav.rows, 0.7f);
+    EXPECT_EQ(0, cv::countNonZero(expected != wav));
+}
+
+TEST(audio, noise_pack)
+{
+    string tmp_dir    = file_util::make_temp_directory();
+    string index_file = file_util::path_join(tmp_dir, "noise_index.txt");
+    {
+        ofstream index(index_file);
+        for (int i = 0; i < 2; i++)
+        {
+            sinewave_generator sg{400.0f * (i + 1), 1000};
+            wav_data           wav(sg, 1, 8000, false);
+            string             name = "noise" + to_string(i) + ".wav";
+            wav.write_to_file(file_util::path_join(tmp_dir, name));
+            index << name << "\n";
+        }
+    }
+
+    // the first loader decodes the clips and leaves a packed file for everyone else
+    noise_clips first(index_file, tmp_dir);
+    EXPECT_EQ(2, first.size());
+    EXPECT_TRUE(first.is_mapped());
+    EXPECT_TRUE(noise_clips::is_pack(index_file + ".pack"));
+    EXPECT_FALSE(noise_clips::is_pack(index_file));
+
+    noise_clips second(index_file, tmp_dir);
+    noise_clips direct(index_file + ".pack", "");
+    EXPECT_TRUE(second.is_mapped());
+    EXPECT_EQ(2, direct.size());
+
+    // mixing into silence reproduces the clip, wrapping around at its end
+    sinewave_generator sg{800, 1000};
+    wav_data           reference(sg, 1, 8000, false);
+    cv::Mat            silence = cv::Mat::zeros(12000, 1, CV_16SC1);
+    direct.addNoise(silence, true, 1, 0.5f, 1.0f);
+    for (int i = 0; i < silence.rows; i++)
+    {
+        int src = (i + 4000) % 8000;
+        ASSERT_EQ(reference.get_data().at<int16_t>(src, 0), silence.at<int16_t>(i, 0)) << i;
+    }
+
+    // the pack is readable by loaders running as other users
+    string      pack_file = index_file + ".pack";
+    struct stat stats;
+    ASSERT_EQ(0, stat(pack_file.c_str(), &stats));
+    EXPECT_EQ(0644, stats.st_mode & 0777);
+
+    // replacing a clip without touching the index rebuilds the pack
+    struct utimbuf old_times;
+    old_times.actime  = stats.st_mtime - 10;
+    old_times.modtime = stats.st_mtime - 10;
+    ASSERT_EQ(0, utime(pack_file.c_str(), &old_times));
+    ASSERT_EQ(0, utime(index_file.c_str(), &old_times));
+    {
+        sinewave_generator sg{1200, 1000};
+        wav_data           wav(sg, 1, 4000, false);
+        wav.write_to_file(file_util::path_join(tmp_dir, "noise0.wav"));
+    }
+    noise_clips rebuilt(index_file, tmp_dir);
+    EXPECT_TRUE(rebuilt.is_mapped());
+    ASSERT_EQ(0, stat(pack_file.c_str(), &stats));
+    EXPECT_LT(old_times.modtime, stats.st_mtime);
+    cv::Mat short_silence = cv::Mat::zeros(4000, 1, CV_16SC1);
+    rebuilt.addNoise(short_silence, true, 0, 0.0f, 1.0f);
+    sinewave_generator replaced_sg{1200, 1000};
+    wav_data           replaced(replaced_sg, 1, 4000, false);
+    EXPECT_EQ(0, cv::countNonZero(replaced.get_data() != short_silence));
+
+    // a clip changed within the same second as the pack is still seen as newer
+    time_t          past = stats.st_mtime - 20;
+    struct timespec pack_time[2]{{past, 100}, {past, 100}};
+    struct timespec clip_time[2]{{past, 200}, {past, 200}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, pack_file.c_str(), pack_time, 0));
+    ASSERT_EQ(0, utimensat(AT_FDCWD, index_file.c_str(), pack_time, 0));
+    string unchanged = file_util::path_join(tmp_dir, "noise0.wav");
+    string changed   = file_util::path_join(tmp_dir, "noise1.wav");
+    ASSERT_EQ(0, utimensat(AT_FDCWD, unchanged.c_str(), pack_time, 0));
+    ASSERT_EQ(0, utimensat(AT_FDCWD, changed.c_str(), clip_time, 0));
+    noise_clips same_second(index_file, tmp_dir);
+    ASSERT_EQ(0, stat(pack_file.c_str(), &stats));
+    EXPECT_LT(past, stats.st_mtime);
+
+    file_util::remove_directory(tmp_dir);
+}
+
 #ifdef PYTHON_PLUGIN
 TEST(plugin, audio_example_scale)
 {
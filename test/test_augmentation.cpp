@@ -440,6 +440,60 @@ TEST(image_augmentation, default_patch)
     }
 }
 
+TEST(image_augmentation, batch_sampler_matches_scalar)
+{
+    vector<normalized_box::box> object_bboxes;
+    object_bboxes.emplace_back(0.2, 0.2, 0.6, 0.4);
+    object_bboxes.emplace_back(0, 0, 0.4, 0.4);
+    object_bboxes.emplace_back(0.5, 0.5, 0.6, 0.6);
+
+    vector<string> constraints = {"min_jaccard_overlap",
+                                  "max_jaccard_overlap",
+                                  "min_sample_coverage",
+                                  "max_sample_coverage",
+                                  "min_object_coverage",
+                                  "max_object_coverage"};
+    for (int max_sample : {-1, 1, 7})
+    {
+        for (const string& constraint : constraints)
+        {
+            nlohmann::json batch_sampler_json = {
+                {"max_trials", 150},
+                {"sampler", {{"scale", {0.1, 1}}, {"aspect_ratio", {0.5, 2}}}},
+                {"sample_constraint", {{constraint, 0.3}}}};
+            if (max_sample >= 0)
+            {
+                batch_sampler_json["max_sample"] = max_sample;
+            }
+            augment::image::batch_sampler sampler(batch_sampler_json);
+
+            // reference: draw and test the patches one at a time
+            get_thread_local_random_engine().seed(42);
+            vector<normalized_box::box> expected;
+            for (int i = 0; i < sampler.m_max_trials; i++)
+            {
+                if (max_sample >= 0 && expected.size() >= max_sample)
+                {
+                    break;
+                }
+                auto patch = sampler.m_sampler.sample_patch();
+                if (sampler.m_sample_constraint.satisfies(patch, object_bboxes))
+                {
+                    expected.push_back(patch);
+                }
+            }
+            auto expected_state = get_thread_local_random_engine();
+
+            get_thread_local_random_engine().seed(42);
+            vector<normalized_box::box> output;
+            sampler.sample_patches(object_bboxes, output);
+
+            EXPECT_EQ(expected, output) << constraint << " max_sample " << max_sample;
+            EXPECT_EQ(expected_state, get_thread_local_random_engine()) << constraint;
+        }
+    }
+}
+
 TEST(image_augmentation, padding_with_crop_enabled)
 {
     nlohmann::json js = {{"type", "image"},
@@ -252,6 +252,37 @@ TEST(boundingbox, extractor_missing_label)
     EXPECT_THROW(extractor.extract(&data[0], data.size()), std::invalid_argument);
 }
 
+TEST(boundingbox, extractor_binary)
+{
+    auto                   cfg = make_bbox_config(100);
+    boundingbox::extractor extractor{cfg.label_map};
+    for (string name : {"000001.json", "006637.json", "009952.json"})
+    {
+        string       data   = file_util::read_file_to_string(CURDIR "/test_data/" + name);
+        vector<char> binary = extractor.to_binary(&data[0], data.size());
+        EXPECT_FALSE(boundingbox::extractor::is_binary(&data[0], data.size()));
+        ASSERT_TRUE(boundingbox::extractor::is_binary(binary.data(), binary.size()));
+
+        auto expected = extractor.extract(&data[0], data.size());
+        auto decoded  = extractor.extract(binary.data(), binary.size());
+        EXPECT_EQ(expected->width(), decoded->width());
+        EXPECT_EQ(expected->height(), decoded->height());
+        EXPECT_EQ(expected->depth(), decoded->depth());
+        EXPECT_EQ(expected->boxes(), decoded->boxes());
+
+        vector<char> truncated_record(binary.begin(), binary.end() - 1);
+        EXPECT_THROW(extractor.extract(truncated_record.data(), truncated_record.size()),
+                     std::invalid_argument);
+    }
+
+    nlohmann::json obj = {{"height", 100}, {"width", 150}, {"max_bbox_count", 20}};
+    obj["class_names"] = {"monkey"};
+    boundingbox::extractor small_extractor{boundingbox::config(obj).label_map};
+    string       data   = file_util::read_file_to_string(CURDIR "/test_data/000001.json");
+    vector<char> binary = extractor.to_binary(&data[0], data.size());
+    EXPECT_THROW(small_extractor.extract(binary.data(), binary.size()), std::invalid_argument);
+}
+
 TEST(boundingbox, bbox)
 {
     // Create test metadata
@@ -332,6 +363,38 @@ TEST(boundingbox, crop)
     EXPECT_EQ(cv::Rect(0, 0, 35, 35), tx_boxes[5].rect()) << "6";
 }
 
+TEST(boundingbox, crop_many)
+{
+    // more boxes than one transform group, alternating inside and outside of the crop
+    vector<bbox> boxes;
+    for (int i = 0; i < 150; i++)
+    {
+        int x = i % 2 == 0 ? 40 + i : 200 + i;
+        boxes.emplace_back(x, 40, x + 9, 49, i % 11, i % 3 == 0, i % 5 == 0);
+    }
+
+    shared_ptr<augment::image::params> iparam = make_params(512, 512);
+    iparam->cropbox                           = cv::Rect(35, 35, 160, 100);
+    iparam->output_size                       = cv::Size(320, 100);
+    iparam->flip                              = true;
+    vector<bbox> tx_boxes = boundingbox::transformer::transform_box(boxes, iparam);
+    ASSERT_EQ(75, tx_boxes.size());
+    for (int i = 0; i < tx_boxes.size(); i++)
+    {
+        const bbox& original = boxes[2 * i];
+        float       xmin     = original.xmin() - 35;
+        float       xmax     = std::min(original.xmax() - 35, 159.0f);
+        bbox        expected(2 * (160 - xmax - 1),
+                      5,
+                      2 * (160 - xmin) - 1,
+                      14,
+                      original.label(),
+                      original.difficult(),
+                      original.truncated());
+        EXPECT_EQ(expected, tx_boxes[i]) << "at box " << i;
+    }
+}
+
 TEST(boundingbox, expand)
 {
     int   width        = 100;
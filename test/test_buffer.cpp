@@ -16,12 +16,18 @@
 
 #include "gtest/gtest.h"
 
+#include <unistd.h>
+
+#include "batch_frame.hpp"
 #include "buffer_batch.hpp"
+#include "bucket_iterator.hpp"
 #include "helpers.hpp"
 #include "log.hpp"
 #include "file_util.hpp"
 #include "provider_factory.hpp"
 #include "provider_interface.hpp"
+#include "shm_ring.hpp"
+#include "transpose.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -129,7 +135,8 @@ TEST(buffer, serialization)
     shared_ptr<nervana::provider_interface> provider = provider_factory::create(config);
 
     // generate fixed_buffer_map sample
-    nervana::fixed_buffer_map fbm(provider->get_output_shapes(), batch_size, pinned);
+    nervana::fixed_buffer_map fbm(
+        provider->get_output_shapes(), batch_size, host_allocator::from_pinned(pinned));
 
     std::minstd_rand0 rand_items(0);
     for (auto name : fbm.get_names())
@@ -183,3 +190,465 @@ TEST(buffer, serialization)
         ASSERT_TRUE(found);
     }
 }
+
+TEST(buffer, shrink_last_axis)
+{
+    // items of shape {2, 4} holding 10 * item + 4 * row + column
+    shape_type shape{{2, 4}, output_type{"uint8_t"}};
+    shape.set_names({"rows", "columns"});
+    size_t batch_size = 3;
+
+    buffer_fixed_size_elements record_major(shape, batch_size);
+    buffer_fixed_size_elements batch_minor(shape, batch_size);
+    for (size_t item = 0; item < batch_size; item++)
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            uint8_t value                             = 10 * item + i;
+            record_major.get_item(item)[i]            = value;
+            batch_minor.data()[i * batch_size + item] = value;
+        }
+    }
+
+    record_major.set_item_extent(0, 1);
+    record_major.set_item_extent(1, 3);
+    record_major.set_item_extent(2, 2);
+    EXPECT_EQ(3, record_major.get_max_extent());
+    EXPECT_EQ(2, record_major.get_item_extent(2));
+
+    record_major.shrink_last_axis(record_major.get_max_extent(), false);
+    batch_minor.shrink_last_axis(3, true);
+    for (auto buffer : {&record_major, &batch_minor})
+    {
+        EXPECT_EQ((vector<size_t>{2, 3}), buffer->get_shape_type().get_shape());
+        EXPECT_EQ((vector<string>{"rows", "columns"}), buffer->get_shape_type().get_names());
+        EXPECT_EQ(6, buffer->get_stride());
+        EXPECT_EQ(batch_size, buffer->get_item_count());
+    }
+
+    for (size_t item = 0; item < batch_size; item++)
+    {
+        for (size_t row = 0; row < 2; row++)
+        {
+            for (size_t column = 0; column < 3; column++)
+            {
+                uint8_t expected = 10 * item + 4 * row + column;
+                size_t  i        = row * 3 + column;
+                EXPECT_EQ(expected, (uint8_t)record_major.get_item(item)[i]);
+                EXPECT_EQ(expected, (uint8_t)batch_minor.data()[i * batch_size + item]);
+            }
+        }
+    }
+
+    record_major.restore_shape();
+    EXPECT_EQ(shape, record_major.get_shape_type());
+    EXPECT_EQ(8, record_major.get_stride());
+    EXPECT_EQ(4, record_major.get_max_extent());
+}
+
+TEST(buffer, transpose)
+{
+    // shapes around the tile sizes of every kernel, with padded rows on both sides
+    vector<pair<size_t, size_t>> shapes{
+        {1, 1}, {1, 37}, {37, 1}, {16, 16}, {17, 33}, {32, 64}, {100, 7}, {300, 45}, {64, 130}};
+    random_engine_t engine(0);
+
+    int top = int(transpose::supported_isa());
+    for (int kernel = 0; kernel <= top; kernel++)
+    {
+        for (size_t element_size : {1, 2, 4, 8})
+        {
+            for (auto shape : shapes)
+            {
+                size_t rows        = shape.first;
+                size_t cols        = shape.second;
+                size_t src_stride  = cols + 3;
+                size_t dest_stride = rows + 5;
+
+                vector<char> src(rows * src_stride * element_size);
+                vector<char> dest(cols * dest_stride * element_size, 0x55);
+                vector<char> expected(dest);
+                for (char& c : src)
+                {
+                    c = char(engine());
+                }
+                for (size_t r = 0; r < rows; r++)
+                {
+                    for (size_t c = 0; c < cols; c++)
+                    {
+                        memcpy(&expected[(c * dest_stride + r) * element_size],
+                               &src[(r * src_stride + c) * element_size],
+                               element_size);
+                    }
+                }
+
+                transpose::block(dest.data(),
+                                 dest_stride,
+                                 src.data(),
+                                 src_stride,
+                                 rows,
+                                 cols,
+                                 element_size,
+                                 transpose::isa(kernel));
+                EXPECT_EQ(expected, dest) << transpose::isa_name(transpose::isa(kernel)) << " "
+                                          << element_size << " " << rows << "x" << cols;
+            }
+        }
+    }
+
+    char c;
+    EXPECT_THROW(transpose::block(&c, 1, &c, 1, 1, 1, 3), invalid_argument);
+}
+
+TEST(buffer, batch_pool)
+{
+    vector<pair<string, shape_type>> shapes{{"data", shape_type{{4}, output_type{"uint8_t"}}}};
+
+    auto             pool = make_shared<batch_pool>(shapes, 2, host_allocator::standard(), 2);
+    fixed_buffer_map batch(shapes, 2);
+
+    batch["data"]->data()[0] = 7;
+    char* first              = batch["data"]->data();
+    auto  held               = pool->borrow(batch);
+    EXPECT_EQ(first, (*held)["data"]->data());
+    EXPECT_EQ(7, (*held)["data"]->data()[0]);
+    EXPECT_NE(first, batch["data"]->data());
+    EXPECT_EQ(2, batch["data"]->get_item_count());
+
+    // writing to the batch again leaves the borrowed one alone
+    batch["data"]->data()[0] = 9;
+    auto second              = pool->borrow(batch);
+    EXPECT_EQ(7, (*held)["data"]->data()[0]);
+    EXPECT_EQ(9, (*second)["data"]->data()[0]);
+    EXPECT_EQ(2, pool->borrowed());
+    EXPECT_THROW(pool->borrow(batch), runtime_error);
+
+    // released buffers are reused and outlive the pool
+    held.reset();
+    EXPECT_EQ(1, pool->borrowed());
+    char* spare = batch["data"]->data();
+    auto  third = pool->borrow(batch);
+    EXPECT_EQ(spare, (*third)["data"]->data());
+    EXPECT_EQ(first, batch["data"]->data());
+    pool.reset();
+    EXPECT_EQ(9, (*second)["data"]->data()[0]);
+}
+
+TEST(buffer, batch_frame)
+{
+    shape_type image{{3, 5}, output_type{"float"}};
+    image.set_names({"height", "width"});
+    fixed_buffer_map batch;
+    batch.add_item("image", image, 4);
+    batch.add_item("label", shape_type{{1}, output_type{"uint32_t"}}, 4);
+    for (auto name : batch.get_names())
+    {
+        for (int i = 0; i < batch[name]->size(); i++)
+            batch[name]->data()[i] = i % 101;
+    }
+    stringstream expected;
+    expected << batch;
+
+    batch_frame_writer writer(batch);
+    string             frame = writer.to_string();
+    ASSERT_EQ(writer.size(), frame.size());
+    EXPECT_EQ(0, frame.size() % batch_frame::alignment);
+
+    // any split of the input decodes to the same batch, bytes after the frame are ignored
+    batch_frame_reader reader;
+    for (size_t chunk : {1, 7, 64, 4096})
+    {
+        reader.begin();
+        for (size_t offset = 0; offset < frame.size(); offset += chunk)
+        {
+            reader.append(&frame[offset], min(chunk, frame.size() - offset));
+        }
+        reader.append("padding", 7);
+        ASSERT_TRUE(reader.complete());
+        auto         decoded = reader.finish();
+        stringstream actual;
+        actual << *decoded;
+        EXPECT_EQ(expected.str(), actual.str());
+        EXPECT_EQ(image, (*decoded)["image"]->get_shape_type());
+    }
+    // released batches are decoded into again
+    EXPECT_EQ(1, reader.allocated());
+
+    // a smaller frame fits in the same buffers
+    fixed_buffer_map small;
+    small.add_item("image", shape_type{{3, 2}, output_type{"float"}}, 4);
+    small.add_item("label", shape_type{{1}, output_type{"uint32_t"}}, 4);
+    string small_frame = batch_frame_writer(small, 7).to_string();
+    reader.begin();
+    reader.append(small_frame.data(), small_frame.size());
+    EXPECT_EQ(7, reader.get_sequence());
+    auto decoded = reader.finish();
+    EXPECT_EQ(1, reader.allocated());
+    EXPECT_EQ(small["image"]->size(), (*decoded)["image"]->size());
+
+    // scatter gather writes produce the same bytes
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    writer.write_to(fds[1]);
+    close(fds[1]);
+    string piped(frame.size(), '\0');
+    ASSERT_EQ(frame.size(), read(fds[0], &piped[0], piped.size()));
+    close(fds[0]);
+    EXPECT_EQ(frame, piped);
+
+    // input in another format is kept as is
+    reader.begin();
+    reader.append("{\"status\"", 9);
+    EXPECT_FALSE(reader.is_frame());
+    EXPECT_EQ("{\"status\"", reader.get_other_data());
+
+    reader.begin();
+    reader.append(frame.data(), frame.size() / 2);
+    EXPECT_THROW(reader.finish(), runtime_error);
+
+    string future = frame;
+    future[6]     = 9;
+    reader.begin();
+    EXPECT_THROW(reader.append(future.data(), future.size()), runtime_error);
+
+    // sizes that overflow do not get past the range checks
+    fixed_buffer_map labels;
+    labels.add_item("label", shape_type{{1}, output_type{"uint32_t"}}, 4);
+    string   labels_frame = batch_frame_writer(labels).to_string();
+    uint64_t payload      = unpack<uint32_t>(labels_frame.data(), 8);
+    size_t   offset_field = labels_frame.find(string(reinterpret_cast<char*>(&payload), 8));
+    ASSERT_NE(string::npos, offset_field);
+
+    string wrapped = labels_frame;
+    pack<uint64_t>(&wrapped[0], UINT64_MAX - 7, offset_field);
+    reader.begin();
+    EXPECT_THROW(reader.append(wrapped.data(), wrapped.size()), runtime_error);
+
+    // batch size 4 and one dimension of 1, the byte size of 2^62 elements wraps around
+    size_t dimension_field = labels_frame.find(string("\4\0\0\0\1\0\0\0\1\0", 10)) + 8;
+    ASSERT_LT(dimension_field, offset_field);
+    string huge = labels_frame;
+    pack<uint64_t>(&huge[0], uint64_t(1) << 62, dimension_field);
+    pack<uint64_t>(&huge[0], 0, offset_field + 8);
+    reader.begin();
+    EXPECT_THROW(reader.append(huge.data(), huge.size()), runtime_error);
+}
+
+TEST(buffer, shm_ring)
+{
+    fixed_buffer_map batch;
+    batch.add_item("image", shape_type{{3, 5}, output_type{"float"}}, 4);
+    batch.add_item("label", shape_type{{1}, output_type{"uint32_t"}}, 4);
+    for (auto name : batch.get_names())
+    {
+        for (int i = 0; i < batch[name]->size(); i++)
+            batch[name]->data()[i] = i % 101;
+    }
+    stringstream expected;
+    expected << batch;
+
+    string prefix = "/aeon-test-" + std::to_string(getpid());
+    size_t max_size =
+        batch_frame_writer::max_size({{"image", batch["image"]->get_shape_type()},
+                                      {"label", batch["label"]->get_shape_type()}},
+                                     4);
+    batch_frame_writer writer(batch, 3);
+    EXPECT_EQ(writer.size(), max_size);
+
+    auto   owner = shm_ring::create(prefix, 2, max_size);
+    string name  = owner->name();
+    EXPECT_EQ(0, name.find(prefix + "-"));
+    EXPECT_EQ(0, owner->slot_size() % sysconf(_SC_PAGESIZE));
+    auto ring = shm_ring::open(name);
+
+    // a second ring with the same prefix gets a name of its own and leaves the first in place
+    {
+        auto other = shm_ring::create(prefix, 1, max_size);
+        EXPECT_NE(name, other->name());
+        EXPECT_EQ(2, shm_ring::open(name)->slot_count());
+    }
+    EXPECT_EQ(2, ring->slot_count());
+    EXPECT_EQ(owner->slot_size(), ring->slot_size());
+
+    // every slot is claimed once
+    size_t first;
+    size_t second;
+    size_t third;
+    ASSERT_TRUE(owner->claim(first));
+    ASSERT_TRUE(owner->claim(second));
+    EXPECT_NE(first, second);
+    EXPECT_FALSE(owner->claim(third));
+
+    // the batch is read where it was written and the slot is free once it is dropped
+    writer.copy_to(owner->slot(first));
+    uint64_t sequence = 0;
+    auto     mapped   = batch_frame_reader::map(
+        ring->slot(first), writer.size(), [ring, first]() { ring->release(first); }, &sequence);
+    EXPECT_EQ(3, sequence);
+    stringstream actual;
+    actual << *mapped;
+    EXPECT_EQ(expected.str(), actual.str());
+    EXPECT_GE((*mapped)["label"]->data(), ring->slot(first));
+    EXPECT_LT((*mapped)["label"]->data(), ring->slot(first) + ring->slot_size());
+    EXPECT_FALSE(owner->is_free(first));
+    mapped = nullptr;
+    EXPECT_TRUE(owner->is_free(first));
+    EXPECT_TRUE(owner->claim(third));
+    EXPECT_EQ(first, third);
+
+    EXPECT_THROW(ring->slot(2), out_of_range);
+    EXPECT_THROW(batch_frame_reader::map(ring->slot(second), 16, []() {}), runtime_error);
+
+    // the name is gone with the ring, mappings stay valid
+    owner = nullptr;
+    EXPECT_THROW(shm_ring::open(name), runtime_error);
+    EXPECT_EQ('A', ring->slot(first)[0]);
+}
+
+TEST(buffer, host_allocator)
+{
+    vector<pair<string, shape_type>> shapes{
+        {"image", shape_type{{3, 512, 512}, output_type{"uint8_t"}}},
+        {"label", shape_type{{1}, output_type{"uint32_t"}}}};
+
+    for (const string& name : {"default", "huge_pages"})
+    {
+        fixed_buffer_map batch(shapes, 4, host_allocator::get(name));
+        for (const string& buffer : batch.get_names())
+        {
+            char* data = batch[buffer]->data();
+            EXPECT_EQ(0, reinterpret_cast<uintptr_t>(data) % host_allocator::alignment) << name;
+            memset(data, 0x5a, batch[buffer]->size());
+        }
+    }
+
+    // a single page stays well within the default RLIMIT_MEMLOCK
+    for (const string& name : {"locked", "huge_pages_locked"})
+    {
+        auto  allocator = host_allocator::get(name);
+        void* memory    = allocator->allocate(4096);
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(memory) % host_allocator::alignment) << name;
+        EXPECT_TRUE(allocator->page_locked());
+        allocator->free(memory, 4096);
+    }
+    EXPECT_FALSE(host_allocator::standard()->page_locked());
+
+    // serialized buffers record cuda_host memory only, locked memory comes back pageable
+    {
+        vector<pair<string, shape_type>> labels{{"label", shapes[1].second}};
+        fixed_buffer_map                 locked(labels, 1, host_allocator::get("locked"));
+        fixed_buffer_map                 pageable(labels, 1);
+        memset(locked["label"]->data(), 0x5a, locked["label"]->size());
+        memset(pageable["label"]->data(), 0x5a, pageable["label"]->size());
+        stringstream locked_stream;
+        stringstream pageable_stream;
+        locked_stream << locked;
+        pageable_stream << pageable;
+        EXPECT_EQ(pageable_stream.str(), locked_stream.str());
+    }
+    EXPECT_THROW(host_allocator::get("not registered"), invalid_argument);
+
+    // runtimes register their own callbacks and buffers hand the memory back on destruction
+    auto allocated = make_shared<size_t>(0);
+    auto freed     = make_shared<size_t>(0);
+    host_allocator::register_allocator(
+        "test_counting",
+        make_shared<host_allocator>(
+            [allocated](size_t size) {
+                *allocated += size;
+                return host_allocator::standard()->allocate(size);
+            },
+            [freed](void* memory, size_t size) {
+                *freed += size;
+                host_allocator::standard()->free(memory, size);
+            }));
+    {
+        fixed_buffer_map batch(shapes, 2, host_allocator::get("test_counting"));
+        EXPECT_EQ(2 * (3 * 512 * 512 + 4), *allocated);
+        EXPECT_EQ(0, *freed);
+    }
+    EXPECT_EQ(*allocated, *freed);
+
+    // misaligned memory is refused
+    alignas(host_allocator::alignment) static char storage[2 * host_allocator::alignment];
+    auto misaligned = make_shared<host_allocator>([](size_t) { return storage + 1; },
+                                                  [](void*, size_t) {});
+    EXPECT_THROW(buffer_fixed_size_elements(shapes[1].second, 1, misaligned), runtime_error);
+}
+
+namespace
+{
+    // serves blocks of single element records holding the given lengths, round robin
+    class length_source : public async_manager_source<encoded_record_list>
+    {
+    public:
+        length_source(const vector<int>& lengths, size_t block_size)
+            : m_lengths{lengths}
+            , m_block_size{block_size}
+        {
+        }
+
+        encoded_record_list* next() override
+        {
+            m_block.clear();
+            for (size_t i = 0; i < m_block_size; i++)
+            {
+                encoded_record record;
+                record.add_element(string2vector(to_string(m_lengths[m_index++])));
+                m_index %= m_lengths.size();
+                m_block.add_record(std::move(record));
+            }
+            return &m_block;
+        }
+
+        size_t record_count() const override { return m_block_size; }
+        size_t elements_per_record() const override { return 1; }
+        void   reset() override { m_index = 0; }
+    private:
+        vector<int>         m_lengths;
+        size_t              m_block_size;
+        size_t              m_index = 0;
+        encoded_record_list m_block;
+    };
+}
+
+TEST(buffer, bucket_iterator)
+{
+    EXPECT_EQ(0, bucket_iterator::bucket_index({10, 20}, 0));
+    EXPECT_EQ(0, bucket_iterator::bucket_index({10, 20}, 10));
+    EXPECT_EQ(1, bucket_iterator::bucket_index({10, 20}, 11));
+    EXPECT_EQ(2, bucket_iterator::bucket_index({10, 20}, 21));
+    EXPECT_EQ(2, bucket_iterator::bucket_index({10, 20}, UINT32_MAX));
+
+    using nlohmann::json;
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json config       = {{"manifest_filename", ""}, {"batch_size", 4}, {"etl", {label_config}}};
+    shared_ptr<provider_interface> provider = provider_factory::create(config);
+
+    vector<uint32_t> boundaries = {10, 20};
+    vector<int>      lengths    = {3, 15, 40, 7, 12, 1, 18, 33};
+    size_t           group      = 2;
+    auto             source     = make_shared<length_source>(lengths, 5);
+    auto buckets = make_shared<bucket_iterator>(source, provider, boundaries, 0, group);
+
+    size_t records = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        encoded_record_list* output = buckets->next();
+        ASSERT_NE(nullptr, output);
+        ASSERT_EQ(0, output->size() % group);
+        for (size_t g = 0; g < output->size(); g += group)
+        {
+            auto key = [&](size_t k) {
+                return bucket_iterator::bucket_index(
+                    boundaries, stoi(vector2string(output->record(k).element(0))));
+            };
+            for (size_t k = g + 1; k < g + group; k++)
+            {
+                EXPECT_EQ(key(g), key(k));
+            }
+        }
+        records += output->size();
+    }
+    EXPECT_GT(records, 0);
+}
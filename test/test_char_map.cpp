@@ -151,3 +151,50 @@ TEST(char_map, test)
         }
     }
 }
+
+TEST(char_map, lookup_table)
+{
+    string         alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ .,()ąćŁŻź𐍈✓ßабвгдЖЗ'";
+    nlohmann::json js       = {{"alphabet", alphabet}, {"max_length", 20}};
+    char_map::config cfg{js};
+
+    const char_map::cmap_t&       cmap  = cfg.get_cmap();
+    const char_map::lookup_table& table = cfg.get_table();
+    vector<wchar_t>               codes;
+    for (wchar_t c = 0; c < 0x3000; c++)
+    {
+        codes.push_back(c);
+    }
+    codes.push_back(L'𐍈');
+    codes.push_back(L'𐍉');
+    for (wchar_t c : codes)
+    {
+        auto     it       = cmap.find(std::towupper(c));
+        uint32_t expected = it == cmap.end() ? char_map::lookup_table::not_found : it->second;
+        EXPECT_EQ(expected, table.find(c)) << "at code point " << uint32_t(c);
+    }
+}
+
+TEST(char_map, extract_in_place)
+{
+    uint32_t       max_length = 8;
+    nlohmann::json js         = {{"alphabet", "abcdefg "}, {"max_length", max_length}};
+    char_map::config    cfg{js};
+    char_map::extractor extractor(cfg);
+
+    // unknown characters are discarded but still count towards max_length
+    string           transcript = "cab x dabba";
+    vector<uint32_t> out(max_length, 99);
+    uint32_t         length = extractor.extract(transcript.data(), transcript.size(), out.data());
+    EXPECT_EQ(max_length, length);
+    vector<uint32_t> expected = {2, 0, 1, 7, 7, 3, 0, 0};
+    EXPECT_EQ(expected, out);
+
+    // the input does not need to be terminated and the output is padded with 0
+    string short_transcript = "bad";
+    out.assign(max_length, 99);
+    length   = extractor.extract(short_transcript.data(), 2, out.data());
+    expected = {1, 0, 0, 0, 0, 0, 0, 0};
+    EXPECT_EQ(2, length);
+    EXPECT_EQ(expected, out);
+}
@@ -0,0 +1,423 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "curl_pool.hpp"
+#include "manifest_nds.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    // The parts of HTTP/2 the h2c server needs
+    namespace h2
+    {
+        const size_t  preface_size = 24; // PRI * HTTP/2.0, sent by the client after the upgrade
+        const size_t  header_size  = 9;
+        const uint8_t data         = 0;
+        const uint8_t headers      = 1;
+        const uint8_t settings     = 4;
+        const uint8_t ping         = 6;
+        const uint8_t goaway       = 7;
+        const uint8_t continuation = 9;
+        const uint8_t end_stream   = 0x1; // DATA and HEADERS
+        const uint8_t ack          = 0x1; // SETTINGS and PING
+        const uint8_t end_headers  = 0x4;
+        const char    status_200   = char(0x88); // HPACK static table entry for :status 200
+
+        string frame(uint8_t type, uint8_t flags, uint32_t stream, const string& payload)
+        {
+            string out(header_size, '\0');
+            out[0] = payload.size() >> 16;
+            out[1] = payload.size() >> 8;
+            out[2] = payload.size();
+            out[3] = type;
+            out[4] = flags;
+            out[5] = stream >> 24;
+            out[6] = stream >> 16;
+            out[7] = stream >> 8;
+            out[8] = stream;
+            return out + payload;
+        }
+    }
+
+    // HTTP/1.1 server on an ephemeral port that keeps connections open and answers every
+    // request with its own path, counting the connections it accepts. With h2c set it agrees to
+    // upgrade to cleartext HTTP/2 and answers every stream with "h2".
+    class keep_alive_server
+    {
+    public:
+        explicit keep_alive_server(bool h2c = false)
+            : m_h2c{h2c}
+        {
+            m_socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family      = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port        = 0;
+            socklen_t length        = sizeof(address);
+            if (bind(m_socket, (sockaddr*)&address, length) != 0 || listen(m_socket, 16) != 0 ||
+                getsockname(m_socket, (sockaddr*)&address, &length) != 0)
+            {
+                throw runtime_error("could not start keep alive server");
+            }
+            m_port   = ntohs(address.sin_port);
+            m_thread = thread(&keep_alive_server::accept_loop, this);
+        }
+
+        ~keep_alive_server()
+        {
+            shutdown(m_socket, SHUT_RDWR);
+            close(m_socket);
+            m_thread.join();
+            for (int client : m_clients)
+            {
+                shutdown(client, SHUT_RDWR);
+            }
+            for (thread& handler : m_handlers)
+            {
+                handler.join();
+            }
+        }
+
+        string url(const string& path) const
+        {
+            return "http://127.0.0.1:" + std::to_string(m_port) + path;
+        }
+        size_t accepted() const { return m_accepted; }
+        size_t h2_streams() const { return m_h2_streams; }
+
+    private:
+        void accept_loop()
+        {
+            for (;;)
+            {
+                int client = accept(m_socket, nullptr, nullptr);
+                if (client < 0)
+                {
+                    return;
+                }
+                m_accepted++;
+                m_clients.push_back(client);
+                m_handlers.emplace_back(&keep_alive_server::serve, this, client);
+            }
+        }
+
+        void serve(int client)
+        {
+            string pending;
+            char   buffer[4096];
+            for (;;)
+            {
+                size_t end = pending.find("\r\n\r\n");
+                if (m_h2c && end != string::npos &&
+                    pending.substr(0, end).find("Upgrade: h2c") != string::npos)
+                {
+                    pending.erase(0, end + 4);
+                    serve_h2(client, pending);
+                    break;
+                }
+                if (end == string::npos)
+                {
+                    ssize_t size = read(client, buffer, sizeof(buffer));
+                    if (size <= 0)
+                    {
+                        break;
+                    }
+                    pending.append(buffer, size);
+                    continue;
+                }
+                string request = pending.substr(0, end);
+                pending.erase(0, end + 4);
+
+                size_t path_start = request.find(' ') + 1;
+                size_t path_end   = request.find(' ', path_start);
+                string path       = request.substr(path_start, path_end - path_start);
+                ostringstream response;
+                response << "HTTP/1.1 200 OK\r\nContent-Length: " << path.size()
+                         << "\r\nConnection: keep-alive\r\n\r\n"
+                         << path;
+                string text = response.str();
+                if (write(client, text.data(), text.size()) != ssize_t(text.size()))
+                {
+                    break;
+                }
+            }
+            close(client);
+        }
+
+        // The upgraded request is stream 1, later requests come as HEADERS frames on the
+        // connection. Answers carry the static table entry for :status 200 and no other headers.
+        void serve_h2(int client, string& pending)
+        {
+            auto answer = [&](uint32_t stream) {
+                m_h2_streams++;
+                string status(1, h2::status_200);
+                return h2::frame(h2::headers, h2::end_headers, stream, status) +
+                       h2::frame(h2::data, h2::end_stream, stream, "h2");
+            };
+            auto send = [client](const string& text) {
+                return write(client, text.data(), text.size()) == ssize_t(text.size());
+            };
+
+            if (!send("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\n"
+                      "Upgrade: h2c\r\n\r\n" +
+                      h2::frame(h2::settings, 0, 0, "") + answer(1)))
+            {
+                return;
+            }
+            bool preface = false;
+            char buffer[4096];
+            for (;;)
+            {
+                size_t wanted = h2::preface_size;
+                if (preface)
+                {
+                    wanted = h2::header_size;
+                    if (pending.size() >= h2::header_size)
+                    {
+                        wanted += (uint8_t(pending[0]) << 16) | (uint8_t(pending[1]) << 8) |
+                                  uint8_t(pending[2]);
+                    }
+                }
+                if (pending.size() < wanted)
+                {
+                    ssize_t size = read(client, buffer, sizeof(buffer));
+                    if (size <= 0)
+                    {
+                        return;
+                    }
+                    pending.append(buffer, size);
+                    continue;
+                }
+                if (!preface)
+                {
+                    pending.erase(0, h2::preface_size);
+                    preface = true;
+                    continue;
+                }
+
+                uint8_t  type   = pending[3];
+                uint8_t  flags  = pending[4];
+                uint32_t stream = ((uint8_t(pending[5]) & 0x7f) << 24) |
+                                  (uint8_t(pending[6]) << 16) | (uint8_t(pending[7]) << 8) |
+                                  uint8_t(pending[8]);
+                string payload = pending.substr(h2::header_size, wanted - h2::header_size);
+                pending.erase(0, wanted);
+
+                bool sent = true;
+                if (type == h2::settings && !(flags & h2::ack))
+                {
+                    sent = send(h2::frame(h2::settings, h2::ack, 0, ""));
+                }
+                else if (type == h2::ping && !(flags & h2::ack))
+                {
+                    sent = send(h2::frame(h2::ping, h2::ack, 0, payload));
+                }
+                else if ((type == h2::headers || type == h2::continuation) &&
+                         (flags & h2::end_headers))
+                {
+                    sent = send(answer(stream));
+                }
+                else if (type == h2::goaway)
+                {
+                    return;
+                }
+                if (!sent)
+                {
+                    return;
+                }
+            }
+        }
+
+        bool           m_h2c;
+        int            m_socket;
+        uint16_t       m_port;
+        thread         m_thread;
+        atomic<size_t> m_accepted{0};
+        atomic<size_t> m_h2_streams{0};
+        vector<int>    m_clients;
+        vector<thread> m_handlers;
+    };
+
+    size_t append_body(void* data, size_t size, size_t count, void* body)
+    {
+        static_cast<string*>(body)->append(static_cast<char*>(data), size * count);
+        return size * count;
+    }
+
+    string fetch(curl_pool& pool, const string& url)
+    {
+        curl_pool::lease handle = pool.acquire();
+        string           body;
+        curl_easy_setopt(handle.get(), CURLOPT_URL, url.c_str());
+        curl_easy_setopt(handle.get(), CURLOPT_WRITEFUNCTION, append_body);
+        curl_easy_setopt(handle.get(), CURLOPT_WRITEDATA, &body);
+        curl_easy_setopt(handle.get(), CURLOPT_NOPROXY, "*");
+        EXPECT_EQ(CURLE_OK, pool.perform(handle));
+        return body;
+    }
+
+    curl_pool::connection_stats total(const vector<curl_pool::connection_stats>& stats)
+    {
+        curl_pool::connection_stats result;
+        for (const auto& s : stats)
+        {
+            result.requests += s.requests;
+            result.connects += s.connects;
+            result.bytes_received += s.bytes_received;
+        }
+        return result;
+    }
+
+    void fetch_concurrently(curl_pool& pool, const keep_alive_server& server)
+    {
+        vector<thread> clients;
+        for (int t = 0; t < 4; t++)
+        {
+            clients.emplace_back([&pool, &server, t]() {
+                for (int i = 0; i < 5; i++)
+                {
+                    string path = "/" + std::to_string(t) + "/" + std::to_string(i);
+                    EXPECT_EQ(path, fetch(pool, server.url(path)));
+                }
+            });
+        }
+        for (thread& client : clients)
+        {
+            client.join();
+        }
+    }
+}
+
+TEST(curl_pool, keep_alive)
+{
+    keep_alive_server server;
+    curl_pool         pool;
+
+    for (int i = 0; i < 5; i++)
+    {
+        EXPECT_EQ("/block", fetch(pool, server.url("/block")));
+    }
+
+    EXPECT_EQ(1, server.accepted());
+    EXPECT_EQ(1, pool.idle());
+    auto stats = pool.get_stats();
+    ASSERT_EQ(1, stats.size());
+    EXPECT_EQ(5, stats[0].requests);
+    EXPECT_EQ(1, stats[0].connects);
+    EXPECT_EQ(5 * string("/block").size(), stats[0].bytes_received);
+}
+
+TEST(curl_pool, concurrent)
+{
+    keep_alive_server server;
+    curl_pool         pool;
+
+    fetch_concurrently(pool, server);
+
+    // a handle per concurrent request at most, each keeping its connection
+    auto stats = pool.get_stats();
+    EXPECT_LE(stats.size(), 4);
+    EXPECT_EQ(stats.size(), pool.idle());
+    EXPECT_EQ(20, total(stats).requests);
+    EXPECT_EQ(server.accepted(), total(stats).connects);
+    EXPECT_LE(server.accepted(), 4);
+}
+
+TEST(curl_pool, http2_fallback)
+{
+    keep_alive_server  server;
+    curl_pool::options options;
+    options.http2 = true;
+    curl_pool pool(options);
+
+    // the server only speaks HTTP/1.1, so the connections come from the multi handle cache
+    fetch_concurrently(pool, server);
+
+    auto stats = pool.get_stats();
+    EXPECT_EQ(20, total(stats).requests);
+    EXPECT_EQ(server.accepted(), total(stats).connects);
+    EXPECT_LE(server.accepted(), 4);
+}
+
+TEST(curl_pool, multiplexed)
+{
+    if (LIBCURL_VERSION_NUM < 0x072b00 ||
+        !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+    {
+        cout << "HTTP/2 multiplexing is not available in this libcurl, test skipped\n";
+        return;
+    }
+
+    keep_alive_server  server(true);
+    curl_pool::options options;
+    options.http2 = true;
+    curl_pool pool(options);
+
+    // the first request upgrades the connection, concurrent requests then share it as streams
+    EXPECT_EQ("h2", fetch(pool, server.url("/upgrade")));
+    vector<thread> clients;
+    for (int t = 0; t < 4; t++)
+    {
+        clients.emplace_back([&pool, &server]() {
+            for (int i = 0; i < 5; i++)
+            {
+                EXPECT_EQ("h2", fetch(pool, server.url("/stream")));
+            }
+        });
+    }
+    for (thread& client : clients)
+    {
+        client.join();
+    }
+
+    EXPECT_EQ(1, server.accepted());
+    EXPECT_EQ(21, server.h2_streams());
+    auto stats = pool.get_stats();
+    EXPECT_EQ(21, total(stats).requests);
+    EXPECT_EQ(1, total(stats).connects);
+}
+
+TEST(curl_pool, network_client)
+{
+    keep_alive_server server;
+    network_client    client(server.url(""), "token", 1, 500, 1, 0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        stringstream stream;
+        client.get(server.url("/object_count/"), stream);
+        EXPECT_EQ("/object_count/", stream.str());
+    }
+
+    EXPECT_EQ(1, server.accepted());
+    auto stats = client.get_connection_stats();
+    ASSERT_EQ(1, stats.size());
+    EXPECT_EQ(3, stats[0].requests);
+    EXPECT_EQ(1, stats[0].connects);
+}
@@ -256,5 +256,40 @@ def test_dataloader_axes_info():
     assert label[0] == 'label'
 
 
+def test_loader_buffer_output():
+    # NOTE: manifest needs to stay in scope until DataLoader has read it.
+    manifest = random_manifest(4)
+    for batch_major in (True, False):
+        config = generic_config(manifest.name, batch_size)
+        config['batch_major'] = batch_major
+        arrays = DataLoader(config)
+        buffers = DataLoader(config, output="buffer")
+
+        for array_batch, buffer_batch in zip(arrays, buffers):
+            for (name, array), (buffer_name, buffer) in zip(array_batch, buffer_batch):
+                assert name == buffer_name
+                assert buffer.batch_major == batch_major
+                assert buffer.dtype == array.dtype
+
+                exported = np.asarray(buffer)
+                assert exported.shape == buffer.shape
+                assert exported.strides == buffer.strides
+                assert (exported.reshape(array.shape) == array).all()
+                assert memoryview(buffer).format == array.dtype.char
+
+                dlpacked = np.from_dlpack(buffer)
+                assert dlpacked.shape == buffer.shape
+                assert dlpacked.ctypes.data == exported.ctypes.data
+                if batch_major:
+                    assert buffer.shape == array.shape
+                else:
+                    assert buffer.shape[-1] == batch_size
+                    assert np.prod(buffer.shape[:-1]) == array.shape[0]
+
+    with pytest.raises(RuntimeError) as ex:
+        DataLoader(generic_config(manifest.name, batch_size), output="list")
+    assert 'output' in str(ex)
+
+
 if __name__ == '__main__':
     pytest.main()
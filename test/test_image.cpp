@@ -28,6 +28,7 @@
 #include "json.hpp"
 #include "helpers.hpp"
 #include "image.hpp"
+#include "mat_pool.hpp"
 #include "log.hpp"
 #include "util.hpp"
 #include "file_util.hpp"
@@ -392,6 +393,58 @@ TEST(image, transform_flip)
     EXPECT_TRUE(check_value(transformed, 0, 19, 119, 169));
 }
 
+TEST(image, mat_pool_bucket_capacity)
+{
+    EXPECT_EQ(4096, image::mat_pool::bucket_capacity(1));
+    EXPECT_EQ(4096, image::mat_pool::bucket_capacity(4096));
+    EXPECT_EQ(5120, image::mat_pool::bucket_capacity(4097));
+    EXPECT_EQ(8192, image::mat_pool::bucket_capacity(8000));
+    EXPECT_EQ(10240, image::mat_pool::bucket_capacity(8193));
+    EXPECT_EQ(image::mat_pool::bucket_capacity(224 * 224 * 3),
+              image::mat_pool::bucket_capacity(223 * 224 * 3));
+}
+
+TEST(image, mat_pool_steady_state)
+{
+    auto                  indexed = generate_indexed_image(256, 256);
+    vector<unsigned char> img;
+    cv::imencode(".png", indexed, img);
+
+    nlohmann::json js = {{"width", 64}, {"height", 64}};
+    nlohmann::json aug;
+    image::config  cfg(js);
+
+    image::extractor              ext{cfg};
+    image::transformer            trans{cfg};
+    augment::image::param_factory factory(aug);
+
+    auto process = [&]() {
+        shared_ptr<image::decoded> decoded = ext.extract((char*)&img[0], img.size());
+        auto                       image_size = decoded->get_image_size();
+        image_params_builder       builder(
+            factory.make_params(image_size.width, image_size.height, cfg.width, cfg.height));
+        shared_ptr<augment::image::params> params_ptr =
+            builder.angle(10).cropbox(10, 10, 128, 128).output_size(64, 64).flip(true);
+        trans.transform(params_ptr, decoded);
+    };
+
+    // warm up the pool of this thread
+    process();
+    process();
+
+    image::mat_pool::stats before = image::mat_pool::thread_instance().get_stats();
+    for (int i = 0; i < 10; i++)
+    {
+        process();
+    }
+    image::mat_pool::stats after = image::mat_pool::thread_instance().get_stats();
+
+    EXPECT_EQ(before.allocations, after.allocations);
+    EXPECT_EQ(before.bytes_reserved, after.bytes_reserved);
+    EXPECT_LT(before.reuses, after.reuses);
+    EXPECT_EQ(after.reuses - before.reuses, after.releases - before.releases);
+}
+
 TEST(image, transform_padding)
 {
     struct test
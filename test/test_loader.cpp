@@ -15,6 +15,7 @@
 *******************************************************************************/
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <sstream>
 #include <random>
@@ -431,6 +432,148 @@ TEST(loader, provider)
     }
 }
 
+TEST(loader, decode_pass_spans_batches)
+{
+    // several decode threads make every decode pass cover many small batches, which are
+    // handed out in place one after the other
+    int    height       = 8;
+    int    width        = 8;
+    size_t batch_size   = 4;
+    size_t record_count = 101;
+    string manifest     = create_manifest_file(record_count, width, height);
+
+    json image_config = {
+        {"type", "image"}, {"height", height}, {"width", width}, {"channel_major", false}};
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json js           = {{"decode_thread_count", 8},
+               {"manifest_filename", manifest},
+               {"batch_size", batch_size},
+               {"iteration_mode", "COUNT"},
+               {"iteration_mode_count", 60},
+               {"etl", {image_config, label_config}}};
+
+    loader_factory factory;
+    auto           train_set = factory.get_loader(js);
+
+    int expected_id = 0;
+    for (const fixed_buffer_map& data : *train_set)
+    {
+        const buffer_fixed_size_elements* image_buffer = data["image"];
+        ASSERT_NE(nullptr, image_buffer);
+        ASSERT_EQ(batch_size, image_buffer->get_item_count());
+        for (int i = 0; i < batch_size; i++)
+        {
+            cv::Mat image{height, width, CV_8UC3, (char*)image_buffer->get_item(i)};
+            ASSERT_EQ(expected_id % record_count, embedded_id_image::read_embedded_id(image));
+            expected_id++;
+        }
+    }
+    EXPECT_EQ(60 * batch_size, expected_id);
+}
+
+TEST(loader, batch_minor)
+{
+    // an odd batch size leaves partial tiles for the transpose kernels
+    int    height       = 8;
+    int    width        = 12;
+    size_t batch_size   = 5;
+    size_t record_count = 23;
+    string manifest     = create_manifest_file(record_count, width, height);
+
+    json image_config = {
+        {"type", "image"}, {"height", height}, {"width", width}, {"channel_major", false}};
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json js           = {{"decode_thread_count", 8},
+               {"manifest_filename", manifest},
+               {"batch_size", batch_size},
+               {"iteration_mode", "COUNT"},
+               {"iteration_mode_count", 9},
+               {"etl", {image_config, label_config}}};
+
+    loader_factory factory;
+    auto           batch_major = factory.get_loader(js);
+    js["batch_major"]          = false;
+    auto batch_minor           = factory.get_loader(js);
+
+    auto major = batch_major->begin();
+    int  count = 0;
+    for (const fixed_buffer_map& minor : *batch_minor)
+    {
+        ASSERT_NE(major, batch_major->end());
+        for (const string& name : minor.get_names())
+        {
+            const buffer_fixed_size_elements* expected = (*major)[name];
+            const buffer_fixed_size_elements* actual   = minor[name];
+            size_t element_size = actual->get_shape_type().get_otype().get_size();
+            size_t elements     = actual->get_stride() / element_size;
+            ASSERT_EQ(expected->size(), actual->size());
+            for (size_t item = 0; item < batch_size; item++)
+            {
+                for (size_t e = 0; e < elements; e++)
+                {
+                    ASSERT_EQ(0,
+                              memcmp(expected->get_item(item) + e * element_size,
+                                     actual->data() + (e * batch_size + item) * element_size,
+                                     element_size));
+                }
+            }
+        }
+        major++;
+        count++;
+    }
+    EXPECT_EQ(9, count);
+}
+
+TEST(loader, borrow_output_buffer)
+{
+    // borrowed batches stay intact while the loader moves on through several decode passes
+    int    height       = 8;
+    int    width        = 8;
+    size_t batch_size   = 4;
+    size_t record_count = 50;
+    size_t pool_size    = 3;
+    string manifest     = create_manifest_file(record_count, width, height);
+
+    json image_config = {
+        {"type", "image"}, {"height", height}, {"width", width}, {"channel_major", false}};
+    json label_config = {{"type", "label"}, {"binary", false}};
+    json js           = {{"decode_thread_count", 2},
+               {"manifest_filename", manifest},
+               {"batch_size", batch_size},
+               {"batch_pool_size", pool_size},
+               {"iteration_mode", "COUNT"},
+               {"iteration_mode_count", 20},
+               {"etl", {image_config, label_config}}};
+
+    loader_factory factory;
+    auto           train_set = factory.get_loader(js);
+
+    auto first_id = [&](const fixed_buffer_map& batch) {
+        const buffer_fixed_size_elements* image_buffer = batch["image"];
+        cv::Mat image{height, width, CV_8UC3, (char*)image_buffer->get_item(0)};
+        return embedded_id_image::read_embedded_id(image);
+    };
+
+    deque<pair<shared_ptr<const fixed_buffer_map>, int>> held;
+    auto it = train_set->begin();
+    for (int i = 0; i < 20; i++, it++)
+    {
+        if (held.size() == pool_size)
+        {
+            EXPECT_THROW(train_set->borrow_output_buffer(), runtime_error);
+            EXPECT_EQ(held.front().second, first_id(*held.front().first));
+            held.pop_front();
+        }
+        auto batch = train_set->borrow_output_buffer();
+        EXPECT_EQ(i * batch_size % record_count, first_id(*batch));
+        held.emplace_back(batch, first_id(*batch));
+    }
+    for (auto& batch : held)
+    {
+        EXPECT_EQ(batch.second, first_id(*batch.first));
+    }
+}
+
 static std::string generate_manifest_file(size_t record_count)
 {
     std::string   manifest_name = "manifest.txt";
@@ -334,3 +334,170 @@ TEST(loader_remote, close_session)
         EXPECT_CALL(*mock, close_session(session_id)).Times(0);
     }
 }
+
+namespace
+{
+    // Connections to one session that share the service side batch counter. Responses take a
+    // random time so they come back out of order.
+    class numbered_service : public service
+    {
+    public:
+        struct shared_state
+        {
+            mutex              lock;
+            condition_variable opened;
+            uint64_t           next{0};
+            uint64_t           end{0};
+            uint64_t           stride{1};         // other clients take the numbers in between
+            uint64_t           gated{UINT64_MAX}; // this batch waits until the gate is open
+            bool               open{false};
+            bool               timed_out{false};
+        };
+
+        numbered_service(const shared_ptr<shared_state>& state)
+            : m_state{state}
+        {
+        }
+
+        service_response<string> create_session(const std::string&) override
+        {
+            return service_response<string>(success(), "123");
+        }
+        service_status reset_session(const std::string&) override
+        {
+            lock_guard<mutex> lock(m_state->lock);
+            m_state->next = 0;
+            return success();
+        }
+        service_status close_session(const std::string&) override { return success(); }
+        service_response<next_response> get_next(const std::string&) override
+        {
+            uint64_t sequence;
+            {
+                unique_lock<mutex> lock(m_state->lock);
+                sequence = m_state->next;
+                if (sequence >= m_state->end)
+                {
+                    return service_response<next_response>(
+                        service_status(service_status_type::END_OF_DATASET, ""), next_response());
+                }
+                m_state->next += m_state->stride;
+                if (sequence == m_state->gated)
+                {
+                    m_state->timed_out = !m_state->opened.wait_for(
+                        lock, chrono::seconds(5), [this] { return m_state->open; });
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(rand() % 5));
+            return service_response<next_response>(
+                success(), next_response(make_shared<fixed_buffer_map>(), sequence));
+        }
+        service_response<names_and_shapes> get_names_and_shapes(const std::string&) override
+        {
+            return service_response<names_and_shapes>(success(), names_and_shapes());
+        }
+        service_response<int> get_record_count(const std::string&) override
+        {
+            return service_response<int>(success(), 0);
+        }
+        service_response<int> get_batch_size(const std::string&) override
+        {
+            return service_response<int>(success(), 0);
+        }
+        service_response<int> get_batch_count(const std::string&) override
+        {
+            return service_response<int>(success(), 0);
+        }
+
+    private:
+        static service_status success() { return service_status(service_status_type::SUCCESS, ""); }
+
+        shared_ptr<shared_state> m_state;
+    };
+}
+
+TEST(loader_remote, service_prefetch)
+{
+    const size_t depth       = 4;
+    const size_t batch_count = 50;
+    auto         state       = make_shared<numbered_service::shared_state>();
+    state->end               = batch_count;
+
+    vector<shared_ptr<service>> connections;
+    for (size_t i = 0; i < depth; i++)
+    {
+        connections.push_back(make_shared<numbered_service>(state));
+    }
+    service_prefetch prefetch(connections);
+    EXPECT_EQ(prefetch.depth(), depth);
+
+    for (int epoch = 0; epoch < 2; epoch++)
+    {
+        for (uint64_t i = 0; i < batch_count; i++)
+        {
+            auto response = prefetch.get_next("123");
+            ASSERT_EQ(response.status.type, service_status_type::SUCCESS);
+            EXPECT_EQ(response.data.sequence, i);
+        }
+        auto response = prefetch.get_next("123");
+        EXPECT_EQ(response.status.type, service_status_type::END_OF_DATASET);
+
+        auto stats = prefetch.get_stats();
+        EXPECT_EQ(stats.batches, batch_count * (epoch + 1));
+        EXPECT_LE(stats.max_in_flight, depth);
+        EXPECT_GT(stats.wire_nanoseconds, 0);
+
+        EXPECT_EQ(prefetch.reset_session("123").type, service_status_type::SUCCESS);
+    }
+    EXPECT_THROW(service_prefetch(vector<shared_ptr<service>>()), invalid_argument);
+}
+
+TEST(loader_remote, service_prefetch_shared_session)
+{
+    // other clients of the session take two of every three batches and one batch is slow, the
+    // batches that arrived are handed out without waiting for it
+    const size_t depth = 4;
+    auto         state = make_shared<numbered_service::shared_state>();
+    state->end         = 30;
+    state->stride      = 3;
+    state->gated       = 9;
+
+    vector<shared_ptr<service>> connections;
+    for (size_t i = 0; i < depth; i++)
+    {
+        connections.push_back(make_shared<numbered_service>(state));
+    }
+    service_prefetch prefetch(connections, true);
+
+    set<uint64_t> received;
+    for (int i = 0; i < 3; i++)
+    {
+        auto response = prefetch.get_next("123");
+        ASSERT_EQ(response.status.type, service_status_type::SUCCESS);
+        received.insert(response.data.sequence);
+    }
+    {
+        lock_guard<mutex> lock(state->lock);
+        EXPECT_FALSE(state->timed_out);
+        EXPECT_EQ(0, received.count(9));
+        state->open = true;
+    }
+    state->opened.notify_all();
+
+    for (;;)
+    {
+        auto response = prefetch.get_next("123");
+        if (response.status.type == service_status_type::END_OF_DATASET)
+        {
+            break;
+        }
+        ASSERT_EQ(response.status.type, service_status_type::SUCCESS);
+        received.insert(response.data.sequence);
+    }
+    set<uint64_t> expected;
+    for (uint64_t i = 0; i < state->end; i += state->stride)
+    {
+        expected.insert(i);
+    }
+    EXPECT_EQ(expected, received);
+}
@@ -1370,6 +1370,87 @@ TEST(localization_rcnn, compute_targets)
     EXPECT_NEAR(dh_1_expected, result[1].dh, acceptable_error);
 }
 
+TEST(localization_rcnn, assign_labels)
+{
+    int            height = 600;
+    int            width  = 800;
+    nlohmann::json js_loc = {
+        {"width", width}, {"height", height}, {"class_names", label_list}, {"max_gt_boxes", 64}};
+    config        cfg{js_loc};
+    ::transformer transformer(cfg, 0);
+    cv::Size      image_size{width, height};
+    auto          anchors = transformer.inside_anchors(image_size);
+    ASSERT_EQ(anchors.get(), transformer.inside_anchors(image_size).get());
+    ASSERT_EQ(anchors->index.size(), anchors->boxes.size());
+
+    // gt boxes with random extents, one of them identical to an anchor
+    std::minstd_rand0        random(0);
+    vector<boundingbox::box> gt_boxes;
+    for (int i = 0; i < 6; i++)
+    {
+        float x = random() % (width - 100);
+        float y = random() % (height - 100);
+        gt_boxes.emplace_back(x, y, x + 20 + random() % 300, y + 20 + random() % 300);
+    }
+    const box& anchor = anchors->boxes[anchors->boxes.size() / 2];
+    gt_boxes.emplace_back(anchor.xmin(), anchor.ymin(), anchor.xmax(), anchor.ymax());
+
+    vector<int> labels;
+    vector<int> argmax;
+    transformer.assign_labels(*anchors, gt_boxes, labels, argmax);
+    ASSERT_EQ(anchors->boxes.size(), labels.size());
+    ASSERT_EQ(anchors->boxes.size(), argmax.size());
+
+    // scalar reference
+    size_t        count = anchors->boxes.size();
+    vector<float> overlaps(count * gt_boxes.size(), 0.0f);
+    vector<float> column_max(gt_boxes.size(), 0.0f);
+    for (size_t n = 0; n < count; n++)
+    {
+        const box& b = anchors->boxes[n];
+        for (size_t k = 0; k < gt_boxes.size(); k++)
+        {
+            const boundingbox::box& g = gt_boxes[k];
+
+            float iw = min(b.xmax(), g.xmax()) - max(b.xmin(), g.xmin()) + 1;
+            float ih = min(b.ymax(), g.ymax()) - max(b.ymin(), g.ymin()) + 1;
+            if (iw > 0 && ih > 0)
+            {
+                float area_union = b.width() * b.height() + g.width() * g.height() - iw * ih;
+                overlaps[n * gt_boxes.size() + k] = iw * ih / area_union;
+            }
+            column_max[k] = max(column_max[k], overlaps[n * gt_boxes.size() + k]);
+        }
+    }
+    for (size_t n = 0; n < count; n++)
+    {
+        float row_max  = 0;
+        int   expected = 0;
+        bool  tie      = false;
+        for (size_t k = 0; k < gt_boxes.size(); k++)
+        {
+            float overlap = overlaps[n * gt_boxes.size() + k];
+            tie |= overlap == column_max[k];
+            if (overlap > row_max)
+            {
+                row_max  = overlap;
+                expected = k;
+            }
+        }
+        int label = -1;
+        if (tie || row_max >= cfg.positive_overlap)
+        {
+            label = 1;
+        }
+        else if (row_max < cfg.negative_overlap)
+        {
+            label = 0;
+        }
+        ASSERT_EQ(expected, argmax[n]) << "anchor " << n;
+        ASSERT_EQ(label, labels[n]) << "anchor " << n;
+    }
+}
+
 TEST(localization_rcnn, provider)
 {
     int   height               = 1000;
@@ -0,0 +1,221 @@
+/*******************************************************************************
+* Copyright 2018 Intel Corporation
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "batch_frame.hpp"
+#include "ofi_connector.hpp"
+#include "service.hpp"
+
+using namespace std;
+using namespace nervana;
+
+namespace
+{
+    const string address = "127.0.0.1";
+
+    // TEST_OFI_PORT or a port the kernel hands out as free, the sockets provider listens on TCP
+    unsigned int test_port()
+    {
+        const char* configured = getenv("TEST_OFI_PORT");
+        if (configured)
+        {
+            return stoi(configured);
+        }
+        sockaddr_in bound{};
+        bound.sin_family      = AF_INET;
+        bound.sin_addr.s_addr = inet_addr(address.c_str());
+        socklen_t size        = sizeof(bound);
+        int       fd          = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&bound), sizeof(bound)) != 0 ||
+            getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &size) != 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            throw runtime_error("no free port for the OFI test");
+        }
+        close(fd);
+        return ntohs(bound.sin_port);
+    }
+
+    // Sets an environment variable that is not set yet and removes it again when it goes out of
+    // scope, so the rest of the test process sees the environment it started with
+    class default_env
+    {
+    public:
+        default_env(const string& name, const string& value)
+            : m_name(name)
+            , m_set(getenv(name.c_str()) == nullptr)
+        {
+            if (m_set)
+            {
+                setenv(name.c_str(), value.c_str(), 1);
+            }
+        }
+        ~default_env()
+        {
+            if (m_set)
+            {
+                unsetenv(m_name.c_str());
+            }
+        }
+
+    private:
+        string m_name;
+        bool   m_set;
+    };
+
+    // Stands in for the HTTP side of the service, next requests are answered by a function
+    // that puts the batch into registered memory
+    class rdma_http_stub : public http_connector
+    {
+    public:
+        explicit rdma_http_stub(const function<http_response(const http_query_t&)>& next)
+            : m_next(next)
+        {
+        }
+
+        http_response get(const string& endpoint, const http_query_t& query) override
+        {
+            if (endpoint.size() >= 4 && endpoint.substr(endpoint.size() - 4) == "next")
+            {
+                return m_next(query);
+            }
+            return http_response(404, "");
+        }
+        http_response post(const string&, const string&) override
+        {
+            return http_response(http::status_ok, "");
+        }
+        http_response post(const string&, const http_query_t&) override
+        {
+            return http_response(http::status_ok, "");
+        }
+        http_response del(const string&, const http_query_t&) override
+        {
+            return http_response(http::status_ok, "");
+        }
+
+    private:
+        function<http_response(const http_query_t&)> m_next;
+    };
+
+    fixed_buffer_map numbered_batch(int number)
+    {
+        fixed_buffer_map batch;
+        batch.add_item("data", shape_type{{2, 3}, output_type{"int32_t"}}, 4);
+        for (size_t i = 0; i < batch["data"]->get_item_count(); i++)
+        {
+            *reinterpret_cast<int32_t*>(batch["data"]->get_item(i)) = number;
+        }
+        return batch;
+    }
+
+    int batch_number(const next_response& response)
+    {
+        return *reinterpret_cast<int32_t*>((*response.data)["data"]->get_item(0));
+    }
+}
+
+TEST(ofi, region_ring)
+{
+    // the sockets provider runs over TCP, so no RDMA hardware is needed
+    default_env  provider("FI_PROVIDER", "sockets");
+    unsigned int port = test_port();
+
+    ofi::ofi listener;
+    listener.bind_and_listen(port, address);
+    ofi::ofi server;
+    thread   accept([&]() {
+        if (listener.wait_for_connect(server))
+        {
+            ofi::message connection_id;
+            connection_id.allocate(1);
+            connection_id.buffer()[0] = '1';
+            server.send(connection_id);
+        }
+    });
+
+    // the service writes batch n into region n % 2, like the connection pool of the service
+    vector<unique_ptr<ofi::rdma_memory>> server_regions;
+    uint64_t                             sequence = 0;
+    auto next = [&](const http_query_t& query) {
+        EXPECT_EQ("1", query.at("connection_id"));
+        fixed_buffer_map   batch = numbered_batch(sequence);
+        batch_frame_writer writer(batch, sequence);
+        ofi::rdma_memory&  memory = *server_regions[sequence % server_regions.size()];
+        writer.copy_to(static_cast<char*>(memory.get_buffer()));
+        sequence++;
+
+        nlohmann::json reply;
+        reply["status"]["type"]  = "SUCCESS";
+        reply["data"]["address"] = reinterpret_cast<uint64_t>(memory.get_buffer());
+        reply["data"]["size"]    = writer.size();
+        reply["data"]["key"]     = memory.get_key();
+        reply["data"]["format"]  = batch_frame::format_name;
+        return http_response(http::status_ok, reply.dump());
+    };
+
+    auto rdma = make_shared<ofi_connector>(address, port, make_shared<rdma_http_stub>(next));
+    accept.join();
+    for (int i = 0; i < 2; i++)
+    {
+        server_regions.emplace_back(new ofi::rdma_memory(
+            batch_frame_writer(numbered_batch(0)).size()));
+        server.register_memory(*server_regions.back());
+    }
+    service_connector connector(rdma);
+
+    // batches are read in place and keep their region while they are held
+    vector<next_response> held;
+    for (int i = 0; i < 6; i++)
+    {
+        service_response<next_response> response = connector.get_next("1");
+        ASSERT_EQ(service_status_type::SUCCESS, response.status.type);
+        EXPECT_EQ(i, response.data.sequence);
+        held.push_back(response.data);
+    }
+    for (int i = 0; i < 6; i++)
+    {
+        EXPECT_EQ(i, batch_number(held[i]));
+    }
+    EXPECT_EQ(6, rdma->regions());
+
+    // dropped batches give their regions back
+    held.clear();
+    for (int i = 6; i < 12; i++)
+    {
+        service_response<next_response> response = connector.get_next("1");
+        ASSERT_EQ(service_status_type::SUCCESS, response.status.type);
+        EXPECT_EQ(i, batch_number(response.data));
+    }
+    EXPECT_EQ(6, rdma->regions());
+
+    for (auto& memory : server_regions)
+    {
+        server.unregister_memory(*memory);
+    }
+}
@@ -154,6 +154,46 @@ TEST(pixel_mask, rotate)
     EXPECT_TRUE(verify_image(tximg));
 }
 
+TEST(pixel_mask, warp_matches_separate_steps)
+{
+    cv::Mat mask(120, 160, CV_8UC1);
+    cv::randu(mask, 0, 255);
+
+    nlohmann::json js = {{"width", 64}, {"height", 48}};
+    nlohmann::json aug;
+    image::config  cfg(js);
+
+    pixel_mask::transformer       transformer{cfg};
+    augment::image::param_factory factory{aug};
+
+    for (bool flip : {false, true})
+    {
+        for (int padding : {0, 4})
+        {
+            image_params_builder builder(factory.make_params(mask.cols, mask.rows, 64, 48));
+            shared_ptr<augment::image::params> params =
+                builder.cropbox(10, 20, 100, 70).output_size(64, 48).flip(flip).padding(
+                    padding, 1, 6);
+
+            cv::Mat cropped = mask(params->cropbox);
+            image::add_padding(cropped, params->padding, params->padding_crop_offset);
+            cv::Mat expected;
+            image::resize(cropped, expected, params->output_size, false);
+            if (flip)
+            {
+                cv::flip(expected, expected, 1);
+            }
+
+            // warp into an existing buffer of the right size, as the provider does
+            vector<uint8_t> buffer(64 * 48);
+            cv::Mat         warped(params->output_size, CV_8UC1, buffer.data());
+            transformer.transform(*params, mask, warped);
+            ASSERT_EQ(buffer.data(), warped.data);
+            EXPECT_EQ(0, cv::countNonZero(warped != expected));
+        }
+    }
+}
+
 TEST(pixel_mask, load_int)
 {
     cv::Mat  test_image(256, 256, CV_8UC3);
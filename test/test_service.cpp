@@ -17,10 +17,13 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include <unistd.h>
+
 #include "base64.hpp"
 #include "helpers.hpp"
 #include "log.hpp"
 #include "service.hpp"
+#include "shm_connector.hpp"
 
 using namespace std;
 using namespace nervana;
@@ -195,7 +198,31 @@ TEST(service_connector, close)
 
 TEST(service_connector, next)
 {
-    // success scenario
+    const http_query_t frame_query{{"format", batch_frame::format_name}};
+
+    // success scenario with a batch frame
+    {
+        auto              mock = shared_ptr<mock_http_connector>(new mock_http_connector());
+        service_connector connector(mock);
+
+        auto buffer_map = make_shared<fixed_buffer_map>();
+        buffer_map->add_item("data", shape_type{{2, 3}, output_type{"int16_t"}}, 4);
+        for (int i = 0; i < (*buffer_map)["data"]->size(); i++)
+            (*buffer_map)["data"]->data()[i] = i;
+
+        auto   expected_next_response = next_response(buffer_map);
+        auto   expected_response      = http_response(http::status_ok,
+                                               batch_frame_writer(*buffer_map).to_string());
+        string endpoint               = "/api/v1/dataset/" + session_id + "/next";
+        EXPECT_CALL(*mock, get(endpoint, frame_query)).WillOnce(Return(expected_response));
+
+        service_response<next_response> response = connector.get_next(session_id);
+
+        EXPECT_EQ(response.status.type, service_status_type::SUCCESS);
+        EXPECT_TRUE(response.data == expected_next_response);
+    }
+
+    // success scenario with a serialized batch from a service without batch frames
     {
         auto              mock = shared_ptr<mock_http_connector>(new mock_http_connector());
         service_connector connector(mock);
@@ -210,7 +237,7 @@ TEST(service_connector, next)
         auto expected_response      = http_response(
             http::status_ok, string(encoded_buffer_map.begin(), encoded_buffer_map.end()));
         string endpoint = "/api/v1/dataset/" + session_id + "/next";
-        EXPECT_CALL(*mock, get(endpoint, http_query_t())).WillOnce(Return(expected_response));
+        EXPECT_CALL(*mock, get(endpoint, frame_query)).WillOnce(Return(expected_response));
 
         service_response<next_response> response = connector.get_next(session_id);
 
@@ -227,7 +254,7 @@ TEST(service_connector, next)
         expected_json["status"]["type"] = "END_OF_DATASET";
         auto   expected_response        = http_response(http::status_no_data, expected_json.dump());
         string endpoint                 = "/api/v1/dataset/" + session_id + "/next";
-        EXPECT_CALL(*mock, get(endpoint, http_query_t())).WillOnce(Return(expected_response));
+        EXPECT_CALL(*mock, get(endpoint, frame_query)).WillOnce(Return(expected_response));
 
         service_response<next_response> response = connector.get_next(session_id);
 
@@ -241,12 +268,144 @@ TEST(service_connector, next)
 
         auto   expected_response = http_response(http::status_ok, "");
         string endpoint          = "/api/v1/dataset/" + session_id + "/next";
-        EXPECT_CALL(*mock, get(endpoint, http_query_t())).WillOnce(Return(expected_response));
+        EXPECT_CALL(*mock, get(endpoint, frame_query)).WillOnce(Return(expected_response));
 
         ASSERT_THROW(connector.get_next(session_id), std::runtime_error);
     }
 }
 
+TEST(service_connector, next_shared_memory)
+{
+    const string endpoint     = "/api/v1/dataset/" + session_id + "/next";
+    const string shm_endpoint = "/api/v1/dataset/" + session_id + "/shared_memory";
+
+    const http_query_t shm_query{{"format", batch_frame::format_name},
+                                 {"transport", "shared_memory"}};
+
+    auto buffer_map = make_shared<fixed_buffer_map>();
+    buffer_map->add_item("data", shape_type{{2, 3}, output_type{"int16_t"}}, 4);
+    for (int i = 0; i < (*buffer_map)["data"]->size(); i++)
+        (*buffer_map)["data"]->data()[i] = i;
+    auto expected_next_response = next_response(buffer_map);
+
+    // the service side of the ring
+    auto ring = shm_ring::create(
+        "/aeon-test-" + std::to_string(getpid()), 4, batch_frame_writer(*buffer_map).size());
+    json ring_json;
+    ring_json["status"]["type"]     = "SUCCESS";
+    ring_json["data"]["name"]       = ring->name();
+    ring_json["data"]["slot_count"] = ring->slot_count();
+    ring_json["data"]["slot_size"]  = ring->slot_size();
+
+    auto              mock = shared_ptr<mock_http_connector>(new mock_http_connector());
+    service_connector connector(make_shared<shm_connector>(mock, 4));
+    EXPECT_CALL(*mock, get(shm_endpoint, http_query_t{{"slots", "4"}}))
+        .WillOnce(Return(http_response(http::status_ok, ring_json.dump())));
+
+    // batch in a slot
+    {
+        size_t slot;
+        ASSERT_TRUE(ring->claim(slot));
+        batch_frame_writer writer(*buffer_map, 5);
+        writer.copy_to(ring->slot(slot));
+        json slot_json;
+        slot_json["status"]["type"] = "SUCCESS";
+        slot_json["data"]["slot"]   = slot;
+        slot_json["data"]["size"]   = writer.size();
+        EXPECT_CALL(*mock, get(endpoint, shm_query))
+            .WillOnce(Return(http_response(http::status_ok, slot_json.dump())));
+
+        service_response<next_response> response = connector.get_next(session_id);
+
+        EXPECT_EQ(response.status.type, service_status_type::SUCCESS);
+        EXPECT_EQ(5, response.data.sequence);
+        EXPECT_TRUE(response.data == expected_next_response);
+        // the batch is read in place, the client has a mapping of its own
+        string in_slot(ring->slot(slot), writer.size());
+        (*response.data.data)["data"]->data()[0] = 42;
+        EXPECT_NE(in_slot, string(ring->slot(slot), writer.size()));
+        EXPECT_FALSE(ring->is_free(slot));
+        response.data.data = nullptr;
+        EXPECT_TRUE(ring->is_free(slot));
+    }
+
+    // a size larger than the slot is rejected and the slot goes back to the ring
+    {
+        size_t slot;
+        ASSERT_TRUE(ring->claim(slot));
+        batch_frame_writer writer(*buffer_map, 5);
+        writer.copy_to(ring->slot(slot));
+        json slot_json;
+        slot_json["status"]["type"] = "SUCCESS";
+        slot_json["data"]["slot"]   = slot;
+        slot_json["data"]["size"]   = ring->slot_size() + 1;
+        EXPECT_CALL(*mock, get(endpoint, shm_query))
+            .WillOnce(Return(http_response(http::status_ok, slot_json.dump())));
+
+        EXPECT_THROW(connector.get_next(session_id), std::runtime_error);
+        EXPECT_TRUE(ring->is_free(slot));
+    }
+
+    // a slot that does not hold a frame is released as well
+    {
+        size_t slot;
+        ASSERT_TRUE(ring->claim(slot));
+        memset(ring->slot(slot), 0, ring->slot_size());
+        json slot_json;
+        slot_json["status"]["type"] = "SUCCESS";
+        slot_json["data"]["slot"]   = slot;
+        slot_json["data"]["size"]   = ring->slot_size();
+        EXPECT_CALL(*mock, get(endpoint, shm_query))
+            .WillOnce(Return(http_response(http::status_ok, slot_json.dump())));
+
+        EXPECT_THROW(connector.get_next(session_id), std::runtime_error);
+        EXPECT_TRUE(ring->is_free(slot));
+    }
+
+    // every slot in use, the frame comes in the body
+    {
+        auto frame = http_response(http::status_ok, batch_frame_writer(*buffer_map, 6).to_string());
+        EXPECT_CALL(*mock, get(endpoint, shm_query)).WillOnce(Return(frame));
+
+        service_response<next_response> response = connector.get_next(session_id);
+
+        EXPECT_EQ(response.status.type, service_status_type::SUCCESS);
+        EXPECT_EQ(6, response.data.sequence);
+        EXPECT_TRUE(response.data == expected_next_response);
+    }
+
+    // end of data
+    {
+        json end_json;
+        end_json["status"]["type"] = "END_OF_DATASET";
+        EXPECT_CALL(*mock, get(endpoint, shm_query))
+            .WillOnce(Return(http_response(http::status_no_data, end_json.dump())));
+
+        service_response<next_response> response = connector.get_next(session_id);
+
+        EXPECT_EQ(response.status.type, service_status_type::END_OF_DATASET);
+    }
+
+    // a service without shared memory keeps sending frames over HTTP
+    {
+        auto              remote = shared_ptr<mock_http_connector>(new mock_http_connector());
+        service_connector remote_connector(make_shared<shm_connector>(remote, 4));
+        EXPECT_CALL(*remote, get(shm_endpoint, http_query_t{{"slots", "4"}}))
+            .WillOnce(Return(http_response(404, "")));
+        auto frame = http_response(http::status_ok, batch_frame_writer(*buffer_map).to_string());
+        EXPECT_CALL(*remote, get(endpoint, http_query_t{{"format", batch_frame::format_name}}))
+            .Times(2)
+            .WillRepeatedly(Return(frame));
+
+        for (int i = 0; i < 2; i++)
+        {
+            service_response<next_response> response = remote_connector.get_next(session_id);
+            EXPECT_EQ(response.status.type, service_status_type::SUCCESS);
+            EXPECT_TRUE(response.data == expected_next_response);
+        }
+    }
+}
+
 TEST(service_connector, names_and_shapes)
 {
     // success scenario
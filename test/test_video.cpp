@@ -55,7 +55,8 @@ TEST(video, extract_transform)
         video::extractor extractor{config};
         auto             decoded_vid = extractor.extract((const char*)buf.data(), buf.size());
 
-        ASSERT_EQ(decoded_vid->get_image_count(), 25);
+        // only the first max_frame_count frames of the clip are decoded
+        ASSERT_EQ(decoded_vid->get_image_count(), 5);
         ASSERT_EQ(decoded_vid->get_image_size(), cv::Size2i(width, height));
 
         // transform
@@ -84,6 +85,70 @@ TEST(video, extract_transform)
     }
 }
 
+TEST(video, in_place_capture)
+{
+    string test_file = "in_place.avi";
+    string command   = "ffmpeg -loglevel quiet -hide_banner -f lavfi "
+                     "-i testsrc=duration=1:size=64x48:rate=10 -c:v mjpeg -q:v 3 -y " +
+                     test_file;
+
+    if (system(command.c_str()) == 0)
+    {
+        basic_ifstream<char> ifs(test_file, ios::binary);
+        vector<char> buf((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+        remove(test_file.c_str());
+
+        MotionJpegCapture parsed(buf.data(), buf.size());
+        ASSERT_TRUE(parsed.isOpened());
+        ASSERT_EQ(10, parsed.getFrameCount());
+
+        // a copy of the clip in another buffer is recognized and its index reused
+        vector<char>      copy(buf);
+        MotionJpegCapture cached(copy.data(), copy.size());
+        ASSERT_EQ(parsed.getFrameCount(), cached.getFrameCount());
+
+        for (size_t i = 0; i < parsed.getFrameCount(); i++)
+        {
+            const char* data;
+            size_t      size;
+            ASSERT_TRUE(cached.getFrameSpan(i, data, size));
+            EXPECT_GE(data, copy.data());
+            EXPECT_LE(data + size, copy.data() + copy.size());
+            EXPECT_EQ(parsed.readFrame(i), vector<char>(data, data + size));
+
+            cv::Mat frame;
+            ASSERT_TRUE(cached.decodeFrame(i, frame));
+            EXPECT_EQ(cv::Size(64, 48), frame.size());
+        }
+    }
+    else
+    {
+        ERR << "Missing ffmpeg for video extraction test" << endl;
+    }
+}
+
+TEST(video, select_frames)
+{
+    random_engine_t random(0);
+
+    EXPECT_EQ((vector<size_t>{0, 1, 2}), video::extractor::select_frames("first", 10, 3, random));
+    EXPECT_EQ((vector<size_t>{0, 1}), video::extractor::select_frames("uniform", 2, 3, random));
+    EXPECT_EQ((vector<size_t>{1, 5, 8}), video::extractor::select_frames("uniform", 10, 3, random));
+
+    for (int i = 0; i < 20; i++)
+    {
+        auto frames = video::extractor::select_frames("random", 10, 4, random);
+        ASSERT_EQ(4, frames.size());
+        EXPECT_LE(frames.back(), 9);
+        for (size_t k = 1; k < frames.size(); k++)
+        {
+            EXPECT_EQ(frames[k - 1] + 1, frames[k]);
+        }
+    }
+
+    EXPECT_THROW(video::extractor::select_frames("last", 10, 3, random), invalid_argument);
+}
+
 TEST(video, image_transform)
 {
     int width  = 352;